@@ -0,0 +1,354 @@
+/*
+ * Copyright (c) 2024 Mirco Heitmann
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ * vera_decode.cpp
+ *
+ * Command line tool: integrity check, time range, .csv export (same output as Python/vera2csv.py -tf 1) and .parquet export (as -sc) of a measurement
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <string>
+
+#include "vera_decoder.h"
+
+void Print_Help();
+void Print_Check(const vera::Measurement &m, const vera::Check &check);
+bool Confirm_Overwrite(const char *path, bool overwrite);
+
+int main(int argc, char **argv)
+{
+	double arg_t0 = 0;
+	double arg_t1 = INFINITY;
+	double arg_d = NAN;
+	bool arg_ni = false;
+	unsigned arg_threads = 0;
+	bool arg_benchmark = false;
+	const char *arg_save = nullptr;
+	const char *arg_save_columns = nullptr;
+	bool arg_ow = false;
+	std::string arg_path = ".";
+	for (int i = 1; i < argc; i++)
+	{
+		std::string a = argv[i];
+		bool has_value = i + 1 < argc;
+		if (a == "-h" || a == "--help")
+		{
+			Print_Help();
+			return 0;
+		}
+		else if ((a == "-t0" || a == "--time0") && has_value)
+		{
+			arg_t0 = atof(argv[++i]);
+		}
+		else if ((a == "-t1" || a == "--time1") && has_value)
+		{
+			arg_t1 = atof(argv[++i]);
+		}
+		else if ((a == "-d" || a == "--duration") && has_value)
+		{
+			arg_d = atof(argv[++i]);
+		}
+		else if (a == "-ni" || a == "--no-interpolate")
+		{
+			arg_ni = true;
+		}
+		else if ((a == "-j" || a == "--threads") && has_value)
+		{
+			arg_threads = (unsigned)atoi(argv[++i]);
+		}
+		else if (a == "-b" || a == "--benchmark")
+		{
+			arg_benchmark = true;
+		}
+		else if ((a == "-s" || a == "--save") && has_value)
+		{
+			arg_save = argv[++i];
+		}
+		else if ((a == "-sc" || a == "--savecolumns") && has_value)
+		{
+			arg_save_columns = argv[++i];
+		}
+		else if (a == "-ow" || a == "--overwrite")
+		{
+			arg_ow = true;
+		}
+		else
+		{
+			if (a[0] == '-')
+			{
+				printf("! WARNING: Possibly unknown option %s, except if it's part of the path\n", a.c_str());
+			}
+			arg_path = a;
+		}
+	}
+	if (!std::isnan(arg_d))
+	{
+		arg_t1 = arg_t0 + arg_d;
+	}
+
+	// Directory or first page (a_X.bin)
+	std::string dir_path = arg_path;
+	int first_page = 0;
+	if (std::filesystem::is_regular_file(arg_path))
+	{
+		std::filesystem::path path(arg_path);
+		std::string stem = path.stem().string();
+		first_page = atoi(stem.substr(stem.find_last_of('_') + 1).c_str());
+		dir_path = path.has_parent_path() ? path.parent_path().string() : ".";
+	}
+	else if (!std::filesystem::is_directory(arg_path))
+	{
+		printf("! ERROR: Cannot read path \"%s\"\n", arg_path.c_str());
+		return 1;
+	}
+
+	auto time_start = std::chrono::steady_clock::now();
+	vera::Measurement m;
+	if (!m.Open(dir_path, first_page))
+	{
+		printf("! ERROR: %s\n", m.error.c_str());
+		return 1;
+	}
+	for (const std::string &warning : m.warnings)
+	{
+		printf("! WARNING: %s\n", warning.c_str());
+	}
+	vera::Decoder decoder(m);
+	decoder.Select(arg_t0, arg_t1);
+	printf("Loaded \"%s\" (pages %d to %d) with %zu acceleration data points and %zu position data points, %u Sa/s, %u threads\n",
+		dir_path.c_str(), m.pages.front().num, m.pages.back().num, m.ACount(), m.PCount(), m.SamplingRate(), vera::ThreadCount(arg_threads));
+	if (!decoder.date_valid)
+	{
+		printf("! WARNING: Date is invalid, assuming today\n");
+	}
+	if (decoder.end <= decoder.begin)
+	{
+		printf("! ERROR: Cropped out all data (check options -t0 -t1 -d and actual duration of given data)\n");
+		return 1;
+	}
+	double fs = m.SamplingRate();
+	double t_begin = decoder.begin < m.ACount() ? vera::AReader(m).A(decoder.begin).timestamp / fs : 0;
+	double t_end = vera::AReader(m).A(decoder.end - 1).timestamp / fs;
+	printf("Selected %.3f s - %.3f s (%zu data points)\n", t_begin, t_end, decoder.end - decoder.begin);
+
+	// Integrity check
+	auto time_check = std::chrono::steady_clock::now();
+	vera::Check check = decoder.CheckData(arg_threads);
+	double check_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - time_check).count();
+	Print_Check(m, check);
+	if (arg_benchmark)
+	{
+		printf("Check: %.3f s, %.2f GB/s\n", check_s, check.bytes / check_s / 1e9);
+
+		// Decoding without .csv formatting (samples of each chunk are discarded, buffer reused per thread as in export)
+		unsigned threads = vera::ThreadCount(arg_threads);
+		std::vector<std::vector<vera::Sample>> samples(threads);
+		auto time_decode = std::chrono::steady_clock::now();
+		vera::ForEachChunk(decoder.begin, decoder.end, threads, [&](size_t chunk, size_t chunk_begin, size_t chunk_end)
+		{
+			decoder.Decode(chunk_begin, chunk_end, !arg_ni, samples[chunk % threads]);
+		});
+		double decode_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - time_decode).count();
+		printf("Decode: %.3f s, %.2f GB/s\n", decode_s, check.bytes / decode_s / 1e9);
+	}
+
+	// Export .csv (benchmark without file: decoding and formatting only)
+	if (arg_save != nullptr || arg_benchmark)
+	{
+		FILE *f = nullptr;
+		if (arg_save != nullptr)
+		{
+			if (!Confirm_Overwrite(arg_save, arg_ow))
+			{
+				return 0;
+			}
+			f = fopen(arg_save, "wb");
+			if (f == nullptr)
+			{
+				printf("! ERROR: Cannot write \"%s\"\n", arg_save);
+				return 1;
+			}
+		}
+		auto time_export = std::chrono::steady_clock::now();
+		size_t written = 0;
+		std::string header = decoder.CsvHeader(check);
+		if (f != nullptr)
+		{
+			fwrite(header.data(), 1, header.size(), f);
+		}
+		decoder.ExportCsv(arg_threads, !arg_ni, check, [&](const std::string &lines)
+		{
+			if (f != nullptr)
+			{
+				fwrite(lines.data(), 1, lines.size(), f);
+			}
+			written += lines.size();
+		});
+		double export_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - time_export).count();
+		if (f != nullptr)
+		{
+			fclose(f);
+			printf("File \"%s\" written\n", arg_save);
+		}
+		if (arg_benchmark)
+		{
+			printf("Decode and .csv: %.3f s, %.2f GB/s input, %.2f GB/s output\n", export_s, check.bytes / export_s / 1e9, written / export_s / 1e9);
+		}
+	}
+
+	// Export columns (.parquet)
+	if (arg_save_columns != nullptr)
+	{
+		std::string ext = std::filesystem::path(arg_save_columns).extension().string();
+		std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+		if (ext != ".parquet")
+		{
+			printf("! ERROR: Unknown column format \"%s\" (.parquet)\n", ext.c_str());
+			return 1;
+		}
+		if (!Confirm_Overwrite(arg_save_columns, arg_ow))
+		{
+			return 0;
+		}
+		printf("Writing .parquet...\n");
+		auto time_columns = std::chrono::steady_clock::now();
+		std::string error;
+		if (!decoder.ExportParquet(arg_threads, !arg_ni, check, arg_save_columns, std::filesystem::absolute(dir_path).lexically_normal().string(), error))
+		{
+			printf("! ERROR: %s\n", error.c_str());
+			return 1;
+		}
+		double columns_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - time_columns).count();
+		printf("File \"%s\" written\n", arg_save_columns);
+		if (arg_benchmark)
+		{
+			printf("Decode and .parquet: %.3f s, %.2f GB/s input, %.2f GB/s output\n", columns_s, check.bytes / columns_s / 1e9,
+				std::filesystem::file_size(arg_save_columns) / columns_s / 1e9);
+		}
+	}
+	if (arg_benchmark)
+	{
+		printf("Total: %.3f s\n", std::chrono::duration<double>(std::chrono::steady_clock::now() - time_start).count());
+	}
+	return 0;
+}
+
+void Print_Help()
+{
+	printf("Usage: vera_decode (options) [path like \"./24_08_01-1\" or \"./24_08_01-1/a_0.bin\"]\n");
+	printf("\tDecodes measurement files (a_X.bin, p_X.bin) with the layout of STM32/Core/Inc/data_points.h\n");
+	printf("\tIf no path argument is given, the current working directory is used\n");
+	printf("Options:\n");
+	printf("\t-t0  / --time0 (sec)        | Sets time (in seconds) to start saving data\n");
+	printf("\t-t1  / --time1 (sec)        | Sets time (in seconds) to stop saving data\n");
+	printf("\t-d   / --duration (sec)     | Sets duration (in seconds) of data, starting from -t0\n");
+	printf("\t-ni  / --no-interpolate     | Nearest position data point instead of linear interpolation of coordinates\n");
+	printf("\t-j   / --threads (N)        | Worker threads (default: all cores)\n");
+	printf("\t-s   / --save (path)        | Saves data as .csv file (columns as vera2csv.py --timeformat 1)\n");
+	printf("\t-sc  / --savecolumns (path) | Saves raw channels as columns to .parquet file (as vera2csv.py -sc), one row group per page\n");
+	printf("\t-ow  / --overwrite          | Automatically overwrite .csv or .parquet file if it exists\n");
+	printf("\t-b   / --benchmark          | Prints throughput of check, decoding and .csv formatting (formats without -s)\n");
+	printf("If neither -s nor -sc is selected, the tool only checks data for integrity\n");
+}
+
+void Print_Check(const vera::Measurement &m, const vera::Check &check)
+{
+	const char *axes[] = {"X", "Y", "Z"};
+	if (check.a_incomplete[A_COMPLETE_TIMESTAMP] + check.a_incomplete[A_COMPLETE_MEMS] + check.a_incomplete[A_COMPLETE_PZ] > 0)
+	{
+		printf("! WARNING: Incomplete acceleration data points\n");
+		if (check.a_incomplete[A_COMPLETE_TIMESTAMP] > 0)
+		{
+			printf("! WARNING: %zu acceleration data points are missing timestamps. This should not have happened.\n", check.a_incomplete[A_COMPLETE_TIMESTAMP]);
+		}
+		if (check.MemsMissing())
+		{
+			printf("! WARNING: All MEMS data missing\n");
+		}
+		if (check.PiezoMissing())
+		{
+			printf("! WARNING: All piezo data missing\n");
+		}
+	}
+	if (m.HasDistance() && check.DistanceMissing())
+	{
+		printf("! WARNING: All track distance data missing\n");
+	}
+	if (check.a_gaps > 0)
+	{
+		printf("! WARNING: Missing acceleration timestamps (bad!): %zu gaps, max. %u\n", check.a_gaps, check.a_gap_max);
+	}
+	for (int ch = 0; ch < m.ChannelCount(); ch++)
+	{
+		if (check.a_out_of_range[ch] > 0)
+		{
+			if (ch < 3)
+			{
+				printf("! WARNING: MEMS %s data out of range (%zu data points)\n", axes[ch], check.a_out_of_range[ch]);
+			}
+			else
+			{
+				printf("! WARNING: Piezo [%d] data out of range (%zu data points)\n", ch - 2, check.a_out_of_range[ch]);
+			}
+		}
+	}
+
+	if (check.p_count == 0)
+	{
+		printf("! WARNING: No position data\n");
+		return;
+	}
+	const char *position_names[] = {"GNSS times", "coordinates", "speed data", "altitude data"};
+	bool incomplete = false;
+	for (int bit = 0; bit < 5; bit++)
+	{
+		incomplete |= check.p_incomplete[bit] > 0;
+	}
+	if (incomplete)
+	{
+		printf("! WARNING: Incomplete position data points\n");
+		if (check.p_incomplete[P_COMPLETE_TIMESTAMP] > 0)
+		{
+			printf("! WARNING: %zu position data points are missing timestamps. This should not have happened.\n", check.p_incomplete[P_COMPLETE_TIMESTAMP]);
+		}
+		for (int channel = 0; channel < vera::POSITION_CHANNEL_COUNT; channel++)
+		{
+			if (check.PositionMissing(channel))
+			{
+				printf("! WARNING: All %s missing\n", position_names[channel]);
+			}
+		}
+	}
+	if (check.p_gap_max / (double)m.SamplingRate() > 30)
+	{
+		printf("! WARNING: Missing position timestamps (max. %.1f s)\n", check.p_gap_max / (double)m.SamplingRate());
+	}
+	if (check.p_invalid_coordinates == check.p_count)
+	{
+		printf("! WARNING: No position data (invalid)\n");
+	}
+}
+
+// Returns true if file does not exist or may be overwritten
+bool Confirm_Overwrite(const char *path, bool overwrite)
+{
+	if (std::filesystem::exists(path) && !overwrite)
+	{
+		printf("! WARNING: File \"%s\" exists. Do you want to overwrite it? (y/n) ", path);
+		std::string confirm;
+		std::getline(std::cin, confirm);
+		return confirm == "y" || confirm == "Y" || confirm == "yes";
+	}
+	return true;
+}
@@ -0,0 +1,1055 @@
+/*
+ * Copyright (c) 2024 Mirco Heitmann
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ * vera_decoder.cpp
+ */
+
+#include "vera_decoder.h"
+#include "vera_parquet.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <thread>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Layout of firmware (ARM, natural alignment) must match the host
+static_assert(sizeof(a_data_header_t) == 24, "a_data_header_t");
+static_assert(sizeof(a_data_point_t) == 36 + 4, "a_data_point_t");
+static_assert(offsetof(a_data_point_t, distance) == 36, "a_data_point_t version 1");
+static_assert(sizeof(p_data_header_t) == 20, "p_data_header_t");
+static_assert(sizeof(p_data_point_t) == 32, "p_data_point_t");
+
+namespace vera
+{
+
+int64_t Days_From_Civil(int64_t y, unsigned m, unsigned d);
+void Append_Number(std::string &out, double value, int decimals);
+void Append_Integer(std::string &out, int64_t value);
+void Append_Json_String(std::string &out, const std::string &value);
+void Append_Json_Number(std::string &out, double value);
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+MappedFile::MappedFile(MappedFile &&other) noexcept
+{
+	*this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile &&other) noexcept
+{
+	if (this != &other)
+	{
+		Close();
+		std::swap(data_, other.data_);
+		std::swap(size_, other.size_);
+#ifdef _WIN32
+		std::swap(file_, other.file_);
+		std::swap(mapping_, other.mapping_);
+#endif
+	}
+	return *this;
+}
+
+bool MappedFile::Open(const std::string &path)
+{
+	Close();
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+	file_ = file;
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size))
+	{
+		Close();
+		return false;
+	}
+	size_ = (size_t)size.QuadPart;
+	if (size_ == 0)
+	{
+		return true;
+	}
+	mapping_ = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping_ == nullptr)
+	{
+		Close();
+		return false;
+	}
+	data_ = (const uint8_t*)MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+	if (data_ == nullptr)
+	{
+		Close();
+		return false;
+	}
+#else
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+	{
+		close(fd);
+		return false;
+	}
+	size_ = (size_t)st.st_size;
+	if (size_ > 0)
+	{
+		void *data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED)
+		{
+			close(fd);
+			size_ = 0;
+			return false;
+		}
+		// Data points are read once from start to end
+		madvise(data, size_, MADV_SEQUENTIAL);
+		data_ = (const uint8_t*)data;
+	}
+	close(fd);
+#endif
+	return true;
+}
+
+void MappedFile::Close()
+{
+#ifdef _WIN32
+	if (data_ != nullptr)
+	{
+		UnmapViewOfFile(data_);
+	}
+	if (mapping_ != nullptr)
+	{
+		CloseHandle(mapping_);
+	}
+	if (file_ != nullptr)
+	{
+		CloseHandle(file_);
+	}
+	file_ = nullptr;
+	mapping_ = nullptr;
+#else
+	if (data_ != nullptr)
+	{
+		munmap((void*)data_, size_);
+	}
+#endif
+	data_ = nullptr;
+	size_ = 0;
+}
+
+bool Measurement::Open(const std::string &dir_path, int first_page)
+{
+	pages.clear();
+	a_offsets = {0};
+	p_offsets = {0};
+	error.clear();
+	warnings.clear();
+	for (int num = first_page;; num++)
+	{
+		std::string a_path = dir_path + "/a_" + std::to_string(num) + ".bin";
+		std::string p_path = dir_path + "/p_" + std::to_string(num) + ".bin";
+		if (!std::filesystem::is_regular_file(a_path) || !std::filesystem::is_regular_file(p_path))
+		{
+			if (num == 0)
+			{
+				continue;
+			}
+			break;
+		}
+
+		Page page;
+		page.num = num;
+		if (!page.a_file.Open(a_path) || !page.p_file.Open(p_path))
+		{
+			error = "Cannot read page " + std::to_string(num);
+			return false;
+		}
+		if (page.a_file.Size() < sizeof(a_data_header_t) || page.p_file.Size() < sizeof(p_data_header_t))
+		{
+			warnings.push_back("Page " + std::to_string(num) + " is empty");
+			continue;
+		}
+
+		// Headers
+		memcpy(&page.a_header, page.a_file.Data(), sizeof(a_data_header_t));
+		memcpy(&page.p_header, page.p_file.Data(), sizeof(p_data_header_t));
+		if (page.a_header.version < 1 || page.a_header.version > A_VERSION_MAX)
+		{
+			error = "Acceleration data version " + std::to_string(page.a_header.version) + " is not supported (max. " + std::to_string(A_VERSION_MAX) + ")";
+			return false;
+		}
+		if (page.p_header.version < 1 || page.p_header.version > P_VERSION_MAX)
+		{
+			error = "Position data version " + std::to_string(page.p_header.version) + " is not supported (max. " + std::to_string(P_VERSION_MAX) + ")";
+			return false;
+		}
+		if (page.a_header.piezo_count_max != PIEZO_COUNT_MAX || page.a_header.piezo_count > PIEZO_COUNT_MAX)
+		{
+			error = "Page " + std::to_string(num) + " has " + std::to_string(page.a_header.piezo_count_max) + " piezo channels, decoder is compiled for " + std::to_string(PIEZO_COUNT_MAX);
+			return false;
+		}
+		if (page.a_header.a_sampling_rate == 0)
+		{
+			error = "Page " + std::to_string(num) + " has no sampling rate";
+			return false;
+		}
+		if (!pages.empty())
+		{
+			const a_data_header_t &first = pages.front().a_header;
+			if (page.a_header.version != first.version || page.a_header.a_sampling_rate != first.a_sampling_rate
+				|| page.a_header.piezo_count != first.piezo_count || page.a_header.fir_taps_len != first.fir_taps_len)
+			{
+				warnings.push_back("Page " + std::to_string(num) + " has different config, following pages are skipped");
+				break;
+			}
+		}
+
+		// Data points, incomplete data point at end of file is ignored
+		page.a_point_size = page.a_header.version >= 2 ? sizeof(a_data_point_t) : offsetof(a_data_point_t, distance);
+		page.a_points = page.a_file.Data() + sizeof(a_data_header_t);
+		page.a_count = (page.a_file.Size() - sizeof(a_data_header_t)) / page.a_point_size;
+		page.p_points = reinterpret_cast<const p_data_point_t*>(page.p_file.Data() + sizeof(p_data_header_t));
+		page.p_count = (page.p_file.Size() - sizeof(p_data_header_t)) / sizeof(p_data_point_t);
+		a_offsets.push_back(a_offsets.back() + page.a_count);
+		p_offsets.push_back(p_offsets.back() + page.p_count);
+		pages.push_back(std::move(page));
+	}
+	if (pages.empty())
+	{
+		error = "No input files found (a_X.bin and p_X.bin)";
+		return false;
+	}
+	return true;
+}
+
+const p_data_point_t &Measurement::P(size_t i) const
+{
+	size_t page = std::upper_bound(p_offsets.begin(), p_offsets.end(), i) - p_offsets.begin() - 1;
+	return pages[page].p_points[i - p_offsets[page]];
+}
+
+void AReader::Seek(size_t i)
+{
+	size_t page = std::upper_bound(m_.a_offsets.begin(), m_.a_offsets.end(), i) - m_.a_offsets.begin() - 1;
+	page_ = &m_.pages[page];
+	begin_ = m_.a_offsets[page];
+	end_ = m_.a_offsets[page + 1];
+}
+
+unsigned ThreadCount(unsigned threads)
+{
+	if (threads == 0)
+	{
+		threads = std::thread::hardware_concurrency();
+	}
+	return std::max(threads, 1u);
+}
+
+void ForEachChunk(size_t begin, size_t end, unsigned threads, const std::function<void(size_t, size_t, size_t)> &work, const std::function<void(size_t)> &done)
+{
+	if (end <= begin)
+	{
+		return;
+	}
+	size_t chunk_count = (end - begin + CHUNK_LEN - 1) / CHUNK_LEN;
+	threads = ThreadCount(threads);
+	for (size_t batch = 0; batch < chunk_count; batch += threads)
+	{
+		size_t batch_end = std::min(chunk_count, batch + threads);
+		std::vector<std::thread> workers;
+		for (size_t chunk = batch; chunk < batch_end; chunk++)
+		{
+			size_t chunk_begin = begin + chunk * CHUNK_LEN;
+			size_t chunk_end = std::min(end, chunk_begin + CHUNK_LEN);
+			if (batch_end - batch == 1)
+			{
+				work(chunk, chunk_begin, chunk_end);
+			}
+			else
+			{
+				workers.emplace_back(work, chunk, chunk_begin, chunk_end);
+			}
+		}
+		for (std::thread &worker : workers)
+		{
+			worker.join();
+		}
+		if (done)
+		{
+			for (size_t chunk = batch; chunk < batch_end; chunk++)
+			{
+				done(chunk);
+			}
+		}
+	}
+}
+
+// Days since 1970-01-01 of date (proleptic Gregorian calendar)
+int64_t Days_From_Civil(int64_t y, unsigned m, unsigned d)
+{
+	y -= m <= 2;
+	int64_t era = (y >= 0 ? y : y - 399) / 400;
+	unsigned yoe = (unsigned)(y - era * 400);
+	unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+	unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + (int64_t)doe - 719468;
+}
+
+Decoder::Decoder(const Measurement &m) : m_(m)
+{
+	double fs = m.SamplingRate();
+	delay_mems_ = (int)(DELAY_MEMS * fs);
+	delay_piezo_ = (int)((DELAY_PIEZO_ANALOG + (m.pages.front().a_header.fir_taps_len - 1) / 2.0 / fs) * fs);
+	end = m.ACount();
+
+	// GNSS date of first page, today if invalid (year not set before first GNSS fix)
+	p_data_header_t date = m.pages.front().p_header;
+	if (date.year < 1800)
+	{
+		time_t now = time(nullptr);
+		struct tm *today = gmtime(&now);
+		if (date.month < 1 || date.month > 12 || date.day < 1 || date.day > 31)
+		{
+			date.month = today->tm_mon + 1;
+			date.day = today->tm_mday;
+		}
+		date.year = today->tm_year + 1900;
+		date_valid = false;
+	}
+	day_start_ = 86400.0 * Days_From_Civil(date.year, date.month, date.day);
+
+	// Position data points without first after boot (invalid)
+	std::vector<p_data_point_t> points;
+	for (size_t i = 1; i < m.PCount(); i++)
+	{
+		points.push_back(m.P(i));
+	}
+
+	// Position data points delayed by NMEA parsing are moved to the position of their GNSS time
+	std::vector<double> gnss_times;
+	for (const p_data_point_t &dp : points)
+	{
+		gnss_times.push_back(3600.0 * dp.gnss_hour + 60.0 * dp.gnss_minute + dp.gnss_second);
+	}
+	for (size_t i = 0; i + 1 < points.size(); i++)
+	{
+		bool valid = (points[i].complete & (1 << P_COMPLETE_GNSS_TIME)) && (points[i + 1].complete & (1 << P_COMPLETE_GNSS_TIME));
+		if (!valid || gnss_times[i + 1] >= gnss_times[i] || gnss_times[i] <= 1 || gnss_times[i + 1] <= 1)
+		{
+			continue;
+		}
+		size_t true_i = 0;
+		for (size_t j = 0; j < gnss_times.size(); j++)
+		{
+			double d = std::fabs(gnss_times[j] + 1.0 / m.pages.front().p_header.p_sampling_rate - gnss_times[i + 1]);
+			if (d < std::fabs(gnss_times[true_i] + 1.0 / m.pages.front().p_header.p_sampling_rate - gnss_times[i + 1]))
+			{
+				true_i = j;
+			}
+		}
+		if (true_i >= i)
+		{
+			continue;
+		}
+		p_data_point_t moved = points[i + 1];
+		std::copy_backward(points.begin() + true_i + 1, points.begin() + i + 1, points.begin() + i + 2);
+		points[true_i + 1] = moved;
+		points[true_i + 1].timestamp = (uint32_t)std::lround((points[true_i].timestamp + (double)points[true_i + 2].timestamp) / 2);
+	}
+
+	// Tracks of valid values, GNSS time continues after midnight
+	double day_offset = 0;
+	double last_time = -1;
+	for (const p_data_point_t &dp : points)
+	{
+		if (dp.complete & (1 << P_COMPLETE_GNSS_TIME))
+		{
+			double t = 3600.0 * dp.gnss_hour + 60.0 * dp.gnss_minute + dp.gnss_second + day_offset;
+			if (last_time >= 0 && t < last_time - 43200)
+			{
+				day_offset += 86400;
+				t += 86400;
+			}
+			last_time = t;
+			tracks_[POSITION_GNSS_TIME].timestamps.push_back(dp.timestamp);
+			tracks_[POSITION_GNSS_TIME].values[0].push_back(t);
+		}
+		if (dp.complete & (1 << P_COMPLETE_POSITION))
+		{
+			tracks_[POSITION_COORDINATES].timestamps.push_back(dp.timestamp);
+			tracks_[POSITION_COORDINATES].values[0].push_back(dp.lat);
+			tracks_[POSITION_COORDINATES].values[1].push_back(dp.lon);
+		}
+		if (dp.complete & (1 << P_COMPLETE_SPEED))
+		{
+			tracks_[POSITION_SPEED].timestamps.push_back(dp.timestamp);
+			tracks_[POSITION_SPEED].values[0].push_back(dp.speed);
+		}
+		if (dp.complete & (1 << P_COMPLETE_ALTITUDE))
+		{
+			tracks_[POSITION_ALTITUDE].timestamps.push_back(dp.timestamp);
+			tracks_[POSITION_ALTITUDE].values[0].push_back(dp.altitude);
+		}
+	}
+}
+
+void Decoder::Select(double t0, double t1)
+{
+	// Timestamps increase within a capture, binary search over all pages
+	double fs = m_.SamplingRate();
+	AReader reader(m_);
+	auto first_after = [&](double t, bool inclusive)
+	{
+		size_t lo = 1, hi = m_.ACount();
+		while (lo < hi)
+		{
+			size_t mid = lo + (hi - lo) / 2;
+			double t_mid = reader.A(mid).timestamp / fs;
+			if (inclusive ? t_mid < t : t_mid <= t)
+			{
+				lo = mid + 1;
+			}
+			else
+			{
+				hi = mid;
+			}
+		}
+		return lo;
+	};
+	begin = first_after(t0, true);
+	end = std::isinf(t1) ? m_.ACount() : first_after(t1, true);
+	end = std::max(begin, end);
+}
+
+Check Decoder::CheckData(unsigned threads)
+{
+	int channel_count = m_.ChannelCount();
+	std::vector<Check> chunks((end - begin + CHUNK_LEN - 1) / CHUNK_LEN);
+	std::vector<double> piezo_sums(chunks.size() * PIEZO_COUNT_MAX);
+	ForEachChunk(begin, end, threads, [&](size_t chunk, size_t chunk_begin, size_t chunk_end)
+	{
+		Check &c = chunks[chunk];
+		double *piezo_sum = &piezo_sums[chunk * PIEZO_COUNT_MAX];
+		AReader reader(m_);
+		std::fill(c.a_min, c.a_min + CHANNEL_MAX, INT32_MAX);
+		std::fill(c.a_max, c.a_max + CHANNEL_MAX, INT32_MIN);
+		uint32_t last_timestamp = chunk_begin > begin ? reader.A(chunk_begin - 1).timestamp : reader.A(chunk_begin).timestamp - 1;
+		for (size_t i = chunk_begin; i < chunk_end; i++)
+		{
+			const a_data_point_t &dp = reader.A(i);
+			for (int bit = 0; bit < 4; bit++)
+			{
+				c.a_incomplete[bit] += !(dp.complete & (1 << bit));
+			}
+			uint32_t step = dp.timestamp - last_timestamp;
+			if (step != 1)
+			{
+				c.a_gaps++;
+				c.a_gap_max = std::max(c.a_gap_max, step);
+			}
+			last_timestamp = dp.timestamp;
+			for (int ch = 0; ch < channel_count; ch++)
+			{
+				int32_t value = ch < 3 ? dp.xyz_mems1[ch] : dp.a_piezo[ch - 3];
+				int32_t range = ch < 3 ? MEMS_RANGE : PIEZO_RANGE;
+				c.a_min[ch] = std::min(c.a_min[ch], value);
+				c.a_max[ch] = std::max(c.a_max[ch], value);
+				c.a_out_of_range[ch] += value < -range || value > range;
+				// Offset over piezo data points used by Decode (shifted by delay compensation) as Python/vera2csv.py
+				if (ch >= 3 && i >= begin + delay_piezo_)
+				{
+					piezo_sum[ch - 3] += value;
+				}
+			}
+		}
+		c.a_count = chunk_end - chunk_begin;
+	});
+
+	Check check;
+	std::fill(check.a_min, check.a_min + CHANNEL_MAX, INT32_MAX);
+	std::fill(check.a_max, check.a_max + CHANNEL_MAX, INT32_MIN);
+	for (size_t chunk = 0; chunk < chunks.size(); chunk++)
+	{
+		const Check &c = chunks[chunk];
+		check.a_count += c.a_count;
+		check.a_gaps += c.a_gaps;
+		check.a_gap_max = std::max(check.a_gap_max, c.a_gap_max);
+		for (int bit = 0; bit < 4; bit++)
+		{
+			check.a_incomplete[bit] += c.a_incomplete[bit];
+		}
+		for (int ch = 0; ch < channel_count; ch++)
+		{
+			check.a_out_of_range[ch] += c.a_out_of_range[ch];
+			check.a_min[ch] = std::min(check.a_min[ch], c.a_min[ch]);
+			check.a_max[ch] = std::max(check.a_max[ch], c.a_max[ch]);
+		}
+		for (int ch = 0; ch < PIEZO_COUNT_MAX; ch++)
+		{
+			check.piezo_mean[ch] += piezo_sums[chunk * PIEZO_COUNT_MAX + ch];
+		}
+	}
+	for (int ch = 0; ch < PIEZO_COUNT_MAX; ch++)
+	{
+		check.piezo_mean[ch] /= std::max<double>((double)check.a_count - delay_piezo_, 1);
+		piezo_mean_[ch] = check.piezo_mean[ch];
+	}
+	check.bytes = check.a_count * m_.pages.front().a_point_size;
+
+	// Position data points within selected time (without first after boot)
+	if (check.a_count > 0)
+	{
+		AReader reader(m_);
+		uint32_t t_begin = reader.A(begin).timestamp;
+		uint32_t t_end = reader.A(end - 1).timestamp;
+		uint32_t last_timestamp = 0;
+		for (size_t i = 1; i < m_.PCount(); i++)
+		{
+			const p_data_point_t &dp = m_.P(i);
+			if (dp.timestamp < t_begin || dp.timestamp > t_end)
+			{
+				continue;
+			}
+			for (int bit = 0; bit < 5; bit++)
+			{
+				check.p_incomplete[bit] += !(dp.complete & (1 << bit));
+			}
+			if (check.p_count > 0 && dp.timestamp > last_timestamp)
+			{
+				check.p_gap_max = std::max(check.p_gap_max, dp.timestamp - last_timestamp);
+			}
+			check.p_invalid_coordinates += std::fabs(dp.lat) <= 1 || std::fabs(dp.lon) <= 1;
+			last_timestamp = dp.timestamp;
+			check.p_count++;
+		}
+		check.bytes += check.p_count * sizeof(p_data_point_t);
+	}
+	return check;
+}
+
+// Segment of position channel containing timestamp: between valid data points, before first or after last (value held)
+void Decoder::Seek(int channel, uint32_t timestamp, Segment &segment) const
+{
+	const Track &track = tracks_[channel];
+	size_t n = track.timestamps.size();
+	if (n == 0)
+	{
+		segment = {0, UINT32_MAX, true, {NAN, NAN}, {NAN, NAN}, {NAN, NAN}};
+		return;
+	}
+	size_t i = std::upper_bound(track.timestamps.begin(), track.timestamps.end(), timestamp) - track.timestamps.begin();
+	size_t i0 = i > 0 ? i - 1 : 0;
+	size_t i1 = i > 0 && i < n ? i : i0;
+	segment.t0 = i > 0 ? track.timestamps[i0] : 0;
+	segment.t1 = i < n ? track.timestamps[i] : UINT32_MAX;
+	segment.hold = i0 == i1;
+	for (int value = 0; value < 2; value++)
+	{
+		const std::vector<double> &v = track.values[value];
+		segment.v0[value] = v.empty() ? NAN : v[i0];
+		segment.v1[value] = v.empty() ? NAN : v[i1];
+		segment.dv[value] = segment.v1[value] - segment.v0[value];
+	}
+}
+
+void Decoder::Decode(size_t begin, size_t end, bool interpolate, std::vector<Sample> &samples) const
+{
+	double fs = m_.SamplingRate();
+	int piezo_count = m_.ChannelCount() - 3;
+	bool has_distance = m_.HasDistance();
+	size_t count = m_.ACount();
+	AReader reader(m_), reader_mems(m_), reader_piezo(m_);
+	Segment segments[POSITION_CHANNEL_COUNT];
+	samples.resize(end - begin);
+	for (size_t i = begin; i < end; i++)
+	{
+		const a_data_point_t &dp = reader.A(i);
+		Sample &s = samples[i - begin];
+		s.timestamp = dp.timestamp;
+		s.time = dp.timestamp / fs;
+		s.temp_mems1 = dp.temp_mems1;
+
+		// Delay compensation: values of later data points, 0 at end of data
+		size_t i_mems = i + delay_mems_;
+		size_t i_piezo = i + delay_piezo_;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			s.a[axis] = i_mems < count ? std::clamp(reader_mems.A(i_mems).xyz_mems1[axis] / MEMS_FULL_SCALE, -1.0, 1.0) : 0;
+		}
+		for (int ch = 0; ch < piezo_count; ch++)
+		{
+			s.a[3 + ch] = i_piezo < count ? std::clamp((reader_piezo.A(i_piezo).a_piezo[ch] - piezo_mean_[ch]) / PIEZO_FULL_SCALE, -1.0, 1.0) : 0;
+		}
+		s.distance = has_distance ? dp.distance : 0;
+
+		// Position: linear interpolation (or nearest) between valid data points, fraction shared by channels with the same data points
+		double position[2 * POSITION_CHANNEL_COUNT];
+		uint32_t t0 = 0;
+		uint32_t t1 = 0;
+		double t_r = 0;
+		for (int channel = 0; channel < POSITION_CHANNEL_COUNT; channel++)
+		{
+			Segment &segment = segments[channel];
+			if (dp.timestamp < segment.t0 || dp.timestamp >= segment.t1)
+			{
+				Seek(channel, dp.timestamp, segment);
+			}
+			if (segment.t0 != t0 || segment.t1 != t1)
+			{
+				t0 = segment.t0;
+				t1 = segment.t1;
+				t_r = (double)(dp.timestamp - t0) / (t1 - t0);
+			}
+			for (int value = 0; value < (channel == POSITION_COORDINATES ? 2 : 1); value++)
+			{
+				if (segment.hold || dp.timestamp == segment.t0)
+				{
+					position[2 * channel + value] = segment.v0[value];
+				}
+				else if (!interpolate)
+				{
+					position[2 * channel + value] = t_r < 0.5 ? segment.v0[value] : segment.v1[value];
+				}
+				else
+				{
+					position[2 * channel + value] = segment.v0[value] + segment.dv[value] * t_r;
+				}
+			}
+		}
+		s.gnss_time = day_start_ + position[2 * POSITION_GNSS_TIME];
+		s.lat = position[2 * POSITION_COORDINATES];
+		s.lon = position[2 * POSITION_COORDINATES + 1];
+		s.speed = position[2 * POSITION_SPEED];
+		s.altitude = position[2 * POSITION_ALTITUDE];
+	}
+}
+
+// Appends value rounded to decimals with trailing zeros removed (as str(round(value, decimals)) in Python)
+void Append_Number(std::string &out, double value, int decimals)
+{
+	char buffer[64];
+	char *end = std::to_chars(buffer, buffer + sizeof(buffer), value, std::chars_format::fixed, decimals).ptr;
+	if (decimals > 0 && std::isfinite(value))
+	{
+		while (end[-1] == '0' && end[-2] != '.')
+		{
+			end--;
+		}
+	}
+	out.append(buffer, end);
+}
+
+void Append_Integer(std::string &out, int64_t value)
+{
+	char buffer[24];
+	out.append(buffer, std::to_chars(buffer, buffer + sizeof(buffer), value).ptr);
+}
+
+std::string Decoder::CsvHeader(const Check &check) const
+{
+	std::string header = "time";
+	if (!check.MemsMissing())
+	{
+		header += ",temp_mems1,x_mems1,y_mems1,z_mems1";
+	}
+	if (!check.PiezoMissing())
+	{
+		for (int ch = 3; ch < m_.ChannelCount(); ch++)
+		{
+			header += ",a_piezo" + std::to_string(ch - 2);
+		}
+	}
+	if (check.p_count > 0)
+	{
+		header += check.PositionMissing(POSITION_GNSS_TIME) ? "" : ",gnss_timestamp";
+		header += check.PositionMissing(POSITION_COORDINATES) ? "" : ",lat,lon";
+		header += check.PositionMissing(POSITION_SPEED) ? "" : ",speed";
+		header += check.PositionMissing(POSITION_ALTITUDE) ? "" : ",altitude";
+	}
+	if (m_.HasDistance() && !check.DistanceMissing())
+	{
+		header += ",distance";
+	}
+	return header + "\n";
+}
+
+void Decoder::CsvLines(const Check &check, const std::vector<Sample> &samples, std::string &out) const
+{
+	bool mems = !check.MemsMissing();
+	bool piezo = !check.PiezoMissing();
+	bool position = check.p_count > 0;
+	bool gnss_time = position && !check.PositionMissing(POSITION_GNSS_TIME);
+	bool coordinates = position && !check.PositionMissing(POSITION_COORDINATES);
+	bool speed = position && !check.PositionMissing(POSITION_SPEED);
+	bool altitude = position && !check.PositionMissing(POSITION_ALTITUDE);
+	bool distance = m_.HasDistance() && !check.DistanceMissing();
+	int channel_count = m_.ChannelCount();
+	for (const Sample &s : samples)
+	{
+		Append_Number(out, s.time, 6);
+		if (mems)
+		{
+			out += ',';
+			Append_Integer(out, s.temp_mems1);
+			for (int axis = 0; axis < 3; axis++)
+			{
+				out += ',';
+				Append_Number(out, s.a[axis], 6);
+			}
+		}
+		if (piezo)
+		{
+			for (int ch = 3; ch < channel_count; ch++)
+			{
+				out += ',';
+				Append_Number(out, s.a[ch], 6);
+			}
+		}
+		if (gnss_time)
+		{
+			out += ',';
+			Append_Number(out, s.gnss_time, 6);
+		}
+		if (coordinates)
+		{
+			out += ',';
+			Append_Number(out, s.lat, 8);
+			out += ',';
+			Append_Number(out, s.lon, 8);
+		}
+		if (speed)
+		{
+			out += ',';
+			Append_Number(out, s.speed, 3);
+		}
+		if (altitude)
+		{
+			out += ',';
+			Append_Number(out, s.altitude, 3);
+		}
+		if (distance)
+		{
+			out += ',';
+			Append_Number(out, s.distance, 3);
+		}
+		out += '\n';
+	}
+}
+
+void Decoder::ExportCsv(unsigned threads, bool interpolate, const Check &check, const std::function<void(const std::string&)> &write) const
+{
+	threads = ThreadCount(threads);
+	std::vector<std::string> lines(threads);
+	std::vector<std::vector<Sample>> samples(threads); // Reused by chunks of each thread (no page faults of new allocations)
+	ForEachChunk(begin, end, threads, [&](size_t chunk, size_t chunk_begin, size_t chunk_end)
+	{
+		Decode(chunk_begin, chunk_end, interpolate, samples[chunk % threads]);
+		std::string &out = lines[chunk % threads];
+		out.clear();
+		CsvLines(check, samples[chunk % threads], out);
+	}, [&](size_t chunk)
+	{
+		write(lines[chunk % threads]);
+	});
+}
+
+// Appends value as JSON string (quotes, backslashes and control characters escaped)
+void Append_Json_String(std::string &out, const std::string &value)
+{
+	out += '"';
+	for (char c : value)
+	{
+		if (c == '"' || c == '\\')
+		{
+			out += '\\';
+			out += c;
+		}
+		else if ((unsigned char)c < 0x20)
+		{
+			char buffer[8];
+			snprintf(buffer, sizeof(buffer), "\\u%04x", (unsigned)c);
+			out += buffer;
+		}
+		else
+		{
+			out += c;
+		}
+	}
+	out += '"';
+}
+
+// Appends value as shortest round-trip number (as repr(float) in Python, null if not finite)
+void Append_Json_Number(std::string &out, double value)
+{
+	if (!std::isfinite(value))
+	{
+		out += "null";
+		return;
+	}
+	char buffer[32];
+	char *end = std::to_chars(buffer, buffer + sizeof(buffer), value).ptr;
+	out.append(buffer, end);
+	if (std::find_if(buffer, end, [](char c) { return c == '.' || c == 'e'; }) == end)
+	{
+		out += ".0";
+	}
+}
+
+// Sets values of k = 0 to count - 1 (PLAIN encoding of Parquet)
+template<typename T, typename F>
+void Fill_Values(std::string &out, size_t count, F value)
+{
+	out.resize(count * sizeof(T));
+	for (size_t k = 0; k < count; k++)
+	{
+		T v = value(k);
+		memcpy(&out[k * sizeof(T)], &v, sizeof(T));
+	}
+}
+
+// Columns of .parquet export
+enum ColumnSource
+{
+	COLUMN_TIMESTAMP,
+	COLUMN_TEMP_MEMS1,
+	COLUMN_MEMS,
+	COLUMN_PIEZO,
+	COLUMN_GNSS_TIME,
+	COLUMN_LAT,
+	COLUMN_LON,
+	COLUMN_SPEED,
+	COLUMN_ALTITUDE,
+	COLUMN_DISTANCE
+};
+
+bool Decoder::ExportParquet(unsigned threads, bool interpolate, const Check &check, const std::string &path, const std::string &source, std::string &error) const
+{
+	threads = ThreadCount(threads);
+	double fs = m_.SamplingRate();
+	int channel_count = m_.ChannelCount();
+	bool position = check.p_count > 0;
+
+	// Raw channels as Python/vera2csv.py --savecolumns, scaled values are raw * scale - offset (time in s, acceleration -1 to 1 as in .csv)
+	struct Column
+	{
+		ParquetColumn column;
+		ColumnSource source;
+		int index;
+		double scale;
+		double offset;
+		const char *unit;
+	};
+	std::vector<Column> columns;
+	columns.push_back({{"timestamp", PARQUET_INT32, PARQUET_UINT32}, COLUMN_TIMESTAMP, 0, 1.0 / fs, 0.0, nullptr});
+	if (!check.MemsMissing())
+	{
+		columns.push_back({{"temp_mems1", PARQUET_INT32, PARQUET_UINT16}, COLUMN_TEMP_MEMS1, 0, NAN, NAN, nullptr});
+		for (int axis = 0; axis < 3; axis++)
+		{
+			columns.push_back({{std::string(1, (char)('x' + axis)) + "_mems1", PARQUET_INT32}, COLUMN_MEMS, axis, 1.0 / MEMS_FULL_SCALE, 0.0, nullptr});
+		}
+	}
+	if (!check.PiezoMissing())
+	{
+		for (int ch = 0; ch < channel_count - 3; ch++)
+		{
+			columns.push_back({{"a_piezo" + std::to_string(ch + 1), PARQUET_INT32, PARQUET_INT16}, COLUMN_PIEZO, ch, 1.0 / PIEZO_FULL_SCALE, piezo_mean_[ch] / PIEZO_FULL_SCALE, nullptr});
+		}
+	}
+	if (position && !check.PositionMissing(POSITION_GNSS_TIME))
+	{
+		columns.push_back({{"gnss_time", PARQUET_INT64, PARQUET_TIMESTAMP_US_UTC}, COLUMN_GNSS_TIME, 0, NAN, NAN, "us since 1970-01-01 UTC"});
+	}
+	if (position && !check.PositionMissing(POSITION_COORDINATES))
+	{
+		columns.push_back({{"lat", PARQUET_DOUBLE}, COLUMN_LAT, 0, NAN, NAN, "deg"});
+		columns.push_back({{"lon", PARQUET_DOUBLE}, COLUMN_LON, 0, NAN, NAN, "deg"});
+	}
+	if (position && !check.PositionMissing(POSITION_SPEED))
+	{
+		columns.push_back({{"speed", PARQUET_FLOAT}, COLUMN_SPEED, 0, NAN, NAN, "km/h"});
+	}
+	if (position && !check.PositionMissing(POSITION_ALTITUDE))
+	{
+		columns.push_back({{"altitude", PARQUET_FLOAT}, COLUMN_ALTITUDE, 0, NAN, NAN, "m"});
+	}
+	bool distance = m_.HasDistance() && !check.DistanceMissing();
+	if (distance)
+	{
+		columns.push_back({{"distance", PARQUET_FLOAT}, COLUMN_DISTANCE, 0, NAN, NAN, "m"});
+	}
+
+	std::vector<ParquetColumn> schema;
+	for (const Column &column : columns)
+	{
+		schema.push_back(column.column);
+	}
+	ParquetWriter writer;
+	if (!writer.Open(path, schema))
+	{
+		error = writer.error;
+		return false;
+	}
+
+	// One row group per page, values of each thread reused by its chunks
+	size_t count = m_.ACount();
+	std::string pages;
+	std::vector<std::vector<Sample>> samples(threads);
+	std::vector<std::vector<std::string>> values(threads, std::vector<std::string>(columns.size()));
+	for (size_t page = 0; page < m_.pages.size(); page++)
+	{
+		size_t page_begin = std::max(begin, m_.a_offsets[page]);
+		size_t page_end = std::min(end, m_.a_offsets[page + 1]);
+		if (page_begin >= page_end)
+		{
+			continue;
+		}
+		AReader reader(m_);
+		const a_data_point_t &first = reader.A(page_begin);
+		pages += pages.empty() ? "[" : ", ";
+		pages += "{\"page\": " + std::to_string(m_.pages[page].num) + ", \"row\": " + std::to_string(page_begin - begin) + ", \"timestamp\": " + std::to_string(first.timestamp) + ", \"distance\": ";
+		if (distance)
+		{
+			Append_Json_Number(pages, first.distance);
+		}
+		else
+		{
+			pages += "null";
+		}
+		pages += "}";
+
+		ForEachChunk(page_begin, page_end, threads, [&](size_t chunk, size_t chunk_begin, size_t chunk_end)
+		{
+			std::vector<Sample> &x = samples[chunk % threads];
+			Decode(chunk_begin, chunk_end, interpolate, x);
+			AReader reader_delayed(m_);
+			size_t n = chunk_end - chunk_begin;
+			for (size_t c = 0; c < columns.size(); c++)
+			{
+				std::string &out = values[chunk % threads][c];
+				int index = columns[c].index;
+				switch (columns[c].source)
+				{
+				case COLUMN_TIMESTAMP:
+					Fill_Values<int32_t>(out, n, [&](size_t k) { return (int32_t)x[k].timestamp; });
+					break;
+				case COLUMN_TEMP_MEMS1:
+					Fill_Values<int32_t>(out, n, [&](size_t k) { return (int32_t)x[k].temp_mems1; });
+					break;
+				case COLUMN_MEMS:
+					// Delay compensation as Decode, 0 at end of data
+					Fill_Values<int32_t>(out, n, [&](size_t k)
+					{
+						size_t i_mems = chunk_begin + k + delay_mems_;
+						return i_mems < count ? reader_delayed.A(i_mems).xyz_mems1[index] : 0;
+					});
+					break;
+				case COLUMN_PIEZO:
+					Fill_Values<int32_t>(out, n, [&](size_t k)
+					{
+						size_t i_piezo = chunk_begin + k + delay_piezo_;
+						return i_piezo < count ? (int32_t)reader_delayed.A(i_piezo).a_piezo[index] : 0;
+					});
+					break;
+				case COLUMN_GNSS_TIME:
+					Fill_Values<int64_t>(out, n, [&](size_t k) { return (int64_t)std::llround(x[k].gnss_time * 1e6); });
+					break;
+				case COLUMN_LAT:
+					Fill_Values<double>(out, n, [&](size_t k) { return x[k].lat; });
+					break;
+				case COLUMN_LON:
+					Fill_Values<double>(out, n, [&](size_t k) { return x[k].lon; });
+					break;
+				case COLUMN_SPEED:
+					Fill_Values<float>(out, n, [&](size_t k) { return (float)x[k].speed; });
+					break;
+				case COLUMN_ALTITUDE:
+					Fill_Values<float>(out, n, [&](size_t k) { return (float)x[k].altitude; });
+					break;
+				case COLUMN_DISTANCE:
+					Fill_Values<float>(out, n, [&](size_t k) { return x[k].distance; });
+					break;
+				}
+			}
+		}, [&](size_t chunk)
+		{
+			for (size_t c = 0; c < columns.size(); c++)
+			{
+				const std::string &out = values[chunk % threads][c];
+				writer.Append(c, out.data(), out.size() / ParquetValueSize(columns[c].column.type));
+			}
+		});
+		if (!writer.EndRowGroup())
+		{
+			error = writer.error;
+			return false;
+		}
+	}
+
+	// Metadata "vera" as JSON (as vera2csv.py, scales and units of columns are included since fields of Parquet have no metadata without an Arrow schema)
+	const p_data_header_t &date = m_.pages.front().p_header;
+	char date_string[16];
+	snprintf(date_string, sizeof(date_string), "%04u-%02u-%02u", date.year, date.month, date.day);
+	std::string json = "{\"source\": ";
+	Append_Json_String(json, source);
+	json += ", \"a_sampling_rate\": " + std::to_string(m_.SamplingRate()) + ", \"skip\": 0, \"date\": \"" + date_string + "\", \"interpolated\": " + (interpolate ? "true" : "false");
+	json += ", \"delay_mems\": " + std::to_string(delay_mems_) + ", \"delay_piezo\": " + std::to_string(delay_piezo_) + ", \"pages\": " + (pages.empty() ? "[" : pages) + "]";
+	json += ", \"columns\": {";
+	for (size_t c = 0; c < columns.size(); c++)
+	{
+		const Column &column = columns[c];
+		json += c > 0 ? ", " : "";
+		Append_Json_String(json, column.column.name);
+		if (column.unit != nullptr)
+		{
+			json += ": {\"unit\": ";
+			Append_Json_String(json, column.unit);
+		}
+		else if (!std::isnan(column.scale))
+		{
+			json += ": {\"scale\": ";
+			Append_Json_Number(json, column.scale);
+			json += ", \"offset\": ";
+			Append_Json_Number(json, column.offset);
+		}
+		else
+		{
+			json += ": {";
+		}
+		json += "}";
+	}
+	json += "}}";
+	if (!writer.Close({{"vera", json}}))
+	{
+		error = writer.error;
+		return false;
+	}
+	return true;
+}
+
+}
@@ -0,0 +1,240 @@
+/*
+ * Copyright (c) 2024 Mirco Heitmann
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ * vera_decoder.h
+ *
+ * Decoder of measurement files (a_X.bin, p_X.bin) on the host, layout of data points from STM32/Core/Inc/data_points.h
+ * Pages are memory-mapped, data points are read in place (no copy), decoding and integrity check are split into chunks for worker threads
+ */
+
+#ifndef VERA_DECODER_H_
+#define VERA_DECODER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "data_points.h"
+
+namespace vera
+{
+
+// Supported versions of a_data_header_t (version 1 without distance) and p_data_header_t
+constexpr uint8_t A_VERSION_MAX = 2;
+constexpr uint8_t P_VERSION_MAX = 2;
+// MEMS axes followed by piezo channels
+constexpr int CHANNEL_MAX = 3 + PIEZO_COUNT_MAX;
+// Full scale of channels (LSB), scaled to -1 to 1
+constexpr double MEMS_FULL_SCALE = 524287.0;
+constexpr double PIEZO_FULL_SCALE = 4095.0;
+// Raw values beyond are reported as out of range
+constexpr int32_t MEMS_RANGE = 524287;
+constexpr int32_t PIEZO_RANGE = 8190;
+// Delay of MEMS (digital filter of ADXL357) and analog piezo filter (s), delay of piezo FIR filter from a_data_header_t.fir_taps_len
+constexpr double DELAY_MEMS = 12.25e-3;
+constexpr double DELAY_PIEZO_ANALOG = 300e-6;
+// Data points per chunk of worker threads
+constexpr size_t CHUNK_LEN = 1 << 16;
+
+// Position channels of p_data_point_t (complete bit, values)
+enum PositionChannel
+{
+	POSITION_GNSS_TIME,
+	POSITION_COORDINATES,
+	POSITION_SPEED,
+	POSITION_ALTITUDE,
+	POSITION_CHANNEL_COUNT
+};
+
+// Read-only memory-mapped file
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	~MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	MappedFile(MappedFile &&other) noexcept;
+	MappedFile& operator=(MappedFile &&other) noexcept;
+
+	bool Open(const std::string &path);
+	void Close();
+	const uint8_t *Data() const { return data_; }
+	size_t Size() const { return size_; }
+
+private:
+	const uint8_t *data_ = nullptr;
+	size_t size_ = 0;
+#ifdef _WIN32
+	void *file_ = nullptr;
+	void *mapping_ = nullptr;
+#endif
+};
+
+// Acceleration and position file with the same page number
+struct Page
+{
+	int num = 0;
+	MappedFile a_file;
+	MappedFile p_file;
+	a_data_header_t a_header{};
+	p_data_header_t p_header{};
+	const uint8_t *a_points = nullptr;
+	size_t a_point_size = 0; // sizeof(a_data_point_t) of version
+	size_t a_count = 0;
+	const p_data_point_t *p_points = nullptr;
+	size_t p_count = 0;
+
+	// Data point of page, distance is only valid if a_header.version >= 2
+	const a_data_point_t &A(size_t i) const { return *reinterpret_cast<const a_data_point_t*>(a_points + i * a_point_size); }
+};
+
+// All pages of a measurement directory, data points are addressed by index over all pages
+class Measurement
+{
+public:
+	// Maps pages from first_page up to first missing page (page 0 may be missing), returns false on error (see error)
+	bool Open(const std::string &dir_path, int first_page = 0);
+
+	size_t ACount() const { return a_offsets.back(); }
+	size_t PCount() const { return p_offsets.back(); }
+	const p_data_point_t &P(size_t i) const;
+	uint32_t SamplingRate() const { return pages.front().a_header.a_sampling_rate; }
+	int ChannelCount() const { return 3 + pages.front().a_header.piezo_count; }
+	bool HasDistance() const { return pages.front().a_header.version >= 2; }
+
+	std::vector<Page> pages;
+	// First index of each page, followed by total count
+	std::vector<size_t> a_offsets{0};
+	std::vector<size_t> p_offsets{0};
+	std::string error;
+	std::vector<std::string> warnings;
+};
+
+// Sequential access to acceleration data points by index over all pages (page of last access is cached)
+class AReader
+{
+public:
+	explicit AReader(const Measurement &m) : m_(m) {}
+	const a_data_point_t &A(size_t i)
+	{
+		if (i < begin_ || i >= end_)
+		{
+			Seek(i);
+		}
+		return page_->A(i - begin_);
+	}
+
+private:
+	void Seek(size_t i);
+	const Measurement &m_;
+	const Page *page_ = nullptr;
+	size_t begin_ = 0;
+	size_t end_ = 0;
+};
+
+// Result of integrity check
+struct Check
+{
+	size_t a_count = 0;
+	size_t a_incomplete[4] = {}; // Data points without complete bit (A_COMPLETE_XXX)
+	size_t a_gaps = 0; // Timestamp steps other than 1
+	uint32_t a_gap_max = 0;
+	size_t a_out_of_range[CHANNEL_MAX] = {};
+	int32_t a_min[CHANNEL_MAX];
+	int32_t a_max[CHANNEL_MAX];
+	double piezo_mean[PIEZO_COUNT_MAX] = {}; // LSB, removed while decoding
+	size_t p_count = 0;
+	size_t p_incomplete[5] = {}; // Data points without complete bit (P_COMPLETE_XXX)
+	uint32_t p_gap_max = 0; // Timestamps
+	size_t p_invalid_coordinates = 0; // |lat| or |lon| <= 1
+	size_t bytes = 0; // Size of checked data points
+
+	bool MemsMissing() const { return a_count > 0 && a_incomplete[A_COMPLETE_MEMS] == a_count; }
+	bool PiezoMissing() const { return a_count > 0 && a_incomplete[A_COMPLETE_PZ] == a_count; }
+	bool DistanceMissing() const { return a_count > 0 && a_incomplete[A_COMPLETE_DISTANCE] == a_count; }
+	bool PositionMissing(int channel) const { return p_count == 0 || p_incomplete[P_COMPLETE_GNSS_TIME + channel] == p_count; }
+};
+
+// Decoded acceleration data point with position interpolated at its timestamp
+struct Sample
+{
+	uint32_t timestamp;
+	double time; // s since start of capture
+	uint16_t temp_mems1;
+	double a[CHANNEL_MAX]; // MEMS x, y, z and piezo channels scaled to -1 to 1, delays compensated, piezo offset removed
+	float distance;
+	double gnss_time; // POSIX time (s)
+	double lat;
+	double lon;
+	double speed;
+	double altitude;
+};
+
+// Position channel with valid data points only, sorted by timestamp
+struct Track
+{
+	std::vector<uint32_t> timestamps;
+	std::vector<double> values[2];
+};
+
+class Decoder
+{
+public:
+	explicit Decoder(const Measurement &m);
+
+	// Selects data points with timestamps from t0 to t1 (s), first data point after boot is always excluded
+	void Select(double t0, double t1);
+	// Integrity check of selected data points (also piezo offsets removed by Decode), threads 0: all cores
+	Check CheckData(unsigned threads);
+	// Decodes data points begin to end (index over all pages), interpolate false: nearest position data point
+	void Decode(size_t begin, size_t end, bool interpolate, std::vector<Sample> &samples) const;
+	// Decodes selected data points on worker threads and formats them as CSV lines (columns as Python/vera2csv.py with --timeformat 1)
+	// write is called with the lines of each chunk in order, missing channels of check are omitted
+	void ExportCsv(unsigned threads, bool interpolate, const Check &check, const std::function<void(const std::string&)> &write) const;
+	// Decodes selected data points on worker threads and saves raw channels as columns to .parquet (as Python/vera2csv.py --savecolumns, one row group per page)
+	// source is the path of the measurement in the metadata, returns false on error
+	bool ExportParquet(unsigned threads, bool interpolate, const Check &check, const std::string &path, const std::string &source, std::string &error) const;
+	std::string CsvHeader(const Check &check) const;
+	void CsvLines(const Check &check, const std::vector<Sample> &samples, std::string &out) const;
+
+	size_t begin = 1;
+	size_t end = 0;
+	bool date_valid = true; // Date of position header, today if invalid
+
+private:
+	// Values of position channel from t0 to t1 (excl.), dv = v1 - v0, hold: v0 before first or after last data point
+	struct Segment
+	{
+		uint32_t t0 = 1;
+		uint32_t t1 = 0;
+		bool hold = true;
+		double v0[2];
+		double v1[2];
+		double dv[2];
+	};
+	void Seek(int channel, uint32_t timestamp, Segment &segment) const;
+
+	const Measurement &m_;
+	int delay_mems_;
+	int delay_piezo_;
+	double piezo_mean_[PIEZO_COUNT_MAX] = {};
+	double day_start_; // POSIX time of GNSS date
+	Track tracks_[POSITION_CHANNEL_COUNT];
+};
+
+// Number of worker threads (threads 0: all cores)
+unsigned ThreadCount(unsigned threads);
+// Calls work(chunk, begin, end) for chunks of CHUNK_LEN data points from begin to end on worker threads (one batch of chunks per thread count)
+// done(chunk) is called in order of chunks after each batch
+void ForEachChunk(size_t begin, size_t end, unsigned threads, const std::function<void(size_t, size_t, size_t)> &work, const std::function<void(size_t)> &done = nullptr);
+
+}
+
+#endif /* VERA_DECODER_H_ */
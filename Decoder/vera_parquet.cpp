@@ -0,0 +1,320 @@
+/*
+ * Copyright (c) 2024 Mirco Heitmann
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ * vera_parquet.cpp
+ */
+
+#include "vera_parquet.h"
+
+namespace vera
+{
+
+// Element types of Thrift compact protocol
+enum ThriftType
+{
+	THRIFT_TRUE = 1,
+	THRIFT_FALSE = 2,
+	THRIFT_BYTE = 3,
+	THRIFT_I32 = 5,
+	THRIFT_I64 = 6,
+	THRIFT_BINARY = 8,
+	THRIFT_LIST = 9,
+	THRIFT_STRUCT = 12
+};
+
+// Serializes structs of parquet.thrift (Thrift compact protocol), fields of each struct must be written in order of their ids
+class ThriftWriter
+{
+public:
+	explicit ThriftWriter(std::string &out) : out_(out) {}
+
+	void Begin()
+	{
+		ids_.push_back(id_);
+		id_ = 0;
+	}
+	void End()
+	{
+		out_ += '\0';
+		id_ = ids_.back();
+		ids_.pop_back();
+	}
+	void Struct(int16_t id)
+	{
+		Field(id, THRIFT_STRUCT);
+		Begin();
+	}
+	void List(int16_t id, ThriftType type, size_t size)
+	{
+		Field(id, THRIFT_LIST);
+		if (size < 15)
+		{
+			out_ += (char)(size << 4 | type);
+		}
+		else
+		{
+			out_ += (char)(0xF0 | type);
+			Varint(size);
+		}
+	}
+	void Bool(int16_t id, bool value) { Field(id, value ? THRIFT_TRUE : THRIFT_FALSE); }
+	void Byte(int16_t id, int8_t value)
+	{
+		Field(id, THRIFT_BYTE);
+		out_ += (char)value;
+	}
+	void I32(int16_t id, int32_t value)
+	{
+		Field(id, THRIFT_I32);
+		Integer(value);
+	}
+	void I64(int16_t id, int64_t value)
+	{
+		Field(id, THRIFT_I64);
+		Integer(value);
+	}
+	void Binary(int16_t id, const std::string &value)
+	{
+		Field(id, THRIFT_BINARY);
+		Binary(value);
+	}
+	// Elements of lists (zigzag varint of I32 and I64)
+	void Integer(int64_t value) { Varint((uint64_t)value << 1 ^ (uint64_t)(value >> 63)); }
+	void Binary(const std::string &value)
+	{
+		Varint(value.size());
+		out_ += value;
+	}
+
+private:
+	void Field(int16_t id, ThriftType type)
+	{
+		if (id > id_ && id - id_ <= 15)
+		{
+			out_ += (char)((id - id_) << 4 | type);
+		}
+		else
+		{
+			out_ += (char)type;
+			Integer(id);
+		}
+		id_ = id;
+	}
+	void Varint(uint64_t value)
+	{
+		while (value >= 0x80)
+		{
+			out_ += (char)(value | 0x80);
+			value >>= 7;
+		}
+		out_ += (char)value;
+	}
+
+	std::string &out_;
+	int16_t id_ = 0; // Last field id of current struct
+	std::vector<int16_t> ids_;
+};
+
+ParquetWriter::~ParquetWriter()
+{
+	if (file_ != nullptr)
+	{
+		fclose(file_);
+	}
+}
+
+bool ParquetWriter::Open(const std::string &path, const std::vector<ParquetColumn> &columns)
+{
+	file_ = fopen(path.c_str(), "wb");
+	if (file_ == nullptr)
+	{
+		error = "Cannot write \"" + path + "\"";
+		return false;
+	}
+	columns_ = columns;
+	pages_.assign(columns.size(), std::string());
+	values_.assign(columns.size(), 0);
+	offset_ = 0;
+	return Write("PAR1");
+}
+
+void ParquetWriter::Append(size_t column, const void *values, size_t count)
+{
+	int32_t size = (int32_t)(count * ParquetValueSize(columns_[column].type));
+
+	// PageHeader with DataPageHeader (levels are omitted for required columns)
+	std::string &out = pages_[column];
+	ThriftWriter thrift(out);
+	thrift.Begin();
+	thrift.I32(1, 0); // DATA_PAGE
+	thrift.I32(2, size);
+	thrift.I32(3, size);
+	thrift.Struct(5);
+	thrift.I32(1, (int32_t)count);
+	thrift.I32(2, 0); // PLAIN
+	thrift.I32(3, 3); // RLE
+	thrift.I32(4, 3);
+	thrift.End();
+	thrift.End();
+	out.append(static_cast<const char*>(values), size);
+	values_[column] += count;
+}
+
+bool ParquetWriter::EndRowGroup()
+{
+	RowGroup group{values_.empty() ? 0 : values_[0], {}};
+	for (size_t column = 0; column < columns_.size(); column++)
+	{
+		if (values_[column] != group.rows)
+		{
+			error = "Column \"" + columns_[column].name + "\" has " + std::to_string(values_[column]) + " values instead of " + std::to_string(group.rows);
+			return false;
+		}
+		group.chunks.push_back({offset_, (int64_t)pages_[column].size(), values_[column]});
+		if (!Write(pages_[column]))
+		{
+			return false;
+		}
+		pages_[column].clear();
+		values_[column] = 0;
+	}
+	if (group.rows > 0)
+	{
+		row_groups_.push_back(group);
+	}
+	return true;
+}
+
+bool ParquetWriter::Close(const std::vector<std::pair<std::string, std::string>> &metadata)
+{
+	if (!EndRowGroup())
+	{
+		return false;
+	}
+
+	// FileMetaData
+	std::string footer;
+	ThriftWriter thrift(footer);
+	thrift.Begin();
+	thrift.I32(1, 1);
+	thrift.List(2, THRIFT_STRUCT, 1 + columns_.size());
+	thrift.Begin();
+	thrift.Binary(4, "schema");
+	thrift.I32(5, (int32_t)columns_.size());
+	thrift.End();
+	for (const ParquetColumn &column : columns_)
+	{
+		thrift.Begin();
+		thrift.I32(1, column.type);
+		thrift.I32(3, 0); // REQUIRED
+		thrift.Binary(4, column.name);
+		if (column.logical != PARQUET_PLAIN)
+		{
+			// ConvertedType and LogicalType (union of IntType and TimestampType)
+			if (column.logical == PARQUET_TIMESTAMP_US_UTC)
+			{
+				thrift.I32(6, 10); // TIMESTAMP_MICROS
+				thrift.Struct(10);
+				thrift.Struct(8);
+				thrift.Bool(1, true);
+				thrift.Struct(2);
+				thrift.Struct(2); // MICROS
+				thrift.End();
+				thrift.End();
+				thrift.End();
+				thrift.End();
+			}
+			else
+			{
+				bool is_signed = column.logical == PARQUET_INT16;
+				int8_t bit_width = column.logical == PARQUET_UINT32 ? 32 : 16;
+				thrift.I32(6, column.logical == PARQUET_UINT16 ? 12 : column.logical == PARQUET_UINT32 ? 13 : 16);
+				thrift.Struct(10);
+				thrift.Struct(10);
+				thrift.Byte(1, bit_width);
+				thrift.Bool(2, is_signed);
+				thrift.End();
+				thrift.End();
+			}
+		}
+		thrift.End();
+	}
+	int64_t rows = 0;
+	for (const RowGroup &group : row_groups_)
+	{
+		rows += group.rows;
+	}
+	thrift.I64(3, rows);
+	thrift.List(4, THRIFT_STRUCT, row_groups_.size());
+	for (const RowGroup &group : row_groups_)
+	{
+		int64_t group_size = 0;
+		thrift.Begin();
+		thrift.List(1, THRIFT_STRUCT, group.chunks.size());
+		for (size_t column = 0; column < group.chunks.size(); column++)
+		{
+			// ColumnChunk with ColumnMetaData
+			const Chunk &chunk = group.chunks[column];
+			group_size += chunk.size;
+			thrift.Begin();
+			thrift.I64(2, chunk.offset);
+			thrift.Struct(3);
+			thrift.I32(1, columns_[column].type);
+			thrift.List(2, THRIFT_I32, 1);
+			thrift.Integer(0); // PLAIN
+			thrift.List(3, THRIFT_BINARY, 1);
+			thrift.Binary(columns_[column].name);
+			thrift.I32(4, 0); // UNCOMPRESSED
+			thrift.I64(5, chunk.values);
+			thrift.I64(6, chunk.size);
+			thrift.I64(7, chunk.size);
+			thrift.I64(9, chunk.offset);
+			thrift.End();
+			thrift.End();
+		}
+		thrift.I64(2, group_size);
+		thrift.I64(3, group.rows);
+		thrift.End();
+	}
+	if (!metadata.empty())
+	{
+		thrift.List(5, THRIFT_STRUCT, metadata.size());
+		for (const auto &key_value : metadata)
+		{
+			thrift.Begin();
+			thrift.Binary(1, key_value.first);
+			thrift.Binary(2, key_value.second);
+			thrift.End();
+		}
+	}
+	thrift.Binary(6, "vera_decode");
+	thrift.End();
+
+	uint32_t footer_size = (uint32_t)footer.size();
+	char footer_size_le[4] = {(char)footer_size, (char)(footer_size >> 8), (char)(footer_size >> 16), (char)(footer_size >> 24)};
+	bool ok = Write(footer) && Write(std::string(footer_size_le, 4)) && Write("PAR1");
+	if (fclose(file_) != 0 && ok)
+	{
+		error = "Cannot write file";
+		ok = false;
+	}
+	file_ = nullptr;
+	return ok;
+}
+
+bool ParquetWriter::Write(const std::string &data)
+{
+	if (fwrite(data.data(), 1, data.size(), file_) != data.size())
+	{
+		error = "Cannot write file";
+		return false;
+	}
+	offset_ += data.size();
+	return true;
+}
+
+}
@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2024 Mirco Heitmann
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ * vera_parquet.h
+ *
+ * Writer of Parquet files without dependencies (metadata in Thrift compact protocol as in parquet.thrift)
+ * Only required (non-null) flat columns, PLAIN encoding and no compression, values of a row group are buffered until EndRowGroup
+ */
+
+#ifndef VERA_PARQUET_H_
+#define VERA_PARQUET_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace vera
+{
+
+// Physical types (parquet.thrift Type), values are int32_t, int64_t, float or double
+enum ParquetType
+{
+	PARQUET_INT32 = 1,
+	PARQUET_INT64 = 2,
+	PARQUET_FLOAT = 4,
+	PARQUET_DOUBLE = 5
+};
+
+// Logical types of INT32 and INT64 columns (written as ConvertedType and LogicalType)
+enum ParquetLogical
+{
+	PARQUET_PLAIN,
+	PARQUET_UINT16,
+	PARQUET_UINT32,
+	PARQUET_INT16,
+	PARQUET_TIMESTAMP_US_UTC
+};
+
+struct ParquetColumn
+{
+	std::string name;
+	ParquetType type;
+	ParquetLogical logical = PARQUET_PLAIN;
+};
+
+// Size of value (bytes) of physical type
+inline size_t ParquetValueSize(ParquetType type) { return type == PARQUET_INT64 || type == PARQUET_DOUBLE ? 8 : 4; }
+
+class ParquetWriter
+{
+public:
+	ParquetWriter() = default;
+	~ParquetWriter();
+	ParquetWriter(const ParquetWriter&) = delete;
+	ParquetWriter& operator=(const ParquetWriter&) = delete;
+
+	// Creates file, returns false on error (see error)
+	bool Open(const std::string &path, const std::vector<ParquetColumn> &columns);
+	// Appends count values (PLAIN encoding: little-endian, 4 or 8 bytes of type) of column to current row group as one data page
+	void Append(size_t column, const void *values, size_t count);
+	// Writes current row group, all columns must have the same number of values
+	bool EndRowGroup();
+	// Writes footer with key-value metadata and closes file
+	bool Close(const std::vector<std::pair<std::string, std::string>> &metadata);
+
+	std::string error;
+
+private:
+	struct Chunk
+	{
+		int64_t offset;
+		int64_t size;
+		int64_t values;
+	};
+	struct RowGroup
+	{
+		int64_t rows;
+		std::vector<Chunk> chunks;
+	};
+	bool Write(const std::string &data);
+
+	FILE *file_ = nullptr;
+	int64_t offset_ = 0;
+	std::vector<ParquetColumn> columns_;
+	std::vector<std::string> pages_; // Data pages of current row group per column
+	std::vector<int64_t> values_;
+	std::vector<RowGroup> row_groups_;
+};
+
+}
+
+#endif /* VERA_PARQUET_H_ */
@@ -0,0 +1,108 @@
+import sys, os, re, struct
+
+events_path = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'STM32', 'Core', 'Inc', 'trace_events.h')
+trace_sync = 0xA5
+version_support = 2
+
+# Reads event table X(id, format) of trace_events.h, returns [(id, format)]
+def events_parse(path):
+    with open(path, 'r') as f:
+        text = f.read()
+    events = []
+    for name, fmt in re.findall(r'X\((\w+),\s*"((?:[^"\\]|\\.)*)"\)', text):
+        events.append((name, fmt.encode().decode('unicode_escape')))
+    return events
+
+# Conversion specifications of C format string: (flags/width/precision, conversion)
+conversion_re = re.compile(r'%([-+ #0]*\d*(?:\.\d+)?)(?:hh|h|ll|l|z|j|t)?([diouxXcfFeEgG%])')
+
+# Renders format string with raw 32 bit argument words
+def event_format(fmt, args):
+    words = list(args)
+    def convert(m):
+        spec, conv = m.groups()
+        if conv == '%':
+            return '%'
+        if not words:
+            return '<?>'
+        word = words.pop(0)
+        if conv in 'fFeEgG':
+            value = struct.unpack('<f', struct.pack('<I', word))[0]
+        elif conv in 'di':
+            value = struct.unpack('<i', struct.pack('<I', word))[0]
+        elif conv == 'c':
+            value = chr(word & 0xFF)
+        else:
+            value = word
+        return ('%' + spec + conv) % value
+    text = conversion_re.sub(convert, fmt)
+    if words:
+        text += f' <{len(words)} unused arguments>'
+    return text
+
+# Decodes trace file, returns list of text lines
+def trace_parse(path, events):
+    with open(path, 'rb') as f:
+        data = f.read()
+    lines = []
+    i = 0
+    while i + 8 <= len(data):
+        header, tick = struct.unpack_from('<II', data, i)
+        sync, nargs, event_id = header >> 24, (header >> 16) & 0xFF, header & 0xFFFF
+        if sync != trace_sync or i + 8 + nargs * 4 > len(data):
+            # Resynchronize on next word
+            print(f'! WARNING: Invalid record at offset {i}')
+            i += 4
+            continue
+        args = struct.unpack_from(f'<{nargs}I', data, i + 8)
+        i += 8 + nargs * 4
+        if event_id >= len(events):
+            lines.append(f'({tick}) <unknown event {event_id}> {" ".join(hex(a) for a in args)}')
+            continue
+        name, fmt = events[event_id]
+        if name == 'TRACE_START' and len(args) == 2:
+            if args[0] > version_support:
+                print(f'! WARNING: Trace version {args[0]} is not supported. This script version supports max. {version_support}.')
+            if args[1] != len(events):
+                print(f'! WARNING: Firmware has {args[1]} events, "{events_path}" has {len(events)}, trace may be decoded incorrectly')
+        lines.append(f'({tick}) ' + event_format(fmt, args))
+    return lines
+
+if '-h' in sys.argv or '--help' in sys.argv or len(sys.argv) < 2:
+    print('Usage: python trace2txt.py (options) [path like "./24_08_01-1/_log.bin"]')
+    print('Options:')
+    print('\t-e   / --events (path)      | Event table of firmware (default: ../STM32/Core/Inc/trace_events.h)')
+    print('\t-s   / --save (path)        | Saves text as file instead of printing')
+    exit()
+
+# Parse arguments
+arg_path = None
+arg_save = None
+argv_i = 1
+while argv_i < len(sys.argv):
+    a = sys.argv[argv_i]
+    if a == '-e' or a == '--events':
+        events_path = sys.argv[argv_i + 1]
+        argv_i += 1
+    elif a == '-s' or a == '--save':
+        arg_save = sys.argv[argv_i + 1]
+        argv_i += 1
+    else:
+        arg_path = a
+    argv_i += 1
+
+if arg_path is None or not os.path.isfile(arg_path):
+    print(f'! ERROR: Cannot read path "{arg_path}"')
+    exit()
+if not os.path.isfile(events_path):
+    print(f'! ERROR: Cannot read event table "{events_path}"')
+    exit()
+
+lines = trace_parse(arg_path, events_parse(events_path))
+if arg_save is None:
+    for line in lines:
+        print(line)
+else:
+    with open(arg_save, 'w') as f:
+        f.write('\n'.join(lines) + '\n')
+    print(f'File "{arg_save}" written')
@@ -1,6 +1,7 @@
-import sys, os, ctypes, datetime
+import sys, os, types, datetime, json
 import numpy as np
 from scipy import signal
+import vera_format
 
 enable_matplotlib_preview = False # Requires matplotlib
 enable_plotly_preview = True # Requires pandas and plotly
@@ -17,98 +18,24 @@ delay_pz_analog = 300e-6 # 300 µs
 delay_mems = 12.25e-3 # 12.25 ms
 img_dir = 'vera2csv_img' # For -sp
 img_scale = 2.0 # For -sp
-version_support = 1
 
-# Reads acceleration file, returns (a_header, [a_data_point])
+# Reads acceleration file, returns (a_header, a_data_point_t as structured array, memory-mapped)
 def a_parse(a_path, n_skip):
-    with open(a_path, 'rb') as f:
-        a_data = f.read() # Read binary acceleration data
-    if len(a_data) == 0:
+    a_header, a_dp = vera_format.a_map(a_path)
+    if a_header is None:
         return None, None
+    return header_fields(a_header), a_dp[::n_skip + 1]
 
-    # Definition of a_data_header_t
-    a_version = a_data[0]
-    if a_version == 1:
-        class A_DataHeader(ctypes.Structure):
-            _fields_ = (
-                ('version', ctypes.c_uint8),
-                ('boot_duration', ctypes.c_uint32),
-                ('a_buffer_len', ctypes.c_uint32),
-                ('a_sampling_rate', ctypes.c_uint32),
-                ('piezo_count_max', ctypes.c_uint8),
-                ('piezo_count', ctypes.c_uint8),
-                ('oversampling_ratio', ctypes.c_uint8),
-                ('fir_taps_len', ctypes.c_uint32),
-            )
-    else:
-        print(f'! ERROR: Acceleration data version {a_version} is not supported. This script version supports min. 1 max. {version_support}.')
-        exit()
-    a_hd_t = A_DataHeader # Type to use for header parsing
-    a_header = a_hd_t.from_buffer_copy(a_data[:ctypes.sizeof(a_hd_t)]) # Parse from byte array
-    a_data = a_data[ctypes.sizeof(a_hd_t):] # Remove header from byte array
-
-    # Definition of a_data_point_t
-    class A_DataPoint(ctypes.Structure):
-        _fields_ = (
-            ('complete', ctypes.c_uint8),
-            ('timestamp', ctypes.c_uint32),
-            ('temp_mems1', ctypes.c_uint16),
-            ('xyz_mems1', ctypes.c_int32 * 3),
-            ('a_piezo', ctypes.c_int16 * a_header.piezo_count_max),
-        )
-    a_data_points = [] # Define list for parsed data (will be filled with instances of A_DataPoint)
-    a_dp_t = A_DataPoint # Type to use for parsing
-    for i in range(0, len(a_data), ctypes.sizeof(a_dp_t) * (n_skip + 1)): # Step through binary data, step size is sizeof(a_data_point_t)
-        dp_slice = a_data[i:i + ctypes.sizeof(a_dp_t)] # Region of binary data for current A_DataPoint
-        if len(dp_slice) >= ctypes.sizeof(a_dp_t):
-            a_data_points.append(a_dp_t.from_buffer_copy(dp_slice)) # Parse and add A_DataPoint from binary data
-    return a_header, a_data_points
-
-# Reads position file, returns (p_header, [p_data_point])
+# Reads position file, returns (p_header, p_data_point_t as structured array, memory-mapped)
 def p_parse(p_path, n_skip):
-    with open(p_path, 'rb') as f:
-        p_data = f.read()
-    if len(p_data) == 0:
+    p_header, p_dp = vera_format.p_map(p_path)
+    if p_header is None:
         return None, None
+    return header_fields(p_header), p_dp[::n_skip + 1]
 
-    p_version = p_data[0]
-    if p_version == 1:
-        class P_DataHeader(ctypes.Structure):
-            _fields_ = (
-                ('version', ctypes.c_uint8),
-                ('boot_duration', ctypes.c_uint32),
-                ('p_buffer_len', ctypes.c_uint32),
-                ('p_sampling_rate', ctypes.c_uint32),
-                ('year', ctypes.c_uint16),
-                ('month', ctypes.c_uint8),
-                ('day', ctypes.c_uint8),
-            )
-    else:
-        print(f'! ERROR: Position data version {p_version} is not supported. This script version supports min. 1 max. {version_support}.')
-        exit()
-    p_hd_t = P_DataHeader
-    p_header = p_hd_t.from_buffer_copy(p_data[:ctypes.sizeof(p_hd_t)])
-    p_data = p_data[ctypes.sizeof(p_hd_t):]
-
-    class P_DataPoint(ctypes.Structure):
-        _fields_ = (
-            ('complete', ctypes.c_uint8),
-            ('timestamp', ctypes.c_uint32),
-            ('gnss_hour', ctypes.c_uint8),
-            ('gnss_minute', ctypes.c_uint8),
-            ('gnss_second', ctypes.c_float),
-            ('lat', ctypes.c_float),
-            ('lon', ctypes.c_float),
-            ('speed', ctypes.c_float),
-            ('altitude', ctypes.c_float),
-        )
-    p_data_points = []
-    p_dp_t = P_DataPoint
-    for i in range(0, len(p_data), ctypes.sizeof(p_dp_t) * (n_skip + 1)):
-        dp_slice = p_data[i:i + ctypes.sizeof(p_dp_t)]
-        if len(dp_slice) >= ctypes.sizeof(p_dp_t):
-            p_data_points.append(p_dp_t.from_buffer_copy(dp_slice))
-    return p_header, p_data_points
+# Header fields as attributes (int)
+def header_fields(header):
+    return types.SimpleNamespace(**{key: int(header[key]) for key in header.dtype.names})
 
 # Returns datetime object in local timezone based on UTC time as [hour, minute, second, microseconds]
 def utc_datetime(utc_time):
@@ -118,7 +45,7 @@ def utc_datetime(utc_time):
 
 # Returns datetime object in local timezone based on GNSS date from position data point
 def p_dp_datetime(dp):
-    return utc_datetime([dp.gnss_hour, dp.gnss_minute, int(dp.gnss_second), int((dp.gnss_second % 1) * 1000)])
+    return utc_datetime([int(dp['gnss_hour']), int(dp['gnss_minute']), int(dp['gnss_second']), int((dp['gnss_second'] % 1) * 1000)])
 
 # Checks if array exceeds maximum, returns True if a <= mx
 def check_max(a, mx):
@@ -153,9 +80,11 @@ if '-h' in sys.argv or '--help' in sys.argv:
     print('\t-m   / --map                | Shows interactive map preview of position data')
     print('\t-sp  / --saveplot           | Saves selected plots (see above options) as .png and .pdf')
     print('\t-s   / --save (path)        | Saves data as .csv file')
+    print('\t-sc  / --savecolumns (path) | Saves raw channels as columns to .parquet (requires pyarrow) or .h5 file (requires h5py), one row group per page')
     print('\t-ow  / --overwrite          | Automatically overwrite .csv file if it exists')
-    print('If neither -p/-pf/-m nor -s are selected, the script only checks data for integrity')
+    print('If neither -p/-pf/-m nor -s/-sc are selected, the script only checks data for integrity')
     print('IMPORTANT: --skip 32 is highly recommended for PREVIEW of measurements longer than 10 minutes (128 for multiple hours), for full export do not use --skip')
+    print('\tvera_lod.py shows a zoomable preview of long measurements without skipping data points (impulse peaks are kept)')
     exit()
 
 # Parse arguments
@@ -170,6 +99,7 @@ arg_fftaxis = None
 arg_map_view = False
 arg_sp = False
 arg_save = None
+arg_save_columns = None
 arg_ow = False
 arg_path = './'
 argv_i = 1
@@ -206,6 +136,9 @@ while argv_i < len(sys.argv):
     elif a in ['-s', '--save']:
         arg_save = sys.argv[argv_i + 1]
         argv_i += 1
+    elif a in ['-sc', '--savecolumns']:
+        arg_save_columns = sys.argv[argv_i + 1]
+        argv_i += 1
     elif a in ['-ow', '--overwrite']:
         arg_ow = True
     elif a in ['-fir', '--firfilter']:
@@ -264,14 +197,11 @@ if len(p_file_paths) == 0:
 file_count = len(a_file_paths) + len(p_file_paths)
 print(f'Reading and parsing {file_count} file{"" if file_count == 1 else "s"}...')
 print('0.0 %')
-a_data_points = []
-p_data_points = []
-# Parse the number in the filename, since sorting by string would result in ['1', '10', '11', '2', '3', ...]
-def get_file_num(f):
-    basename = os.path.splitext(os.path.basename(f))[0]
-    return int(basename[2:])
-a_file_paths = sorted(a_file_paths, key=get_file_num)
-p_file_paths = sorted(p_file_paths, key=get_file_num)
+a_pages = [] # Structured arrays of pages (memory-mapped, data points are addressed by index over all pages)
+a_page_nums = [] # Number X of a_X.bin
+p_data_points = [] # Structured arrays of pages, concatenated after reading
+a_file_paths = sorted(a_file_paths, key=vera_format.page_num)
+p_file_paths = sorted(p_file_paths, key=vera_format.page_num)
 max_len = max(len(a_file_paths), len(p_file_paths))
 stop_at_next = False
 
@@ -284,34 +214,36 @@ for i in range(max_len):
         if a_header is None or a_dp is None or len(a_dp) == 0:
             continue
         if arg_t1 is not None:
-            if a_dp[-1].timestamp / a_header.a_sampling_rate > arg_t1:
+            if a_dp['timestamp'][-1] / a_header.a_sampling_rate > arg_t1:
                 stop_at_next = True
         elif arg_d is not None:
-            if a_dp[-1].timestamp / a_header.a_sampling_rate > arg_t0 + arg_d:
+            if a_dp['timestamp'][-1] / a_header.a_sampling_rate > arg_t0 + arg_d:
                 stop_at_next = True
-        if a_dp[-1].timestamp / a_header.a_sampling_rate >= arg_t0:
-            a_data_points.extend(a_dp)
+        if a_dp['timestamp'][-1] / a_header.a_sampling_rate >= arg_t0:
+            a_pages.append(a_dp)
+            a_page_nums.append(vera_format.page_num(a_file_paths[i]))
     if i < len(p_file_paths):
         p_header, p_dp = p_parse(p_file_paths[i], arg_skip)
         if p_header is None or p_dp is None or len(p_dp) == 0:
             continue
         if arg_t1 is not None:
-            if p_dp[-1].timestamp / a_header.a_sampling_rate > arg_t1:
+            if p_dp['timestamp'][-1] / a_header.a_sampling_rate > arg_t1:
                 stop_at_next = True
         elif arg_d is not None:
-            if p_dp[-1].timestamp / a_header.a_sampling_rate > arg_t0 + arg_d:
+            if p_dp['timestamp'][-1] / a_header.a_sampling_rate > arg_t0 + arg_d:
                 stop_at_next = True
-        if p_dp[-1].timestamp / a_header.a_sampling_rate >= arg_t0:
-            p_data_points.extend(p_dp)
+        if p_dp['timestamp'][-1] / a_header.a_sampling_rate >= arg_t0:
+            p_data_points.append(p_dp)
     print(round(100 * (i + 1) / max_len, 2), '%')
+p_data_points = np.concatenate(p_data_points) if len(p_data_points) > 0 else np.zeros(0, dtype = vera_format.p_point_dtype)
 print("a_data_header:")
-for key, f_type in type(a_header)._fields_:
-    print(f" {key}: {getattr(a_header, key)}")
+for key, value in vars(a_header).items():
+    print(f" {key}: {value}")
 print("p_data_header:")
-for key, f_type in type(p_header)._fields_:
-    print(f" {key}: {getattr(p_header, key)}")
+for key, value in vars(p_header).items():
+    print(f" {key}: {value}")
 
-print(f'Loaded "{arg_path}" with {len(a_data_points)} acceleration data points and {len(p_data_points)} position data points')
+print(f'Loaded "{arg_path}" with {sum(len(dp) for dp in a_pages)} acceleration data points and {len(p_data_points)} position data points')
 
 # Check date
 if p_header.year < 1800:
@@ -325,48 +257,75 @@ if p_header.year < 1800:
         print(f'! WARNING: Year is invalid, assuming {str(p_header.year).zfill(4)}-{str(p_header.month).zfill(2)}-{str(p_header.day).zfill(2)}')
 
 # Remove first sample after boot (invalid)
-a_data_points = a_data_points[1:]
+if len(a_pages) > 0:
+    a_pages[0] = a_pages[0][1:]
 p_data_points = p_data_points[1:]
+a_count = sum(len(dp) for dp in a_pages)
+if a_count == 0:
+    print('! ERROR: No acceleration data')
+    exit()
 
 # Sort by GNSS time
-def get_p_dp_time(dp):
-    return 3600.0 * dp.gnss_hour + 60.0 * dp.gnss_minute + dp.gnss_second
-gnss_times = np.array([get_p_dp_time(dp) for dp in p_data_points])
-gnss_times_valid = np.array([dp.complete & (1 << 1) != 0 for dp in p_data_points])
+gnss_times = 3600.0 * p_data_points['gnss_hour'] + 60.0 * p_data_points['gnss_minute'] + p_data_points['gnss_second']
+gnss_times_valid = p_data_points['complete'] & (1 << 1) != 0
 for i in range(len(gnss_times) - 1):
     if gnss_times_valid[i] and gnss_times_valid[i + 1]:
         if gnss_times[i + 1] < gnss_times[i] and gnss_times[i] > 1 and gnss_times[i + 1] > 1:
             true_i = np.argmin(np.abs(gnss_times + 1.0 / p_header.p_sampling_rate - gnss_times[i + 1]))
-            unchanged = p_data_points[true_i + 1:i + 1]
+            unchanged = p_data_points[true_i + 1:i + 1].copy()
             p_data_points[true_i + 1] = p_data_points[i + 1]
             p_data_points[true_i + 2:i + 2] = unchanged
-            p_data_points[true_i + 1].timestamp = round((p_data_points[true_i].timestamp + p_data_points[true_i + 2].timestamp) / 2)
+            p_data_points['timestamp'][true_i + 1] = round((int(p_data_points['timestamp'][true_i]) + int(p_data_points['timestamp'][true_i + 2])) / 2)
+
+# Returns acceleration data points i0 to i1 (index over all pages), only this range is read from the pages
+def a_range(i0, i1):
+    parts = []
+    page_start = 0
+    for dp in a_pages:
+        page_end = page_start + len(dp)
+        if i0 < page_end and i1 > page_start:
+            parts.append(dp[max(i0 - page_start, 0):min(i1, page_end) - page_start])
+        page_start = page_end
+    if len(parts) == 0:
+        return np.zeros(0, dtype = a_pages[0].dtype)
+    return np.concatenate(parts)
+
+# Returns index (over all pages) of acceleration data point with timestamp nearest to t (s), only the page containing t is searched
+def a_nearest(t):
+    ts = t * a_header.a_sampling_rate
+    i = 0
+    for dp in a_pages:
+        if dp['timestamp'][-1] >= ts:
+            i += int(np.searchsorted(dp['timestamp'], np.uint32(min(max(np.ceil(ts), 0), 0xFFFFFFFF))))
+            break
+        i += len(dp)
+    if i > 0 and (i == a_count or ts - a_range(i - 1, i)['timestamp'][0] <= a_range(i, i + 1)['timestamp'][0] - ts):
+        i -= 1
+    return i
 
 # Get timestamps
 def get_x_data(data_points):
-    x = []
-    for dp in data_points:
-        x.append(dp.timestamp / a_header.a_sampling_rate)
-        if arg_t1 is not None:
-            if x[-1] > arg_t1:
-                break
-        elif arg_d is not None:
-            if x[-1] > arg_t0 + arg_d:
-                break
-    return np.array(x)
+    x = data_points['timestamp'] / a_header.a_sampling_rate
+    # Up to first timestamp after end
+    t_stop = arg_t1 if arg_t1 is not None else arg_t0 + arg_d if arg_d is not None else None
+    if t_stop is not None:
+        i_stop = np.flatnonzero(x > t_stop)
+        if len(i_stop) > 0:
+            x = x[:i_stop[0] + 1]
+    return x
 
-full_data_x = get_x_data(a_data_points)
 full_data_x_p = get_x_data(p_data_points)
 
 # Get timespan
 t_start = arg_t0
-t_end = full_data_x[-1]
+t_end = a_range(a_count - 1, a_count)['timestamp'][0] / a_header.a_sampling_rate
+t_total = t_end
 if arg_t1 is not None:
     t_end = arg_t1
 elif arg_d is not None:
     t_end = arg_t0 + arg_d
-i_start = np.argmin(np.abs(full_data_x - t_start))
-i_end = np.argmin(np.abs(full_data_x - t_end))
+i_start = a_nearest(t_start)
+i_end = a_nearest(t_end)
 if len(full_data_x_p) > 0:
     i_start_p = np.argmin(np.abs(full_data_x_p - t_start))
     i_end_p = np.argmin(np.abs(full_data_x_p - t_end))
@@ -376,81 +335,118 @@ delay_pz_digital = (a_header.fir_taps_len - 1) / 2.0 / a_header.a_sampling_rate
 delay_piezo = delay_pz_analog + delay_pz_digital
 delay_piezo_i = int(delay_piezo * a_header.a_sampling_rate / (arg_skip + 1))
 delay_mems_i = int(delay_mems * a_header.a_sampling_rate / (arg_skip + 1))
+delay_min_i = min(delay_mems_i, delay_piezo_i) if a_header.piezo_count > 0 else delay_mems_i
 
 if arg_t0 > 0 or arg_t1 is not None or arg_d is not None:
     duration = t_end - t_start
     print(f"Cropped duration: {str(int(duration / 3600)).zfill(2)}:{str(int(duration / 60) % 60).zfill(2)}:{round(duration % 60, 3)} ({round(t_start, 3)} s - {round(t_end, 3)} s)")
 else:
-    print(f"Total duration: {str(int(full_data_x[-1] / 3600)).zfill(2)}:{str(int(full_data_x[-1] / 60) % 60).zfill(2)}:{round(full_data_x[-1] % 60, 3)}")
+    print(f"Total duration: {str(int(t_total / 3600)).zfill(2)}:{str(int(t_total / 60) % 60).zfill(2)}:{round(t_total % 60, 3)}")
 
-# Crop x axis
-full_data_x = full_data_x[i_start:i_end]
-if len(full_data_x) == 0:
-    if len(a_data_points) > 0:
-        print("! ERROR: Cropped out all data (check options -t0 -t1 -d and actual duration of given data)")
-    else:
-        print("! ERROR: No data")
+# Crop (acceleration data points i_start to i_end, rows of output shortened by delay)
+row_count = i_end - i_start - delay_min_i
+if row_count <= 0:
+    print("! ERROR: Cropped out all data (check options -t0 -t1 -d and actual duration of given data)")
     exit()
-a_data_points = a_data_points[i_start:i_end]
 if len(full_data_x_p) > 0:
     full_data_x_p = full_data_x_p[i_start_p:i_end_p]
     p_data_points = p_data_points[i_start_p:i_end_p]
 
-# Convert and scale acceleration data
-full_data_y = []
-# Scale to -1 <= y <= 1
-for a in range(3):
-    full_data_y.append(np.array([dp.xyz_mems1[a] for dp in a_data_points[delay_mems_i:]]) / 524287.0)
-for i in range(a_header.piezo_count):
-    full_data_y.append(2 * np.array([dp.a_piezo[i] for dp in a_data_points[delay_piezo_i:]]) / 8190.0)
-    # Remove DC offset of piezos (~1%)
-    full_data_y[-1] -= np.average(full_data_y[-1])
-# Extend missing due to delay
-if len(full_data_y) > 3:
-    for a in range(3):
-        if len(full_data_y[a]) < len(full_data_y[3]):
-            full_data_y[a] = np.append(full_data_y[a], [0] * (len(full_data_y[3]) - len(full_data_y[a])))
-    for i in range(a_header.piezo_count):
-        if len(full_data_y[3 + i]) < len(full_data_y[0]):
-            full_data_y[3 + i] = np.append(full_data_y[3 + i], [0] * (len(full_data_y[0]) - len(full_data_y[3 + i])))
-full_data_x = full_data_x[:len(full_data_y[0])]
-full_data_y = np.array(full_data_y).clip(-1, 1)
-# Preprocess
-if pp is not None:
-    try:
-        print('Running preprocess.py...')
-        full_data_y = pp(full_data_y)
-        print('...done')
-    except Exception as e:
-        print(f'! WARNING: Preprocess script failed: {e}')
+# Selection is scanned and exported in chunks of data points, memory does not grow with duration of measurement
+chunk_len = 1 << 16
+channel_count = 3 + a_header.piezo_count
+
+# Scan acceleration data (DC offset of piezos, integrity)
+piezo_offset = np.zeros(a_header.piezo_count)
+cplt_all = 0xFF # Complete bits set in all data points
+cplt_any = 0 # Complete bits set in any data point
+cplt_min = 7
+ts_last = None
+ts_diff_min = None
+ts_diff_max = None
+a_min = np.full(channel_count, np.iinfo(np.int32).max)
+a_max = np.full(channel_count, np.iinfo(np.int32).min)
+for i0 in range(i_start, i_end, chunk_len):
+    dps = a_range(i0, min(i0 + chunk_len, i_end))
+    piezo_offset += np.sum(2.0 * dps['a_piezo'][max(i_start + delay_piezo_i - i0, 0):, :a_header.piezo_count] / 8190.0, axis = 0)
+    if arg_skip != 0:
+        continue
+    cplt = dps['complete']
+    cplt_all &= int(np.bitwise_and.reduce(cplt))
+    cplt_any |= int(np.bitwise_or.reduce(cplt))
+    cplt_min = min(cplt_min, int(np.min(cplt & 7)))
+    ts = dps['timestamp'].astype(np.int64)
+    ts_diff = np.diff(ts if ts_last is None else np.concatenate(([ts_last], ts)))
+    ts_last = ts[-1]
+    if len(ts_diff) > 0:
+        ts_diff_min = np.min(ts_diff) if ts_diff_min is None else min(ts_diff_min, np.min(ts_diff))
+        ts_diff_max = np.max(ts_diff) if ts_diff_max is None else max(ts_diff_max, np.max(ts_diff))
+    channels = np.column_stack((dps['xyz_mems1'], dps['a_piezo'][:, :a_header.piezo_count]))
+    a_min = np.minimum(a_min, np.min(channels, axis = 0))
+    a_max = np.maximum(a_max, np.max(channels, axis = 0))
+# Remove DC offset of piezos (~1%)
+piezo_offset /= max(i_end - i_start - delay_piezo_i, 1)
+
+# Returns raw acceleration (LSB) of output rows k0 to k1 as array (channel, row), delays are compensated (zeros after end of selection)
+# Also returns number of rows before end of selection (MEMS, piezos)
+def a_raw(k0, k1):
+    i0 = i_start + k0 + delay_min_i
+    dps = a_range(i0, min(i_start + k1 + max(delay_mems_i, delay_piezo_i), i_end))
+    raw = np.zeros((channel_count, k1 - k0), dtype = np.int32)
+    n_mems = max(min(k1, i_end - i_start - delay_mems_i) - k0, 0)
+    o = i_start + k0 + delay_mems_i - i0
+    raw[:3, :n_mems] = dps['xyz_mems1'][o:o + n_mems].T
+    n_piezo = max(min(k1, i_end - i_start - delay_piezo_i) - k0, 0)
+    if a_header.piezo_count > 0:
+        o = i_start + k0 + delay_piezo_i - i0
+        raw[3:, :n_piezo] = dps['a_piezo'][o:o + n_piezo, :a_header.piezo_count].T
+    return raw, n_mems, n_piezo
+
+# Returns acceleration of output rows k0 to k1 as array (channel, row), scaled to -1 <= y <= 1
+# Piezo DC offset is removed, preprocess.py is called per chunk
+def a_channels(k0, k1):
+    raw, n_mems, n_piezo = a_raw(k0, k1)
+    y = np.zeros(raw.shape)
+    y[:3, :n_mems] = raw[:3, :n_mems] / 524287.0
+    y[3:, :n_piezo] = 2.0 * raw[3:, :n_piezo] / 8190.0 - piezo_offset[:, np.newaxis]
+    y = y.clip(-1, 1)
+    # Preprocess
+    global pp
+    if pp is not None:
+        try:
+            y = pp(y)
+        except Exception as e:
+            print(f'! WARNING: Preprocess script failed: {e}')
+            pp = None
+    return y
 
 # Check acceleration data
 piezos_missing = False
 mems_missing = False
-if len(a_data_points) == 0:
-    print('! ERROR: No acceleration data')
-    exit()
-elif arg_skip != 0:
+distance_missing = a_header.version < 2
+if arg_skip != 0:
     print('! WARNING: Option --skip in use, data integrity will not be checked')
 else:
-    cplt = np.array([dp.complete for dp in a_data_points])
-    if not check_min_max(cplt, 7, 7):
+    if not check_min_max(np.array([cplt_min]), 7, 7):
         print('! WARNING: Incomplete acceleration data points')
-        if np.any(cplt & (1 << 0) == 0):
+        if cplt_all & (1 << 0) == 0:
             print('! WARNING: Some acceleration data points are missing timestamps. This should not have happened.')
-        if np.all(cplt & (1 << 1) == 0):
+        if cplt_any & (1 << 1) == 0:
             mems_missing = True
             print('! WARNING: All MEMS data missing')
-        if np.all(cplt & (1 << 2) == 0):
+        if cplt_any & (1 << 2) == 0:
             piezos_missing = True
             print('! WARNING: All piezo data missing')
-    if not check_min_max(np.diff(full_data_x), 0.9 / a_header.a_sampling_rate, 1.1 / a_header.a_sampling_rate):
+    if not distance_missing and cplt_any & (1 << 3) == 0:
+        distance_missing = True
+        print('! WARNING: All track distance data missing')
+    if ts_diff_min is not None and not check_min_max(np.array([ts_diff_min, ts_diff_max]) / a_header.a_sampling_rate, 0.9 / a_header.a_sampling_rate, 1.1 / a_header.a_sampling_rate):
         print('! WARNING: Missing acceleration timestamps (bad!)')
     for a in range(3):
-        if not check_min_max([dp.xyz_mems1[a] for dp in a_data_points], -524287, 524287):
+        if not check_min_max(np.array([a_min[a], a_max[a]]), -524287, 524287):
             print(f'! WARNING: MEMS {["X", "Y", "Z"][a]} data out of range')
     for i in range(a_header.piezo_count):
-        if not check_min_max([dp.a_piezo[i] for dp in a_data_points], -8190, 8190):
+        if not check_min_max(np.array([a_min[3 + i], a_max[3 + i]]), -8190, 8190):
             print(f'! WARNING: Piezo [{i + 1}] data out of range')
 
 # Check position data
@@ -463,7 +459,7 @@ if len(p_data_points) == 0:
 elif arg_skip != 0:
     pass
 else:
-    cplt = np.array([dp.complete for dp in p_data_points])
+    cplt = p_data_points['complete']
     if not check_min_max(cplt, 3, 31):
         print('! WARNING: Incomplete position data points')
         if np.any(cplt & (1 << 0) == 0):
@@ -482,23 +478,86 @@ else:
             print('! WARNING: All altitude data missing')
     if not check_max(np.diff(full_data_x_p), 30):
         print('! WARNING: Missing position timestamps')
-    if np.all(np.abs(np.array([dp.lat for dp in p_data_points])) <= 1) or np.all(np.abs(np.array([dp.lon for dp in p_data_points])) <= 1):
+    if np.all(np.abs(p_data_points['lat']) <= 1) or np.all(np.abs(p_data_points['lon']) <= 1):
         print('! WARNING: No position data (invalid)')
 
+# Position channels (GNSS time as s since midnight UTC, coordinates, speed, altitude), linear interpolation between valid data points
+p_values = [[3600.0 * p_data_points['gnss_hour'] + 60.0 * p_data_points['gnss_minute'] + p_data_points['gnss_second']],
+            [p_data_points['lat'], p_data_points['lon']], [p_data_points['speed']], [p_data_points['altitude']]]
+do_lerp = not arg_ni and len(full_data_x_p) > 0
+if do_lerp:
+    p_tracks = []
+    for c in range(len(p_values)):
+        p_valid = p_data_points['complete'] & (1 << (c + 1)) != 0
+        if not np.any(p_valid):
+            p_valid[-1] = True
+        p_tracks.append((p_data_points['timestamp'][p_valid], [v[p_valid] for v in p_values[c]]))
+
+# Returns position channels (like p_values) at acceleration timestamps
+def p_channels(a_timestamps):
+    if do_lerp:
+        return [[np.interp(a_timestamps, p_ts, v) for v in values] for p_ts, values in p_tracks]
+    # Nearest position data point
+    x = a_timestamps / a_header.a_sampling_rate
+    p_i = np.searchsorted(full_data_x_p, x)
+    p_i_prev = np.maximum(p_i - 1, 0)
+    p_i_next = np.minimum(p_i, len(full_data_x_p) - 1)
+    p_i = np.where((p_i == len(full_data_x_p)) | ((p_i > 0) & (x - full_data_x_p[p_i_prev] <= full_data_x_p[p_i_next] - x)), p_i_prev, p_i_next)
+    return [[v[p_i] for v in values] for values in p_values]
+
+# Returns POSIX times (µs) of GNSS times (s since midnight UTC of date in p_header)
+def gnss_posix_us(s_total):
+    h = s_total // 3600
+    m = (s_total - h * 3600) // 60
+    us = ((h.astype(np.int64) * 60 + m.astype(np.int64)) * 60 + (s_total % 60).astype(np.int64)) * 1000000 + np.round(1e+6 * (s_total % 1)).astype(np.int64)
+    return us + int(utc_datetime([0, 0, 0, 0]).timestamp()) * 1000000
+
+# Yields (page index, k0, k1) of output rows in chunks of max. chunk_len, chunks do not cross pages
+def row_chunks():
+    page_start = 0
+    for page_i, dp in enumerate(a_pages):
+        k_page_end = min(page_start + len(dp) - i_start, row_count)
+        for k0 in range(max(page_start - i_start, 0), k_page_end, chunk_len):
+            yield page_i, k0, min(k0 + chunk_len, k_page_end)
+        page_start += len(dp)
+
+# Returns True if file does not exist or may be overwritten
+def confirm_overwrite(path):
+    if os.path.isfile(path) and not arg_ow:
+        confirm = input(f'! WARNING: File "{path}" exists. Do you want to overwrite it? (y/n) ')
+        return confirm.lower() in ['y', 'yes']
+    return True
+
+# Formats column like str(round(v, decimals)) of each value
+def csv_column(v, decimals):
+    return list(map(str, np.round(np.asarray(v, dtype = np.float64), decimals).tolist()))
+
+# Returns columns of GNSS times (s since midnight UTC of date in p_header) in local timezone, format of arg_tf
+def csv_gnss_time(s_total):
+    us = gnss_posix_us(s_total)
+    if arg_tf == 1:
+        return [list(map(str, (us / 1e+6).tolist()))]
+    # UTC offset of local timezone for each hour (daylight saving time may change during measurement)
+    hours, hour_i = np.unique(us // 3600000000, return_inverse = True)
+    offsets = [datetime.datetime.fromtimestamp(3600 * int(hour), datetime.timezone.utc).astimezone().utcoffset() // datetime.timedelta(microseconds = 1) for hour in hours]
+    us = (us + np.array(offsets, dtype = np.int64)[hour_i]) % 86400000000
+    hour, minute, second, microsecond = us // 3600000000, us // 60000000 % 60, us // 1000000 % 60, us % 1000000
+    if arg_tf == 0:
+        return [[f'{hh:02d}:{mm:02d}:{ss:02d}.{uu:06d}' if uu != 0 else f'{hh:02d}:{mm:02d}:{ss:02d}' for hh, mm, ss, uu in zip(hour.tolist(), minute.tolist(), second.tolist(), microsecond.tolist())]]
+    elif arg_tf == 2:
+        return [list(map(str, hour.tolist())), list(map(str, minute.tolist())), csv_column(second + microsecond * 1e-6, 3)]
+    return []
+
 # Export .csv
 if arg_save is not None:
     csv_line_sep = '\n'
 
-    do_save = 1
-    if os.path.isfile(arg_save) and not arg_ow:
-        confirm = input(f'! WARNING: File "{arg_save}" exists. Do you want to overwrite it? (y/n) ')
-        do_save = confirm.lower() in ['y', 'yes']
-    if do_save:
+    if confirm_overwrite(arg_save):
         with open(arg_save, 'w') as f:
             csv_header = ['time']
             if not mems_missing:
                 csv_header.extend(['temp_mems1'])
-            for i in range(len(full_data_y)):
+            for i in range(channel_count):
                 if i < 3 and mems_missing:
                     continue
                 if i >= 3 and piezos_missing:
@@ -520,114 +579,167 @@ if arg_save is not None:
                     csv_header.extend(['speed'])
                 if not altitude_missing:
                     csv_header.extend(['altitude'])
+            if not distance_missing:
+                csv_header.extend(['distance'])
             f.write(','.join(csv_header) + csv_line_sep)
 
-            do_lerp = not arg_ni and len(full_data_x_p) > 0
-            if do_lerp:
-                p_lambda_valid = [lambda dp: dp.complete & (1 << 1), lambda dp: dp.complete & (1 << 2), lambda dp: dp.complete & (1 << 3), lambda dp: dp.complete & (1 << 4)]
-                p_lambda_value = [lambda dp: [dp.gnss_hour * 3600 + dp.gnss_minute * 60 + dp.gnss_second], lambda dp: [dp.lat, dp.lon], lambda dp: [dp.speed], lambda dp: [dp.altitude]]
-                last_valid_i = [-1] * len(p_lambda_valid)
-                next_valid_i = [0] * len(p_lambda_valid)
-                def find_next_valid_i(c):
-                    for p_i in range(last_valid_i[c] + 1, len(p_data_points)):
-                        if p_lambda_valid[c](p_data_points[p_i]):
-                            return p_i
-                    return -1
-                def p_lerp(c, t_a):
-                    v1 = p_lambda_value[c](p_data_points[last_valid_i[c]])
-                    v2 = p_lambda_value[c](p_data_points[next_valid_i[c]])
-                    res = [0] * len(v1)
-                    if p_data_points[last_valid_i[c]].timestamp == p_data_points[next_valid_i[c]].timestamp:
-                        return v1
-                    else:
-                        t_r = (t_a - p_data_points[last_valid_i[c]].timestamp) / (p_data_points[next_valid_i[c]].timestamp - p_data_points[last_valid_i[c]].timestamp)
-                        t_r = min(1, max(0, t_r))
-                    for vi in range(len(res)):
-                        res[vi] = v1[vi] + (v2[vi] - v1[vi]) * t_r
-                    return res
-                for c in range(len(p_lambda_valid)):
-                    last_valid_i[c] = find_next_valid_i(c)
-                    next_valid_i[c] = find_next_valid_i(c)
-
-            for a_dp_i in range(len(full_data_x)):
-                t = full_data_x[a_dp_i]
-                if do_lerp:
-                    for c in range(len(p_lambda_valid)):
-                        if next_valid_i[c] != -1 and a_data_points[a_dp_i].timestamp >= p_data_points[next_valid_i[c]].timestamp:
-                            last_valid_i[c] = next_valid_i[c]
-                            next_valid_i[c] = find_next_valid_i(c)
-                            if next_valid_i[c] == -1:
-                                last_valid_i[c] = -1
-                elif len(full_data_x_p) > 0:
-                    p_dp_i = np.argmin(np.abs(full_data_x_p - t))
-                    p_dp = p_data_points[p_dp_i]
-
-                csv = [round(t, 6)]
+            print('Writing .csv...')
+            progress = 0
+            for page_i, k0, k1 in row_chunks():
+                dps = a_range(i_start + k0, i_start + k1)
+                full_data_y = a_channels(k0, k1)
+
+                csv = [csv_column(dps['timestamp'] / a_header.a_sampling_rate, 6)]
                 if not mems_missing:
-                    csv.extend([a_data_points[a_dp_i].temp_mems1])
+                    csv.append(list(map(str, dps['temp_mems1'].tolist())))
                 for i in range(len(full_data_y)):
                     if i < 3 and mems_missing:
                         continue
                     if i >= 3 and piezos_missing:
                         continue
-                    csv.append(round(full_data_y[i][a_dp_i], 6))
+                    csv.append(csv_column(full_data_y[i], 6))
                 if len(full_data_x_p) > 0:
-                    def format_dt(dt):
-                        if arg_tf == 0:
-                            return [dt.time().isoformat()]
-                        elif arg_tf == 1:
-                            return [dt.timestamp()]
-                        elif arg_tf == 2:
-                            return [dt.hour, dt.minute, round(dt.second + (dt.microsecond * 1e-6), 3)]
-                    
-                    if do_lerp:
-                        a_t = a_data_points[a_dp_i].timestamp
-                        if not gnss_times_missing:
-                            s_total = p_lerp(0, a_t)[0]
-                            h = int(s_total // 3600)
-                            m = int((s_total - h * 3600) // 60)
-                            s = int(s_total % 60)
-                            ms = round(1e+6 * (s_total % 1))
-                            csv.extend(format_dt(utc_datetime([h, m, s, ms])))
-                        if not pos_missing:
-                            p_lat, p_lon = p_lerp(1, a_t)
-                            csv.extend([round(p_lat, 8), round(p_lon, 8)])
-                        if not speed_missing:
-                            csv.extend([round(p_lerp(2, a_t)[0], 3)])
-                        if not altitude_missing:
-                            p_lerp(3, a_t)
-                            csv.extend([round(p_lerp(3, a_t)[0], 3)])
-                    else:
-                        if not gnss_times_missing:
-                            csv.extend(format_dt(p_dp_datetime(p_dp)))
-                        if not pos_missing:
-                            csv.extend([round(p_dp.lat, 8), round(p_dp.lon, 8)])
-                        if not speed_missing:
-                            csv.extend([round(p_dp.speed, 3)])
-                        if not altitude_missing:
-                            csv.extend([round(p_dp.altitude, 3)])
-                f.write(','.join([str(v) for v in csv]) + csv_line_sep)
+                    p_rows = p_channels(dps['timestamp'])
+                    if not gnss_times_missing:
+                        csv.extend(csv_gnss_time(p_rows[0][0]))
+                    if not pos_missing:
+                        csv.extend([csv_column(p_rows[1][0], 8), csv_column(p_rows[1][1], 8)])
+                    if not speed_missing:
+                        csv.append(csv_column(p_rows[2][0], 3))
+                    if not altitude_missing:
+                        csv.append(csv_column(p_rows[3][0], 3))
+                if not distance_missing:
+                    csv.append(csv_column(dps['distance'], 3))
+                f.write(csv_line_sep.join(map(','.join, zip(*csv))) + csv_line_sep)
+                if int(100 * k1 / row_count) > progress or k1 == row_count:
+                    progress = int(100 * k1 / row_count)
+                    print(round(100 * k1 / row_count, 2), '%')
         print(f'File "{arg_save}" written')
 
-# 4 Hz FIR
-if arg_fir:
-    f = 4
-    numtaps = 2048
-    h = signal.firwin(numtaps, f, fs = a_header.a_sampling_rate / (arg_skip + 1))
-    fir_delay_i = int((numtaps - 1) / 2)
-    plot_x = full_data_x[:-fir_delay_i]
-    plot_y = []
-    for i in range(len(full_data_y)):
-        plot_y.append(signal.lfilter(h, [1.0], full_data_y[i])[fir_delay_i:])
-else:
-    plot_x = full_data_x
-    plot_y = full_data_y
+# Returns raw columns of output rows k0 to k1 as dict (name: array), scaled values are raw * scale - offset (see column_scales)
+def export_columns(k0, k1):
+    dps = a_range(i_start + k0, i_start + k1)
+    raw, n_mems, n_piezo = a_raw(k0, k1)
+    columns = {'timestamp': dps['timestamp']}
+    if not mems_missing:
+        columns['temp_mems1'] = dps['temp_mems1']
+        for a in range(3):
+            columns[f"{['x', 'y', 'z'][a]}_mems1"] = raw[a]
+    if not piezos_missing:
+        for i in range(a_header.piezo_count):
+            columns[f'a_piezo{i + 1}'] = raw[3 + i].astype(np.int16)
+    if len(full_data_x_p) > 0:
+        p_rows = p_channels(dps['timestamp'])
+        if not gnss_times_missing:
+            columns['gnss_time'] = gnss_posix_us(p_rows[0][0])
+        if not pos_missing:
+            columns['lat'] = p_rows[1][0].astype(np.float64)
+            columns['lon'] = p_rows[1][1].astype(np.float64)
+        if not speed_missing:
+            columns['speed'] = p_rows[2][0].astype(np.float32)
+        if not altitude_missing:
+            columns['altitude'] = p_rows[3][0].astype(np.float32)
+    if not distance_missing:
+        columns['distance'] = dps['distance']
+    return columns
+
+# Export columns (.parquet or .h5)
+if arg_save_columns is not None:
+    # Scale and offset of raw columns (time in s, acceleration -1 to 1 as in .csv, without preprocess.py)
+    column_scales = {'timestamp': (1.0 / a_header.a_sampling_rate, 0.0)}
+    for a in range(3):
+        column_scales[f"{['x', 'y', 'z'][a]}_mems1"] = (1.0 / 524287.0, 0.0)
+    for i in range(a_header.piezo_count):
+        column_scales[f'a_piezo{i + 1}'] = (2.0 / 8190.0, float(piezo_offset[i]))
+    column_units = {'gnss_time': 'us since 1970-01-01 UTC', 'lat': 'deg', 'lon': 'deg', 'speed': 'km/h', 'altitude': 'm', 'distance': 'm'}
+    # Index of pages (row group of .parquet): first row, timestamp and track distance
+    page_index = []
+    for page_i, k0, k1 in row_chunks():
+        if len(page_index) == 0 or page_index[-1]['page'] != a_page_nums[page_i]:
+            dp = a_range(i_start + k0, i_start + k0 + 1)
+            page_index.append({'page': a_page_nums[page_i], 'row': k0, 'timestamp': int(dp['timestamp'][0]),
+                               'distance': float(dp['distance'][0]) if not distance_missing else None})
+    metadata = {'source': os.path.abspath(dir_path), 'a_sampling_rate': a_header.a_sampling_rate, 'skip': arg_skip,
+                'date': f'{str(p_header.year).zfill(4)}-{str(p_header.month).zfill(2)}-{str(p_header.day).zfill(2)}',
+                'interpolated': do_lerp, 'delay_mems': delay_mems_i, 'delay_piezo': delay_piezo_i, 'pages': page_index}
+
+    ext = os.path.splitext(arg_save_columns)[1].lower()
+    if ext not in ['.parquet', '.h5', '.hdf5']:
+        print(f'! ERROR: Unknown column format "{ext}" (.parquet or .h5)')
+    elif confirm_overwrite(arg_save_columns):
+        print(f'Writing {ext}...')
+        if ext == '.parquet':
+            import pyarrow as pa
+            import pyarrow.parquet as pq
+            columns = export_columns(0, 0)
+            fields = []
+            for name, v in columns.items():
+                field_type = pa.timestamp('us', tz = 'UTC') if name == 'gnss_time' else pa.from_numpy_dtype(v.dtype)
+                field_meta = {}
+                if name in column_scales:
+                    field_meta = {'scale': repr(column_scales[name][0]), 'offset': repr(column_scales[name][1])}
+                elif name in column_units:
+                    field_meta = {'unit': column_units[name]}
+                fields.append(pa.field(name, field_type, metadata = field_meta))
+            schema = pa.schema(fields, metadata = {'vera': json.dumps(metadata)})
+            # Monotonic integers delta encoded, floats split by byte for compression, all columns with zstd
+            encodings = {name: 'DELTA_BINARY_PACKED' for name in ['timestamp', 'gnss_time'] if name in columns}
+            encodings.update({name: 'BYTE_STREAM_SPLIT' for name, v in columns.items() if v.dtype.kind == 'f'})
+            with pq.ParquetWriter(arg_save_columns, schema, compression = 'zstd', use_dictionary = ['temp_mems1'],
+                                  column_encoding = encodings, write_statistics = True) as writer:
+                # One row group per page
+                page_tables = []
+                page_last = None
+                for page_i, k0, k1 in row_chunks():
+                    if page_i != page_last and len(page_tables) > 0:
+                        writer.write_table(pa.concat_tables(page_tables), row_group_size = sum(t.num_rows for t in page_tables))
+                        page_tables = []
+                    page_last = page_i
+                    page_tables.append(pa.Table.from_pydict(export_columns(k0, k1), schema = schema))
+                writer.write_table(pa.concat_tables(page_tables), row_group_size = sum(t.num_rows for t in page_tables))
+        else:
+            import h5py
+            with h5py.File(arg_save_columns, 'w') as f:
+                for key, value in metadata.items():
+                    if key != 'pages':
+                        f.attrs[key] = value
+                f.create_dataset('pages', data = np.array([(p['page'], p['row'], p['timestamp'], np.nan if p['distance'] is None else p['distance']) for p in page_index],
+                                                                   dtype = [('page', '<u4'), ('row', '<u8'), ('timestamp', '<u4'), ('distance', '<f4')]))
+                for page_i, k0, k1 in row_chunks():
+                    for name, v in export_columns(k0, k1).items():
+                        if name not in f:
+                            # Chunks of rows with shuffle and gzip per column
+                            ds = f.create_dataset(name, shape = (0,), maxshape = (None,), dtype = v.dtype, chunks = (chunk_len,), shuffle = True, compression = 'gzip')
+                            if name in column_scales:
+                                ds.attrs['scale'], ds.attrs['offset'] = column_scales[name]
+                            elif name in column_units:
+                                ds.attrs['unit'] = column_units[name]
+                        f[name].resize((k1,))
+                        f[name][k0:k1] = v
+        print(f'File "{arg_save_columns}" written')
 
 # Preview
 show_plot = arg_preview or arg_fftaxis is not None
 show_fft = arg_fftaxis is not None
 show_coords = arg_map_view and not enable_map_view
 if show_plot or show_fft or show_coords:
+    # Full selection in memory (--skip recommended for long measurements)
+    full_data_x = a_range(i_start, i_start + row_count)['timestamp'] / a_header.a_sampling_rate
+    full_data_y = a_channels(0, row_count)
+
+    # 4 Hz FIR
+    if arg_fir:
+        f = 4
+        numtaps = 2048
+        h = signal.firwin(numtaps, f, fs = a_header.a_sampling_rate / (arg_skip + 1))
+        fir_delay_i = int((numtaps - 1) / 2)
+        plot_x = full_data_x[:-fir_delay_i]
+        plot_y = []
+        for i in range(len(full_data_y)):
+            plot_y.append(signal.lfilter(h, [1.0], full_data_y[i])[fir_delay_i:])
+    else:
+        plot_x = full_data_x
+        plot_y = full_data_y
     if not enable_matplotlib_preview and not enable_plotly_preview:
         print('! ERROR: Preview disabled (check settings at the beginning of vera2csv.py)')
     if enable_plotly_preview:
@@ -751,8 +863,8 @@ if show_plot or show_fft or show_coords:
 
         if show_coords and ax_c is not None:
             # matplotlib coordinates
-            full_data_lat = np.array([dp.lat for dp in p_data_points])
-            full_data_lon = np.array([dp.lon for dp in p_data_points])
+            full_data_lat = p_data_points['lat']
+            full_data_lon = p_data_points['lon']
             ax_c[0].plot(full_data_x_p[np.abs(full_data_lat) > 1],
                          full_data_lat[np.abs(full_data_lat) > 1])
             ax_c[0].set(ylabel='Latitude')
@@ -785,17 +897,17 @@ if arg_map_view and len(p_data_points) > 0:
            df_extra['Altitude'] = []
         for dp_i in range(len(p_data_points)):
             dp = p_data_points[dp_i]
-            if np.abs(dp.lat) > 1 and np.abs(dp.lon) > 1:
+            if np.abs(dp['lat']) > 1 and np.abs(dp['lon']) > 1:
                 df['name'].append(str(round(full_data_x_p[dp_i], 3)) + ' s')
                 df['Messung'].append('1')
-                df['Lat'].append(dp.lat)
-                df['Lon'].append(dp.lon)
+                df['Lat'].append(float(dp['lat']))
+                df['Lon'].append(float(dp['lon']))
                 if not gnss_times_missing:
                     df_extra['Time'].append(p_dp_datetime(dp).time().isoformat('milliseconds'))
                 if not speed_missing:
-                    df_extra['Speed'].append(str(round(dp.speed, 2)) + ' km/h')
+                    df_extra['Speed'].append(str(round(float(dp['speed']), 2)) + ' km/h')
                 if not altitude_missing:
-                    df_extra['Altitude'].append(str(round(dp.altitude, 2)) + ' m')
+                    df_extra['Altitude'].append(str(round(float(dp['altitude']), 2)) + ' m')
         cmap = {
             '1': '#FF0000',
         }
@@ -0,0 +1,78 @@
+import sys, time, struct
+
+command_sync = b'VC'
+reply_sync = b'VR'
+reply_status = ['OK', 'ERROR']
+command_len_max = 255
+reply_timeout = 3.0 # Reconfiguration includes ADXL357 init and SD card writes
+
+# Checksum like UBX packets
+def checksum(data):
+    ck_a = ck_b = 0
+    for b in data:
+        ck_a = (ck_a + b) & 0xFF
+        ck_b = (ck_b + ck_a) & 0xFF
+    return bytes((ck_a, ck_b))
+
+# Returns request frame of command text
+def command_frame(text):
+    data = bytes((len(text),)) + text.encode()
+    return command_sync + data + checksum(data)
+
+# Searches reply frame in received bytes (log text and stream frames are skipped), returns (status, text, rest) or None if incomplete
+def reply_parse(buffer):
+    while True:
+        start = buffer.find(reply_sync)
+        if start < 0 or len(buffer) < start + 5:
+            return None
+        status, text_len = struct.unpack_from('<BH', buffer, start + 2)
+        end = start + 5 + text_len + 2
+        if len(buffer) < end:
+            return None
+        if status < len(reply_status) and checksum(buffer[start + 2:end - 2]) == buffer[end - 2:end]:
+            return status, buffer[start + 5:end - 2].decode(errors='replace'), buffer[end:]
+        buffer = buffer[start + 1:]
+
+# Sends command and waits for reply, returns (status, text)
+def command_send(port, text):
+    port.write(command_frame(text))
+    buffer = b''
+    time_start = time.time()
+    while time.time() - time_start < reply_timeout:
+        buffer += port.read(4096)
+        reply = reply_parse(buffer)
+        if reply is not None:
+            return reply[0], reply[1]
+    return None, None
+
+if '-h' in sys.argv or '--help' in sys.argv or len(sys.argv) < 3:
+    print('Usage: python vera_cmd.py [serial port like "COM5" or "/dev/ttyACM0"] [command]')
+    print('\tSends command via USB CDC while capture is running and prints reply')
+    print('Commands:')
+    print('\tget (key)                  | Prints config value (all values without key)')
+    print('\tset [key=value] ...        | Changes config, sampling is reconfigured if necessary (new page)')
+    print('\tsave                       | Writes current config to config file')
+    print('\tstart / stop               | Resumes / pauses capture of acceleration data')
+    print('\tpage                       | Starts new page')
+    print('\tstats                      | Prints status and counters')
+    print('Example: python vera_cmd.py COM5 set fir_type=2 a_sampling_rate=2000')
+    exit()
+
+arg_port = sys.argv[1]
+arg_command = ' '.join(sys.argv[2:])
+if len(arg_command) > command_len_max:
+    print(f'! ERROR: Command longer than {command_len_max} characters')
+    exit()
+
+import serial # Requires pyserial
+port = serial.Serial(arg_port, timeout=0.1)
+port.reset_input_buffer()
+status, text = command_send(port, arg_command)
+port.close()
+if status is None:
+    print('! ERROR: No reply, is capture running?')
+    exit()
+if status != 0:
+    print(f'! {reply_status[status]}: {text}')
+    exit()
+print(text.rstrip('\r\n'))
@@ -0,0 +1,261 @@
+import sys, struct
+import numpy as np
+from scipy import signal
+import vera_format
+
+version_support = 1
+header_format = '<B3xIIHHHHB3x' # h_data_header_t
+channel_dtype = np.dtype([('impacts', '<u2'), ('reserved', '<u2'), ('crest', '<f4'), ('kurtosis', '<f4'), ('envelope_rms', '<f4'), ('envelope_peak', '<f4')]) # h_data_channel_t
+# Same as firmware (envelope.h)
+decimation = 8
+record_ms_max = 2000
+baseline_ms = 1000
+
+def h_record_dtype(channel_count): # h_data_point_t, followed by channel_count h_data_channel_t
+    return np.dtype([('timestamp', '<u4'), ('sample_count', '<u4'), ('distance', '<f4'), ('revolution', 'u1'), ('reserved', 'u1', 3), ('channels', channel_dtype, (channel_count,))])
+
+# Reads envelope file, returns (header dict, records as structured array)
+def h_parse(h_path):
+    with open(h_path, 'rb') as f:
+        data = f.read()
+    header_size = struct.calcsize(header_format)
+    if len(data) < header_size:
+        return None, None
+    version, boot_duration, a_sampling_rate, band_low, band_high, wheel_diameter, impact_ratio, channel_count = struct.unpack_from(header_format, data)
+    if version > version_support:
+        print(f'! ERROR: Envelope data version {version} is not supported. This script version supports max. {version_support}.')
+        exit()
+    header = dict(a_sampling_rate=a_sampling_rate, band_low=band_low, band_high=band_high, wheel_diameter=wheel_diameter, impact_ratio=impact_ratio, channel_count=channel_count)
+    record_dtype = h_record_dtype(channel_count)
+    count = (len(data) - header_size) // record_dtype.itemsize
+    return header, np.frombuffer(data, dtype=record_dtype, count=count, offset=header_size)
+
+# Envelope pipeline on host: band-pass (zero phase), Hilbert envelope, low-pass decimation, envelope spectrum (Welch)
+# Records per wheel revolution like firmware, returns (records as structured array, envelope frequencies, envelope PSD [channel, bin])
+def raw_records(points, fs, channel_count, band_low, band_high, impact_ratio, circumference):
+    record_dtype = h_record_dtype(channel_count)
+    sos = signal.butter(2, [band_low, band_high], btype='bandpass', fs=fs, output='sos')
+    alpha = 1000 * decimation / (baseline_ms * fs)
+    has_distance = 'distance' in points.dtype.names
+    records = []
+    psd_sum, psd_count, freqs = 0, 0, None
+    section_starts = np.concatenate(([0], np.nonzero(np.diff(points['timestamp'].astype(np.int64)) != 1)[0] + 1, [len(points)]))
+    for s0, s1 in zip(section_starts[:-1], section_starts[1:]):
+        section = points[s0:s1]
+        n = len(section)
+        if n < 20 * decimation:
+            continue
+        x = section['a_piezo'][:, :channel_count].astype(np.float64)
+        band = signal.sosfiltfilt(sos, x - np.mean(x, axis=0), axis=0)
+        env = signal.decimate(np.abs(signal.hilbert(band, axis=0)), decimation, axis=0, zero_phase=True)
+        nperseg = min(len(env), 1024)
+        freqs, psd = signal.welch(env - np.mean(env, axis=0), fs=fs / decimation, nperseg=nperseg, axis=0)
+        if nperseg == 1024:
+            psd_sum = psd_sum + psd * len(env)
+            psd_count += len(env)
+
+        # Impacts: rising edges above impact_ratio times running mean, rearmed below half way (hysteresis as in firmware)
+        baseline = signal.lfilter([alpha], [1, alpha - 1], env, axis=0, zi=env[:1] * (1 - alpha))[0]
+        baseline = np.concatenate((env[:1], baseline[:-1]))
+        threshold = baseline * impact_ratio / 100
+        above = env > threshold
+        below = env < (baseline + threshold) / 2
+        state_index = np.maximum.accumulate(np.where(above | below, np.arange(len(env))[:, None], -1), axis=0)
+        state = np.take_along_axis(above, np.maximum(state_index, 0), axis=0) & (state_index >= 0)
+        rising = state & ~np.concatenate((np.zeros((1, channel_count), dtype=bool), state[:-1]))
+        impacts_at = np.zeros((n, channel_count), dtype=np.uint32)
+        impacts_at[::decimation][:len(rising)] = rising[:len(impacts_at[::decimation])]
+
+        # Record boundaries: wheel revolution of track distance or record_ms_max
+        distance = section['distance'].astype(np.float64) if has_distance else np.zeros(n)
+        distance_valid = (section['complete'] >> 3) & 1 if has_distance else np.zeros(n, dtype=np.uint8)
+        len_max = record_ms_max * fs // 1000
+        starts, revolution = [], []
+        i0 = 0
+        while i0 < n:
+            i1 = min(n, i0 + len_max)
+            complete = False
+            if distance_valid[i0]:
+                i_rev = i0 + np.searchsorted(distance[i0:i1], distance[i0] + circumference)
+                if i_rev < i1:
+                    i1 = i_rev + 1
+                    complete = True
+            starts.append(i0)
+            revolution.append(complete)
+            i0 = i1
+        starts = np.array(starts)
+        counts = np.diff(np.concatenate((starts, [n])))
+        m2 = np.add.reduceat(band ** 2, starts, axis=0)
+        m4 = np.add.reduceat(band ** 4, starts, axis=0)
+        peak = np.maximum.reduceat(np.abs(band), starts, axis=0)
+        # Envelope sample at every decimation-th sample
+        decimated = np.arange(n) % decimation == 0
+        env_full = np.repeat(env, decimation, axis=0)[:n]
+        env_m2 = np.add.reduceat(np.where(decimated[:, None], env_full ** 2, 0), starts, axis=0)
+        env_count = np.add.reduceat(decimated.astype(np.float64), starts)
+        rec = np.zeros(len(starts), dtype=record_dtype)
+        rec['timestamp'] = section['timestamp'][starts]
+        rec['sample_count'] = counts
+        rec['distance'] = np.where(distance_valid[starts] > 0, distance[starts], 0)
+        rec['revolution'] = revolution
+        rec['channels']['impacts'] = np.add.reduceat(impacts_at, starts, axis=0)
+        with np.errstate(divide='ignore', invalid='ignore'):
+            rec['channels']['crest'] = np.nan_to_num(peak / np.sqrt(m2 / counts[:, None]))
+            rec['channels']['kurtosis'] = np.nan_to_num(m4 * counts[:, None] / m2 ** 2)
+            rec['channels']['envelope_rms'] = np.nan_to_num(np.sqrt(env_m2 / env_count[:, None]))
+        rec['channels']['envelope_peak'] = np.maximum.reduceat(env_full, starts, axis=0)
+        records.append(rec)
+    if len(records) == 0:
+        return np.zeros(0, dtype=record_dtype), None, None
+    return np.concatenate(records), freqs, (psd_sum / psd_count).T if psd_count > 0 else None
+
+if '-h' in sys.argv or '--help' in sys.argv:
+    print('Usage: python vera_envelope.py (options) [path like "./2024-08-01_1"]')
+    print('\tEnvelope analysis of piezo channels: impacts, crest factor and kurtosis per wheel revolution')
+    print('\tReads records computed during capture (h_X.bin, enabled with envelope_band_low=500) or computes them from raw data (-r)')
+    print('\tIf no path argument is given, the current working directory is used')
+    print('Options:')
+    print('\t-r   / --raw                | Computes envelope from acceleration files (a_X.bin, Hilbert envelope) and prints envelope spectrum peaks')
+    print('\t-b   / --band (low) (high)  | Band-pass for -r in Hz (default: from envelope file or 500 1500)')
+    print('\t-i   / --impact (ratio)     | Impact ratio for -r (x100, default: from envelope file or 300)')
+    print('\t-w   / --wheel (m)          | Wheel diameter for -r (default: from envelope file or 0.92 m)')
+    print('\t-c   / --channel (1-5)      | Piezo channel for -p and list of revolutions (default: 1)')
+    print('\t-p   / --preview            | Plots impacts per revolution, kurtosis and crest factor (requires matplotlib)')
+    print('\t-s   / --save (path)        | Saves records as .csv file (one line per record)')
+    exit()
+
+arg_raw = False
+arg_band = None
+arg_impact = None
+arg_wheel = None
+arg_channel = 1
+arg_preview = False
+arg_save = None
+arg_path = '.'
+argv_i = 1
+while argv_i < len(sys.argv):
+    a = sys.argv[argv_i]
+    if a in ['-r', '--raw']:
+        arg_raw = True
+    elif a in ['-b', '--band']:
+        arg_band = (int(sys.argv[argv_i + 1]), int(sys.argv[argv_i + 2]))
+        argv_i += 2
+    elif a in ['-i', '--impact']:
+        arg_impact = int(sys.argv[argv_i + 1])
+        argv_i += 1
+    elif a in ['-w', '--wheel']:
+        arg_wheel = float(sys.argv[argv_i + 1])
+        argv_i += 1
+    elif a in ['-c', '--channel']:
+        arg_channel = int(sys.argv[argv_i + 1])
+        argv_i += 1
+    elif a in ['-p', '--preview']:
+        arg_preview = True
+    elif a in ['-s', '--save']:
+        arg_save = sys.argv[argv_i + 1]
+        argv_i += 1
+    else:
+        arg_path = a
+    argv_i += 1
+
+# Records of device (pages in order)
+header = None
+records = []
+for h_path in vera_format.page_paths(arg_path, 'h'):
+    h, rec = h_parse(h_path)
+    if h is None:
+        continue
+    if header is not None and h != header:
+        print(f'! WARNING: "{h_path}" has different envelope config, following pages are skipped')
+        break
+    header = h
+    records.append(rec)
+
+if arg_raw:
+    a_header = None
+    points = []
+    for a_path in vera_format.page_paths(arg_path, 'a'):
+        ah, dp = vera_format.a_map(a_path)
+        if ah is None or len(dp) == 0:
+            continue
+        if a_header is not None and (ah['a_sampling_rate'] != a_header['a_sampling_rate'] or ah['version'] != a_header['version'] or ah['piezo_count'] != a_header['piezo_count']):
+            print(f'! WARNING: "{a_path}" has different config, following pages are skipped')
+            break
+        a_header = ah
+        points.append(dp)
+    if a_header is None:
+        print(f'! ERROR: No acceleration files in "{arg_path}"')
+        exit()
+    band = arg_band if arg_band is not None else (header['band_low'], header['band_high']) if header is not None and header['band_low'] > 0 else (500, 1500)
+    impact_ratio = arg_impact if arg_impact is not None else header['impact_ratio'] if header is not None else 300
+    wheel = arg_wheel if arg_wheel is not None else header['wheel_diameter'] / 1000 if header is not None else 0.92
+    fs = int(a_header['a_sampling_rate'])
+    if band[0] <= 0 or band[0] >= band[1] or 2 * band[1] >= fs:
+        print(f'! ERROR: Band {band[0]} to {band[1]} Hz not supported (below a_sampling_rate / 2)')
+        exit()
+    header = dict(a_sampling_rate=fs, band_low=band[0], band_high=band[1], wheel_diameter=round(wheel * 1000), impact_ratio=impact_ratio, channel_count=int(a_header['piezo_count']))
+    records, freqs, psd = raw_records(np.concatenate(points), fs, header['channel_count'], band[0], band[1], impact_ratio, np.pi * wheel)
+    print('Computed from raw data (Hilbert envelope)')
+elif header is None:
+    print(f'! ERROR: No envelope files in "{arg_path}" (disabled by default, enable with envelope_band_low=500, use -r for raw data)')
+    exit()
+else:
+    records = np.concatenate(records)
+if len(records) == 0:
+    print('! ERROR: No records found')
+    exit()
+
+fs = header['a_sampling_rate']
+channel_count = header['channel_count']
+circumference = np.pi * header['wheel_diameter'] / 1000
+ch = records['channels']
+rev = records['revolution'] > 0
+time = records['timestamp'] / fs
+speed = np.where(rev, circumference / (records['sample_count'] / fs) * 3.6, 0)
+print(f'{len(records)} records ({np.count_nonzero(rev)} wheel revolutions, {np.sum(records["sample_count"]) / fs:.1f} s), band {header["band_low"]} to {header["band_high"]} Hz, '
+      f'impact ratio {header["impact_ratio"] / 100:g}, wheel diameter {header["wheel_diameter"]} mm')
+print(f'{"Channel":<8} {"Impacts":>8} {"Imp./rev.":>9} {"Imp./s":>7} {"Crest med.":>10} {"Crest max":>9} {"Kurt. med.":>10} {"Kurt. max":>9}')
+for i_ch in range(channel_count):
+    impacts_rev = np.mean(ch['impacts'][rev, i_ch]) if np.any(rev) else 0
+    print(f'piezo_{i_ch + 1:<2} {np.sum(ch["impacts"][:, i_ch]):>8} {impacts_rev:>9.2f} {np.sum(ch["impacts"][:, i_ch]) / (np.sum(records["sample_count"]) / fs):>7.2f} '
+          f'{np.median(ch["crest"][:, i_ch]):>10.2f} {np.max(ch["crest"][:, i_ch]):>9.2f} {np.median(ch["kurtosis"][:, i_ch]):>10.2f} {np.max(ch["kurtosis"][:, i_ch]):>9.2f}')
+
+if arg_raw and psd is not None:
+    # Envelope spectrum: peaks above 1 Hz, as orders of mean revolution rate if moving
+    rev_rate = np.sum(rev) / np.sum(records['sample_count'][rev] / fs) if np.any(rev) else 0
+    for i_ch in range(channel_count):
+        i_min = np.searchsorted(freqs, 1.0)
+        peaks, _ = signal.find_peaks(psd[i_ch][i_min:])
+        peaks = peaks[np.argsort(psd[i_ch][i_min:][peaks])[::-1][:3]] + i_min
+        orders = ', '.join(f'{freqs[i]:.2f} Hz' + (f' (order {freqs[i] / rev_rate:.2f})' if rev_rate > 0 else '') for i in peaks)
+        print(f'piezo_{i_ch + 1} envelope spectrum peaks: {orders}')
+
+if arg_channel < 1 or arg_channel > channel_count:
+    print(f'! ERROR: Channel {arg_channel} not recorded ({channel_count} channels)')
+    exit()
+i_ch = arg_channel - 1
+print(f'Revolutions with most impacts (piezo_{arg_channel}):')
+print(f'{"Time (s)":>10} {"Dist. (m)":>10} {"km/h":>6} {"Impacts":>7} {"Crest":>6} {"Kurt.":>6} {"Env. RMS":>9} {"Env. peak":>9}')
+for i in np.flatnonzero(rev)[np.argsort(ch['impacts'][rev, i_ch], kind='stable')[::-1][:5]]:
+    print(f'{time[i]:>10.3f} {records["distance"][i]:>10.1f} {speed[i]:>6.1f} {ch["impacts"][i, i_ch]:>7} {ch["crest"][i, i_ch]:>6.2f} {ch["kurtosis"][i, i_ch]:>6.2f} {ch["envelope_rms"][i, i_ch]:>9.1f} {ch["envelope_peak"][i, i_ch]:>9.1f}')
+
+if arg_save is not None:
+    with open(arg_save, 'w') as f:
+        f.write('time,samples,distance,revolution,speed,' + ','.join(f'{k}_{i + 1}' for i in range(channel_count) for k in ['impacts', 'crest', 'kurtosis', 'envelope_rms', 'envelope_peak']) + '\n')
+        for i in range(len(records)):
+            f.write(f'{time[i]:.4f},{records["sample_count"][i]},{records["distance"][i]:.2f},{records["revolution"][i]},{speed[i]:.2f},'
+                    + ','.join(f'{ch["impacts"][i, c]},{ch["crest"][i, c]:.3f},{ch["kurtosis"][i, c]:.3f},{ch["envelope_rms"][i, c]:.2f},{ch["envelope_peak"][i, c]:.2f}' for c in range(channel_count)) + '\n')
+    print(f'Saved "{arg_save}"')
+
+if arg_preview:
+    import matplotlib.pyplot as plt
+    fig, axs = plt.subplots(3, 1, sharex=True)
+    axs[0].step(time, ch['impacts'][:, i_ch], where='post')
+    axs[0].set_ylabel('Impacts')
+    axs[1].plot(time, ch['kurtosis'][:, i_ch])
+    axs[1].set_ylabel('Kurtosis')
+    axs[2].plot(time, ch['crest'][:, i_ch])
+    axs[2].set_ylabel('Crest factor')
+    axs[2].set_xlabel('Time (s)')
+    axs[0].set_title(f'piezo_{arg_channel}')
+    plt.show()
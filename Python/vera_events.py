@@ -0,0 +1,110 @@
+import sys, os, ctypes, struct
+
+events_file = '_events.bin'
+version_support = 1
+header_format = '<B3xII' # e_data_header_t
+record_format = '<IIIIIIB3xffff' # e_data_point_t
+a_header_size = 24 # sizeof(a_data_header_t)
+source_names = {0x01: 'piezo_peak', 0x02: 'mems_rms', 0x04: 'kurtosis', 0x08: 'speed'}
+
+# Reads event file, returns (a_sampling_rate, [record dict]), parts of events spanning several pages are merged
+def events_parse(path):
+    with open(path, 'rb') as f:
+        data = f.read()
+    header_size = struct.calcsize(header_format)
+    record_size = struct.calcsize(record_format)
+    if len(data) < header_size:
+        print('! ERROR: Event file too short')
+        exit()
+    version, boot_duration, a_sampling_rate = struct.unpack_from(header_format, data)
+    if version > version_support:
+        print(f'! ERROR: Event file version {version} is not supported. This script version supports max. {version_support}.')
+        exit()
+    events = []
+    for offset in range(header_size, len(data) - record_size + 1, record_size):
+        num, page, a_offset, count, t_start, t_trigger, sources, peak, rms, kurtosis, speed = struct.unpack_from(record_format, data, offset)
+        part = dict(page=page, offset=a_offset, count=count)
+        if len(events) > 0 and events[-1]['num'] == num:
+            events[-1]['parts'].append(part)
+            events[-1]['count'] += count
+            continue
+        events.append(dict(num=num, t_start=t_start, t_trigger=t_trigger, count=count, sources=sources, peak=peak, rms=rms, kurtosis=kurtosis, speed=speed, parts=[part]))
+    return a_sampling_rate, events
+
+# Reads data points of event from acceleration files (a_X.bin), returns [A_DataPoint]
+def event_points(dir_path, event):
+    points = []
+    for part in event['parts']:
+        a_path = os.path.join(dir_path, f'a_{part["page"]}.bin')
+        with open(a_path, 'rb') as f:
+            header = f.read(a_header_size)
+            piezo_count_max = header[16]
+            class A_DataPoint(ctypes.Structure):
+                _fields_ = (
+                    ('complete', ctypes.c_uint8),
+                    ('timestamp', ctypes.c_uint32),
+                    ('temp_mems1', ctypes.c_uint16),
+                    ('xyz_mems1', ctypes.c_int32 * 3),
+                    ('a_piezo', ctypes.c_int16 * piezo_count_max),
+                    ('distance', ctypes.c_float),
+                )
+            size = ctypes.sizeof(A_DataPoint)
+            f.seek(part['offset'])
+            data = f.read(part['count'] * size)
+        points += [A_DataPoint.from_buffer_copy(data[i:i + size]) for i in range(0, len(data) - size + 1, size)]
+    return points
+
+if '-h' in sys.argv or '--help' in sys.argv:
+    print('Usage: python vera_events.py (options) [path like "./2024-08-01_1"]')
+    print('\tLists events of triggered capture (trigger_mode=1) from event file, reads only the data of exported events')
+    print('\tIf no path argument is given, the current working directory is used')
+    print('Options:')
+    print('\t-s   / --source (name)      | Lists events of given trigger source only (piezo_peak, mems_rms, kurtosis, speed)')
+    print('\t-x   / --export (N) (path)  | Saves data points of event N as .csv file')
+    exit()
+
+arg_path = '.'
+arg_source = None
+arg_export = None
+argv_i = 1
+while argv_i < len(sys.argv):
+    a = sys.argv[argv_i]
+    if a in ['-s', '--source']:
+        arg_source = sys.argv[argv_i + 1]
+        argv_i += 1
+    elif a in ['-x', '--export']:
+        arg_export = (int(sys.argv[argv_i + 1]), sys.argv[argv_i + 2])
+        argv_i += 2
+    else:
+        arg_path = a
+    argv_i += 1
+
+events_path = os.path.join(arg_path, events_file)
+if not os.path.isfile(events_path):
+    print(f'! ERROR: No event file "{events_path}" (created with first event of triggered capture)')
+    exit()
+
+fs, events = events_parse(events_path)
+if arg_source is not None:
+    events = [e for e in events if any(source_names[b] == arg_source for b in source_names if e['sources'] & b)]
+
+if arg_export is not None:
+    event = next((e for e in events if e['num'] == arg_export[0]), None)
+    if event is None:
+        print(f'! ERROR: Event {arg_export[0]} not found')
+        exit()
+    points = event_points(arg_path, event)
+    with open(arg_export[1], 'w') as f:
+        f.write('time,mems_x,mems_y,mems_z,' + ','.join(f'piezo_{i + 1}' for i in range(len(points[0].a_piezo))) + '\n')
+        for dp in points:
+            f.write(f'{dp.timestamp / fs:.6f},' + ','.join(str(v) for v in list(dp.xyz_mems1) + list(dp.a_piezo)) + '\n')
+    print(f'Saved {len(points)} data points of event {event["num"]} to "{arg_export[1]}"')
+    exit()
+
+print(f'{"Event":>6} {"Trigger (s)":>11} {"Pre (s)":>8} {"Dur. (s)":>8} {"Pages":>6} {"Peak":>7} {"RMS":>8} {"Kurt.":>6} {"km/h":>6}  Sources')
+for e in events:
+    sources = ', '.join(source_names[b] for b in source_names if e['sources'] & b)
+    speed = '?' if e['speed'] < 0 else f'{e["speed"]:.1f}'
+    pages = '+'.join(str(p['page']) for p in e['parts'])
+    print(f'{e["num"]:>6} {e["t_trigger"] / fs:>11.3f} {(e["t_trigger"] - e["t_start"]) / fs:>8.3f} {e["count"] / fs:>8.3f} {pages:>6} {e["peak"]:>7.0f} {e["rms"]:>8.0f} {e["kurtosis"]:>6.2f} {speed:>6}  {sources}')
+print(f'{len(events)} event{"" if len(events) == 1 else "s"}, total duration {sum(e["count"] for e in events) / fs:.1f} s')
@@ -0,0 +1,62 @@
+import os, glob
+import numpy as np
+
+# Layout of measurement files as in STM32/Core/Inc/data_points.h (natural alignment of C structs)
+a_version_support = 2 # Acceleration data (a_X.bin)
+p_version_support = 2 # Position data (p_X.bin)
+
+# Definition of a_data_header_t
+a_header_dtype = np.dtype([('version', 'u1'), ('boot_duration', '<u4'), ('a_buffer_len', '<u4'), ('a_sampling_rate', '<u4'),
+                           ('piezo_count_max', 'u1'), ('piezo_count', 'u1'), ('oversampling_ratio', 'u1'), ('fir_taps_len', '<u4')], align=True)
+
+# Definition of p_data_header_t
+p_header_dtype = np.dtype([('version', 'u1'), ('boot_duration', '<u4'), ('p_buffer_len', '<u4'), ('p_sampling_rate', '<u4'),
+                           ('year', '<u2'), ('month', 'u1'), ('day', 'u1')], align=True)
+
+# Definition of a_data_point_t (distance since version 2)
+def a_point_dtype(version, piezo_count_max):
+    fields = [('complete', 'u1'), ('timestamp', '<u4'), ('temp_mems1', '<u2'), ('xyz_mems1', '<i4', 3), ('a_piezo', '<i2', int(piezo_count_max))]
+    if version >= 2:
+        fields.append(('distance', '<f4'))
+    return np.dtype(fields, align=True)
+
+# Definition of p_data_point_t
+p_point_dtype = np.dtype([('complete', 'u1'), ('timestamp', '<u4'), ('gnss_hour', 'u1'), ('gnss_minute', 'u1'), ('gnss_second', '<f4'),
+                          ('lat', '<f4'), ('lon', '<f4'), ('speed', '<f4'), ('altitude', '<f4')], align=True)
+
+def channel_names(channel_count): # MEMS axes followed by piezo channels
+    return ['x', 'y', 'z'] + [f'piezo_{i + 1}' for i in range(channel_count - 3)]
+
+def page_num(path): # Number X of a_X.bin
+    return int(os.path.basename(path)[2:-4])
+
+# Paths of pages (prefix_X.bin), sorted by number since sorting by string would result in ['1', '10', '11', '2', '3', ...]
+def page_paths(dir_path, prefix):
+    return sorted(glob.glob(os.path.join(dir_path, f'{prefix}_*.bin')), key=page_num)
+
+# Maps data points after header of file (view, no copy)
+def points_map(path, header_size, point_dtype):
+    count = (os.path.getsize(path) - header_size) // point_dtype.itemsize
+    if count <= 0:
+        return np.zeros(0, dtype=point_dtype)
+    return np.memmap(path, dtype=point_dtype, mode='r', offset=header_size, shape=(count,))
+
+# Maps acceleration file, returns (header, data points as structured memmap), (None, None) if file has no header
+def a_map(a_path):
+    if os.path.getsize(a_path) < a_header_dtype.itemsize:
+        return None, None
+    header = np.fromfile(a_path, dtype=a_header_dtype, count=1)[0]
+    if header['version'] < 1 or header['version'] > a_version_support:
+        print(f'! ERROR: Acceleration data version {header["version"]} is not supported. This script version supports min. 1 max. {a_version_support}.')
+        exit()
+    return header, points_map(a_path, a_header_dtype.itemsize, a_point_dtype(header['version'], header['piezo_count_max']))
+
+# Maps position file, returns (header, data points as structured memmap), (None, None) if file has no header
+def p_map(p_path):
+    if os.path.getsize(p_path) < p_header_dtype.itemsize:
+        return None, None
+    header = np.fromfile(p_path, dtype=p_header_dtype, count=1)[0]
+    if header['version'] < 1 or header['version'] > p_version_support:
+        print(f'! ERROR: Position data version {header["version"]} is not supported. This script version supports min. 1 max. {p_version_support}.')
+        exit()
+    return header, points_map(p_path, p_header_dtype.itemsize, p_point_dtype)
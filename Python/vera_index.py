@@ -0,0 +1,79 @@
+import sys, os, struct
+
+index_file = 'index.bin'
+index_magic = 0x58444956 # "VIDX"
+version_support = 1
+header_format = '<IBBHIHBBII' # SD_Index_Header_t
+entry_format = '<HBBIIIB3x' # SD_Index_Entry_t
+flag_scanned = 0x01
+flag_stopped = 0x02
+
+# Reads index file, returns list of (dir name, duration in s or None, page count or None, status)
+def index_parse(path):
+    with open(path, 'rb') as f:
+        data = f.read()
+    header_size = struct.calcsize(header_format)
+    if len(data) < header_size:
+        print('! ERROR: Index file too short')
+        exit()
+    magic, version, entry_size, _, run_count, *_ = struct.unpack_from(header_format, data)
+    if magic != index_magic:
+        print('! ERROR: Not an index file')
+        exit()
+    if version > version_support:
+        print(f'! ERROR: Index version {version} is not supported. This script version supports max. {version_support}.')
+        exit()
+    if len(data) < header_size + run_count * entry_size:
+        print(f'! WARNING: Index file incomplete, expected {run_count} runs')
+        run_count = (len(data) - header_size) // entry_size
+    runs = []
+    for i in range(run_count):
+        year, month, day, dir_num, duration_ms, page_count, flags = struct.unpack_from(entry_format, data, header_size + i * entry_size)
+        name = f'{year:04}-{month:02}-{day:02}_{dir_num}'
+        if flags & flag_scanned:
+            runs.append((name, None, None, 'scanned'))
+        else:
+            runs.append((name, duration_ms / 1000, page_count, 'stopped' if flags & flag_stopped else 'interrupted'))
+    return runs
+
+def duration_str(d):
+    return '?' if d is None else f'{int(d / 3600):02}:{int(d / 60) % 60:02}:{int(d % 60):02}'
+
+if '-h' in sys.argv or '--help' in sys.argv:
+    print('Usage: python vera_index.py (options) [path of SD card like "E:/" or "/media/sd"]')
+    print('\tLists measurement directories (runs) from index file without reading data files')
+    print('\tIf no path argument is given, the current working directory is used')
+    print('Options:')
+    print('\t-d   / --date (YYYY-MM-DD)  | Lists runs of given date only')
+    print('\t-e   / --exists             | Marks runs whose directory is missing on SD card')
+    exit()
+
+arg_path = '.'
+arg_date = None
+arg_exists = False
+argv_i = 1
+while argv_i < len(sys.argv):
+    a = sys.argv[argv_i]
+    if a in ['-d', '--date']:
+        arg_date = sys.argv[argv_i + 1]
+        argv_i += 1
+    elif a in ['-e', '--exists']:
+        arg_exists = True
+    else:
+        arg_path = a
+    argv_i += 1
+
+index_path = os.path.join(arg_path, index_file)
+if not os.path.isfile(index_path):
+    print(f'! ERROR: No index file "{index_path}" (created by firmware on first capture)')
+    exit()
+
+runs = index_parse(index_path)
+if arg_date is not None:
+    runs = [r for r in runs if r[0].startswith(arg_date + '_')]
+print(f'{"Directory":<20} {"Duration":>9} {"Pages":>6}  Status')
+for name, duration, pages, status in runs:
+    if arg_exists and not os.path.isdir(os.path.join(arg_path, name)):
+        status += ', missing'
+    print(f'{name:<20} {duration_str(duration):>9} {"?" if pages is None else pages:>6}  {status}')
+print(f'{len(runs)} run{"" if len(runs) == 1 else "s"}, total duration {duration_str(sum(r[1] for r in runs if r[1] is not None))}')
@@ -0,0 +1,229 @@
+import sys, os, struct
+import numpy as np
+import vera_format
+
+lod_file = '_lod.bin'
+lod_version = 1
+header_format = '<BBBBII' # version, channel_count, level_count, base_shift, a_sampling_rate, page_count
+page_format = '<IIII' # page, first timestamp, last timestamp, point count
+chunk_len = 1 << 20 # Data points read at once while indexing
+top_bins = 1024 # Coarsest level has at most this many bins
+view_bins = 4000 # Bins drawn per channel, finest level that fits is used
+view_raw = 20000 # Raw samples are drawn if the visible range has at most this many
+
+# Channel values of data points as [point, channel] (int32)
+def point_values(points, channel_count):
+    return np.concatenate((points['xyz_mems1'], points['a_piezo'][:, :channel_count - 3].astype(np.int32)), axis=1)
+
+# Combines bins of index >> shift, returns (index, min, max) with min/max as [bin, channel]
+def reduce_bins(index, mn, mx, shift):
+    index = index >> shift
+    if np.any(index[1:] < index[:-1]): # Timestamps restarted (new capture in same directory)
+        order = np.argsort(index, kind='stable')
+        index, mn, mx = index[order], mn[order], mx[order]
+    starts = np.concatenate(([0], np.flatnonzero(index[1:] != index[:-1]) + 1))
+    return index[starts], np.minimum.reduceat(mn, starts, axis=0), np.maximum.reduceat(mx, starts, axis=0)
+
+# Builds pyramid from acceleration files: level k has bins of 2^(base_shift + k) samples (by timestamp), empty bins are omitted
+def lod_build(dir_path, base_shift):
+    pages, parts = [], []
+    a_header = None
+    for a_path in vera_format.page_paths(dir_path, 'a'):
+        header, points = vera_format.a_map(a_path)
+        if header is None or len(points) == 0:
+            continue
+        if a_header is not None and (header['a_sampling_rate'] != a_header['a_sampling_rate'] or header['piezo_count'] != a_header['piezo_count']):
+            print(f'! WARNING: "{a_path}" has different config, following pages are skipped')
+            break
+        a_header = header
+        channel_count = 3 + int(header['piezo_count'])
+        pages.append((vera_format.page_num(a_path), int(points['timestamp'][0]), int(points['timestamp'][-1]), len(points)))
+        for i in range(0, len(points), chunk_len):
+            chunk = points[i:i + chunk_len]
+            values = point_values(chunk, channel_count)
+            parts.append(reduce_bins(chunk['timestamp'].astype(np.int64), values, values, base_shift))
+    if a_header is None:
+        return None
+    # Bins spanning chunks or pages are merged
+    level = reduce_bins(np.concatenate([p[0] for p in parts]), np.concatenate([p[1] for p in parts]), np.concatenate([p[2] for p in parts]), 0)
+    levels = [level]
+    while len(level[0]) > top_bins and len(levels) < 32 - base_shift:
+        level = reduce_bins(*level, 1)
+        levels.append(level)
+    return dict(a_sampling_rate=int(a_header['a_sampling_rate']), channel_count=channel_count, base_shift=base_shift, pages=pages, levels=levels)
+
+def lod_save(path, lod):
+    with open(path, 'wb') as f:
+        f.write(struct.pack(header_format, lod_version, lod['channel_count'], len(lod['levels']), lod['base_shift'], lod['a_sampling_rate'], len(lod['pages'])))
+        for page in lod['pages']:
+            f.write(struct.pack(page_format, *page))
+        f.write(np.array([len(level[0]) for level in lod['levels']], dtype='<u4').tobytes())
+        for index, mn, mx in lod['levels']:
+            f.write(index.astype('<u4').tobytes())
+            f.write(np.stack((mn, mx), axis=2).astype('<i4').tobytes()) # [bin, channel, min/max]
+
+# Reads pyramid, levels are memory-mapped
+def lod_load(path):
+    with open(path, 'rb') as f:
+        data = f.read(struct.calcsize(header_format))
+        if len(data) < struct.calcsize(header_format):
+            return None
+        version, channel_count, level_count, base_shift, a_sampling_rate, page_count = struct.unpack(header_format, data)
+        if version > lod_version:
+            print(f'! ERROR: LOD file version {version} is not supported. This script version supports max. {lod_version}.')
+            exit()
+        pages = [struct.unpack(page_format, f.read(struct.calcsize(page_format))) for _ in range(page_count)]
+        counts = np.frombuffer(f.read(4 * level_count), dtype='<u4')
+        offset = f.tell()
+    levels = []
+    for count in counts:
+        index = np.memmap(path, dtype='<u4', mode='r', offset=offset, shape=(int(count),)) if count > 0 else np.zeros(0, dtype='<u4')
+        offset += 4 * int(count)
+        values = np.memmap(path, dtype='<i4', mode='r', offset=offset, shape=(int(count), channel_count, 2)) if count > 0 else np.zeros((0, channel_count, 2), dtype='<i4')
+        offset += 8 * int(count) * channel_count
+        levels.append((index, values[:, :, 0], values[:, :, 1]))
+    return dict(a_sampling_rate=a_sampling_rate, channel_count=channel_count, base_shift=base_shift, pages=pages, levels=levels)
+
+# Pages of acceleration files as in pyramid (page, first timestamp, last timestamp, point count)
+def current_pages(dir_path):
+    pages = []
+    for a_path in vera_format.page_paths(dir_path, 'a'):
+        header, points = vera_format.a_map(a_path)
+        if header is not None and len(points) > 0:
+            pages.append((vera_format.page_num(a_path), int(points['timestamp'][0]), int(points['timestamp'][-1]), len(points)))
+    return pages
+
+if '-h' in sys.argv or '--help' in sys.argv:
+    print('Usage: python vera_lod.py (options) [path like "./2024-08-01_1"]')
+    print('\tBuilds a min/max pyramid (level-of-detail) of all channels from the acceleration files (_lod.bin in the measurement directory)')
+    print('\tand shows a zoomable preview: overview of a whole run down to single samples without skipping data points (impulse peaks are kept)')
+    print('\tThe pyramid is rebuilt if acceleration files have changed')
+    print('\tIf no path argument is given, the current working directory is used')
+    print('Options:')
+    print('\t-b   / --base (shift)       | Finest level has bins of 2^shift samples (default: 7, larger for less memory with long runs)')
+    print('\t-r   / --rebuild            | Rebuilds pyramid even if acceleration files have not changed')
+    print('\t-c   / --channel (names)    | Channels of preview, comma separated (x, y, z, piezo_1 to piezo_5, default: all)')
+    print('\t-p   / --preview            | Shows zoomable preview (requires matplotlib)')
+    exit()
+
+arg_base = 7
+arg_rebuild = False
+arg_channels = None
+arg_preview = False
+arg_path = '.'
+argv_i = 1
+while argv_i < len(sys.argv):
+    a = sys.argv[argv_i]
+    if a in ['-b', '--base']:
+        arg_base = int(sys.argv[argv_i + 1])
+        argv_i += 1
+    elif a in ['-r', '--rebuild']:
+        arg_rebuild = True
+    elif a in ['-c', '--channel']:
+        arg_channels = sys.argv[argv_i + 1].split(',')
+        argv_i += 1
+    elif a in ['-p', '--preview']:
+        arg_preview = True
+    else:
+        arg_path = a
+    argv_i += 1
+if arg_base < 1 or arg_base > 24:
+    print('! ERROR: Base shift must be 1 to 24')
+    exit()
+
+lod_path = os.path.join(arg_path, lod_file)
+lod = lod_load(lod_path) if os.path.exists(lod_path) and not arg_rebuild else None
+if lod is not None and ([tuple(p) for p in lod['pages']] != current_pages(arg_path) or lod['base_shift'] != arg_base):
+    lod = None
+if lod is None:
+    print('Building pyramid ...')
+    lod = lod_build(arg_path, arg_base)
+    if lod is None:
+        print(f'! ERROR: No acceleration files in "{arg_path}"')
+        exit()
+    lod_save(lod_path, lod)
+    lod = lod_load(lod_path)
+    print(f'Saved "{lod_path}" ({os.path.getsize(lod_path) / 1e6:.1f} MB)')
+
+fs = lod['a_sampling_rate']
+names = vera_format.channel_names(lod['channel_count'])
+point_total = sum(p[3] for p in lod['pages'])
+print(f'{len(lod["pages"])} pages, {point_total} data points ({point_total / fs:.1f} s), {fs} Sa/s, channels {", ".join(names)}')
+for k, (index, mn, mx) in enumerate(lod['levels']):
+    print(f'Level {k}: {1 << (lod["base_shift"] + k):>8} samples/bin, {len(index):>9} bins')
+
+if arg_preview:
+    import matplotlib.pyplot as plt
+    channels = arg_channels if arg_channels is not None else names
+    for name in channels:
+        if name not in names:
+            print(f'! ERROR: Channel {name} not recorded ({", ".join(names)})')
+            exit()
+    i_chs = [names.index(name) for name in channels]
+
+    # Raw samples of visible range (timestamps t0 to t1), gaps as NaN
+    def raw_window(t0, t1):
+        x, y = [], []
+        for page, first, last, count in lod['pages']:
+            if last < t0 or first > t1:
+                continue
+            _, points = vera_format.a_map(os.path.join(arg_path, f'a_{page}.bin'))
+            ts = points['timestamp']
+            i0, i1 = np.searchsorted(ts, t0), np.searchsorted(ts, t1, side='right')
+            if i0 < i1:
+                x.append(ts[i0:i1].astype(np.float64))
+                y.append(point_values(points[i0:i1], lod['channel_count']).astype(np.float64))
+        if len(x) == 0:
+            return np.zeros(0), np.zeros((0, lod['channel_count']))
+        x, y = np.concatenate(x), np.concatenate(y)
+        gaps = np.flatnonzero(np.diff(x) != 1) + 1
+        return np.insert(x, gaps, np.nan) / fs, np.insert(y, gaps, np.nan, axis=0)
+
+    # Bins of finest level with at most view_bins in visible range, missing bins as NaN
+    def lod_window(t0, t1):
+        span = max(t1 - t0, 1)
+        k = 0
+        while k < len(lod['levels']) - 1 and span >> (lod['base_shift'] + k) > view_bins:
+            k += 1
+        shift = lod['base_shift'] + k
+        index, mn, mx = lod['levels'][k]
+        i0, i1 = np.searchsorted(index, max(t0, 0) >> shift), np.searchsorted(index, t1 >> shift, side='right')
+        b0 = int(index[i0]) if i0 < i1 else 0
+        b1 = int(index[i1 - 1]) + 1 if i0 < i1 else 0
+        dense_mn = np.full((b1 - b0, lod['channel_count']), np.nan)
+        dense_mx = np.full((b1 - b0, lod['channel_count']), np.nan)
+        dense_mn[index[i0:i1] - b0] = mn[i0:i1]
+        dense_mx[index[i0:i1] - b0] = mx[i0:i1]
+        return (np.arange(b0, b1) << shift) / fs, dense_mn, dense_mx, 1 << shift
+
+    fig, axs = plt.subplots(len(i_chs), 1, sharex=True, squeeze=False)
+    axs = axs[:, 0]
+    artists = []
+    def redraw(ax):
+        t0, t1 = (int(t * fs) for t in ax.get_xlim())
+        for a in artists:
+            a.remove()
+        artists.clear()
+        if t1 - t0 <= view_raw:
+            x, y = raw_window(t0, t1)
+            for ax_ch, i_ch in zip(axs, i_chs):
+                artists.extend(ax_ch.plot(x, y[:, i_ch], color='C0', linewidth=0.8))
+            axs[0].set_title('Raw samples')
+        else:
+            x, mn, mx, samples = lod_window(t0, t1)
+            for ax_ch, i_ch in zip(axs, i_chs):
+                artists.append(ax_ch.fill_between(x, mn[:, i_ch], mx[:, i_ch], step='post', color='C0', linewidth=0))
+            axs[0].set_title(f'Min/max of {samples} samples')
+        fig.canvas.draw_idle()
+
+    for ax_ch, name in zip(axs, channels):
+        ax_ch.set_ylabel(name)
+    axs[-1].set_xlabel('Time (s)')
+    index, mn, mx = lod['levels'][-1]
+    axs[-1].set_xlim(lod['pages'][0][1] / fs, (lod['pages'][-1][2] + 1) / fs)
+    for ax_ch, i_ch in zip(axs, i_chs):
+        margin = 0.05 * (np.max(mx[:, i_ch]) - np.min(mn[:, i_ch])) + 1
+        ax_ch.set_ylim(np.min(mn[:, i_ch]) - margin, np.max(mx[:, i_ch]) + margin)
+    redraw(axs[-1])
+    axs[-1].callbacks.connect('xlim_changed', redraw)
+    plt.show()
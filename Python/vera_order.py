@@ -0,0 +1,232 @@
+import sys
+import numpy as np
+from scipy import signal
+import vera_format
+
+channel_names = vera_format.channel_names(3 + 5) # MEMS axes and PIEZO_COUNT_MAX piezo channels
+# Track distance is sampled at this interval (s) for the angle-time map, float32 distance is too coarse for single samples
+knot_interval = 0.1
+# Anti-aliasing filter cutoff relative to Nyquist frequency of angle domain at lowest speed of a run
+aa_ratio = 0.8
+
+if '-h' in sys.argv or '--help' in sys.argv:
+    print('Usage: python vera_order.py (options) [path like "./2024-08-01_1"]')
+    print('\tOrder tracking: resamples acceleration to constant samples per wheel revolution, computes order spectra and per-revolution metrics')
+    print('\tThe wheel angle is taken from the track distance (a_data_point_t.distance, dead-reckoned) or from the GNSS speed (-g)')
+    print('\tOrder 1 is once per revolution, the phase of revolutions is arbitrary but continuous within a run')
+    print('\tIf no path argument is given, the current working directory is used')
+    print('Options:')
+    print('\t-w   / --wheel (m)          | Wheel diameter (default: 0.92 m)')
+    print('\t-c   / --channel (0-7)      | Channel (0-2: MEMS [X-Z], 3-7: Piezo [1-5], default: 3)')
+    print('\t-n   / --samples (N)        | Samples per revolution (default: 256, orders up to N / 2)')
+    print('\t-r   / --revolutions (N)    | Revolutions per order spectrum (default: 8, resolution 1 / N orders)')
+    print('\t-v   / --speedmin (km/h)    | Minimum speed, slower sections are skipped (default: 10 km/h)')
+    print('\t-o   / --orders (N)         | Orders printed and saved per revolution (default: 10)')
+    print('\t-g   / --gnss               | Use GNSS speed (p_X.bin) instead of track distance')
+    print('\t-p   / --preview            | Shows order spectrogram (requires matplotlib)')
+    print('\t-s   / --save (path)        | Saves per-revolution metrics as .csv file')
+    exit()
+
+arg_wheel = 0.92
+arg_channel = 3
+arg_samples = 256
+arg_revolutions = 8
+arg_speed_min = 10
+arg_orders = 10
+arg_gnss = False
+arg_preview = False
+arg_save = None
+arg_path = '.'
+argv_i = 1
+while argv_i < len(sys.argv):
+    a = sys.argv[argv_i]
+    if a in ['-w', '--wheel']:
+        arg_wheel = float(sys.argv[argv_i + 1])
+        argv_i += 1
+    elif a in ['-c', '--channel']:
+        arg_channel = int(sys.argv[argv_i + 1])
+        argv_i += 1
+    elif a in ['-n', '--samples']:
+        arg_samples = int(sys.argv[argv_i + 1])
+        argv_i += 1
+    elif a in ['-r', '--revolutions']:
+        arg_revolutions = int(sys.argv[argv_i + 1])
+        argv_i += 1
+    elif a in ['-v', '--speedmin']:
+        arg_speed_min = float(sys.argv[argv_i + 1])
+        argv_i += 1
+    elif a in ['-o', '--orders']:
+        arg_orders = int(sys.argv[argv_i + 1])
+        argv_i += 1
+    elif a in ['-g', '--gnss']:
+        arg_gnss = True
+    elif a in ['-p', '--preview']:
+        arg_preview = True
+    elif a in ['-s', '--save']:
+        arg_save = sys.argv[argv_i + 1]
+        argv_i += 1
+    else:
+        arg_path = a
+    argv_i += 1
+
+if arg_wheel <= 0 or arg_samples < 8 or arg_revolutions < 1 or arg_orders < 1:
+    print('! ERROR: Invalid wheel diameter, samples per revolution, revolutions or orders')
+    exit()
+arg_orders = min(arg_orders, arg_samples // 2)
+circumference = np.pi * arg_wheel
+
+# Read pages
+a_paths = vera_format.page_paths(arg_path, 'a')
+if len(a_paths) == 0:
+    print(f'! ERROR: No acceleration files in "{arg_path}"')
+    exit()
+header = None
+points = []
+for a_path in a_paths:
+    h, dp = vera_format.a_map(a_path)
+    if h is None or len(dp) == 0:
+        continue
+    if header is not None and (h['a_sampling_rate'] != header['a_sampling_rate'] or h['version'] != header['version'] or h['piezo_count_max'] != header['piezo_count_max']):
+        print(f'! WARNING: "{a_path}" has different config, following pages are skipped')
+        break
+    header = h
+    points.append(dp)
+if header is None:
+    print('! ERROR: No data points found')
+    exit()
+points = np.concatenate(points)
+fs = int(header['a_sampling_rate'])
+if arg_channel < 0 or arg_channel >= 3 + header['piezo_count']:
+    print(f'! ERROR: Channel {arg_channel} not recorded ({3 + header["piezo_count"]} channels)')
+    exit()
+t = points['timestamp'].astype(np.float64) / fs
+x = (points['xyz_mems1'][:, arg_channel] if arg_channel < 3 else points['a_piezo'][:, arg_channel - 3]).astype(np.float64)
+
+# Distance (m) at every sample
+if not arg_gnss and (header['version'] < 2 or np.all(points['complete'] & (1 << 3) == 0)):
+    print('! WARNING: No track distance recorded (version 1 or track_axis=0), using GNSS speed')
+    arg_gnss = True
+if arg_gnss:
+    p_points = [p for _, p in (vera_format.p_map(p_path) for p_path in vera_format.page_paths(arg_path, 'p')) if p is not None]
+    p_points = np.concatenate(p_points) if len(p_points) > 0 else np.zeros(0, dtype=vera_format.p_point_dtype)
+    p_points = p_points[p_points['complete'] & (1 << 3) != 0]
+    if len(p_points) < 2:
+        print('! ERROR: No GNSS speed recorded')
+        exit()
+    # Speed (m/s) is integrated at sample times, gaps of triggered capture are bridged with the interpolated speed
+    v = np.interp(t, p_points['timestamp'] / fs, p_points['speed'] / 3.6)
+    distance = np.concatenate(([0], np.cumsum((v[1:] + v[:-1]) / 2 * np.diff(t))))
+else:
+    distance = points['distance'].astype(np.float64)
+
+# Continuous sections (gaps of triggered capture or lost data split sections), angle-time map from knots
+knot_len = max(1, int(round(knot_interval * fs)))
+section_starts = np.concatenate(([0], np.nonzero(np.diff(points['timestamp'].astype(np.int64)) != 1)[0] + 1, [len(points)]))
+revs_order = [] # Resampled revolutions [revolution, sample]
+revs_time = []
+revs_speed = []
+revs_run = []
+run_count = 0
+for i_start, i_end in zip(section_starts[:-1], section_starts[1:]):
+    i_knots = np.unique(np.concatenate((np.arange(i_start, i_end, knot_len), [i_end - 1])))
+    if len(i_knots) < 2:
+        continue
+    t_k = t[i_knots]
+    d_k = np.maximum.accumulate(distance[i_knots])
+    v_k = np.diff(d_k) / np.diff(t_k)
+    # Runs of knot intervals at minimum speed
+    fast = np.concatenate(([False], v_k * 3.6 >= arg_speed_min, [False]))
+    edges = np.nonzero(np.diff(fast.astype(np.int8)))[0]
+    for k0, k1 in zip(edges[::2], edges[1::2]):
+        r_run = d_k[k0:k1 + 1] / circumference
+        t_run = t_k[k0:k1 + 1]
+        rev_first = int(np.ceil(r_run[0]))
+        rev_count = int(np.floor(r_run[-1])) - rev_first
+        if rev_count < 1:
+            continue
+        run_count += 1
+        s0, s1 = i_knots[k0], i_knots[k1] + 1
+        x_run = x[s0:s1] - np.mean(x[s0:s1])
+        # Anti-aliasing if angle domain sampling rate at lowest speed is below sampling rate
+        cutoff = aa_ratio * arg_samples / 2 * np.min(v_k[k0:k1]) / circumference
+        if cutoff < aa_ratio * fs / 2 and len(x_run) > 50:
+            sos = signal.butter(8, cutoff, fs=fs, output='sos')
+            x_run = signal.sosfiltfilt(sos, x_run)
+        grid = rev_first + np.arange(rev_count * arg_samples) / arg_samples
+        t_grid = np.interp(grid, r_run, t_run)
+        revs_order.append(np.interp(t_grid, t[s0:s1], x_run).reshape(rev_count, arg_samples))
+        t_revs = t_grid[::arg_samples]
+        t_next = np.interp(rev_first + np.arange(1, rev_count + 1), r_run, t_run)
+        revs_time.append(t_revs)
+        revs_speed.append(circumference / (t_next - t_revs) * 3.6)
+        revs_run.append(np.full(rev_count, run_count))
+
+if run_count == 0:
+    print(f'! ERROR: No complete revolution at {arg_speed_min:g} km/h or faster')
+    exit()
+revs_order = np.concatenate(revs_order)
+revs_time = np.concatenate(revs_time)
+revs_speed = np.concatenate(revs_speed)
+revs_run = np.concatenate(revs_run)
+print(f'{len(revs_order)} revolutions in {run_count} run(s) ({len(revs_order) * circumference:.0f} m at {arg_speed_min:g} km/h or faster), '
+      f'wheel diameter {arg_wheel:g} m, {arg_samples} samples per revolution, channel {channel_names[arg_channel]}, '
+      f'angle from {"GNSS speed" if arg_gnss else "track distance"}')
+
+# Per revolution: integer orders are exact without window (signal resampled to full revolutions)
+dev = revs_order - np.mean(revs_order, axis=1, keepdims=True)
+m2 = np.mean(dev ** 2, axis=1)
+rms = np.sqrt(m2)
+peak = np.max(np.abs(dev), axis=1)
+crest = np.divide(peak, rms, out=np.zeros_like(rms), where=rms > 0)
+kurtosis = np.divide(np.mean(dev ** 4, axis=1), m2 ** 2, out=np.zeros_like(rms), where=m2 > 0)
+order_amp = np.abs(np.fft.rfft(dev, axis=1))[:, 1:arg_orders + 1] * 2 / arg_samples
+
+# Order spectra of arg_revolutions consecutive revolutions (Hann window), runs are not joined
+spectrum_len = arg_revolutions * arg_samples
+spectra = []
+spectra_time = []
+i = 0
+while i + arg_revolutions <= len(revs_order):
+    if revs_run[i] != revs_run[i + arg_revolutions - 1]:
+        i += 1
+        continue
+    block = revs_order[i:i + arg_revolutions].reshape(-1)
+    window = np.hanning(spectrum_len)
+    spectra.append(np.abs(np.fft.rfft((block - np.mean(block)) * window)) * 2 / np.sum(window))
+    spectra_time.append(revs_time[i])
+    i += arg_revolutions
+orders = np.arange(spectrum_len // 2 + 1) / arg_revolutions
+
+print(f'{"Order":>5} {"Mean amp.":>10} {"Max amp.":>10}')
+for k in range(arg_orders):
+    print(f'{k + 1:>5} {np.mean(order_amp[:, k]):>10.2f} {np.max(order_amp[:, k]):>10.2f}')
+if len(spectra) > 0:
+    mean_spectrum = np.sqrt(np.mean(np.array(spectra) ** 2, axis=0))
+    i_max = np.argmax(mean_spectrum[arg_revolutions // 2 + 1:]) + arg_revolutions // 2 + 1 # Above order 0.5
+    print(f'Highest order of mean order spectrum ({len(spectra)} spectra): {orders[i_max]:.3f} ({mean_spectrum[i_max]:.2f})')
+print(f'Per revolution: RMS median {np.median(rms):.2f}, crest factor median {np.median(crest):.2f}, kurtosis median {np.median(kurtosis):.2f}')
+print('Highest crest factors (wheel flat candidates):')
+print(f'{"Time (s)":>10} {"km/h":>6} {"Peak":>8} {"RMS":>8} {"Crest":>6} {"Kurt.":>6}')
+for i in np.argsort(crest)[::-1][:5]:
+    print(f'{revs_time[i]:>10.3f} {revs_speed[i]:>6.1f} {peak[i]:>8.1f} {rms[i]:>8.1f} {crest[i]:>6.2f} {kurtosis[i]:>6.2f}')
+
+if arg_save is not None:
+    with open(arg_save, 'w') as f:
+        f.write('time,speed,rms,peak,crest,kurtosis,' + ','.join(f'order_{k + 1}' for k in range(arg_orders)) + '\n')
+        for i in range(len(revs_order)):
+            f.write(f'{revs_time[i]:.4f},{revs_speed[i]:.2f},{rms[i]:.3f},{peak[i]:.3f},{crest[i]:.3f},{kurtosis[i]:.3f},' + ','.join(f'{a:.3f}' for a in order_amp[i]) + '\n')
+    print(f'Saved "{arg_save}"')
+
+if arg_preview:
+    if len(spectra) == 0:
+        print(f'! ERROR: No run of {arg_revolutions} revolutions for order spectrogram')
+        exit()
+    import matplotlib.pyplot as plt
+    with np.errstate(divide='ignore'):
+        plt.pcolormesh(np.array(spectra_time), orders, 20 * np.log10(np.array(spectra).T), shading='nearest')
+    plt.colorbar(label='Amplitude (dB of LSB)')
+    plt.xlabel('Time (s)')
+    plt.ylabel('Order (per revolution)')
+    plt.ylim(0, min(orders[-1], 4 * arg_orders))
+    plt.title(channel_names[arg_channel])
+    plt.show()
@@ -0,0 +1,127 @@
+import sys, os, glob, struct
+import numpy as np
+
+version_support = 1
+header_format = '<B3xIIHHB3x' # f_data_header_t
+record_format = '<IHH' # f_data_point_t, followed by bin_count int16 bins per channel
+channel_names = ['mems_x', 'mems_y', 'mems_z'] + [f'piezo_{i + 1}' for i in range(5)]
+db_min = -32768 # Bin with zero power
+
+# Reads spectrum file, returns (header dict, timestamps, segment counts, PSD in dB as array [spectrum, channel, bin])
+def f_parse(f_path):
+    with open(f_path, 'rb') as f:
+        data = f.read()
+    header_size = struct.calcsize(header_format)
+    if len(data) < header_size:
+        return None, None, None, None
+    version, boot_duration, a_sampling_rate, segment_len, average_count, channel_count = struct.unpack_from(header_format, data)
+    if version > version_support:
+        print(f'! ERROR: Spectrum data version {version} is not supported. This script version supports max. {version_support}.')
+        exit()
+    header = dict(boot_duration=boot_duration, a_sampling_rate=a_sampling_rate, segment_len=segment_len, average_count=average_count, channel_count=channel_count)
+    bin_count = segment_len // 2 + 1
+    record_size = struct.calcsize(record_format) + channel_count * bin_count * 2
+    timestamps, segment_counts, spectra = [], [], []
+    for offset in range(header_size, len(data) - record_size + 1, record_size):
+        timestamp, segment_count, record_bins = struct.unpack_from(record_format, data, offset)
+        if record_bins != bin_count:
+            print(f'! ERROR: Spectrum record at {offset} is invalid ({record_bins} bins, expected {bin_count})')
+            break
+        bins = np.frombuffer(data, dtype='<i2', count=channel_count * bin_count, offset=offset + struct.calcsize(record_format))
+        timestamps.append(timestamp)
+        segment_counts.append(segment_count)
+        spectra.append(bins.reshape(channel_count, bin_count))
+    db = np.array(spectra, dtype=np.float64).reshape(-1, channel_count, bin_count)
+    db[db == db_min] = -np.inf
+    return header, np.array(timestamps), np.array(segment_counts), db / 100
+
+if '-h' in sys.argv or '--help' in sys.argv:
+    print('Usage: python vera_psd.py (options) [path like "./2024-08-01_1" or "./2024-08-01_1/f_1.bin"]')
+    print('\tReads power spectral density computed during capture (f_X.bin, Welch\'s method, dB of LSB^2/Hz) without raw data')
+    print('\tIf no path argument is given, the current working directory is used')
+    print('Options:')
+    print('\t-c   / --channel (0-7)      | Channel for -p (0-2: MEMS [X-Z], 3-7: Piezo [1-5], default: 0)')
+    print('\t-p   / --preview            | Shows spectrogram of channel (requires matplotlib)')
+    print('\t-m   / --mean               | Prints frequency and level of highest bin of mean spectrum per channel')
+    print('\t-s   / --save (path)        | Saves spectra as .csv file (one line per spectrum and channel)')
+    exit()
+
+arg_channel = 0
+arg_preview = False
+arg_mean = False
+arg_save = None
+arg_path = '.'
+argv_i = 1
+while argv_i < len(sys.argv):
+    a = sys.argv[argv_i]
+    if a in ['-c', '--channel']:
+        arg_channel = int(sys.argv[argv_i + 1])
+        argv_i += 1
+    elif a in ['-p', '--preview']:
+        arg_preview = True
+    elif a in ['-m', '--mean']:
+        arg_mean = True
+    elif a in ['-s', '--save']:
+        arg_save = sys.argv[argv_i + 1]
+        argv_i += 1
+    else:
+        arg_path = a
+    argv_i += 1
+
+# Pages in order
+if os.path.isfile(arg_path):
+    f_paths = [arg_path]
+else:
+    f_paths = sorted(glob.glob(os.path.join(arg_path, 'f_*.bin')), key=lambda p: int(os.path.basename(p)[2:-4]))
+if len(f_paths) == 0:
+    print(f'! ERROR: No spectrum files in "{arg_path}" (disabled by default, enable with psd_segment_len=512)')
+    exit()
+
+header = None
+timestamps, segment_counts, spectra = [], [], []
+for f_path in f_paths:
+    h, t, n, db = f_parse(f_path)
+    if h is None:
+        continue
+    if header is not None and (h['segment_len'] != header['segment_len'] or h['channel_count'] != header['channel_count'] or h['a_sampling_rate'] != header['a_sampling_rate']):
+        print(f'! WARNING: "{f_path}" has different spectrum config, following pages are skipped')
+        break
+    header = h
+    timestamps.append(t)
+    segment_counts.append(n)
+    spectra.append(db)
+if header is None or sum(len(t) for t in timestamps) == 0:
+    print('! ERROR: No spectra found')
+    exit()
+timestamps = np.concatenate(timestamps)
+segment_counts = np.concatenate(segment_counts)
+spectra = np.concatenate(spectra)
+fs = header['a_sampling_rate']
+freqs = np.arange(header['segment_len'] // 2 + 1) * fs / header['segment_len']
+print(f'{len(timestamps)} spectra from {len(f_paths)} page(s), {header["channel_count"]} channels, {header["segment_len"]} samples per segment ({fs / header["segment_len"]:.2f} Hz resolution), {header["average_count"]} segments per spectrum')
+
+if arg_mean:
+    mean_db = 10 * np.log10(np.mean(10 ** (spectra / 10), axis=0))
+    for i_ch in range(header['channel_count']):
+        i_max = np.argmax(mean_db[i_ch][1:]) + 1 # Without DC
+        print(f'{channel_names[i_ch]:<8} peak {freqs[i_max]:8.2f} Hz {mean_db[i_ch][i_max]:7.2f} dB')
+
+if arg_save is not None:
+    with open(arg_save, 'w') as f:
+        f.write('time,channel,segments,' + ','.join(f'{x:g}' for x in freqs) + '\n')
+        for i, t in enumerate(timestamps):
+            for i_ch in range(header['channel_count']):
+                f.write(f'{t / fs:.4f},{channel_names[i_ch]},{segment_counts[i]},' + ','.join(f'{x:.2f}' for x in spectra[i][i_ch]) + '\n')
+    print(f'Saved "{arg_save}"')
+
+if arg_preview:
+    if arg_channel >= header['channel_count']:
+        print(f'! ERROR: Channel {arg_channel} not recorded ({header["channel_count"]} channels)')
+        exit()
+    import matplotlib.pyplot as plt
+    plt.pcolormesh(timestamps / fs, freqs, spectra[:, arg_channel, :].T, shading='nearest')
+    plt.colorbar(label='PSD (dB of LSB²/Hz)')
+    plt.xlabel('Time (s)')
+    plt.ylabel('Frequency (Hz)')
+    plt.title(channel_names[arg_channel])
+    plt.show()
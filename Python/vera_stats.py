@@ -0,0 +1,122 @@
+import sys, struct
+import numpy as np
+import vera_format
+
+version_support = 1
+header_format = '<B3xIIB3x' # s_data_header_t
+channel_dtype = np.dtype([('min', '<i4'), ('max', '<i4'), ('mean', '<f4'), ('rms', '<f4'), ('peak', '<f4'), ('kurtosis', '<f4'), ('clipped', '<u4')]) # s_data_channel_t
+
+def s_record_dtype(channel_count): # s_data_point_t, followed by channel_count s_data_channel_t
+    return np.dtype([('timestamp', '<u4'), ('sample_count', '<u4'), ('channels', channel_dtype, (channel_count,))])
+
+# Reads statistics file, returns (header dict, records as structured array)
+def s_parse(s_path):
+    with open(s_path, 'rb') as f:
+        data = f.read()
+    header_size = struct.calcsize(header_format)
+    if len(data) < header_size:
+        return None, None
+    version, boot_duration, a_sampling_rate, channel_count = struct.unpack_from(header_format, data)
+    if version > version_support:
+        print(f'! ERROR: Statistics data version {version} is not supported. This script version supports max. {version_support}.')
+        exit()
+    header = dict(a_sampling_rate=a_sampling_rate, channel_count=channel_count)
+    record_dtype = s_record_dtype(channel_count)
+    count = (len(data) - header_size) // record_dtype.itemsize
+    return header, np.frombuffer(data, dtype=record_dtype, count=count, offset=header_size)
+
+if '-h' in sys.argv or '--help' in sys.argv:
+    print('Usage: python vera_stats.py (options) [path like "./2024-08-01_1"]')
+    print('\tOverview of a run from statistics computed for each acceleration buffer during capture (s_X.bin, enabled with block_stats=1)')
+    print('\tPrints min, max, RMS, kurtosis and clipped samples per channel without reading the acceleration files')
+    print('\tIf no path argument is given, the current working directory is used')
+    print('Options:')
+    print('\t-c   / --channel (name)     | Channel for -p and list of blocks (x, y, z, piezo_1 to piezo_5, default: z)')
+    print('\t-p   / --preview            | Plots min/max band, mean and RMS over time (requires matplotlib)')
+    print('\t-s   / --save (path)        | Saves records as .csv file (one line per block)')
+    exit()
+
+arg_channel = 'z'
+arg_preview = False
+arg_save = None
+arg_path = '.'
+argv_i = 1
+while argv_i < len(sys.argv):
+    a = sys.argv[argv_i]
+    if a in ['-c', '--channel']:
+        arg_channel = sys.argv[argv_i + 1]
+        argv_i += 1
+    elif a in ['-p', '--preview']:
+        arg_preview = True
+    elif a in ['-s', '--save']:
+        arg_save = sys.argv[argv_i + 1]
+        argv_i += 1
+    else:
+        arg_path = a
+    argv_i += 1
+
+# Records of device (pages in order)
+header = None
+records = []
+for s_path in vera_format.page_paths(arg_path, 's'):
+    h, rec = s_parse(s_path)
+    if h is None:
+        continue
+    if header is not None and h != header:
+        print(f'! WARNING: "{s_path}" has different config, following pages are skipped')
+        break
+    header = h
+    records.append(rec)
+if header is None:
+    print(f'! ERROR: No statistics files in "{arg_path}" (disabled by default, enable with block_stats=1)')
+    exit()
+records = np.concatenate(records)
+if len(records) == 0:
+    print('! ERROR: No records found')
+    exit()
+
+fs = header['a_sampling_rate']
+names = vera_format.channel_names(header['channel_count'])
+ch = records['channels']
+time = records['timestamp'] / fs
+sample_total = np.sum(records['sample_count'], dtype=np.int64)
+print(f'{len(records)} blocks ({sample_total / fs:.1f} s, {time[0]:.1f} to {time[-1] + records["sample_count"][-1] / fs:.1f} s), {fs} Sa/s, values in LSB')
+print(f'{"Channel":<8} {"Min":>8} {"Max":>8} {"Mean":>9} {"RMS med.":>9} {"RMS max":>9} {"Peak max":>9} {"Kurt. med.":>10} {"Kurt. max":>9} {"Clipped":>8}')
+for i_ch, name in enumerate(names):
+    c = ch[:, i_ch]
+    mean = np.sum(c['mean'] * records['sample_count']) / sample_total
+    print(f'{name:<8} {np.min(c["min"]):>8} {np.max(c["max"]):>8} {mean:>9.1f} {np.median(c["rms"]):>9.1f} {np.max(c["rms"]):>9.1f} {np.max(c["peak"]):>9.1f} '
+          f'{np.median(c["kurtosis"]):>10.2f} {np.max(c["kurtosis"]):>9.2f} {np.sum(c["clipped"], dtype=np.int64):>8}')
+
+if arg_channel not in names:
+    print(f'! ERROR: Channel {arg_channel} not recorded ({", ".join(names)})')
+    exit()
+i_ch = names.index(arg_channel)
+c = ch[:, i_ch]
+print(f'Blocks with highest RMS ({arg_channel}):')
+print(f'{"Time (s)":>10} {"Min":>8} {"Max":>8} {"Mean":>9} {"RMS":>9} {"Peak":>9} {"Kurt.":>6} {"Clipped":>7}')
+for i in np.argsort(c['rms'], kind='stable')[::-1][:5]:
+    print(f'{time[i]:>10.3f} {c["min"][i]:>8} {c["max"][i]:>8} {c["mean"][i]:>9.1f} {c["rms"][i]:>9.1f} {c["peak"][i]:>9.1f} {c["kurtosis"][i]:>6.2f} {c["clipped"][i]:>7}')
+
+if arg_save is not None:
+    with open(arg_save, 'w') as f:
+        f.write('time,samples,' + ','.join(f'{k}_{n}' for n in names for k in ['min', 'max', 'mean', 'rms', 'peak', 'kurtosis', 'clipped']) + '\n')
+        for i in range(len(records)):
+            f.write(f'{time[i]:.4f},{records["sample_count"][i]},'
+                    + ','.join(f'{ch["min"][i, k]},{ch["max"][i, k]},{ch["mean"][i, k]:.2f},{ch["rms"][i, k]:.2f},{ch["peak"][i, k]:.2f},{ch["kurtosis"][i, k]:.3f},{ch["clipped"][i, k]}' for k in range(len(names))) + '\n')
+    print(f'Saved "{arg_save}"')
+
+if arg_preview:
+    import matplotlib.pyplot as plt
+    fig, axs = plt.subplots(2, 1, sharex=True)
+    axs[0].fill_between(time, c['min'], c['max'], step='post', alpha=0.4, label='min/max')
+    axs[0].step(time, c['mean'], where='post', label='mean')
+    axs[0].set_ylabel('LSB')
+    axs[0].legend()
+    axs[1].step(time, c['rms'], where='post', label='RMS')
+    axs[1].step(time, c['kurtosis'], where='post', label='kurtosis')
+    axs[1].set_yscale('log')
+    axs[1].set_xlabel('Time (s)')
+    axs[1].legend()
+    axs[0].set_title(arg_channel)
+    plt.show()
@@ -0,0 +1,240 @@
+import sys, os, struct, time
+
+enable_live_plot = True # Requires matplotlib (-p)
+
+stream_version = 2
+stream_sync = b'VS'
+stream_header = struct.Struct('<2sBBHHIIHHIB3x') # Stream_Frame_Header_t
+stream_cmd_stop = 0
+stream_cmd_start = 1
+stream_cmd_start_raw = 2
+stream_cmd_benchmark = 3
+stream_type_data_points = 0
+stream_type_piezo_raw = 1
+stream_type_benchmark = 2
+benchmark_pattern = bytes(range(256)) * 10 # Frame payload: (sequence + i) & 0xFF, longer than 255 + max. payload
+channel_names = ['mems_x', 'mems_y', 'mems_z', 'piezo_1', 'piezo_2', 'piezo_3', 'piezo_4', 'piezo_5']
+plot_duration = 5.0 # Seconds shown in live plot
+
+# Returns struct format of one sample and names of selected channels (raw: unsigned ADC values)
+def sample_format(channels, frame_type=stream_type_data_points):
+    fmt = '<'
+    names = []
+    for i, name in enumerate(channel_names):
+        if channels & (1 << i):
+            fmt += 'i' if i < 3 else ('H' if frame_type == stream_type_piezo_raw else 'h')
+            names.append(name if frame_type == stream_type_data_points else name + '_raw')
+    return struct.Struct(fmt), names
+
+# Checksum like UBX packets
+def checksum(data):
+    ck_a = ck_b = 0
+    for b in data:
+        ck_a = (ck_a + b) & 0xFF
+        ck_b = (ck_b + ck_a) & 0xFF
+    return bytes((ck_a, ck_b))
+
+# Splits received bytes into frames, keeps incomplete rest, returns [(header fields, [(time, values)])]
+class StreamParser:
+    def __init__(self):
+        self.buffer = b''
+        self.frames = 0
+        self.samples = 0
+        self.checksum_errors = 0
+        self.lost_frames = 0
+        self.dropped_points = 0
+        self.next_sequence = None
+        self.payload_bytes = 0
+        self.pattern_errors = 0
+
+    def feed(self, data):
+        self.buffer += data
+        result = []
+        while True:
+            start = self.buffer.find(stream_sync)
+            if start < 0:
+                self.buffer = self.buffer[-1:] # Log text before streaming started
+                break
+            self.buffer = self.buffer[start:]
+            if len(self.buffer) < stream_header.size:
+                break
+            sync, version, channels, sequence, sample_count, timestamp, sampling_rate, decimation, payload_len, dropped_points, frame_type = stream_header.unpack_from(self.buffer)
+            frame_len = stream_header.size + payload_len + 2
+            if version != stream_version or sampling_rate == 0:
+                self.buffer = self.buffer[1:]
+                continue
+            if len(self.buffer) < frame_len:
+                break
+            frame = self.buffer[:frame_len]
+            if checksum(frame[:-2]) != frame[-2:]:
+                self.checksum_errors += 1
+                self.buffer = self.buffer[1:]
+                continue
+            self.buffer = self.buffer[frame_len:]
+
+            if self.next_sequence is not None and sequence != self.next_sequence:
+                self.lost_frames += (sequence - self.next_sequence) & 0xFFFF
+            self.next_sequence = (sequence + 1) & 0xFFFF
+            self.frames += 1
+            self.payload_bytes += payload_len
+            self.dropped_points = dropped_points
+            if frame_type == stream_type_benchmark:
+                # Payload is only checked, not returned
+                if frame[stream_header.size:-2] != benchmark_pattern[sequence & 0xFF:(sequence & 0xFF) + payload_len]:
+                    self.pattern_errors += 1
+                continue
+
+            fmt, names = sample_format(channels, frame_type)
+            if fmt.size * sample_count != payload_len:
+                self.checksum_errors += 1
+                continue
+            self.samples += sample_count
+            samples = []
+            for i in range(sample_count):
+                t = (timestamp + i * decimation) / sampling_rate
+                samples.append((t, fmt.unpack_from(frame, stream_header.size + i * fmt.size)))
+            result.append((names, samples))
+        return result
+
+    # Returns statistics text, throughput of payload over duration (sec)
+    def stats(self, duration):
+        text = f'{self.frames} frames, {self.samples} samples, {self.payload_bytes / max(duration, 1e-3) / 1000:.1f} kB/s, {self.dropped_points} data points dropped by device, {self.lost_frames} frames lost, {self.checksum_errors} checksum errors'
+        if self.pattern_errors:
+            text += f', {self.pattern_errors} benchmark pattern errors'
+        return text
+
+if '-h' in sys.argv or '--help' in sys.argv or len(sys.argv) < 2:
+    print('Usage: python vera_stream.py (options) [serial port like "COM5" or "/dev/ttyACM0"]')
+    print('\tStarts live streaming of acceleration data via USB CDC (capture must be running), stops with Ctrl+C')
+    print('Options:')
+    print('\t-c   / --channels (mask)    | Channels to stream (bit 0-2: MEMS X-Z, bit 3-7: Piezo 1-5, default: 0xFF)')
+    print('\t-dc  / --decimation (N)     | Stream every N-th data point (default: 1)')
+    print('\t-raw / --raw                | Streams raw piezo ADC samples (a_sampling_rate * oversampling_ratio) of selected piezo channels')
+    print('\t-b   / --benchmark          | Measures USB throughput with pattern frames instead of streaming data')
+    print('\t-d   / --duration (sec)     | Stop after duration')
+    print('\t-p   / --plot               | Shows live plot')
+    print('\t-s   / --save (path)        | Saves data as .csv file (raw values)')
+    print('\t-w   / --write (path)       | Saves received raw stream')
+    print('\t-r   / --replay (path)      | Decodes raw stream saved by -w instead of serial port')
+    exit()
+
+# Parse arguments
+arg_port = None
+arg_channels = 0xFF
+arg_decimation = 1
+arg_duration = None
+arg_plot = False
+arg_save = None
+arg_write = None
+arg_replay = None
+arg_raw = False
+arg_benchmark = False
+argv_i = 1
+while argv_i < len(sys.argv):
+    a = sys.argv[argv_i]
+    if a == '-c' or a == '--channels':
+        arg_channels = int(sys.argv[argv_i + 1], 0)
+        argv_i += 1
+    elif a == '-dc' or a == '--decimation':
+        arg_decimation = int(sys.argv[argv_i + 1])
+        argv_i += 1
+    elif a == '-d' or a == '--duration':
+        arg_duration = float(sys.argv[argv_i + 1])
+        argv_i += 1
+    elif a == '-raw' or a == '--raw':
+        arg_raw = True
+    elif a == '-b' or a == '--benchmark':
+        arg_benchmark = True
+    elif a == '-p' or a == '--plot':
+        arg_plot = True
+    elif a == '-s' or a == '--save':
+        arg_save = sys.argv[argv_i + 1]
+        argv_i += 1
+    elif a == '-w' or a == '--write':
+        arg_write = sys.argv[argv_i + 1]
+        argv_i += 1
+    elif a == '-r' or a == '--replay':
+        arg_replay = sys.argv[argv_i + 1]
+        argv_i += 1
+    else:
+        arg_port = a
+    argv_i += 1
+
+if arg_replay is None and arg_port is None:
+    print('! ERROR: No serial port given')
+    exit()
+if not 1 <= arg_decimation <= 0xFFFF or not 1 <= arg_channels <= 0xFF:
+    print('! ERROR: Invalid channels or decimation')
+    exit()
+
+# Open source of stream
+if arg_replay is not None:
+    if not os.path.isfile(arg_replay):
+        print(f'! ERROR: Cannot read path "{arg_replay}"')
+        exit()
+    source = open(arg_replay, 'rb')
+else:
+    import serial # Requires pyserial
+    source = serial.Serial(arg_port, timeout=0.1)
+    source.reset_input_buffer()
+    if arg_benchmark:
+        source.write(stream_sync + bytes((stream_cmd_benchmark,)))
+        print(f'Benchmark on "{arg_port}", stop with Ctrl+C')
+    else:
+        source.write(stream_sync + bytes((stream_cmd_start_raw if arg_raw else stream_cmd_start, arg_channels)) + struct.pack('<H', arg_decimation))
+        print(f'Streaming {"raw piezo data" if arg_raw else "data points"} from "{arg_port}" (channels 0x{arg_channels:02X}, decimation {arg_decimation}), stop with Ctrl+C')
+
+if arg_plot and enable_live_plot:
+    import matplotlib.pyplot as plt
+    plt.ion()
+    fig, ax = plt.subplots()
+    plot_lines = {}
+plot_data = [] # (time, values) within plot_duration
+
+csv_file = open(arg_save, 'w') if arg_save is not None else None
+raw_file = open(arg_write, 'wb') if arg_write is not None else None
+csv_names = None
+parser = StreamParser()
+time_start = time.time()
+time_stats = time_start
+try:
+    while arg_duration is None or time.time() - time_start < arg_duration:
+        data = source.read(4096)
+        if arg_replay is not None and len(data) == 0:
+            break
+        if raw_file is not None:
+            raw_file.write(data)
+        for names, samples in parser.feed(data):
+            if csv_file is not None:
+                if csv_names != names:
+                    csv_file.write(','.join(['time'] + names) + '\n')
+                    csv_names = names
+                for t, values in samples:
+                    csv_file.write(f'{t:.6f},' + ','.join(str(v) for v in values) + '\n')
+            if arg_plot and enable_live_plot:
+                plot_data += samples
+                plot_data = [s for s in plot_data if s[0] > samples[-1][0] - plot_duration]
+                for i, name in enumerate(names):
+                    if name not in plot_lines:
+                        plot_lines[name], = ax.plot([], [], label=name)
+                        ax.legend(loc='upper left')
+                    plot_lines[name].set_data([s[0] for s in plot_data], [s[1][i] for s in plot_data])
+                ax.relim()
+                ax.autoscale_view()
+        if arg_plot and enable_live_plot:
+            plt.pause(0.001)
+        if time.time() - time_stats >= 1.0 and arg_replay is None:
+            time_stats = time.time()
+            print(parser.stats(time.time() - time_start))
+except KeyboardInterrupt:
+    pass
+finally:
+    if arg_replay is None:
+        source.write(stream_sync + bytes((stream_cmd_stop,)))
+    source.close()
+    if csv_file is not None:
+        csv_file.close()
+        print(f'File "{arg_save}" written')
+    if raw_file is not None:
+        raw_file.close()
+print(parser.stats(time.time() - time_start))
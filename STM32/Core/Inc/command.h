@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2024 Mirco Heitmann
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ * command.h
+ *
+ * Command/control protocol via USB CDC (framed text commands, sent by Python/vera_cmd.py)
+ */
+
+#ifndef INC_COMMAND_H_
+#define INC_COMMAND_H_
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include "config.h"
+#include "stm32f7xx_hal.h"
+#include "usbd_cdc_if.h"
+
+// Request: [COMMAND_SYNC_1][COMMAND_SYNC_2][len][text (len bytes)][ck_a][ck_b], checksum (UBX) over len and text
+#define COMMAND_SYNC_1 'V'
+#define COMMAND_SYNC_2 'C'
+#define COMMAND_LEN_MAX 255
+// Reply: [COMMAND_SYNC_1][COMMAND_REPLY_SYNC_2][status][len (uint16)][text][ck_a][ck_b], checksum over status, len and text
+#define COMMAND_REPLY_SYNC_2 'R'
+#define COMMAND_REPLY_HEADER_LEN 5
+#define COMMAND_REPLY_LEN 1024
+#define COMMAND_STATUS_OK 0
+#define COMMAND_STATUS_ERROR 1
+// Reply is discarded if the host does not read it
+#define COMMAND_TX_TIMEOUT 1000
+
+// Commands returned by Command_Loop ("get" is answered by Command_Loop)
+typedef enum
+{
+	COMMAND_NONE,
+	COMMAND_SET, // set key=value ... | Change config, reconfigure sampling if necessary
+	COMMAND_SAVE, // save | Write config to config file
+	COMMAND_START, // start | Resume capture
+	COMMAND_STOP, // stop | Pause capture (acceleration data), timestamps continue
+	COMMAND_PAGE, // page | Start new page
+	COMMAND_STATS // stats | Query status and counters
+} Command_Type_t;
+
+typedef enum
+{
+	COMMAND_REPLY_FREE,
+	COMMAND_REPLY_READY,
+	COMMAND_REPLY_SENDING
+} Command_Reply_State_t;
+
+typedef struct
+{
+	// Request parser (USB IRQ)
+	uint8_t rx_frame[COMMAND_LEN_MAX + 3];
+	uint16_t rx_index;
+	uint32_t rx_errors;
+
+	// Received request text, valid until processed by Command_Loop
+	char line[COMMAND_LEN_MAX + 1];
+	volatile uint8_t flag_received;
+
+	// Reply frame, transmitted by Command_Loop or on TX complete
+	uint8_t reply[COMMAND_REPLY_HEADER_LEN + COMMAND_REPLY_LEN + 2];
+	uint16_t reply_len;
+	volatile Command_Reply_State_t reply_state;
+	uint32_t tx_start;
+} Command_t;
+
+void Command_Init(Command_t *hcommand);
+Command_Type_t Command_Loop(Command_t *hcommand, char **args);
+void Command_Reply(Command_t *hcommand, uint8_t status, const char *format, ...);
+void Command_Receive(Command_t *hcommand, uint8_t *buffer, uint32_t len);
+void Command_CDC_TxCplt(Command_t *hcommand, uint8_t *buffer);
+
+#endif /* INC_COMMAND_H_ */
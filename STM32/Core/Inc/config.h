@@ -15,63 +15,131 @@
 #include <string.h>
 
 #include "stm32f7xx_hal.h"
+#include "data_points.h"
 
-#define VERSION 1
+#define VERSION 2
 // Enable loading config file from SD if 1, otherwise use default defined in config.c
 #define LOAD_CONFIG 1
+// Format trace events on target and print them (console output) if 1, otherwise write binary trace file (_log.bin, decoded by Python/trace2txt.py)
+#define TRACE_TEXT 0
 
 // Compiled config
 #define OVERSAMPLING_RATIO_MAX 20
-#define PIEZO_COUNT_MAX 5
 #define A_BUFFER_LEN_MAX 4096
 #define P_BUFFER_LEN_MAX 128
+#define PSD_SEGMENT_LEN_MAX 512
+#define TRIGGER_BLOCK_LEN_MIN 16
+// Ring of 2 * A_BUFFER_LEN_MAX samples holds at least one pre-trigger block and 3 reserved blocks (TRIGGER_SLOTS_RESERVED)
+#define TRIGGER_BLOCK_LEN_MAX (2 * A_BUFFER_LEN_MAX / 4)
 #define NMEA_DATE_WAIT_DURATION 180000
 #define NMEA_PACKET_MERGE_DURATION 25
 #define NMEA_NO_PACKET_DURATION 5000
+#define NMEA_WARM_START_SAVE_INTERVAL 600000
+// Stop button is ignored at boot and after each press until released for this duration
+#define BUTTON_DEBOUNCE_DURATION 250
 
-// Format strings for saving/loading config file
-#define C_F_BOOT_WITHOUT_DATE "boot_without_date=%hhu"
-#define C_F_PRINT_ACCELERATION_DATA "print_acceleration_data=%hhu"
-#define C_F_PRINT_POSITION_DATA "print_position_data=%hhu"
-#define C_F_PIEZO_COUNT "piezo_count=%hhu"
-#define C_F_FIR_TYPE "fir_type=%hhu"
-#define C_F_ADXL_RANGE "adxl_range=%hu"
-#define C_F_PAGE_DURATION_MS "page_duration_ms=%lu"
-#define C_F_A_SAMPLING_RATE "a_sampling_rate=%lu"
-#define C_F_P_SAMPLING_RATE "p_sampling_rate=%lu"
-#define C_F_OVERSAMPLING_RATIO "oversampling_ratio=%hhu"
-#define C_F_A_BUFFER_LEN "a_buffer_len=%lu"
-#define C_F_P_BUFFER_LEN "p_buffer_len=%lu"
+// Config keys: X(name, type, default, min, max), saved in this order. Adding a key only requires a line here
+#define CONFIG_KEYS(X) \
+	/* Keep directory "0000-00-00" instead of renaming it to the GNSS date once received (capture always starts immediately) */ \
+	X(boot_without_date, uint8_t, 0, 0, 1) \
+	/* Print live acceleration as amplitude and offset */ \
+	X(print_acceleration_data, uint8_t, 0, 0, 1) \
+	/* Print live position, speed, altitude, GNSS time */ \
+	X(print_position_data, uint8_t, 0, 0, 1) \
+	/* Number of ADC channels */ \
+	X(piezo_count, uint8_t, 3, 1, PIEZO_COUNT_MAX) \
+	/* Select FIR taps (0: disable) */ \
+	X(fir_type, uint8_t, 1, 0, 7) \
+	/* ADXL357 measurement range (g) */ \
+	X(adxl_range, uint16_t, 40, 10, 40) \
+	/* Duration before switching to next page (file) in milliseconds (default: 30 minutes, 0: one page per run on exFAT, 4 GB pages on FAT32) */ \
+	X(page_duration_ms, uint32_t, 30 * 60 * 1000, 0, 100000000) \
+	/* Rate of saved acceleration samples (Sa/s) */ \
+	X(a_sampling_rate, uint32_t, 4000, 1, 100000) \
+	/* Rate of saved position samples (Sa/s) */ \
+	X(p_sampling_rate, uint32_t, 4, 1, 30) \
+	/* ADC sampling rate = a_sampling_rate * oversampling_ratio (default: 16 kSa/s) */ \
+	X(oversampling_ratio, uint8_t, 4, 1, OVERSAMPLING_RATIO_MAX) \
+	/* Length of acceleration data point buffer (write to SD-card every (4096 Sa) / (4 kSa/s) = 1.024 s) */ \
+	/* This option can have a huge impact on RAM usage, it can be reduced if the main function has enough time to save one buffer before the other is filled */ \
+	X(a_buffer_len, uint32_t, 4096, 1, A_BUFFER_LEN_MAX) \
+	/* Length of position data point buffer (write to SD-card every (128 Sa) / (40 Sa/s) = 3.2 s) */ \
+	X(p_buffer_len, uint32_t, 32, 1, P_BUFFER_LEN_MAX) \
+	/* ADXL357 axis in direction of travel for track distance (1: x, 2: y, 3: z, negative if mounted reversed, 0: disable) */ \
+	X(track_axis, int8_t, 1, -3, 3) \
+	/* Samples per segment of power spectral density (0: disable, 32 to PSD_SEGMENT_LEN_MAX, power of two, e.g. 512), resolution a_sampling_rate / psd_segment_len */ \
+	X(psd_segment_len, uint16_t, 0, 0, PSD_SEGMENT_LEN_MAX) \
+	/* Segments averaged per spectrum (default: 16 * 256 Sa / (4 kSa/s) = 1.024 s per spectrum) */ \
+	X(psd_average_count, uint16_t, 16, 1, 1000) \
+	/* Capture mode (0: continuous, 1: triggered, only event windows around triggered blocks are saved, listed in "_events.bin") */ \
+	X(trigger_mode, uint8_t, 0, 0, 1) \
+	/* Samples per block of triggered capture, triggers are evaluated per block (default: 256 Sa / (4 kSa/s) = 64 ms, replaces a_buffer_len) */ \
+	X(trigger_block_len, uint16_t, 256, TRIGGER_BLOCK_LEN_MIN, TRIGGER_BLOCK_LEN_MAX) \
+	/* History saved before first triggered block in milliseconds (kept in acceleration buffers: max. 2 * A_BUFFER_LEN_MAX samples minus 3 blocks, longer history is limited) */ \
+	X(trigger_pre_ms, uint32_t, 500, 0, 60000) \
+	/* Data saved after last triggered block in milliseconds (event is extended by each triggered block) */ \
+	X(trigger_post_ms, uint32_t, 1000, 0, 600000) \
+	/* Trigger if peak deviation of a piezo channel from block mean exceeds this value (ADC LSB, 0: disable) */ \
+	X(trigger_piezo_peak, uint16_t, 500, 0, 4095) \
+	/* Trigger if RMS (without mean) of a MEMS axis exceeds this value (ADXL357 LSB, 0: disable) */ \
+	X(trigger_mems_rms, uint32_t, 0, 0, 524287) \
+	/* Trigger if kurtosis of a piezo channel exceeds this value / 100 (impulses, normal distribution: 300, 0: disable) */ \
+	X(trigger_kurtosis, uint16_t, 0, 0, 10000) \
+	/* Triggers are only accepted at GNSS speeds (km/h) from trigger_speed_min to trigger_speed_max (0: disable), without thresholds all blocks in this window are saved */ \
+	X(trigger_speed_min, uint16_t, 0, 0, 500) \
+	X(trigger_speed_max, uint16_t, 0, 0, 500) \
+	/* Band-pass of piezo channels for envelope analysis (Hz, disabled if not below a_sampling_rate / 2, envelope_band_low 0: disable, e.g. 500) */ \
+	X(envelope_band_low, uint16_t, 0, 0, 50000) \
+	X(envelope_band_high, uint16_t, 1500, 1, 50000) \
+	/* Impact: envelope exceeds its running mean by this factor / 100 (counted per revolution) */ \
+	X(envelope_impact_ratio, uint16_t, 300, 101, 10000) \
+	/* Wheel diameter in millimeters, envelope records are split per revolution of track distance */ \
+	X(wheel_diameter_mm, uint16_t, 920, 100, 2000) \
+	/* Statistics of each acceleration buffer (min, max, mean, RMS, peak, kurtosis, clipped samples) for all channels in "s_X.bin" (1: enable) */ \
+	X(block_stats, uint8_t, 0, 0, 1) \
+	/* Provide SD card as USB mass storage device after capture stopped (1: enable) */ \
+	X(usb_mass_storage, uint8_t, 0, 0, 1)
 
 typedef struct
 {
-	// Skip waiting for date from GNSS module, start capture immediately (in directory "0000-00-00")
-	uint8_t boot_without_date;
-	// Print live acceleration as amplitude and offset
-	uint8_t print_acceleration_data;
-	// Print live position, speed, altitude, GNSS time
-	uint8_t print_position_data;
-	// Number of ADC channels
-	uint8_t piezo_count;
-	// Select FIR taps (0: disable)
-	uint8_t fir_type;
-	// ADXL357 measurement range
-	uint16_t adxl_range;
-	// Duration before switching to next page (file) in milliseconds
-	uint32_t page_duration_ms;
-	// Rate of saved acceleration samples
-	uint32_t a_sampling_rate;
-	// Rate of saved position samples
-	uint32_t p_sampling_rate;
-	// ADC sampling rate = a_sampling_rate * oversampling_ratio
-	uint8_t oversampling_ratio;
-	// Length of acceleration data point buffer (write to SD-card every (4096 Sa) / (4 kSa/s) = 1.024 s)
-	// This option can have a huge impact on RAM usage, it can be reduced if the main function has enough time to save one buffer before the other is filled
-	uint32_t a_buffer_len;
-	// Length of position data point buffer (write to SD-card every (128 Sa) / (40 Sa/s) = 3.2 s)
-	uint32_t p_buffer_len;
+#define X(name, type, def, min, max) type name;
+	CONFIG_KEYS(X)
+#undef X
 } config_t;
 
+// Type of config value (CONFIG_TYPE_ ## type)
+typedef enum
+{
+	CONFIG_TYPE_uint8_t,
+	CONFIG_TYPE_uint16_t,
+	CONFIG_TYPE_uint32_t,
+	CONFIG_TYPE_int8_t
+} Config_Type_t;
+
+typedef struct
+{
+	const char *name;
+	Config_Type_t type;
+	uint16_t offset;
+	int32_t min;
+	int32_t max;
+} Config_Key_t;
+
+// Longest "key=value" token, longer tokens are ignored
+#define CONFIG_TOKEN_LEN_MAX 64
+// Buffer size for Config_Save (all keys)
+#define CONFIG_SAVE_LEN 1024
+// Hash table for key lookup (power of two, larger than number of keys)
+#define CONFIG_HASH_SIZE 64
+
+// Parser state, config text can be passed in chunks of any size
+typedef struct
+{
+	char token[CONFIG_TOKEN_LEN_MAX + 1];
+	uint8_t len;
+	uint8_t overflow;
+} Config_Parser_t;
+
 extern config_t default_config, config;
 
 #define DEBUG1 HAL_GPIO_TogglePin(Debug1_GPIO_Port, Debug1_Pin);
@@ -80,9 +148,9 @@ extern config_t default_config, config;
 // Following defines are called at start and end of a function -> Debug pin is high for entire duration
 // While loop in main function
 #define DEBUG_MAIN_LOOP ;
-// Saving a_buffer_1 to a file
+// Saving hbuffer_a.buffer_1 to a file
 #define DEBUG_A_BUFFER_1_SD ;
-// Saving a_buffer_2 to a file
+// Saving hbuffer_a.buffer_2 to a file
 #define DEBUG_A_BUFFER_2_SD ;
 // Saving p_buffer_1 to a file
 #define DEBUG_P_BUFFER_1_SD ;
@@ -104,9 +172,14 @@ extern config_t default_config, config;
 #define DEBUG_TEST_FIR_DAC 0
 #define DEBUG_TEST_PRINT_NEW_PAGE 0
 #define DEBUG_TEST_FAST_BOOT 0
+#define DEBUG_TEST_NMEA_BENCHMARK 0
+#define DEBUG_TEST_NMEA_RESTART 0
 
 void Config_Default(void);
+void Config_Parse(Config_Parser_t *hparser, const char *data, uint32_t len);
+void Config_Parse_End(Config_Parser_t *hparser);
 void Config_Load(char *buffer, uint32_t size);
+HAL_StatusTypeDef Config_Update(config_t *c, const char *buffer, char *error, uint32_t error_size);
 void Config_Save(char *buffer, uint32_t size);
 HAL_StatusTypeDef Config_Init(ADC_HandleTypeDef *hadc1, TIM_HandleTypeDef *htim2, TIM_HandleTypeDef *htim3);
 
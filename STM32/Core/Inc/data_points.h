@@ -6,17 +6,23 @@
  * LICENSE file in the root directory of this source tree.
  *
  * data_points.h
+ *
+ * Layout of data files, without dependencies on HAL (also included by the host decoder in Decoder/)
  */
 
 #ifndef INC_DATA_POINTS_H_
 #define INC_DATA_POINTS_H_
 
-#include "config.h"
+#include <stdint.h>
+
+// Piezo channels of a_data_point_t (compiled config)
+#define PIEZO_COUNT_MAX 5
 
 // Positions of complete bits (bit 0 = timestamp complete, bit 1 = MEMS complete, etc.)
 #define A_COMPLETE_TIMESTAMP 0
 #define A_COMPLETE_MEMS 1
 #define A_COMPLETE_PZ 2
+#define A_COMPLETE_DISTANCE 3
 
 #define P_COMPLETE_TIMESTAMP 0
 #define P_COMPLETE_GNSS_TIME 1
@@ -43,6 +49,7 @@ typedef struct
 	uint16_t temp_mems1;
 	int32_t xyz_mems1[3];
 	int16_t a_piezo[PIEZO_COUNT_MAX];
+	float distance; // Track distance since start of capture (m)
 } a_data_point_t;
 
 typedef struct
@@ -69,4 +76,107 @@ typedef struct
 	float altitude;
 } p_data_point_t;
 
+typedef struct
+{
+	uint8_t version;
+	uint32_t boot_duration;
+	uint32_t a_sampling_rate;
+	uint16_t segment_len; // Samples per segment (Hann window, overlapped by half)
+	uint16_t average_count; // Segments per spectrum
+	uint8_t channel_count; // MEMS x, y, z followed by piezo channels
+} f_data_header_t;
+
+// Spectrum, followed by bin_count bins (int16, 0.01 dB of PSD in LSB^2/Hz) per channel (one-sided, bin i at i * a_sampling_rate / segment_len)
+typedef struct
+{
+	uint32_t timestamp; // First sample of first segment
+	uint16_t segment_count;
+	uint16_t bin_count;
+} f_data_point_t;
+
+typedef struct
+{
+	uint8_t version;
+	uint32_t boot_duration;
+	uint32_t a_sampling_rate;
+} e_data_header_t;
+
+// Event of triggered capture (events spanning several pages have one record per page with the same event_num)
+typedef struct
+{
+	uint32_t event_num; // Since boot
+	uint32_t page_num; // Acceleration file (a_X.bin) of data points
+	uint32_t offset; // Position of first data point in acceleration file (bytes)
+	uint32_t point_count;
+	uint32_t timestamp_start; // First data point (including pre-trigger history)
+	uint32_t timestamp_trigger; // First triggered block
+	uint8_t sources; // Trigger sources of triggered blocks (TRIGGER_SOURCE_XXX bits)
+	uint8_t reserved[3];
+	// Maximum of triggered blocks: piezo peak deviation from mean (ADC LSB), MEMS RMS (LSB), piezo kurtosis
+	float piezo_peak;
+	float mems_rms;
+	float kurtosis;
+	float speed; // GNSS speed at trigger (km/h, negative if unknown)
+} e_data_point_t;
+
+typedef struct
+{
+	uint8_t version;
+	uint32_t boot_duration;
+	uint32_t a_sampling_rate;
+	uint16_t band_low; // Band-pass of piezo signal before envelope (Hz)
+	uint16_t band_high;
+	uint16_t wheel_diameter; // Records per wheel revolution (mm)
+	uint16_t impact_ratio; // Impact: envelope exceeds baseline by this factor (x100)
+	uint8_t channel_count; // Piezo channels
+} h_data_header_t;
+
+// Envelope record (one wheel revolution), followed by channel_count h_data_channel_t
+typedef struct
+{
+	uint32_t timestamp; // First sample
+	uint32_t sample_count;
+	float distance; // Track distance at first sample (m)
+	uint8_t revolution; // 1: record is a complete wheel revolution, 0: ended by timeout or gap
+	uint8_t reserved[3];
+} h_data_point_t;
+
+typedef struct
+{
+	uint16_t impacts; // Rising edges of envelope above impact threshold
+	uint16_t reserved;
+	// Band-passed signal: crest factor (peak / RMS), kurtosis
+	float crest;
+	float kurtosis;
+	// Envelope (ADC LSB)
+	float envelope_rms;
+	float envelope_peak;
+} h_data_channel_t;
+
+typedef struct
+{
+	uint8_t version;
+	uint32_t boot_duration;
+	uint32_t a_sampling_rate;
+	uint8_t channel_count; // MEMS x, y, z followed by piezo channels
+} s_data_header_t;
+
+// Statistics of one acceleration buffer (block in triggered capture), followed by channel_count s_data_channel_t
+typedef struct
+{
+	uint32_t timestamp; // First sample
+	uint32_t sample_count;
+} s_data_point_t;
+
+typedef struct
+{
+	int32_t min;
+	int32_t max;
+	float mean;
+	float rms; // Without mean
+	float peak; // Maximum deviation from mean
+	float kurtosis;
+	uint32_t clipped; // Samples at full scale (STATS_MEMS_CLIP, STATS_PIEZO_CLIP)
+} s_data_channel_t;
+
 #endif /* INC_DATA_POINTS_H_ */
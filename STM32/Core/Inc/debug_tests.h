@@ -16,11 +16,16 @@
 #include "config.h"
 #include "fir.h"
 #include "data_points.h"
+#include "nmea.h"
+#include "platform.h"
+#include "trace.h"
 
 void Debug_test_fast_boot(ADC_HandleTypeDef *hadc1, TIM_HandleTypeDef *htim2, TIM_HandleTypeDef *htim3, uint16_t *pz_dma_buffer);
 void Debug_test_print_config();
 void Debug_test_FIR_frequency_sweep(FIR_t *hfir);
-void Debug_test_print_a(volatile a_data_point_t *buffer);
+void Debug_test_print_a(volatile a_data_point_t *buffer, uint32_t len);
 void Debug_test_print_p(volatile p_data_point_t *dp);
+void Debug_test_NMEA_benchmark(NMEA_t *hnmea);
+void Debug_test_NMEA_restart(NMEA_t *hnmea);
 
 #endif /* INC_DEBUG_TESTS_H_ */
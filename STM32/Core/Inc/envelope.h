@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2024 Mirco Heitmann
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ * envelope.h
+ *
+ * Envelope analysis of piezo channels (impacts per wheel revolution), written to envelope files (h_X.bin, read by Python/vera_envelope.py)
+ */
+
+#ifndef INC_ENVELOPE_H_
+#define INC_ENVELOPE_H_
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "config.h"
+#include "sd.h"
+#include "data_points.h"
+#include "platform.h"
+#include "stm32f7xx_hal.h"
+#include "arm_math.h"
+
+#define ENVELOPE_VERSION 1
+// Samples filtered per call of CMSIS biquad functions
+#define ENVELOPE_CHUNK_LEN 128
+// Envelope is evaluated at sampling rate / ENVELOPE_DECIMATION, low-pass at 0.4 * decimated rate
+#define ENVELOPE_DECIMATION 8
+// Record is closed after this duration without completed revolution (standstill, track distance disabled)
+#define ENVELOPE_RECORD_MS_MAX 2000
+// Time constant of running mean of envelope (impact threshold)
+#define ENVELOPE_BASELINE_MS 1000
+// Records buffered before writing to SD
+#define ENVELOPE_SAVE_LEN 2048
+// Envelope analysis is disabled if processing of a buffer takes longer than this share of the buffer duration (percent)
+#define ENVELOPE_LOAD_MAX 15
+
+#define ENVELOPE_RECORD_LEN (sizeof(h_data_point_t) + PIEZO_COUNT_MAX * sizeof(h_data_channel_t))
+
+typedef struct
+{
+	Vera_SD_t *hvsd;
+	// Acceleration sampling rate (Sa/s), number of piezo channels
+	uint32_t sampling_rate;
+	uint8_t piezo_count;
+	// Band-pass of piezo signal (Hz, band_low 0: disable)
+	uint16_t band_low;
+	uint16_t band_high;
+	// Impact: envelope exceeds running mean by impact_ratio / 100
+	uint16_t impact_ratio;
+	// Wheel circumference (m)
+	float circumference;
+
+	uint8_t active;
+	// Band-pass (high-pass and low-pass stage) and envelope low-pass, coefficients {b0, b1, b2, -a1, -a2}
+	float band_coeffs[2 * 5];
+	float smooth_coeffs[5];
+	arm_biquad_casd_df1_inst_f32 band[PIEZO_COUNT_MAX];
+	arm_biquad_casd_df1_inst_f32 smooth[PIEZO_COUNT_MAX];
+	float band_state[PIEZO_COUNT_MAX][2 * 4];
+	float smooth_state[PIEZO_COUNT_MAX][4];
+	float chunk_in[ENVELOPE_CHUNK_LEN];
+	float chunk_band[PIEZO_COUNT_MAX][ENVELOPE_CHUNK_LEN];
+	float chunk_env[PIEZO_COUNT_MAX][ENVELOPE_CHUNK_LEN];
+	uint8_t decimation_phase;
+	uint8_t filter_valid; // Filter states are set with first sample after gap
+	uint32_t next_timestamp;
+
+	// Impact detection per channel
+	float baseline[PIEZO_COUNT_MAX];
+	float baseline_alpha;
+	uint8_t impact_armed[PIEZO_COUNT_MAX];
+
+	// Current record
+	uint32_t record_timestamp;
+	uint32_t record_len;
+	uint32_t record_len_max;
+	float record_distance;
+	uint8_t record_distance_valid;
+	float m2[PIEZO_COUNT_MAX];
+	float m4[PIEZO_COUNT_MAX];
+	float peak[PIEZO_COUNT_MAX];
+	float env_m2[PIEZO_COUNT_MAX];
+	float env_peak[PIEZO_COUNT_MAX];
+	uint32_t env_count;
+	uint16_t impacts[PIEZO_COUNT_MAX];
+
+	// Records not yet written
+	uint8_t save_buffer[ENVELOPE_SAVE_LEN] __attribute__((aligned(4)));
+	uint16_t save_len;
+
+	// Processing time (DWT cycles) of last buffer and load (per mille of buffer duration)
+	uint32_t cycles;
+	uint32_t cycles_max;
+	uint32_t cycles_write; // SD writes of records, not included in load
+	uint16_t load;
+	uint32_t record_count;
+	uint32_t impact_count;
+} Envelope_t;
+
+HAL_StatusTypeDef Envelope_Init(Envelope_t *henvelope);
+void Envelope_Write(Envelope_t *henvelope, volatile a_data_point_t *buffer, uint32_t len);
+HAL_StatusTypeDef Envelope_Flush(Envelope_t *henvelope);
+
+#endif /* INC_ENVELOPE_H_ */
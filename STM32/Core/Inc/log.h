@@ -16,25 +16,54 @@
 
 #include "config.h"
 #include "sd.h"
-#include "double_buffering.h"
+#include "ring_buffer.h"
 #include "stm32f7xx_hal.h"
 #include "usbd_cdc_if.h"
 
-#define LOG_BUFFER_LEN 2048
+// Queue of _write spans (power of two)
+#define LOG_RING_SIZE 8192
+// Block transmitted at once via UART DMA and USB CDC
+#define LOG_TX_BUFFER_LEN 1024
+// Batch of SD log file appends
+#define LOG_SD_BUFFER_LEN 4096
+// USB host not reading if transfer is not completed after this duration
+#define LOG_CDC_TIMEOUT 100
 
 typedef struct {
 	Vera_SD_t *hvsd;
 	UART_HandleTypeDef *huart;
+	// Maximum duration before log is appended to log file
 	uint32_t flush_timeout;
+	// Written by printf (main context only), read by Log_Loop
+	Ring_Buffer_t ring;
+	uint8_t ring_buffer[LOG_RING_SIZE] __attribute__((aligned(4)));
+	// Blocks in transmission via UART DMA and USB CDC, USB transfer not completed in time keeps its buffer
+	uint8_t tx_buffer[2][LOG_TX_BUFFER_LEN];
+	uint8_t tx_index;
+	uint32_t tx_len;
+	volatile uint8_t uart_busy;
+	volatile uint8_t cdc_busy;
+	uint8_t cdc_index;
+	// USB host not reading, blocks are not sent via USB CDC until the transfer completes
+	volatile uint8_t cdc_stalled;
+	// USB CDC is used by live streaming
+	uint8_t cdc_disabled;
+	uint32_t tx_start;
+	// Batched log file appends
+	char sd_buffer[LOG_SD_BUFFER_LEN];
+	uint32_t sd_len;
 	uint32_t last_write;
-	char buffer_1[LOG_BUFFER_LEN];
-	char buffer_2[LOG_BUFFER_LEN];
-	Double_Buffer_t hbuffer;
+	// printf calls from interrupts are dropped (queue has a single producer)
+	volatile uint32_t isr_dropped;
+	uint32_t isr_dropped_reported;
 } Log_t;
 
 void Log_Init(Log_t *hlog);
 void Log_Uninit(Log_t *hlog);
 void Log_Loop(Log_t *hlog);
-void Log_Char(Log_t *hlog, char c);
+void Log_Flush(Log_t *hlog);
+int Log_Write(Log_t *hlog, const char *data, int len);
+void Log_UART_TxCplt(Log_t *hlog);
+void Log_CDC_TxCplt(Log_t *hlog);
 
 #endif /* INC_LOG_H_ */
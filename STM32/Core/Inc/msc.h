@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2024 Mirco Heitmann
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ * msc.h
+ *
+ * USB mass storage mode (Bulk-Only Transport, SCSI) exposing the SD card while capture is stopped
+ */
+
+#ifndef INC_MSC_H_
+#define INC_MSC_H_
+
+#include <stdio.h>
+#include <string.h>
+
+#include "stm32f7xx_hal.h"
+#include "usbd_core.h"
+#include "usbd_ctlreq.h"
+#include "usbd_desc.h"
+#include "diskio.h"
+
+// USB endpoints and product ID (re-enumerates as different device than CDC)
+#define MSC_EP_IN 0x81
+#define MSC_EP_OUT 0x01
+#define MSC_PACKET_SIZE USB_FS_MAX_PACKET_SIZE
+#define MSC_PID 22314
+#define MSC_CONFIG_DESC_SIZE 32
+
+// SD card sectors per transfer buffer (two buffers, SD and USB transfers overlap)
+#define MSC_BLOCK_SIZE 512
+#define MSC_BUFFER_SECTORS 32
+#define MSC_BUFFER_SIZE (MSC_BUFFER_SECTORS * MSC_BLOCK_SIZE)
+// Abort command if a transfer does not complete (host gone)
+#define MSC_TIMEOUT 5000
+
+// Bulk-Only Transport
+#define MSC_BOT_GET_MAX_LUN 0xFE
+#define MSC_BOT_RESET 0xFF
+#define MSC_CBW_SIGNATURE 0x43425355
+#define MSC_CSW_SIGNATURE 0x53425355
+#define MSC_CBW_LEN 31
+#define MSC_CSW_LEN 13
+#define MSC_CSW_PASSED 0
+#define MSC_CSW_FAILED 1
+
+// SCSI commands
+#define MSC_SCSI_TEST_UNIT_READY 0x00
+#define MSC_SCSI_REQUEST_SENSE 0x03
+#define MSC_SCSI_INQUIRY 0x12
+#define MSC_SCSI_MODE_SENSE6 0x1A
+#define MSC_SCSI_START_STOP_UNIT 0x1B
+#define MSC_SCSI_ALLOW_MEDIUM_REMOVAL 0x1E
+#define MSC_SCSI_READ_FORMAT_CAPACITIES 0x23
+#define MSC_SCSI_READ_CAPACITY10 0x25
+#define MSC_SCSI_READ10 0x28
+#define MSC_SCSI_WRITE10 0x2A
+#define MSC_SCSI_VERIFY10 0x2F
+#define MSC_SCSI_MODE_SENSE10 0x5A
+
+// SCSI sense keys and additional sense codes
+#define MSC_SENSE_NO_SENSE 0x00
+#define MSC_SENSE_NOT_READY 0x02
+#define MSC_SENSE_MEDIUM_ERROR 0x03
+#define MSC_SENSE_ILLEGAL_REQUEST 0x05
+#define MSC_ASC_INVALID_COMMAND 0x20
+#define MSC_ASC_ADDRESS_OUT_OF_RANGE 0x21
+#define MSC_ASC_MEDIUM_NOT_PRESENT 0x3A
+#define MSC_ASC_READ_ERROR 0x11
+#define MSC_ASC_WRITE_FAULT 0x03
+
+typedef struct
+{
+	uint32_t signature;
+	uint32_t tag;
+	uint32_t data_length;
+	uint8_t flags;
+	uint8_t lun;
+	uint8_t cb_length;
+	uint8_t cb[16];
+} __attribute__((packed)) MSC_CBW_t;
+
+typedef struct
+{
+	uint32_t signature;
+	uint32_t tag;
+	uint32_t residue;
+	uint8_t status;
+} __attribute__((packed)) MSC_CSW_t;
+
+typedef struct
+{
+	USBD_HandleTypeDef *pdev;
+	// FatFs physical drive of SD card (file system must be unmounted)
+	BYTE pdrv;
+	// Transfer buffers of MSC_BUFFER_SIZE bytes (4 byte aligned), memory unused after capture is provided by caller
+	uint8_t *buffer[2];
+
+	// Card
+	uint8_t ready;
+	DWORD block_count;
+	uint8_t sense_key;
+	uint8_t sense_asc;
+
+	// Set in USB IRQ, handled in MSC_Loop
+	volatile uint8_t flag_reset;
+	volatile uint8_t flag_rx;
+	volatile uint8_t flag_tx;
+	volatile uint8_t flag_clear_halt;
+	volatile uint32_t rx_len;
+	// Invalid CBW, endpoints stay stalled until reset recovery
+	volatile uint8_t halted;
+	uint8_t cbw_armed;
+
+	MSC_CBW_t cbw __attribute__((aligned(4)));
+	MSC_CSW_t csw __attribute__((aligned(4)));
+	uint8_t response[64] __attribute__((aligned(4)));
+} MSC_t;
+
+extern USBD_ClassTypeDef USBD_MSC_SD;
+
+HAL_StatusTypeDef MSC_Start(MSC_t *hmsc);
+void MSC_Loop(MSC_t *hmsc);
+
+#endif /* INC_MSC_H_ */
@@ -20,6 +20,8 @@
 
 #include "config.h"
 #include "stm32f7xx_hal.h"
+#include "ring_buffer.h"
+#include "trace.h"
 
 // NMEA talker ID
 #define NMEA_TALKER_GPS 'P'
@@ -64,10 +66,68 @@
 #define UBX_RESET_MODE_GNSS_STOP 0x08
 #define UBX_RESET_MODE_GNSS_START 0x09
 
+// Delay to let GNSS module boot, before configuring baud rate
+#define NMEA_BOOT_DURATION 1000
+// Delay after changing baud rate, before configuring further
+#define NMEA_BAUD_DURATION 250
+
+// Transmit buffer for single PUBX or UBX packet
+#define NMEA_TX_BUFFER_SIZE 100
+// Receive buffer for single UBX packet (sync chars, header, payload, checksum)
+#define NMEA_UBX_RX_BUFFER_SIZE 256
+// Buffer for navigation database dump (UBX-MGA-DBD packets) for warm start
+#define NMEA_DBD_BUFFER_SIZE 8192
+// Database dump is complete if no UBX-MGA-DBD packet was received for this duration
+#define NMEA_DBD_QUIET_DURATION 500
+// Database dump is cancelled if no UBX-MGA-DBD packet was received after this duration
+#define NMEA_DBD_TIMEOUT 3000
+// Next aiding packet is sent if previous one was not acknowledged (UBX-MGA-ACK) within this duration
+#define NMEA_MGA_ACK_TIMEOUT 250
+// Accuracy of saved position for warm start in cm (distance travelled while switched off)
+#define NMEA_AIDING_POS_ACC 10000000
+// Accuracy of saved time for warm start in s, 0 disables time aiding (saved time is only correct if the receiver is powered off shortly)
+#define NMEA_AIDING_TIME_ACC 0
+
+#define NMEA_UBX_ACK_NONE 0
+#define NMEA_UBX_ACK 1
+#define NMEA_UBX_NAK 2
+
+typedef enum
+{
+	NMEA_STATE_BOOT, // Waiting for GNSS module to boot
+	NMEA_STATE_PORT, // Waiting for transmission of baud rate before switching UART
+	NMEA_STATE_BAUD, // Baud rate changed, waiting for GNSS module to switch
+	NMEA_STATE_RATE, // Waiting for UBX-CFG-RATE ACK
+	NMEA_STATE_NAVX5, // Waiting for UBX-CFG-NAVX5 ACK (acknowledgement of aiding enabled)
+	NMEA_STATE_AIDING, // Sending saved state and navigation database for warm start, each packet after UBX-MGA-ACK of previous one
+	NMEA_STATE_READY,
+	NMEA_STATE_ERROR
+} NMEA_State_t;
+
 // NMEA buffer sizes
 #define NMEA_RX_BUFFER_SIZE 128
 #define NMEA_DMA_BUFFER_SIZE 1
-#define NMEA_CIRCULAR_BUFFER_SIZE 32
+// Size of received line queue in bytes (power of two), each line takes 8 bytes plus its length
+#define NMEA_LINE_RING_SIZE 4096
+// Maximum number of comma separated fields per sentence (GSV: 20 + signal ID)
+#define NMEA_FIELDS_MAX 24
+// Maximum number of decimals kept by fixed-point parser
+#define NMEA_FIXED_DECIMALS_MAX 9
+
+// Fixed-point decimal number as received (value = 4807038, decimals = 3 -> 4807.038)
+typedef struct
+{
+	int32_t value;
+	uint8_t decimals;
+	uint8_t valid; // 0 if field was empty
+} NMEA_Fixed_t;
+
+// Start index of each field in line (single pass over line, also checks checksum)
+typedef struct
+{
+	uint8_t field_count;
+	uint8_t field_start[NMEA_FIELDS_MAX];
+} NMEA_Tokens_t;
 
 typedef struct
 {
@@ -94,45 +154,101 @@ typedef struct
 	float second;
 } NMEA_Data_t;
 
+// Last known receiver state, saved to SD card for warm start
+#define NMEA_WARM_START_VERSION 1
+
+typedef struct
+{
+	uint8_t version;
+	uint8_t position_valid;
+	uint8_t time_valid;
+	int32_t lat, lon; // 1e-7 deg
+	int32_t altitude; // cm
+	uint16_t year;
+	uint8_t month;
+	uint8_t day;
+	uint8_t hour;
+	uint8_t minute;
+	float second;
+} NMEA_WarmStart_t;
+
+// Talker IDs (after 'G') with own GSV packets: GPS, GLONASS, Galileo, BeiDou, QZSS
+#define NMEA_GSV_TALKERS "PLABQ"
+#define NMEA_GSV_TALKER_COUNT (sizeof(NMEA_GSV_TALKERS) - 1)
+
+// Receiver status from GSA/GSV packets
+typedef struct
+{
+	uint8_t fix_type; // 1: no fix, 2: 2D, 3: 3D
+	uint8_t satellites_used;
+	uint8_t satellites_in_view; // Sum of all constellations
+	uint8_t satellites_in_view_talker[NMEA_GSV_TALKER_COUNT]; // Per talker ID of NMEA_GSV_TALKERS
+	float pdop;
+	float hdop;
+} NMEA_Status_t;
+
+// Entry of line queue, buffer is null terminated line of variable length
 typedef struct
 {
 	uint32_t timestamp;
-	volatile char buffer[NMEA_RX_BUFFER_SIZE];
+	char buffer[];
 } NMEA_Line_t;
 
 typedef struct
 {
+	NMEA_State_t state;
+	uint32_t state_time; // Time of last state change
 	UART_HandleTypeDef *huart;
 	uint32_t tx_timeout;
 	uint32_t rx_timeout;
 	uint32_t baud;
 	uint8_t sampling_rate;
+	// Interrupt-driven transmission of tx_buffer or dbd_buffer (completed in NMEA_TxCplt)
+	uint8_t tx_buffer[NMEA_TX_BUFFER_SIZE];
+	volatile uint8_t tx_busy;
+	uint32_t tx_start;
 	volatile char dma_buffer[NMEA_DMA_BUFFER_SIZE];
 	volatile char rx_buffer[NMEA_RX_BUFFER_SIZE];
 	volatile uint16_t rx_buffer_write_index;
 	volatile uint8_t overflow_rx_buffer;
 	volatile char line_buffer[NMEA_RX_BUFFER_SIZE];
-	volatile uint32_t circular_read_index;
-	volatile uint32_t circular_write_index;
-	volatile NMEA_Line_t circular_buffer[NMEA_CIRCULAR_BUFFER_SIZE];
-	volatile uint8_t overflow_circular_buffer;
+	volatile uint32_t line_timestamp;
+	Ring_Buffer_t line_ring;
+	volatile uint8_t line_ring_buffer[NMEA_LINE_RING_SIZE] __attribute__((aligned(4)));
 	uint16_t last_ubx_header;
+	volatile uint8_t ubx_rx_buffer[NMEA_UBX_RX_BUFFER_SIZE];
+	volatile uint16_t ubx_rx_index;
+	volatile uint8_t ubx_ack; // See #define NMEA_UBX_ACK_XXX
+	// Warm start: state and database to send after configuration, database dump received from module
+	NMEA_WarmStart_t warm_start;
+	volatile uint8_t dbd_buffer[NMEA_DBD_BUFFER_SIZE];
+	volatile uint16_t dbd_len;
+	volatile uint32_t dbd_dropped; // Bytes of database dump not fitting into dbd_buffer
+	uint16_t dbd_tx_index;
+	uint8_t aiding_step; // Next UBX-MGA-INI packet of warm start
+	uint8_t mga_msg_id; // ID of last transmitted UBX-MGA packet (0: none)
+	volatile uint8_t mga_ack; // UBX-MGA-ACK of last transmitted UBX-MGA packet, see #define NMEA_UBX_ACK_XXX
+	uint16_t aiding_rejected; // Aiding packets not acknowledged
+	volatile uint8_t dbd_receiving;
+	volatile uint32_t dbd_last_rx;
+	int32_t last_rmc_time; // Time of last RMC packet (used to skip redundant GLL packets)
+	NMEA_Status_t status;
 } NMEA_t;
 
 extern const char nmea_pformat_rmc[];
 
 typedef struct
 {
-	float time;
+	NMEA_Fixed_t time;
 	char status;
-	float lat;
+	NMEA_Fixed_t lat;
 	char lat_dir;
-	float lon;
+	NMEA_Fixed_t lon;
 	char lon_dir;
-	float speed_kn;
-	float track;
+	NMEA_Fixed_t speed_kn;
+	NMEA_Fixed_t track;
 	int32_t date;
-	float magvar;
+	NMEA_Fixed_t magvar;
 	char magvar_dir;
 	char mode; // See #define NMEA_MODE_XXX
 } NMEA_Packet_RMC_t;
@@ -141,19 +257,19 @@ extern const char nmea_pformat_gga[];
 
 typedef struct
 {
-	float time;
-	float lat;
+	NMEA_Fixed_t time;
+	NMEA_Fixed_t lat;
 	char lat_dir;
-	float lon;
+	NMEA_Fixed_t lon;
 	char lon_dir;
 	char quality;
 	int32_t num_SV;
-	float HDOP;
-	float altitude;
+	NMEA_Fixed_t HDOP;
+	NMEA_Fixed_t altitude;
 	char M1;
-	float sep;
+	NMEA_Fixed_t sep;
 	char M2;
-	float diff_age;
+	NMEA_Fixed_t diff_age;
 	int32_t diff_station;
 } NMEA_Packet_GGA_t;
 
@@ -161,11 +277,11 @@ extern const char nmea_pformat_gll[];
 
 typedef struct
 {
-	float lat;
+	NMEA_Fixed_t lat;
 	char lat_dir;
-	float lon;
+	NMEA_Fixed_t lon;
 	char lon_dir;
-	float time;
+	NMEA_Fixed_t time;
 	char status;
 	char mode; // See #define NMEA_MODE_XXX
 } NMEA_Packet_GLL_t;
@@ -174,17 +290,49 @@ extern const char nmea_pformat_vtg[];
 
 typedef struct
 {
-	float track;
+	NMEA_Fixed_t track;
 	char T;
-	float track_mag;
+	NMEA_Fixed_t track_mag;
 	char M;
-	float speed_kn;
+	NMEA_Fixed_t speed_kn;
 	char N;
-	float speed_kmh;
+	NMEA_Fixed_t speed_kmh;
 	char K;
 	char mode; // See #define NMEA_MODE_XXX
 } NMEA_Packet_VTG_t;
 
+extern const char nmea_pformat_gsa[];
+
+typedef struct
+{
+	char op_mode;
+	int32_t nav_mode;
+	int32_t svid[12];
+	NMEA_Fixed_t PDOP;
+	NMEA_Fixed_t HDOP;
+	NMEA_Fixed_t VDOP;
+	int32_t system_id;
+} NMEA_Packet_GSA_t;
+
+extern const char nmea_pformat_gsv[];
+
+typedef struct
+{
+	int32_t svid;
+	int32_t elv;
+	int32_t az;
+	int32_t cno;
+} NMEA_Packet_GSV_SV_t;
+
+typedef struct
+{
+	int32_t num_msg;
+	int32_t msg_num;
+	int32_t num_SV;
+	NMEA_Packet_GSV_SV_t sv[4];
+	int32_t signal_id;
+} NMEA_Packet_GSV_t;
+
 // header = Class (0x06), ID (0x08), Length (6)
 #define NMEA_UBX_CFG_RATE_HEADER (0x06 | (0x08 << 8) | (6 << 16))
 typedef struct
@@ -236,6 +384,34 @@ typedef struct
 	uint32_t loadMask;
 } NMEA_UBX_CFG_CFG_t;
 
+#define NMEA_UBX_CFG_NAVX5_HEADER (0x06 | (0x23 << 8) | (40 << 16))
+// Bit of mask1 applying ackAiding
+#define NMEA_UBX_CFG_NAVX5_MASK1_ACK_AID 0x0400
+
+typedef struct
+{
+	uint16_t version; // 2
+	uint16_t mask1; // Fields to apply
+	uint32_t mask2;
+	uint8_t reserved1[2];
+	uint8_t minSVs;
+	uint8_t maxSVs;
+	uint8_t minCNO;
+	uint8_t reserved2;
+	uint8_t iniFix3D;
+	uint8_t reserved3[2];
+	uint8_t ackAiding; // 1: acknowledge aiding with UBX-MGA-ACK
+	uint16_t wknRollover;
+	uint8_t sigAttenCompMode;
+	uint8_t reserved4[5];
+	uint8_t usePPP;
+	uint8_t aopCfg;
+	uint8_t reserved5[2];
+	uint16_t aopOrbMaxErr;
+	uint8_t reserved6[7];
+	uint8_t useAdr;
+} NMEA_UBX_CFG_NAVX5_t;
+
 #define NMEA_UBX_CFG_RST_HEADER (0x06 | (0x04 << 8) | (4 << 16))
 
 typedef struct
@@ -245,12 +421,58 @@ typedef struct
 	uint8_t reserved;
 } NMEA_UBX_CFG_RST_t;
 
+#define NMEA_UBX_MGA_INI_POS_LLH_HEADER (0x13 | (0x40 << 8) | (20 << 16))
+
+typedef struct
+{
+	uint8_t type; // 0x01
+	uint8_t version;
+	uint8_t reserved1[2];
+	int32_t lat; // 1e-7 deg
+	int32_t lon; // 1e-7 deg
+	int32_t alt; // cm
+	uint32_t posAcc; // cm
+} NMEA_UBX_MGA_INI_POS_LLH_t;
+
+#define NMEA_UBX_MGA_INI_TIME_UTC_HEADER (0x13 | (0x40 << 8) | (24 << 16))
+
+typedef struct
+{
+	uint8_t type; // 0x10
+	uint8_t version;
+	uint8_t ref;
+	int8_t leapSecs; // -128: unknown
+	uint16_t year;
+	uint8_t month;
+	uint8_t day;
+	uint8_t hour;
+	uint8_t minute;
+	uint8_t second;
+	uint8_t reserved1;
+	uint32_t ns;
+	uint16_t tAccS;
+	uint8_t reserved2[2];
+	uint32_t tAccNs;
+} NMEA_UBX_MGA_INI_TIME_UTC_t;
+
+// Poll (length 0) and dump entries of navigation database
+#define NMEA_UBX_MGA_DBD_HEADER (0x13 | (0x80 << 8) | (0 << 16))
+
+// Acknowledgement of aiding packet (type 1: accepted, infoCode, msgId of acknowledged UBX-MGA packet, start of its payload)
+#define NMEA_UBX_MGA_ACK_HEADER (0x13 | (0x60 << 8) | (8 << 16))
+
 HAL_StatusTypeDef NMEA_TxPUBX(NMEA_t *hnmea, char *msg_buffer);
 HAL_StatusTypeDef NMEA_TxUBX(NMEA_t *hnmea, uint32_t header, void *packet, size_t packet_size);
-HAL_StatusTypeDef NMEA_RxAckUBX(NMEA_t *hnmea);
 HAL_StatusTypeDef NMEA_Init(NMEA_t *hnmea);
-NMEA_Data_t NMEA_GetDate(NMEA_t *hnmea);
+HAL_StatusTypeDef NMEA_Loop(NMEA_t *hnmea);
+HAL_StatusTypeDef NMEA_RequestDatabase(NMEA_t *hnmea);
+uint8_t NMEA_DatabaseComplete(NMEA_t *hnmea);
+HAL_StatusTypeDef NMEA_Stop(NMEA_t *hnmea);
+HAL_StatusTypeDef NMEA_Start(NMEA_t *hnmea);
+void NMEA_TxCplt(NMEA_t *hnmea);
 HAL_StatusTypeDef NMEA_ProcessDMABuffer(NMEA_t *hnmea);
 uint8_t NMEA_ProcessLine(NMEA_t *hnmea, NMEA_Data_t *data);
+uint8_t NMEA_ParseLine(NMEA_t *hnmea, const char *line, NMEA_Data_t *data);
+uint8_t NMEA_Hex2Dec(char c);
 
 #endif /* INC_NMEA_H_ */
@@ -41,4 +41,7 @@
 #define LED_ERROR LD3_GPIO_Port, LD3_Pin
 #endif
 
+void Platform_Cycles_Enable(void);
+uint8_t Platform_Load(uint32_t cycles, uint32_t sampling_rate, uint32_t len, uint16_t load_max, uint32_t *cycles_max, uint16_t *load);
+
 #endif /* INC_CONFIG_H_ */
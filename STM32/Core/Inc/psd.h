@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2024 Mirco Heitmann
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ * psd.h
+ *
+ * Power spectral density of acceleration channels (Welch's method), written to spectrum files (f_X.bin, read by Python/vera_psd.py)
+ */
+
+#ifndef INC_PSD_H_
+#define INC_PSD_H_
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "config.h"
+#include "sd.h"
+#include "data_points.h"
+#include "platform.h"
+#include "stm32f7xx_hal.h"
+#include "arm_math.h"
+
+#define PSD_VERSION 1
+// MEMS axes (x, y, z) followed by piezo channels
+#define PSD_CHANNEL_MAX (3 + PIEZO_COUNT_MAX)
+#define PSD_BIN_MAX (PSD_SEGMENT_LEN_MAX / 2 + 1)
+// Spectrum is disabled if processing of a buffer takes longer than this share of the buffer duration (percent)
+#define PSD_LOAD_MAX 25
+// Value of bins with zero power (0.01 dB)
+#define PSD_DB_MIN INT16_MIN
+
+typedef struct
+{
+	Vera_SD_t *hvsd;
+	// Acceleration sampling rate (Sa/s), number of piezo channels
+	uint32_t sampling_rate;
+	uint8_t piezo_count;
+	// Segment length (power of two, 0: disable), segments are overlapped by half (Hann window)
+	uint16_t segment_len;
+	// Segments averaged per spectrum
+	uint16_t average_count;
+
+	uint8_t active;
+	uint8_t channel_count;
+	uint16_t bin_count;
+	arm_rfft_fast_instance_f32 fft;
+	float window[PSD_SEGMENT_LEN_MAX];
+	float scale;
+
+	// Samples of current segment per channel (second half is first half of next segment)
+	float segment[PSD_CHANNEL_MAX][PSD_SEGMENT_LEN_MAX];
+	uint16_t segment_fill;
+	uint32_t segment_timestamp;
+	uint32_t next_timestamp;
+
+	// Sum of power of averaged segments
+	float power[PSD_CHANNEL_MAX][PSD_BIN_MAX];
+	uint16_t power_count;
+	uint32_t power_timestamp;
+
+	float fft_in[PSD_SEGMENT_LEN_MAX];
+	float fft_out[PSD_SEGMENT_LEN_MAX];
+
+	// Spectrum record: [f_data_point_t][bins of channel 0 (int16, 0.01 dB)][bins of channel 1]...
+	uint8_t record[sizeof(f_data_point_t) + PSD_CHANNEL_MAX * PSD_BIN_MAX * sizeof(int16_t)] __attribute__((aligned(4)));
+
+	// Processing time (DWT cycles) of last buffer and load (per mille of buffer duration)
+	uint32_t cycles;
+	uint32_t cycles_max;
+	uint32_t cycles_write; // SD writes of spectra, not included in load
+	uint16_t load;
+	uint32_t spectrum_count;
+	// Segments dropped by gaps in timestamps (capture paused)
+	uint32_t gaps;
+} Psd_t;
+
+HAL_StatusTypeDef Psd_Init(Psd_t *hpsd);
+void Psd_Write(Psd_t *hpsd, volatile a_data_point_t *buffer, uint32_t len);
+
+#endif /* INC_PSD_H_ */
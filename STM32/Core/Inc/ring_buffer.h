@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2024 Mirco Heitmann
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ * ring_buffer.h
+ *
+ * Lock-free single-producer/single-consumer ring buffer with variable-length entries
+ */
+
+#ifndef INC_RING_BUFFER_H_
+#define INC_RING_BUFFER_H_
+
+#include <stdio.h>
+#include <string.h>
+
+#include "stm32f7xx_hal.h"
+
+// Entry header (length in bytes), marks unused space at end of buffer if RING_BUFFER_WRAP
+#define RING_BUFFER_HEADER_SIZE 4
+#define RING_BUFFER_WRAP 0xFFFFFFFF
+// Entries are aligned to 4 bytes
+#define RING_BUFFER_ALIGN(len) (((len) + 3) & ~3UL)
+
+typedef struct
+{
+	// Memory of size bytes (power of two, 4-byte aligned)
+	volatile uint8_t *buffer;
+	uint32_t size;
+	// Free-running indices, head is written by producer only, tail by consumer only
+	volatile uint32_t head;
+	volatile uint32_t tail;
+	// Producer: unused bytes at end of buffer skipped by reserved entry
+	uint32_t reserve_skip;
+	// Producer: entries/bytes dropped because buffer was full
+	volatile uint32_t dropped_entries;
+	volatile uint32_t dropped_bytes;
+	// Consumer: dropped entries already reported by Ring_Buffer_Dropped
+	uint32_t dropped_reported;
+} Ring_Buffer_t;
+
+HAL_StatusTypeDef Ring_Buffer_Init(Ring_Buffer_t *hring);
+void *Ring_Buffer_Reserve(Ring_Buffer_t *hring, uint32_t len);
+void Ring_Buffer_Commit(Ring_Buffer_t *hring, uint32_t len);
+uint8_t Ring_Buffer_Write(Ring_Buffer_t *hring, const void *data, uint32_t len);
+void *Ring_Buffer_Peek(Ring_Buffer_t *hring, uint32_t *len);
+void Ring_Buffer_Release(Ring_Buffer_t *hring);
+uint32_t Ring_Buffer_Used(Ring_Buffer_t *hring);
+uint32_t Ring_Buffer_Dropped(Ring_Buffer_t *hring);
+
+#endif /* INC_RING_BUFFER_H_ */
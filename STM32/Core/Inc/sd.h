@@ -22,13 +22,61 @@
 
 // Format of dir and files
 #define CONFIG_FILE_PATH "config.txt"
+#define GNSS_STATE_FILE_PATH "gnss.bin"
+#define GNSS_DBD_FILE_PATH "gnss_dbd.bin"
 #define DIR_FORMAT "%04hu-%02hhu-%02hhu_%lu"
 #define A_FILE_FORMAT DIR_FORMAT "/a_%li.bin"
 #define P_FILE_FORMAT DIR_FORMAT "/p_%li.bin"
+#define F_FILE_FORMAT DIR_FORMAT "/f_%li.bin"
+#define H_FILE_FORMAT DIR_FORMAT "/h_%li.bin"
+#define S_FILE_FORMAT DIR_FORMAT "/s_%li.bin"
 #define LOG_FILE_FORMAT DIR_FORMAT "/_log.txt"
+#define TRACE_FILE_FORMAT DIR_FORMAT "/_log.bin"
+#define EVENTS_FILE_FORMAT DIR_FORMAT "/_events.bin"
+// Catalog of measurement directories (listed by Python/vera_index.py)
+#define INDEX_FILE_PATH "index.bin"
 
 #define PATH_LEN 50
 
+// Cluster size of exFAT volume created by SD_Init, data area is aligned to the allocation unit of the card
+#define SD_FORMAT_CLUSTER_SIZE (256 * 1024)
+// Maximum file size of FAT32 volumes (cards not formatted by SD_Init), pages are changed before
+#define SD_FAT32_FILE_SIZE_MAX 0xFFFFFFFFULL
+
+// Index file: header followed by one entry per measurement directory (run), in order of creation
+#define SD_INDEX_MAGIC 0x58444956 // "VIDX"
+#define SD_INDEX_VERSION 1
+// Entries written in one call when rebuilding the index
+#define SD_INDEX_REBUILD_ENTRIES 16
+// Entry flags
+#define SD_INDEX_FLAG_SCANNED 0x01 // Found by directory scan when the index was rebuilt, duration and page count unknown
+#define SD_INDEX_FLAG_STOPPED 0x02 // Capture was stopped properly (otherwise duration and page count of last update)
+
+typedef struct
+{
+	uint32_t magic;
+	uint8_t version;
+	uint8_t entry_size;
+	uint16_t reserved;
+	uint32_t run_count;
+	// Highest dir_num of latest date and of date 0000-00-00, next dir_num is found without scanning the root dir
+	uint16_t last_year;
+	uint8_t last_month, last_day;
+	uint32_t last_dir_num;
+	uint32_t undated_dir_num;
+} SD_Index_Header_t;
+
+typedef struct
+{
+	uint16_t year;
+	uint8_t month, day;
+	uint32_t dir_num;
+	uint32_t duration_ms; // Since capture start
+	uint32_t page_count;
+	uint8_t flags; // See #define SD_INDEX_FLAG_XXX
+	uint8_t reserved[3];
+} SD_Index_Entry_t;
+
 typedef struct
 {
 	GPIO_TypeDef *Detect_GPIO_Port;
@@ -39,6 +87,7 @@ typedef struct
 	const TCHAR *fatfs_path;
 
 	uint32_t dir_num, page_num;
+	uint8_t dir_provisional; // Directory is renamed once date is known
 
 	uint16_t date_year;
 	uint8_t date_month, date_day;
@@ -46,20 +95,38 @@ typedef struct
 	TCHAR dir_path[PATH_LEN];
 	TCHAR a_file_path[PATH_LEN];
 	TCHAR p_file_path[PATH_LEN];
+	TCHAR f_file_path[PATH_LEN]; // Empty if spectrum is disabled (f_header.segment_len is 0)
+	TCHAR h_file_path[PATH_LEN]; // Empty if envelope analysis is disabled (h_header.band_low is 0)
+	TCHAR s_file_path[PATH_LEN]; // Empty if block statistics are disabled (s_header.channel_count is 0)
 	TCHAR log_file_path[PATH_LEN];
+	TCHAR trace_file_path[PATH_LEN];
+	TCHAR events_file_path[PATH_LEN]; // Created with first event (triggered capture)
 
 	a_data_header_t a_header;
 	p_data_header_t p_header;
+	f_data_header_t f_header;
+	h_data_header_t h_header;
+	s_data_header_t s_header;
+
+	// Index file, entry of current directory
+	SD_Index_Header_t index;
+	SD_Index_Entry_t index_run;
+	uint32_t index_run_num; // Position of index_run in index file
+	uint8_t index_valid;
 } Vera_SD_t;
 
 HAL_StatusTypeDef SD_Init(Vera_SD_t *hsd, uint8_t do_format);
 HAL_StatusTypeDef SD_InitDir(Vera_SD_t *hsd);
+HAL_StatusTypeDef SD_RenameDir(Vera_SD_t *hsd, uint16_t year, uint8_t month, uint8_t day);
 HAL_StatusTypeDef SD_UpdateFilepaths(Vera_SD_t *hsd);
 HAL_StatusTypeDef SD_NewPage(Vera_SD_t *hsd);
 HAL_StatusTypeDef SD_Uninit(Vera_SD_t *hsd);
 HAL_StatusTypeDef SD_TouchFile(Vera_SD_t *hsd, TCHAR *path);
 uint8_t SD_FileExists(Vera_SD_t *hsd, TCHAR *path);
 HAL_StatusTypeDef SD_ReadBuffer(Vera_SD_t *hsd, TCHAR *path, void *data, UINT size, UINT *size_read);
+HAL_StatusTypeDef SD_ReadBufferAt(Vera_SD_t *hsd, TCHAR *path, FSIZE_t offset, void *data, UINT size, UINT *size_read);
 HAL_StatusTypeDef SD_WriteBuffer(Vera_SD_t *hsd, TCHAR *path, void *data, UINT size);
+HAL_StatusTypeDef SD_WriteFile(Vera_SD_t *hsd, TCHAR *path, void *data, UINT size);
+HAL_StatusTypeDef SD_WriteBufferAt(Vera_SD_t *hsd, TCHAR *path, FSIZE_t offset, void *data, UINT size);
 
 #endif /* INC_SD_H_ */
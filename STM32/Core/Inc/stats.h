@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2024 Mirco Heitmann
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ * stats.h
+ *
+ * Statistics of each acceleration buffer for all channels, written to statistics files (s_X.bin, read by Python/vera_stats.py)
+ */
+
+#ifndef INC_STATS_H_
+#define INC_STATS_H_
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "config.h"
+#include "sd.h"
+#include "data_points.h"
+#include "stm32f7xx_hal.h"
+
+#define STATS_VERSION 1
+// MEMS axes (x, y, z) followed by piezo channels
+#define STATS_CHANNEL_MAX (3 + PIEZO_COUNT_MAX)
+// Samples at or beyond +-this value are counted as clipped: ADXL357 20 bit full scale, piezo ADC full scale (-4094 to 4096 after conversion to signed)
+#define STATS_MEMS_CLIP 524287
+#define STATS_PIEZO_CLIP 4094
+// Records buffered before writing to SD (record of 8 channels: 232 bytes)
+#define STATS_SAVE_LEN 2048
+
+typedef struct
+{
+	Vera_SD_t *hvsd;
+	// Statistics enabled, number of piezo channels
+	uint8_t enabled;
+	uint8_t piezo_count;
+
+	uint8_t channel_count; // 0 if disabled
+	// Records not yet written
+	uint8_t save_buffer[STATS_SAVE_LEN] __attribute__((aligned(4)));
+	uint16_t save_len;
+	uint32_t record_count;
+	uint32_t clipped_count;
+} Stats_t;
+
+HAL_StatusTypeDef Stats_Init(Stats_t *hstats);
+void Stats_Write(Stats_t *hstats, volatile a_data_point_t *buffer, uint32_t len);
+HAL_StatusTypeDef Stats_Flush(Stats_t *hstats);
+
+#endif /* INC_STATS_H_ */
@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2024 Mirco Heitmann
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ * stream.h
+ *
+ * Live streaming of acceleration data or raw piezo ADC data via USB CDC (framed binary, decoded by Python/vera_stream.py)
+ */
+
+#ifndef INC_STREAM_H_
+#define INC_STREAM_H_
+
+#include <stdio.h>
+#include <string.h>
+
+#include "config.h"
+#include "data_points.h"
+#include "ring_buffer.h"
+#include "stm32f7xx_hal.h"
+#include "usbd_cdc_if.h"
+
+#define STREAM_VERSION 2
+// Frame buffer size (two buffers, one filled while the other is transmitted)
+#define STREAM_FRAME_LEN 2048
+// Streaming stops if the host does not read for this duration
+#define STREAM_STALL_TIMEOUT 1000
+// Queue of samples to pack into frames (power of two), data points: one entry per frame, raw: one entry per DMA buffer
+#define STREAM_RING_SIZE 16384
+
+// Frame: [Stream_Frame_Header_t][samples][ck_a][ck_b], checksum (UBX) over header and samples
+#define STREAM_SYNC_1 'V'
+#define STREAM_SYNC_2 'S'
+#define STREAM_CHECKSUM_LEN 2
+
+// Frame types
+#define STREAM_TYPE_DATA_POINTS 0 // Samples of saved acceleration data points (a_sampling_rate)
+#define STREAM_TYPE_PIEZO_RAW 1 // Raw ADC samples (uint16) of selected piezo channels (a_sampling_rate * oversampling_ratio)
+#define STREAM_TYPE_BENCHMARK 2 // Byte pattern (sequence + i) for throughput measurement, timestamp in ms
+
+// Channel mask bits, sample: selected MEMS axes (int32) followed by selected piezo channels (int16)
+#define STREAM_CHANNEL_MEMS_X 0
+#define STREAM_CHANNEL_MEMS_Y 1
+#define STREAM_CHANNEL_MEMS_Z 2
+#define STREAM_CHANNEL_PIEZO_1 3
+
+// Host command: [STREAM_SYNC_1][STREAM_SYNC_2][command](start: [channel mask][decimation (uint16)])
+#define STREAM_CMD_STOP 0
+#define STREAM_CMD_START 1
+#define STREAM_CMD_START_RAW 2
+#define STREAM_CMD_BENCHMARK 3
+#define STREAM_CMD_LEN_STOP 3
+#define STREAM_CMD_LEN_START 6
+
+typedef struct
+{
+	uint8_t sync[2];
+	uint8_t version;
+	uint8_t channels;
+	uint16_t sequence;
+	uint16_t sample_count;
+	// Timestamp of first sample (a_data_point_t), following samples every decimation ticks
+	uint32_t timestamp;
+	uint32_t sampling_rate;
+	uint16_t decimation;
+	// Bytes of samples following the header
+	uint16_t payload_len;
+	// Data points (raw: ADC samples per channel) not streamed since start (host not reading fast enough)
+	uint32_t dropped_points;
+	uint8_t type;
+	uint8_t reserved[3];
+} Stream_Frame_Header_t;
+
+typedef enum
+{
+	STREAM_BUFFER_FREE,
+	STREAM_BUFFER_READY,
+	STREAM_BUFFER_SENDING
+} Stream_Buffer_State_t;
+
+typedef struct
+{
+	// Acceleration sampling rate (Sa/s), number of piezo channels and ADC samples per data point
+	uint32_t sampling_rate;
+	uint8_t piezo_count;
+	uint8_t oversampling_ratio;
+
+	// Streaming settings
+	volatile uint8_t active;
+	uint8_t type;
+	uint8_t channels;
+	uint16_t decimation;
+	uint16_t sample_len;
+	uint16_t samples_per_frame;
+
+	// Command received in USB IRQ, applied in Stream_Loop
+	volatile uint8_t flag_command;
+	volatile uint8_t command;
+	volatile uint8_t command_channels;
+	volatile uint16_t command_decimation;
+
+	uint32_t i_decimation;
+
+	// Queue of samples, written by Stream_Write (main loop) or Stream_Write_Raw (ADC IRQ)
+	// Data points, entry: [timestamp of first sample (uint32)][sample_count (uint32)][packed samples of one frame]
+	// Raw piezo ADC data, entry: [index of first ADC sample (uint32)][oversampling_ratio * piezo_count samples (uint16)]
+	Ring_Buffer_t ring;
+	uint8_t ring_buffer[STREAM_RING_SIZE] __attribute__((aligned(4)));
+	uint32_t raw_index;
+	uint32_t raw_offset;
+	uint32_t raw_next;
+
+	// Double buffered frames, transmission of ready frame is started on TX complete
+	uint8_t frame_buffer[2][STREAM_FRAME_LEN] __attribute__((aligned(4)));
+	volatile Stream_Buffer_State_t buffer_state[2];
+	volatile uint8_t i_sending;
+	uint32_t tx_start;
+	uint16_t sequence;
+	uint32_t dropped_points;
+	// Throughput since start
+	uint32_t start_tick;
+	volatile uint32_t tx_bytes;
+} Stream_t;
+
+void Stream_Init(Stream_t *hstream);
+void Stream_Loop(Stream_t *hstream);
+void Stream_Stop(Stream_t *hstream);
+void Stream_Write(Stream_t *hstream, volatile a_data_point_t *buffer, uint32_t len);
+void Stream_Write_Raw(Stream_t *hstream, volatile uint16_t *adc_buffer);
+void Stream_Receive(Stream_t *hstream, uint8_t *buffer, uint32_t len);
+void Stream_CDC_TxCplt(Stream_t *hstream, uint8_t *buffer);
+
+#endif /* INC_STREAM_H_ */
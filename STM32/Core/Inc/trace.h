@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2024 Mirco Heitmann
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ * trace.h
+ *
+ * Binary trace log with deferred formatting (events of trace_events.h)
+ */
+
+#ifndef INC_TRACE_H_
+#define INC_TRACE_H_
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "config.h"
+#include "sd.h"
+#include "ring_buffer.h"
+#include "trace_events.h"
+#include "stm32f7xx_hal.h"
+
+// Queue of event records (power of two)
+#define TRACE_RING_SIZE 4096
+// Batch of SD trace file appends
+#define TRACE_SD_BUFFER_LEN 2048
+// Maximum number of argument words per event
+#define TRACE_ARGS_MAX 8
+// Record: [sync | argument count | id][tick (ms)][arguments]
+#define TRACE_SYNC 0xA5
+#define TRACE_RECORD_HEADER_LEN 8
+
+#define TRACE_ID(id, format) id,
+typedef enum
+{
+	TRACE_EVENTS(TRACE_ID)
+	TRACE_EVENT_COUNT
+} Trace_Event_t;
+#undef TRACE_ID
+
+typedef struct {
+	Vera_SD_t *hvsd;
+	// Maximum duration before trace is appended to trace file
+	uint32_t flush_timeout;
+	// Written by Trace_Event (main loop and interrupts), read by Trace_Loop
+	Ring_Buffer_t ring;
+	uint8_t ring_buffer[TRACE_RING_SIZE] __attribute__((aligned(4)));
+	// Batched trace file appends
+	uint8_t sd_buffer[TRACE_SD_BUFFER_LEN] __attribute__((aligned(4)));
+	uint32_t sd_len;
+	uint32_t last_write;
+} Trace_t;
+
+extern Trace_t htrace;
+
+void Trace_Init(Trace_t *htrace);
+void Trace_Uninit(Trace_t *htrace);
+void Trace_Loop(Trace_t *htrace);
+void Trace_Event(Trace_t *htrace, Trace_Event_t id, const uint32_t *args, uint32_t nargs);
+void Trace_Printf(Trace_Event_t id, ...);
+
+// Argument as raw 32 bit word (floats are not converted)
+static inline uint32_t Trace_Float(float value)
+{
+	uint32_t word;
+	memcpy(&word, &value, sizeof(word));
+	return word;
+}
+#define TRACE_ARG(x) _Generic((x), float: Trace_Float(x), double: Trace_Float(x), default: (uint32_t)(x))
+
+// Apply TRACE_ARG to 0 to TRACE_ARGS_MAX arguments
+#define TRACE_MAP_0()
+#define TRACE_MAP_1(a) TRACE_ARG(a)
+#define TRACE_MAP_2(a, ...) TRACE_ARG(a), TRACE_MAP_1(__VA_ARGS__)
+#define TRACE_MAP_3(a, ...) TRACE_ARG(a), TRACE_MAP_2(__VA_ARGS__)
+#define TRACE_MAP_4(a, ...) TRACE_ARG(a), TRACE_MAP_3(__VA_ARGS__)
+#define TRACE_MAP_5(a, ...) TRACE_ARG(a), TRACE_MAP_4(__VA_ARGS__)
+#define TRACE_MAP_6(a, ...) TRACE_ARG(a), TRACE_MAP_5(__VA_ARGS__)
+#define TRACE_MAP_7(a, ...) TRACE_ARG(a), TRACE_MAP_6(__VA_ARGS__)
+#define TRACE_MAP_8(a, ...) TRACE_ARG(a), TRACE_MAP_7(__VA_ARGS__)
+#define TRACE_MAP_N(_0, _1, _2, _3, _4, _5, _6, _7, _8, name, ...) name
+#define TRACE_MAP(...) TRACE_MAP_N(0, ##__VA_ARGS__, TRACE_MAP_8, TRACE_MAP_7, TRACE_MAP_6, TRACE_MAP_5, TRACE_MAP_4, TRACE_MAP_3, TRACE_MAP_2, TRACE_MAP_1, TRACE_MAP_0)(__VA_ARGS__)
+
+// Log event with up to TRACE_ARGS_MAX integer or float arguments, safe to call from interrupts
+#if TRACE_TEXT
+#define TRACE(id, ...) Trace_Printf(id, ##__VA_ARGS__)
+#else
+#define TRACE(id, ...) do { \
+		const uint32_t trace_args[] = { 0, TRACE_MAP(__VA_ARGS__) }; \
+		Trace_Event(&htrace, id, trace_args + 1, sizeof(trace_args) / sizeof(uint32_t) - 1); \
+	} while (0)
+#endif
+
+#endif /* INC_TRACE_H_ */
@@ -0,0 +1,39 @@
+/*
+ * Copyright (c) 2024 Mirco Heitmann
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ * trace_events.h
+ *
+ * Events of the binary trace log
+ *
+ * X(id, format): the firmware only stores the id and raw argument words, format strings are rendered
+ * by the host decoder (Python/trace2txt.py parses this file). Arguments are 32 bit words, floats are
+ * stored as raw bits (use %f, %e or %g). Append new events at the end, ids are the position in the list.
+ */
+
+#ifndef INC_TRACE_EVENTS_H_
+#define INC_TRACE_EVENTS_H_
+
+#define TRACE_EVENTS(X) \
+	X(TRACE_START, "Trace started (version %lu, %lu events)") \
+	X(TRACE_DROPPED, "WARNING: Trace_Loop: Trace buffer full, %lu events dropped") \
+	X(TRACE_A_BUFFER_OVERFLOW, "WARNING: main: a_buffer overflow") \
+	X(TRACE_P_BUFFER_OVERFLOW, "WARNING: main: p_buffer overflow") \
+	X(TRACE_ADXL_REQUEST_FAILED, "WARNING: ADXL_RequestData: TxRx failed") \
+	X(TRACE_NMEA_RX_DMA_FAILED, "ERROR: NMEA_ProcessDMABuffer: HAL_UART_Receive_DMA failed") \
+	X(TRACE_NMEA_LINES_DROPPED, "WARNING: NMEA line queue full, %lu lines dropped (%lu total)") \
+	X(TRACE_NMEA_NO_DATA, "WARNING: No NMEA data") \
+	X(TRACE_NMEA_NO_LOCK, "WARNING: No position lock") \
+	X(TRACE_GNSS_DATE, "GNSS date: %04lu-%02lu-%02lu") \
+	X(TRACE_GNSS_DATE_TIME, "GNSS date: %04lu-%02lu-%02lu UTC time: %02lu:%02lu:%06.3f") \
+	X(TRACE_PAGE, "Page %lu") \
+	X(TRACE_PRINT_A, "Peak-peak: Piezo: %.3f V\tMEMS: %.3f\tOffset: Piezo: %.3f V\tMEMS: %.3f") \
+	X(TRACE_PRINT_P_TIME, "UTC: %02lu:%02lu:%06.3f") \
+	X(TRACE_PRINT_P_POSITION, "Lat/Lon: %.3f %.3f") \
+	X(TRACE_PRINT_P_SPEED, "Speed: %.1fkm/h") \
+	X(TRACE_PRINT_P_ALTITUDE, "Altitude: %.1fm")
+
+#endif /* INC_TRACE_EVENTS_H_ */
@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2024 Mirco Heitmann
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ * track.h
+ *
+ * Track distance estimation (Kalman filter of MEMS longitudinal acceleration and GNSS speed)
+ */
+
+#ifndef INC_TRACK_H_
+#define INC_TRACK_H_
+
+#include "stm32f7xx_hal.h"
+#include "config.h"
+
+// Standard gravity (m/s^2)
+#define TRACK_G 9.80665f
+// Full scale of ADXL357 raw data (20 bit)
+#define TRACK_ADXL_FULL_SCALE 524287.0f
+
+typedef struct
+{
+	// Acceleration sampling rate (Sa/s)
+	uint32_t sampling_rate;
+	// ADXL357 measurement range (g)
+	uint16_t acceleration_range;
+	// Longitudinal axis (1: x, 2: y, 3: z, negative if mounted reversed, 0: disabled)
+	int8_t axis;
+	// Rate of filter steps (Hz), acceleration is averaged over sampling_rate / filter_rate samples
+	uint32_t filter_rate;
+	// Process noise of acceleration ((m/s^2)^2 * s) and bias ((m/s^2)^2 / s), variance of GNSS speed ((m/s)^2)
+	float accel_noise;
+	float bias_noise;
+	float speed_noise;
+
+	// Decimation
+	uint32_t decimation;
+	uint32_t i_decimation;
+	int64_t accel_sum;
+	uint32_t accel_count;
+	float accel_scale;
+
+	// Filter state: speed (m/s), acceleration bias (m/s^2), covariance
+	uint8_t initialized;
+	float speed;
+	float bias;
+	float P00, P01, P11;
+	// Track distance since start of capture (m)
+	double distance;
+
+	// GNSS speed measurement (set in main loop, processed in sampling IRQ)
+	volatile float gnss_speed;
+	volatile uint8_t flag_gnss_speed;
+} Track_t;
+
+HAL_StatusTypeDef Track_Init(Track_t *htrack);
+void Track_SetSpeed(Track_t *htrack, float speed_kmh);
+float Track_Update(Track_t *htrack, int32_t xyz[3]);
+
+#endif /* INC_TRACK_H_ */
@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2024 Mirco Heitmann
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ * trigger.h
+ *
+ * Triggered capture: only event windows around triggered blocks are saved, events are listed in event file (_events.bin, read by Python/vera_events.py)
+ */
+
+#ifndef INC_TRIGGER_H_
+#define INC_TRIGGER_H_
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "config.h"
+#include "sd.h"
+#include "data_points.h"
+#include "stm32f7xx_hal.h"
+
+#define TRIGGER_VERSION 1
+// Blocks of ring in acceleration buffer memory
+#define TRIGGER_SLOT_MAX (2 * A_BUFFER_LEN_MAX / TRIGGER_BLOCK_LEN_MIN)
+// Blocks in use besides pre-trigger history: block being filled, block being saved, next block
+#define TRIGGER_SLOTS_RESERVED 3
+// GNSS speed is unknown if not received for this duration
+#define TRIGGER_SPEED_TIMEOUT NMEA_NO_PACKET_DURATION
+
+// Trigger sources (bits of e_data_point_t.sources)
+#define TRIGGER_SOURCE_PIEZO_PEAK 0x01
+#define TRIGGER_SOURCE_MEMS_RMS 0x02
+#define TRIGGER_SOURCE_KURTOSIS 0x04
+#define TRIGGER_SOURCE_SPEED 0x08
+
+typedef struct
+{
+	Vera_SD_t *hvsd;
+	// Acceleration buffer memory, used as ring of blocks
+	volatile a_data_point_t *ring;
+	uint32_t ring_len;
+	// Data points per block (0: triggered capture disabled), acceleration sampling rate (Sa/s), number of piezo channels
+	uint16_t block_len;
+	uint32_t sampling_rate;
+	uint8_t piezo_count;
+	// History saved before first and after last triggered block (ms)
+	uint32_t pre_ms;
+	uint32_t post_ms;
+
+	// Thresholds (0: disabled, see config.h), can be changed while capture is running
+	uint16_t piezo_peak;
+	uint32_t mems_rms;
+	uint16_t kurtosis;
+	uint16_t speed_min;
+	uint16_t speed_max;
+
+	uint16_t slot_count;
+	uint16_t slot_next;
+	uint16_t pre_blocks;
+	uint16_t post_blocks;
+
+	// Completed blocks not saved (pre-trigger history), circular
+	volatile a_data_point_t *history[TRIGGER_SLOT_MAX];
+	uint16_t history_len[TRIGGER_SLOT_MAX];
+	uint16_t history_start;
+	uint16_t history_count;
+
+	// GNSS speed (km/h)
+	float speed;
+	uint32_t speed_time;
+	uint8_t speed_valid;
+
+	// Current event (record is written at end of event or page)
+	uint8_t event_active;
+	uint16_t post_remaining;
+	e_data_point_t event;
+	uint32_t event_count;
+
+	// Data points written to acceleration file of page
+	uint32_t page_num;
+	uint32_t page_points;
+
+	// Features of last block
+	float block_peak;
+	float block_rms;
+	float block_kurtosis;
+	uint32_t blocks_total;
+	uint32_t blocks_saved;
+} Trigger_t;
+
+HAL_StatusTypeDef Trigger_Init(Trigger_t *htrigger);
+volatile a_data_point_t *Trigger_Next_Block(Trigger_t *htrigger);
+HAL_StatusTypeDef Trigger_Block(Trigger_t *htrigger, volatile a_data_point_t *block, uint32_t len);
+HAL_StatusTypeDef Trigger_Flush(Trigger_t *htrigger);
+void Trigger_SetSpeed(Trigger_t *htrigger, float speed_kmh);
+
+#endif /* INC_TRIGGER_H_ */
@@ -0,0 +1,245 @@
+/*
+ * Copyright (c) 2024 Mirco Heitmann
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ * command.c
+ *
+ * Command/control protocol via USB CDC (framed text commands, sent by Python/vera_cmd.py)
+ *
+ * Request frames are assembled in the USB IRQ, the text is processed in the main loop. Config queries are
+ * answered here, all other commands are returned to the caller, which answers with Command_Reply. Replies
+ * are framed as well, so they can be separated from log text and stream frames on the same port.
+ */
+
+#include "command.h"
+
+const char *command_names[] = { "", "set", "save", "start", "stop", "page", "stats" };
+
+void Command_Get(Command_t *hcommand, char *key);
+void Command_Transmit(Command_t *hcommand);
+
+void Command_Init(Command_t *hcommand)
+{
+	// Init struct
+	hcommand->rx_index = 0;
+	hcommand->rx_errors = 0;
+	hcommand->flag_received = 0;
+	hcommand->reply_state = COMMAND_REPLY_FREE;
+}
+
+// Process received command, call regularly from main loop. Returns command to execute (args: text after command name)
+Command_Type_t Command_Loop(Command_t *hcommand, char **args)
+{
+	// Host stopped reading (e.g. port closed)
+	if (hcommand->reply_state == COMMAND_REPLY_SENDING && HAL_GetTick() - hcommand->tx_start > COMMAND_TX_TIMEOUT)
+	{
+		hcommand->reply_state = COMMAND_REPLY_FREE;
+	}
+
+	// Start transmission of reply if USB is idle (otherwise started by Command_CDC_TxCplt)
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	Command_Transmit(hcommand);
+	__set_PRIMASK(primask);
+
+	if (!hcommand->flag_received)
+	{
+		return COMMAND_NONE;
+	}
+
+	// Split command name and arguments
+	char *line = hcommand->line;
+	while (*line == ' ')
+	{
+		line++;
+	}
+	char *name_end = line;
+	while (*name_end != ' ' && *name_end != '\0')
+	{
+		name_end++;
+	}
+	*args = name_end;
+	while (**args == ' ')
+	{
+		(*args)++;
+	}
+	*name_end = '\0';
+
+	Command_Type_t command = COMMAND_NONE;
+	if (strcmp(line, "get") == 0)
+	{
+		Command_Get(hcommand, *args);
+	}
+	else
+	{
+		for (uint8_t i = COMMAND_SET; i <= COMMAND_STATS; i++)
+		{
+			if (strcmp(line, command_names[i]) == 0)
+			{
+				command = i;
+			}
+		}
+		if (command == COMMAND_NONE)
+		{
+			Command_Reply(hcommand, COMMAND_STATUS_ERROR, "Unknown command \"%s\"", line);
+		}
+	}
+
+	// Line is valid until next call
+	hcommand->flag_received = 0;
+	return command;
+}
+
+// Send reply to last command (printf format)
+void Command_Reply(Command_t *hcommand, uint8_t status, const char *format, ...)
+{
+	if (hcommand->reply_state == COMMAND_REPLY_SENDING)
+	{
+		printf("(%lu) WARNING: Command_Reply: Previous reply not yet transmitted, reply dropped\r\n", HAL_GetTick());
+		return;
+	}
+
+	// Text
+	uint8_t *text = hcommand->reply + COMMAND_REPLY_HEADER_LEN;
+	va_list va;
+	va_start(va, format);
+	int len = vsnprintf((char*)text, COMMAND_REPLY_LEN, format, va);
+	va_end(va);
+	if (len < 0)
+	{
+		len = 0;
+	}
+	else if (len >= COMMAND_REPLY_LEN)
+	{
+		len = COMMAND_REPLY_LEN - 1;
+	}
+
+	// Header
+	hcommand->reply[0] = COMMAND_SYNC_1;
+	hcommand->reply[1] = COMMAND_REPLY_SYNC_2;
+	hcommand->reply[2] = status;
+	hcommand->reply[3] = len & 0xFF;
+	hcommand->reply[4] = len >> 8;
+
+	// Checksum like UBX packets
+	uint8_t ck_a = 0, ck_b = 0;
+	for (uint8_t *p = hcommand->reply + 2; p < text + len; p++)
+	{
+		ck_a += *p;
+		ck_b += ck_a;
+	}
+	text[len] = ck_a;
+	text[len + 1] = ck_b;
+	hcommand->reply_len = COMMAND_REPLY_HEADER_LEN + len + 2;
+
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	hcommand->reply_state = COMMAND_REPLY_READY;
+	Command_Transmit(hcommand);
+	__set_PRIMASK(primask);
+}
+
+// Parse request frames, call from CDC_RxCallback (USB IRQ)
+void Command_Receive(Command_t *hcommand, uint8_t *buffer, uint32_t len)
+{
+	uint8_t *frame = hcommand->rx_frame;
+	for (uint32_t i = 0; i < len; i++)
+	{
+		uint8_t b = buffer[i];
+		if (hcommand->rx_index == 0)
+		{
+			if (b == COMMAND_SYNC_1)
+			{
+				hcommand->rx_index = 1;
+			}
+			continue;
+		}
+		if (hcommand->rx_index == 1)
+		{
+			hcommand->rx_index = b == COMMAND_SYNC_2 ? 2 : (b == COMMAND_SYNC_1 ? 1 : 0);
+			continue;
+		}
+
+		// Length, text and checksum (frame starts after sync)
+		frame[hcommand->rx_index - 2] = b;
+		hcommand->rx_index++;
+		uint16_t text_len = frame[0];
+		if (hcommand->rx_index - 2 < 1 + text_len + 2)
+		{
+			continue;
+		}
+		hcommand->rx_index = 0;
+
+		uint8_t ck_a = 0, ck_b = 0;
+		for (uint16_t j = 0; j < 1 + text_len; j++)
+		{
+			ck_a += frame[j];
+			ck_b += ck_a;
+		}
+		// Frame is discarded if the previous command is not yet processed
+		if (ck_a != frame[1 + text_len] || ck_b != frame[2 + text_len] || hcommand->flag_received)
+		{
+			hcommand->rx_errors++;
+			continue;
+		}
+		memcpy(hcommand->line, &frame[1], text_len);
+		hcommand->line[text_len] = '\0';
+		hcommand->flag_received = 1;
+	}
+}
+
+// Call from CDC_TxCpltCallback (USB IRQ) before other users of USB CDC, so that replies are not delayed by streaming
+void Command_CDC_TxCplt(Command_t *hcommand, uint8_t *buffer)
+{
+	if (buffer == hcommand->reply && hcommand->reply_state == COMMAND_REPLY_SENDING)
+	{
+		hcommand->reply_state = COMMAND_REPLY_FREE;
+		return;
+	}
+	Command_Transmit(hcommand);
+}
+
+// Reply with config line of key ("key=value"), all config lines if key is empty
+void Command_Get(Command_t *hcommand, char *key)
+{
+	char buffer[COMMAND_REPLY_LEN];
+	Config_Save(buffer, sizeof(buffer));
+	if (*key == '\0')
+	{
+		Command_Reply(hcommand, COMMAND_STATUS_OK, "%s", buffer);
+		return;
+	}
+
+	size_t key_len = strlen(key);
+	for (char *line = buffer; *line != '\0'; line = strstr(line, "\r\n") + 2)
+	{
+		if (strncmp(line, key, key_len) == 0 && line[key_len] == '=')
+		{
+			Command_Reply(hcommand, COMMAND_STATUS_OK, "%.*s", (int)strcspn(line, "\r\n"), line);
+			return;
+		}
+		if (strstr(line, "\r\n") == NULL)
+		{
+			break;
+		}
+	}
+	Command_Reply(hcommand, COMMAND_STATUS_ERROR, "Unknown config key \"%s\"", key);
+}
+
+// Transmit ready reply (called with USB IRQ masked or from USB IRQ)
+void Command_Transmit(Command_t *hcommand)
+{
+	if (hcommand->reply_state != COMMAND_REPLY_READY)
+	{
+		return;
+	}
+	// Retried if USB is busy (e.g. log message or stream frame)
+	if (CDC_Transmit_FS(hcommand->reply, hcommand->reply_len) == USBD_OK)
+	{
+		hcommand->tx_start = HAL_GetTick();
+		hcommand->reply_state = COMMAND_REPLY_SENDING;
+	}
+}
@@ -8,108 +8,268 @@
  * config.c
  */
 
+#include <stddef.h>
+#include <stdlib.h>
+
 #include "config.h"
 
 config_t default_config =
 	{
-		.boot_without_date = 0, // default: 0
-		.print_acceleration_data = 0, // default: 0
-		.print_position_data = 0, // default: 0
-		.piezo_count = 3, // default: 3
-		.fir_type = 1, // default: 1
-		.adxl_range = 40, // default: 40 (g)
-		.page_duration_ms = 30 * 60 * 1000, // default: 30 * 60 * 1000 (ms) -> 30 minutes
-		.a_sampling_rate = 4000, // default: 4000 (Sa/s)
-		.p_sampling_rate = 4, // default: 4 (Sa/s)
-		.oversampling_ratio = 4, // default: 4 (16 kSa/s)
-		.a_buffer_len = 4096, // default: 4096 (Sa)
-		.p_buffer_len = 32, // default: 32 (Sa)
+#define X(name, type, def, min, max) .name = def,
+		CONFIG_KEYS(X)
+#undef X
 	};
 
 config_t config;
 
-#define C_READ_VAR(format, var) \
-	if (sscanf(buffer + i, format "%n", &var, &n)) \
-		i += n; \
-
-#define C_CHECK_VAR(format, var, v_min, v_max) \
-	if (var < v_min || var > v_max) \
-	{ \
-		typeof(var) v_def = *(typeof(var)*)((void*)&var - (void*)&config + (void*)&default_config); \
-		printf("(%lu) WARNING: Config_Load: Invalid value " format ", resetting to " format "\r\n", HAL_GetTick(), var, v_def); \
-		var = v_def; \
-	}
+// Schema of config keys
+const Config_Key_t config_keys[] =
+	{
+#define X(name, type, def, min, max) { #name, CONFIG_TYPE_ ## type, offsetof(config_t, name), min, max },
+		CONFIG_KEYS(X)
+#undef X
+	};
+#define CONFIG_KEY_COUNT (sizeof(config_keys) / sizeof(Config_Key_t))
 
-#define C_WRITE_VAR(format, var) \
-	i += sprintf(buffer + i, format "\r\n", var); \
-	if (i >= size) \
-		return;
+// Index + 1 of key in config_keys by hash of name (0: empty), built on first lookup
+uint8_t config_hash_table[CONFIG_HASH_SIZE];
+uint8_t config_hash_table_built = 0;
 
 HAL_StatusTypeDef Config_Init_ADC1();
 HAL_StatusTypeDef Config_Init_TIM2();
 HAL_StatusTypeDef Config_Init_TIM3();
+uint32_t Config_Hash(const char *name, uint32_t len);
+const Config_Key_t *Config_Find(const char *name, uint32_t len);
+int32_t Config_Get(const config_t *c, const Config_Key_t *key);
+void Config_Set(config_t *c, const Config_Key_t *key, int32_t value);
+void Config_Token(char *token);
+uint8_t Config_Value(const Config_Key_t *key, const char *value, int32_t *v);
 
 void Config_Default(void)
 {
 	memcpy(&config, &default_config, sizeof(config_t));
 }
 
-void Config_Load(char *buffer, uint32_t size)
+// Parse chunk of config text ("key=value" separated by whitespace or line breaks), call Config_Parse_End after last chunk
+void Config_Parse(Config_Parser_t *hparser, const char *data, uint32_t len)
 {
-	for (uint32_t i = 0; i < size; i++)
+	for (uint32_t i = 0; i < len; i++)
 	{
-		if (buffer[i] == '\0')
-			break;
-		if (buffer[i] == '\r' || buffer[i] == '\n')
+		char c = data[i];
+		if (c != ' ' && c != '\t' && c != '\r' && c != '\n')
+		{
+			if (hparser->len < CONFIG_TOKEN_LEN_MAX)
+			{
+				hparser->token[hparser->len++] = c;
+			}
+			else
+			{
+				hparser->overflow = 1;
+			}
 			continue;
+		}
+		Config_Parse_End(hparser);
+	}
+}
 
-		int n = 0;
-		// C_READ_VAR(C_F_, config.);
-		C_READ_VAR(C_F_BOOT_WITHOUT_DATE, config.boot_without_date);
-		C_READ_VAR(C_F_PRINT_ACCELERATION_DATA, config.print_acceleration_data);
-		C_READ_VAR(C_F_PRINT_POSITION_DATA, config.print_position_data);
-		C_READ_VAR(C_F_PIEZO_COUNT, config.piezo_count);
-		C_READ_VAR(C_F_FIR_TYPE, config.fir_type);
-		C_READ_VAR(C_F_ADXL_RANGE, config.adxl_range);
-		C_READ_VAR(C_F_PAGE_DURATION_MS, config.page_duration_ms);
-		C_READ_VAR(C_F_A_SAMPLING_RATE, config.a_sampling_rate);
-		C_READ_VAR(C_F_P_SAMPLING_RATE, config.p_sampling_rate);
-		C_READ_VAR(C_F_OVERSAMPLING_RATIO, config.oversampling_ratio);
-		C_READ_VAR(C_F_A_BUFFER_LEN, config.a_buffer_len);
-		C_READ_VAR(C_F_P_BUFFER_LEN, config.p_buffer_len);
-	}
-
-	// C_CHECK_VAR(C_F_, config., 0, 1);
-	C_CHECK_VAR(C_F_BOOT_WITHOUT_DATE, config.boot_without_date, 0, 1);
-	C_CHECK_VAR(C_F_PRINT_ACCELERATION_DATA, config.print_acceleration_data, 0, 1);
-	C_CHECK_VAR(C_F_PRINT_POSITION_DATA, config.print_position_data, 0, 1);
-	C_CHECK_VAR(C_F_PIEZO_COUNT, config.piezo_count, 1, PIEZO_COUNT_MAX);
-	C_CHECK_VAR(C_F_FIR_TYPE, config.fir_type, 0, 7);
-	C_CHECK_VAR(C_F_ADXL_RANGE, config.adxl_range, 10, 40);
-	C_CHECK_VAR(C_F_PAGE_DURATION_MS, config.page_duration_ms, 1, 100000000);
-	C_CHECK_VAR(C_F_A_SAMPLING_RATE, config.a_sampling_rate, 1, 100000);
-	C_CHECK_VAR(C_F_P_SAMPLING_RATE, config.p_sampling_rate, 1, 30);
-	C_CHECK_VAR(C_F_OVERSAMPLING_RATIO, config.oversampling_ratio, 1, OVERSAMPLING_RATIO_MAX);
-	C_CHECK_VAR(C_F_A_BUFFER_LEN, config.a_buffer_len, 1, A_BUFFER_LEN_MAX);
-	C_CHECK_VAR(C_F_P_BUFFER_LEN, config.p_buffer_len, 1, P_BUFFER_LEN_MAX);
+// Complete last token
+void Config_Parse_End(Config_Parser_t *hparser)
+{
+	if (hparser->len > 0)
+	{
+		hparser->token[hparser->len] = '\0';
+		if (hparser->overflow)
+		{
+			printf("(%lu) WARNING: Config_Parse: Token \"%s...\" too long, ignored\r\n", HAL_GetTick(), hparser->token);
+		}
+		else
+		{
+			Config_Token(hparser->token);
+		}
+	}
+	hparser->len = 0;
+	hparser->overflow = 0;
+}
+
+// Load config text (null-terminated or size bytes)
+void Config_Load(char *buffer, uint32_t size)
+{
+	Config_Parser_t parser = { 0 };
+	Config_Parse(&parser, buffer, strnlen(buffer, size));
+	Config_Parse_End(&parser);
 }
 
 void Config_Save(char *buffer, uint32_t size)
 {
 	uint32_t i = 0;
-	// C_WRITE_VAR(C_F_, config.);
-	C_WRITE_VAR(C_F_BOOT_WITHOUT_DATE, config.boot_without_date);
-	C_WRITE_VAR(C_F_PRINT_ACCELERATION_DATA, config.print_acceleration_data);
-	C_WRITE_VAR(C_F_PRINT_POSITION_DATA, config.print_position_data);
-	C_WRITE_VAR(C_F_PIEZO_COUNT, config.piezo_count);
-	C_WRITE_VAR(C_F_FIR_TYPE, config.fir_type);
-	C_WRITE_VAR(C_F_ADXL_RANGE, config.adxl_range);
-	C_WRITE_VAR(C_F_PAGE_DURATION_MS, config.page_duration_ms);
-	C_WRITE_VAR(C_F_A_SAMPLING_RATE, config.a_sampling_rate);
-	C_WRITE_VAR(C_F_P_SAMPLING_RATE, config.p_sampling_rate);
-	C_WRITE_VAR(C_F_OVERSAMPLING_RATIO, config.oversampling_ratio);
-	C_WRITE_VAR(C_F_A_BUFFER_LEN, config.a_buffer_len);
-	C_WRITE_VAR(C_F_P_BUFFER_LEN, config.p_buffer_len);
+	buffer[0] = '\0';
+	for (uint32_t k = 0; k < CONFIG_KEY_COUNT; k++)
+	{
+		int n = snprintf(buffer + i, size - i, "%s=%li\r\n", config_keys[k].name, Config_Get(&config, &config_keys[k]));
+		if (n < 0 || i + n >= size)
+		{
+			// Keep complete lines only
+			buffer[i] = '\0';
+			return;
+		}
+		i += n;
+	}
+}
+
+// Apply "key=value" tokens to c, stops at first unknown key or invalid value (described in error, c partially changed)
+HAL_StatusTypeDef Config_Update(config_t *c, const char *buffer, char *error, uint32_t error_size)
+{
+	const char *p = buffer;
+	while (*p != '\0')
+	{
+		// Split at whitespace like Config_Parse
+		uint32_t len = strcspn(p, " \t\r\n");
+		if (len == 0)
+		{
+			p++;
+			continue;
+		}
+		char token[CONFIG_TOKEN_LEN_MAX + 1];
+		if (len > CONFIG_TOKEN_LEN_MAX)
+		{
+			snprintf(error, error_size, "Token \"%.*s...\" too long", CONFIG_TOKEN_LEN_MAX, p);
+			return HAL_ERROR;
+		}
+		memcpy(token, p, len);
+		token[len] = '\0';
+		p += len;
+
+		char *value = strchr(token, '=');
+		if (value == NULL)
+		{
+			snprintf(error, error_size, "Missing value of \"%s\"", token);
+			return HAL_ERROR;
+		}
+		const Config_Key_t *key = Config_Find(token, value - token);
+		if (key == NULL)
+		{
+			snprintf(error, error_size, "Unknown key \"%.*s\"", (int)(value - token), token);
+			return HAL_ERROR;
+		}
+		int32_t v;
+		if (!Config_Value(key, ++value, &v))
+		{
+			snprintf(error, error_size, "Invalid value %s=%s (%li to %li)", key->name, value, key->min, key->max);
+			return HAL_ERROR;
+		}
+		Config_Set(c, key, v);
+	}
+	return HAL_OK;
+}
+
+// Apply one "key=value" token, invalid values are reset to default
+void Config_Token(char *token)
+{
+	char *value = strchr(token, '=');
+	const Config_Key_t *key = value != NULL ? Config_Find(token, value - token) : NULL;
+	if (key == NULL)
+	{
+		printf("(%lu) WARNING: Config_Load: Unknown key \"%s\"\r\n", HAL_GetTick(), token);
+		return;
+	}
+
+	int32_t v;
+	if (!Config_Value(key, ++value, &v))
+	{
+		v = Config_Get(&default_config, key);
+		printf("(%lu) WARNING: Config_Load: Invalid value %s=%s, resetting to %s=%li\r\n", HAL_GetTick(), key->name, value, key->name, v);
+	}
+	Config_Set(&config, key, v);
+}
+
+// Parse decimal value of key, returns 0 if not a number or out of range
+uint8_t Config_Value(const Config_Key_t *key, const char *value, int32_t *v)
+{
+	char *end;
+	long l = strtol(value, &end, 10);
+	if (end == value || *end != '\0' || l < key->min || l > key->max)
+	{
+		return 0;
+	}
+	*v = l;
+	return 1;
+}
+
+// FNV-1a
+uint32_t Config_Hash(const char *name, uint32_t len)
+{
+	uint32_t hash = 2166136261UL;
+	for (uint32_t i = 0; i < len; i++)
+	{
+		hash = (hash ^ (uint8_t)name[i]) * 16777619UL;
+	}
+	return hash;
+}
+
+// Returns key of name (len characters), NULL if unknown
+const Config_Key_t *Config_Find(const char *name, uint32_t len)
+{
+	// Open addressing with linear probing
+	if (!config_hash_table_built)
+	{
+		for (uint32_t k = 0; k < CONFIG_KEY_COUNT; k++)
+		{
+			uint32_t h = Config_Hash(config_keys[k].name, strlen(config_keys[k].name));
+			while (config_hash_table[h & (CONFIG_HASH_SIZE - 1)] != 0)
+			{
+				h++;
+			}
+			config_hash_table[h & (CONFIG_HASH_SIZE - 1)] = k + 1;
+		}
+		config_hash_table_built = 1;
+	}
+
+	for (uint32_t h = Config_Hash(name, len); config_hash_table[h & (CONFIG_HASH_SIZE - 1)] != 0; h++)
+	{
+		const Config_Key_t *key = &config_keys[config_hash_table[h & (CONFIG_HASH_SIZE - 1)] - 1];
+		if (strncmp(key->name, name, len) == 0 && key->name[len] == '\0')
+		{
+			return key;
+		}
+	}
+	return NULL;
+}
+
+int32_t Config_Get(const config_t *c, const Config_Key_t *key)
+{
+	const void *p = (const uint8_t*)c + key->offset;
+	switch (key->type)
+	{
+	case CONFIG_TYPE_uint8_t:
+		return *(const uint8_t*)p;
+	case CONFIG_TYPE_uint16_t:
+		return *(const uint16_t*)p;
+	case CONFIG_TYPE_uint32_t:
+		return *(const uint32_t*)p;
+	case CONFIG_TYPE_int8_t:
+		return *(const int8_t*)p;
+	}
+	return 0;
+}
+
+void Config_Set(config_t *c, const Config_Key_t *key, int32_t value)
+{
+	void *p = (uint8_t*)c + key->offset;
+	switch (key->type)
+	{
+	case CONFIG_TYPE_uint8_t:
+		*(uint8_t*)p = value;
+		break;
+	case CONFIG_TYPE_uint16_t:
+		*(uint16_t*)p = value;
+		break;
+	case CONFIG_TYPE_uint32_t:
+		*(uint32_t*)p = value;
+		break;
+	case CONFIG_TYPE_int8_t:
+		*(int8_t*)p = value;
+		break;
+	}
 }
 
 HAL_StatusTypeDef Config_Init(ADC_HandleTypeDef *hadc1, TIM_HandleTypeDef *htim2, TIM_HandleTypeDef *htim3)
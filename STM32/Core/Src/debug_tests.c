@@ -33,7 +33,7 @@ void Debug_test_print_config()
 	printf("    NMEA_DATE_WAIT_DURATION=%u\r\n", NMEA_DATE_WAIT_DURATION);
 	printf("    NMEA_PACKET_MERGE_DURATION=%u\r\n", NMEA_PACKET_MERGE_DURATION);
 	printf("    NMEA_NO_PACKET_DURATION=%u\r\n", NMEA_NO_PACKET_DURATION);
-	char config_buffer[500];
+	char config_buffer[CONFIG_SAVE_LEN];
 	Config_Save(config_buffer, sizeof(config_buffer));
 	printf("(%lu) Loaded Config:\r\n    ", HAL_GetTick());
 	for (uint32_t i = 0; i < strlen(config_buffer); i++)
@@ -87,13 +87,13 @@ void Debug_test_FIR_frequency_sweep(FIR_t *hfir)
 	printf("]\r\n\r\n");
 }
 
-// Print stats for given acceleration buffer
-void Debug_test_print_a(volatile a_data_point_t *buffer)
+// Trace stats for given acceleration buffer
+void Debug_test_print_a(volatile a_data_point_t *buffer, uint32_t len)
 {
 	uint8_t ch = 1;
 	int16_t pz_min = 5000, pz_max = -5000;
 	int32_t mems_min = 1000000000, mems_max = -1000000000;
-	for (uint16_t i = 0; i < config.a_buffer_len; i++)
+	for (uint32_t i = 0; i < len; i++)
 	{
 		pz_min = buffer[i].a_piezo[ch] < pz_min ? buffer[i].a_piezo[ch] : pz_min;
 		pz_max = buffer[i].a_piezo[ch] > pz_max ? buffer[i].a_piezo[ch] : pz_max;
@@ -104,35 +104,135 @@ void Debug_test_print_a(volatile a_data_point_t *buffer)
 	float pz_offs = (pz_min + pz_max) / 4095.0f * 1.65f;
 	float mems_ampl = mems_max - mems_min;
 	float mems_offs = (mems_min + mems_max) / 2.0f;
-	printf("(%lu) Peak-peak: Piezo: %.3f V\tMEMS: %.3f\tOffset: Piezo: %.3f V\tMEMS: %.3f\r\n", HAL_GetTick(), pz_ampl, mems_ampl, pz_offs, mems_offs);
+	TRACE(TRACE_PRINT_A, pz_ampl, mems_ampl, pz_offs, mems_offs);
 }
 
-// Print data of given position data point
+// Trace data of given position data point
 void Debug_test_print_p(volatile p_data_point_t *dp)
 {
-	uint8_t any_valid = 0;
 	if (dp->complete & (1 << P_COMPLETE_GNSS_TIME))
 	{
-		any_valid = 1;
-		printf("UTC: %02u:%02u:%06.3f ", dp->gnss_hour, dp->gnss_minute, dp->gnss_second);
+		TRACE(TRACE_PRINT_P_TIME, dp->gnss_hour, dp->gnss_minute, dp->gnss_second);
 	}
 	if (dp->complete & (1 << P_COMPLETE_POSITION))
 	{
-		any_valid = 1;
-		printf("Lat/Lon: %.3f %.3f ", dp->lat, dp->lon);
+		TRACE(TRACE_PRINT_P_POSITION, dp->lat, dp->lon);
 	}
 	if (dp->complete & (1 << P_COMPLETE_SPEED))
 	{
-		any_valid = 1;
-		printf("Speed: %.1fkm/h ", dp->speed);
+		TRACE(TRACE_PRINT_P_SPEED, dp->speed);
 	}
 	if (dp->complete & (1 << P_COMPLETE_ALTITUDE))
 	{
-		any_valid = 1;
-		printf("Altitude: %.1fm ", dp->altitude);
+		TRACE(TRACE_PRINT_P_ALTITUDE, dp->altitude);
 	}
-	if (any_valid)
+}
+
+// Reference: previous NMEA parsing (separate checksum pass, strlen and strtof per field)
+uint8_t Debug_test_NMEA_legacy_parse(const char *line, float *values)
+{
+	uint8_t checksum_calc = 0;
+	for (uint16_t i = 1; i < strlen(line); i++)
+	{
+		if (line[i] == '*')
+		{
+			if (((NMEA_Hex2Dec(line[i + 1]) << 4) | NMEA_Hex2Dec(line[i + 2])) != checksum_calc)
+			{
+				return 0;
+			}
+			break;
+		}
+		checksum_calc ^= line[i];
+	}
+	const char *line_pointer = strchr(line, ',') + 1;
+	const char *line_end_pointer = line + strlen(line);
+	for (uint8_t i = 0; i < 12 && line_pointer < line_end_pointer; i++)
+	{
+		char *end_pointer;
+		values[i] = strtof(line_pointer, &end_pointer);
+		line_pointer = strchr(end_pointer, ',') ? strchr(end_pointer, ',') + 1 : line_end_pointer;
+	}
+	return 1;
+}
+
+// Measures parsing time per NMEA sentence (DWT cycle counter) of NMEA_ParseLine and previous strtof parser
+void Debug_test_NMEA_benchmark(NMEA_t *hnmea)
+{
+	const char *lines[] = {
+		"$GNRMC,083559.00,A,4717.11437,N,00833.91522,E,0.004,77.52,091202,,,A*49",
+		"$GNVTG,77.52,T,,M,0.004,N,0.008,K,A*18",
+		"$GNGGA,092725.00,4717.11399,N,00833.91590,E,1,08,1.01,499.6,M,48.0,M,,*45",
+		"$GNGSA,A,3,23,29,07,08,09,18,26,28,,,,,1.94,1.18,1.54*13",
+		"$GPGSV,3,1,10,23,38,230,44,29,71,156,47,07,29,116,41,08,09,081,36*7F",
+		"$GNGLL,4717.11364,N,00833.91565,E,092321.00,A,A*7E",
+	};
+	const uint8_t lines_count = sizeof(lines) / sizeof(lines[0]);
+	const uint16_t iterations = 1000;
+
+	Platform_Cycles_Enable();
+
+	NMEA_Data_t data;
+	uint32_t cycles_start = DWT->CYCCNT;
+	for (uint16_t iter = 0; iter < iterations; iter++)
+	{
+		for (uint8_t i = 0; i < lines_count; i++)
+		{
+			NMEA_ParseLine(hnmea, lines[i], &data);
+		}
+	}
+	uint32_t cycles_new = DWT->CYCCNT - cycles_start;
+
+	float values[12];
+	cycles_start = DWT->CYCCNT;
+	for (uint16_t iter = 0; iter < iterations; iter++)
 	{
-		printf("\r\n");
+		for (uint8_t i = 0; i < lines_count; i++)
+		{
+			Debug_test_NMEA_legacy_parse(lines[i], values);
+		}
+	}
+	uint32_t cycles_legacy = DWT->CYCCNT - cycles_start;
+
+	float ns_per_cycle = 1e9f / SystemCoreClock;
+	printf("(%lu) NMEA benchmark: NMEA_ParseLine %.0f ns/sentence, strtof parser %.0f ns/sentence\r\n", HAL_GetTick(),
+		cycles_new * ns_per_cycle / (iterations * lines_count), cycles_legacy * ns_per_cycle / (iterations * lines_count));
+}
+
+// Stops GNSS as at end of capture, reconfigures it as after MCU reset and measures time to first position fix
+void Debug_test_NMEA_restart(NMEA_t *hnmea)
+{
+	const uint32_t fix_timeout = 120000;
+
+	// Wait for configuration of boot
+	while (hnmea->state != NMEA_STATE_READY && hnmea->state != NMEA_STATE_ERROR)
+	{
+		NMEA_Loop(hnmea);
+	}
+
+	NMEA_Stop(hnmea);
+	HAL_Delay(NMEA_BOOT_DURATION);
+
+	// Module keeps running at configured baud rate, only MCU side is reset
+	HAL_UART_DMAStop(hnmea->huart);
+	if (NMEA_Init(hnmea) == HAL_ERROR)
+	{
+		printf("(%lu) ERROR: Debug_test_NMEA_restart: NMEA_Init failed\r\n", HAL_GetTick());
+		return;
+	}
+
+	uint32_t start = HAL_GetTick();
+	NMEA_Data_t data;
+	while (HAL_GetTick() - start < fix_timeout)
+	{
+		NMEA_Loop(hnmea);
+		while (NMEA_ProcessLine(hnmea, &data))
+		{
+			if (data.position_valid)
+			{
+				printf("(%lu) NMEA restart: Position fix %lu ms after reset\r\n", HAL_GetTick(), HAL_GetTick() - start);
+				return;
+			}
+		}
 	}
+	printf("(%lu) ERROR: Debug_test_NMEA_restart: No position fix within %lu ms after reset (GNSS not started?)\r\n", HAL_GetTick(), fix_timeout);
 }
@@ -0,0 +1,296 @@
+/*
+ * Copyright (c) 2024 Mirco Heitmann
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ * envelope.c
+ *
+ * Envelope analysis of piezo channels (impacts per wheel revolution), written to envelope files (h_X.bin, read by Python/vera_envelope.py)
+ *
+ * Saved acceleration buffers are processed in the main loop in chunks: each piezo channel is band-passed (2nd order high-pass and
+ * low-pass), rectified and low-passed (CMSIS biquads, filter states continue across buffers). The envelope is evaluated at a
+ * decimated rate: an impact is counted when it rises above impact_ratio times its running mean. Crest factor and kurtosis of
+ * the band-passed signal, envelope RMS/peak and impact count are recorded per wheel revolution of the track distance (or after
+ * ENVELOPE_RECORD_MS_MAX) and appended to the envelope file of the current page. The envelope spectrum is computed by the host tool.
+ */
+
+#include "envelope.h"
+
+void Envelope_Biquad(float *coeffs, uint8_t high_pass, float cutoff, uint32_t sampling_rate);
+void Envelope_Reset(Envelope_t *henvelope, volatile a_data_point_t *first);
+void Envelope_Save(Envelope_t *henvelope, uint8_t revolution);
+HAL_StatusTypeDef Envelope_Save_Records(Envelope_t *henvelope);
+void Envelope_Clear(Envelope_t *henvelope);
+
+HAL_StatusTypeDef Envelope_Init(Envelope_t *henvelope)
+{
+	// Init struct
+	henvelope->active = 0;
+	henvelope->filter_valid = 0;
+	henvelope->save_len = 0;
+	henvelope->cycles = 0;
+	henvelope->cycles_max = 0;
+	henvelope->load = 0;
+	henvelope->record_count = 0;
+	henvelope->impact_count = 0;
+	Envelope_Clear(henvelope);
+
+	if (henvelope->band_low == 0)
+	{
+		return HAL_OK;
+	}
+	if (henvelope->band_low >= henvelope->band_high)
+	{
+		printf("(%lu) ERROR: Envelope_Init: Band %u to %u Hz not supported (envelope_band_low >= envelope_band_high)\r\n", HAL_GetTick(), henvelope->band_low, henvelope->band_high);
+		return HAL_ERROR;
+	}
+	// Band depends on a_sampling_rate: envelope analysis is disabled instead of failing the sampling setup
+	if (2 * henvelope->band_high >= henvelope->sampling_rate || henvelope->sampling_rate < 10 * ENVELOPE_DECIMATION)
+	{
+		printf("(%lu) WARNING: Envelope_Init: Band %u to %u Hz not below a_sampling_rate / 2 (%lu Hz), envelope analysis disabled\r\n", HAL_GetTick(), henvelope->band_low, henvelope->band_high, henvelope->sampling_rate / 2);
+		return HAL_OK;
+	}
+
+	// Band-pass: high-pass stage followed by low-pass stage, envelope low-pass below Nyquist frequency of decimated rate
+	Envelope_Biquad(&henvelope->band_coeffs[0], 1, henvelope->band_low, henvelope->sampling_rate);
+	Envelope_Biquad(&henvelope->band_coeffs[5], 0, henvelope->band_high, henvelope->sampling_rate);
+	Envelope_Biquad(henvelope->smooth_coeffs, 0, 0.4f * henvelope->sampling_rate / ENVELOPE_DECIMATION, henvelope->sampling_rate);
+	for (uint8_t i_ch = 0; i_ch < henvelope->piezo_count; i_ch++)
+	{
+		arm_biquad_cascade_df1_init_f32(&henvelope->band[i_ch], 2, henvelope->band_coeffs, henvelope->band_state[i_ch]);
+		arm_biquad_cascade_df1_init_f32(&henvelope->smooth[i_ch], 1, henvelope->smooth_coeffs, henvelope->smooth_state[i_ch]);
+	}
+	henvelope->baseline_alpha = 1000.0f * ENVELOPE_DECIMATION / ((float)ENVELOPE_BASELINE_MS * henvelope->sampling_rate);
+	henvelope->record_len_max = (uint64_t)ENVELOPE_RECORD_MS_MAX * henvelope->sampling_rate / 1000;
+
+	Platform_Cycles_Enable();
+
+	henvelope->active = 1;
+	return HAL_OK;
+}
+
+// Process saved acceleration buffer, call from main loop
+void Envelope_Write(Envelope_t *henvelope, volatile a_data_point_t *buffer, uint32_t len)
+{
+	if (!henvelope->active || len == 0)
+	{
+		return;
+	}
+	uint32_t start = DWT->CYCCNT;
+	henvelope->cycles_write = 0;
+
+	for (uint32_t i_chunk = 0; i_chunk < len; i_chunk += ENVELOPE_CHUNK_LEN)
+	{
+		volatile a_data_point_t *chunk = buffer + i_chunk;
+		uint32_t n = len - i_chunk < ENVELOPE_CHUNK_LEN ? len - i_chunk : ENVELOPE_CHUNK_LEN;
+
+		// Filters restart after gap in timestamps (capture paused, triggered capture)
+		if (henvelope->filter_valid && chunk[0].timestamp != henvelope->next_timestamp)
+		{
+			Envelope_Save(henvelope, 0);
+			henvelope->filter_valid = 0;
+		}
+		uint8_t reset = !henvelope->filter_valid;
+		if (reset)
+		{
+			Envelope_Reset(henvelope, chunk);
+		}
+		henvelope->next_timestamp = chunk[n - 1].timestamp + 1;
+
+		// Band-pass, rectify, low-pass
+		for (uint8_t i_ch = 0; i_ch < henvelope->piezo_count; i_ch++)
+		{
+			for (uint32_t i = 0; i < n; i++)
+			{
+				henvelope->chunk_in[i] = chunk[i].a_piezo[i_ch];
+			}
+			arm_biquad_cascade_df1_f32(&henvelope->band[i_ch], henvelope->chunk_in, henvelope->chunk_band[i_ch], n);
+			arm_abs_f32(henvelope->chunk_band[i_ch], henvelope->chunk_env[i_ch], n);
+			arm_biquad_cascade_df1_f32(&henvelope->smooth[i_ch], henvelope->chunk_env[i_ch], henvelope->chunk_env[i_ch], n);
+			if (reset)
+			{
+				// Running mean starts at mean envelope of second half of first chunk (after settling of low-pass)
+				arm_mean_f32(&henvelope->chunk_env[i_ch][n / 2], n - n / 2, &henvelope->baseline[i_ch]);
+			}
+		}
+
+		for (uint32_t i = 0; i < n; i++)
+		{
+			if (henvelope->record_len == 0)
+			{
+				henvelope->record_timestamp = chunk[i].timestamp;
+				henvelope->record_distance = chunk[i].distance;
+				henvelope->record_distance_valid = (chunk[i].complete >> A_COMPLETE_DISTANCE) & 1;
+			}
+			uint8_t decimated = henvelope->decimation_phase == 0;
+			for (uint8_t i_ch = 0; i_ch < henvelope->piezo_count; i_ch++)
+			{
+				float d = henvelope->chunk_band[i_ch][i];
+				float d2 = d * d;
+				henvelope->m2[i_ch] += d2;
+				henvelope->m4[i_ch] += d2 * d2;
+				henvelope->peak[i_ch] = fmaxf(henvelope->peak[i_ch], fabsf(d));
+				if (!decimated)
+				{
+					continue;
+				}
+
+				// Impact: rising edge above threshold, rearmed below half way between running mean and threshold
+				float e = henvelope->chunk_env[i_ch][i];
+				float threshold = henvelope->baseline[i_ch] * henvelope->impact_ratio / 100;
+				if (henvelope->impact_armed[i_ch] && e > threshold)
+				{
+					henvelope->impact_armed[i_ch] = 0;
+					if (henvelope->impacts[i_ch] < UINT16_MAX)
+					{
+						henvelope->impacts[i_ch]++;
+					}
+					henvelope->impact_count++;
+				}
+				else if (!henvelope->impact_armed[i_ch] && e < (henvelope->baseline[i_ch] + threshold) / 2)
+				{
+					henvelope->impact_armed[i_ch] = 1;
+				}
+				henvelope->baseline[i_ch] += henvelope->baseline_alpha * (e - henvelope->baseline[i_ch]);
+				henvelope->env_m2[i_ch] += e * e;
+				henvelope->env_peak[i_ch] = fmaxf(henvelope->env_peak[i_ch], e);
+			}
+			henvelope->env_count += decimated;
+			henvelope->decimation_phase = (henvelope->decimation_phase + 1) % ENVELOPE_DECIMATION;
+			henvelope->record_len++;
+
+			// Record ends with wheel revolution of track distance or after ENVELOPE_RECORD_MS_MAX
+			uint8_t revolution = henvelope->record_distance_valid && ((chunk[i].complete >> A_COMPLETE_DISTANCE) & 1)
+					&& chunk[i].distance - henvelope->record_distance >= henvelope->circumference;
+			if (revolution || henvelope->record_len >= henvelope->record_len_max)
+			{
+				Envelope_Save(henvelope, revolution);
+			}
+		}
+	}
+
+	// Load relative to buffer duration (without SD writes), envelope analysis is disabled if capture can not keep up
+	henvelope->cycles = DWT->CYCCNT - start - henvelope->cycles_write;
+	if (Platform_Load(henvelope->cycles, henvelope->sampling_rate, len, ENVELOPE_LOAD_MAX, &henvelope->cycles_max, &henvelope->load))
+	{
+		printf("(%lu) WARNING: Envelope_Write: Load %u.%u %% exceeds %u %%, envelope analysis disabled\r\n", HAL_GetTick(), henvelope->load / 10, henvelope->load % 10, ENVELOPE_LOAD_MAX);
+		Envelope_Flush(henvelope);
+		henvelope->active = 0;
+	}
+}
+
+// End current record and write buffered records to envelope file (before page change, capture stopped or reconfigured)
+HAL_StatusTypeDef Envelope_Flush(Envelope_t *henvelope)
+{
+	if (!henvelope->active)
+	{
+		return HAL_OK;
+	}
+	Envelope_Save(henvelope, 0);
+	return Envelope_Save_Records(henvelope);
+}
+
+// Second order Butterworth section (bilinear transform), CMSIS coefficient order {b0, b1, b2, -a1, -a2}
+void Envelope_Biquad(float *coeffs, uint8_t high_pass, float cutoff, uint32_t sampling_rate)
+{
+	float w0 = 2 * PI * cutoff / sampling_rate;
+	float cos_w0 = cosf(w0);
+	float alpha = sinf(w0) / (2 * 0.70710678f);
+	float a0 = 1 + alpha;
+	float b1 = high_pass ? -(1 + cos_w0) : 1 - cos_w0;
+	coeffs[0] = fabsf(b1) / 2 / a0;
+	coeffs[1] = b1 / a0;
+	coeffs[2] = coeffs[0];
+	coeffs[3] = 2 * cos_w0 / a0;
+	coeffs[4] = -(1 - alpha) / a0;
+}
+
+// Start filters with first sample (steady state of high-pass for constant input), clear impact detection
+void Envelope_Reset(Envelope_t *henvelope, volatile a_data_point_t *first)
+{
+	memset(henvelope->band_state, 0, sizeof(henvelope->band_state));
+	memset(henvelope->smooth_state, 0, sizeof(henvelope->smooth_state));
+	for (uint8_t i_ch = 0; i_ch < henvelope->piezo_count; i_ch++)
+	{
+		// State of first stage: {x[n-1], x[n-2], y[n-1], y[n-2]}
+		henvelope->band_state[i_ch][0] = first->a_piezo[i_ch];
+		henvelope->band_state[i_ch][1] = first->a_piezo[i_ch];
+		henvelope->impact_armed[i_ch] = 1;
+	}
+	henvelope->decimation_phase = 0;
+	henvelope->filter_valid = 1;
+}
+
+// Append current record to save buffer, buffer is written to SD if full
+void Envelope_Save(Envelope_t *henvelope, uint8_t revolution)
+{
+	if (henvelope->record_len == 0)
+	{
+		return;
+	}
+	uint32_t size = sizeof(h_data_point_t) + henvelope->piezo_count * sizeof(h_data_channel_t);
+	if (henvelope->save_len + size > ENVELOPE_SAVE_LEN)
+	{
+		Envelope_Save_Records(henvelope);
+	}
+
+	h_data_point_t *point = (h_data_point_t*)(henvelope->save_buffer + henvelope->save_len);
+	point->timestamp = henvelope->record_timestamp;
+	point->sample_count = henvelope->record_len;
+	point->distance = henvelope->record_distance_valid ? henvelope->record_distance : 0;
+	point->revolution = revolution;
+	memset(point->reserved, 0, sizeof(point->reserved));
+	h_data_channel_t *channels = (h_data_channel_t*)(point + 1);
+	for (uint8_t i_ch = 0; i_ch < henvelope->piezo_count; i_ch++)
+	{
+		float m2 = henvelope->m2[i_ch];
+		channels[i_ch].impacts = henvelope->impacts[i_ch];
+		channels[i_ch].reserved = 0;
+		channels[i_ch].crest = m2 > 0 ? henvelope->peak[i_ch] / sqrtf(m2 / henvelope->record_len) : 0;
+		channels[i_ch].kurtosis = m2 > 0 ? henvelope->m4[i_ch] * henvelope->record_len / (m2 * m2) : 0;
+		channels[i_ch].envelope_rms = henvelope->env_count > 0 ? sqrtf(henvelope->env_m2[i_ch] / henvelope->env_count) : 0;
+		channels[i_ch].envelope_peak = henvelope->env_peak[i_ch];
+	}
+	henvelope->save_len += size;
+	henvelope->record_count++;
+	Envelope_Clear(henvelope);
+}
+
+// Write buffered records to envelope file of current page
+HAL_StatusTypeDef Envelope_Save_Records(Envelope_t *henvelope)
+{
+	if (henvelope->save_len == 0)
+	{
+		return HAL_OK;
+	}
+	if (henvelope->hvsd == NULL || henvelope->hvsd->h_file_path[0] == '\0')
+	{
+		henvelope->save_len = 0;
+		return HAL_OK;
+	}
+	uint32_t start = DWT->CYCCNT;
+	HAL_StatusTypeDef status = SD_WriteBuffer(henvelope->hvsd, henvelope->hvsd->h_file_path, henvelope->save_buffer, henvelope->save_len);
+	henvelope->cycles_write += DWT->CYCCNT - start;
+	henvelope->save_len = 0;
+	if (status != HAL_OK)
+	{
+		printf("(%lu) ERROR: Envelope_Save_Records: Writing records failed, envelope analysis disabled\r\n", HAL_GetTick());
+		henvelope->active = 0;
+	}
+	return status;
+}
+
+// Clear features of current record
+void Envelope_Clear(Envelope_t *henvelope)
+{
+	henvelope->record_len = 0;
+	henvelope->env_count = 0;
+	memset(henvelope->m2, 0, sizeof(henvelope->m2));
+	memset(henvelope->m4, 0, sizeof(henvelope->m4));
+	memset(henvelope->peak, 0, sizeof(henvelope->peak));
+	memset(henvelope->env_m2, 0, sizeof(henvelope->env_m2));
+	memset(henvelope->env_peak, 0, sizeof(henvelope->env_peak));
+	memset(henvelope->impacts, 0, sizeof(henvelope->impacts));
+}
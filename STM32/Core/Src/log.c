@@ -10,85 +10,195 @@
 
 #include "log.h"
 
-void Log_Save(Log_t *hlog, char *buffer);
+void Log_Transmit(Log_t *hlog);
+void Log_Save(Log_t *hlog);
 
 void Log_Init(Log_t *hlog)
 {
 	// Provide default values
 	if (hlog->flush_timeout == 0)
 	{
-		hlog->flush_timeout = 100;
+		hlog->flush_timeout = 1000;
 	}
 
 	// Init struct
+	hlog->ring.buffer = hlog->ring_buffer;
+	hlog->ring.size = LOG_RING_SIZE;
+	Ring_Buffer_Init(&hlog->ring);
+	hlog->tx_index = 0;
+	hlog->tx_len = 0;
+	hlog->uart_busy = 0;
+	hlog->cdc_busy = 0;
+	hlog->cdc_index = 0;
+	hlog->cdc_stalled = 0;
+	hlog->cdc_disabled = 0;
+	hlog->sd_len = 0;
 	hlog->last_write = 0;
-	hlog->hbuffer.buffer_1 = hlog->buffer_1;
-	hlog->hbuffer.buffer_2 = hlog->buffer_2;
-	hlog->hbuffer.buffer_len = LOG_BUFFER_LEN;
-	hlog->hbuffer.element_size = sizeof(char);
-
-	Double_Buffer_Init(&hlog->hbuffer);
+	hlog->isr_dropped = 0;
+	hlog->isr_dropped_reported = 0;
 }
 
 void Log_Uninit(Log_t *hlog)
 {
-	Double_Buffer_Flush(&hlog->hbuffer);
-	Log_Loop(hlog);
+	Log_Flush(hlog);
+}
+
+// Called by _write (printf), copies span into queue without blocking
+int Log_Write(Log_t *hlog, const char *data, int len)
+{
+	// Interrupts would be a second producer, count instead
+	if (__get_IPSR() != 0)
+	{
+		hlog->isr_dropped++;
+		return len;
+	}
+
+	// Split spans exceeding the transmit block
+	for (int i = 0; i < len; i += LOG_TX_BUFFER_LEN)
+	{
+		uint32_t chunk = len - i < LOG_TX_BUFFER_LEN ? len - i : LOG_TX_BUFFER_LEN;
+		Ring_Buffer_Write(&hlog->ring, data + i, chunk);
+	}
+	return len;
 }
 
+// Drain queue to UART, USB CDC and log file, call regularly from main loop
 void Log_Loop(Log_t *hlog)
 {
-	if (hlog->hbuffer.write_index > 0 && HAL_GetTick() - hlog->last_write > hlog->flush_timeout)
+	// Report dropped messages (written to queue, output with next block)
+	uint32_t isr_dropped = hlog->isr_dropped;
+	if (isr_dropped != hlog->isr_dropped_reported)
 	{
-		hlog->last_write = HAL_GetTick();
-		Double_Buffer_Flush(&hlog->hbuffer);
+		printf("(%lu) WARNING: Log_Loop: %lu messages from interrupts dropped\r\n", HAL_GetTick(), isr_dropped - hlog->isr_dropped_reported);
+		hlog->isr_dropped_reported = isr_dropped;
+	}
+	uint32_t dropped = Ring_Buffer_Dropped(&hlog->ring);
+	if (dropped > 0)
+	{
+		printf("(%lu) WARNING: Log_Loop: Log buffer full, %lu messages dropped\r\n", HAL_GetTick(), dropped);
 	}
 
-	// If buffer_1 is ready to save
-	if (hlog->hbuffer.flag_save_buffer_1)
+	// Abort transfers which did not complete in time (UART: 10 bits per byte, USB: host not reading)
+	if (hlog->uart_busy && HAL_GetTick() - hlog->tx_start > 100 + hlog->tx_len * 10000 / hlog->huart->Init.BaudRate)
+	{
+		HAL_UART_AbortTransmit(hlog->huart);
+		hlog->uart_busy = 0;
+	}
+	if (hlog->cdc_busy && !hlog->cdc_stalled && HAL_GetTick() - hlog->tx_start > LOG_CDC_TIMEOUT)
 	{
-		Log_Save(hlog, hlog->buffer_1);
-		// Flag buffer_1 as saved
-		hlog->hbuffer.flag_save_buffer_1 = 0;
+		// USB keeps reading cdc_index until CDC_TxCplt, following blocks are output to UART and log file only
+		hlog->cdc_stalled = 1;
 	}
-	// If buffer_2 is ready to save
-	if (hlog->hbuffer.flag_save_buffer_2)
+
+	// Next block once previous block is transmitted
+	if (!hlog->uart_busy && (!hlog->cdc_busy || hlog->cdc_stalled))
 	{
-		Log_Save(hlog, hlog->buffer_2);
-		// Flag buffer_2 as saved
-		hlog->hbuffer.flag_save_buffer_2 = 0;
+		if (hlog->cdc_busy)
+		{
+			hlog->tx_index = !hlog->cdc_index;
+		}
+		uint8_t *tx_buffer = hlog->tx_buffer[hlog->tx_index];
+		hlog->tx_len = 0;
+		uint32_t len;
+		void *entry;
+		while ((entry = Ring_Buffer_Peek(&hlog->ring, &len)) != NULL && hlog->tx_len + len <= LOG_TX_BUFFER_LEN)
+		{
+			memcpy(tx_buffer + hlog->tx_len, entry, len);
+			hlog->tx_len += len;
+			Ring_Buffer_Release(&hlog->ring);
+		}
+		if (hlog->tx_len > 0)
+		{
+			Log_Transmit(hlog);
+		}
 	}
-	if (hlog->hbuffer.flag_overflow)
+
+	// Append to log file in batches
+	if (hlog->sd_len > 0 && (hlog->sd_len > LOG_SD_BUFFER_LEN - LOG_TX_BUFFER_LEN || HAL_GetTick() - hlog->last_write > hlog->flush_timeout))
 	{
-		printf("(%lu) WARNING: Log_Loop: Log buffer overflow\r\n", HAL_GetTick());
+		Log_Save(hlog);
 	}
 }
 
-void Log_Char(Log_t *hlog, char c)
+// Blocking output of all queued messages (e.g. before stopping)
+void Log_Flush(Log_t *hlog)
 {
-	if (c != '\0')
+	uint32_t start = HAL_GetTick();
+	while ((Ring_Buffer_Used(&hlog->ring) > 0 || hlog->uart_busy || (hlog->cdc_busy && !hlog->cdc_stalled)) && HAL_GetTick() - start < 1000)
 	{
-		hlog->last_write = HAL_GetTick();
-		// Save via double buffering
-		*((char*)Double_Buffer_Current(&hlog->hbuffer)) = c;
-		Double_Buffer_Increment(&hlog->hbuffer);
+		Log_Loop(hlog);
 	}
+	Log_Save(hlog);
 }
 
-void Log_Save(Log_t *hlog, char *buffer)
+// Start transmission of block in tx_buffer[tx_index], copy to log file batch
+void Log_Transmit(Log_t *hlog)
 {
-	// Save to log file
-	if (hlog->hvsd != NULL)
+	uint8_t *tx_buffer = hlog->tx_buffer[hlog->tx_index];
+	hlog->tx_start = HAL_GetTick();
+
+	// Batch for log file (kept until log file is created)
+	if (hlog->sd_len + hlog->tx_len > LOG_SD_BUFFER_LEN)
+	{
+		Log_Save(hlog);
+	}
+	if (hlog->sd_len + hlog->tx_len <= LOG_SD_BUFFER_LEN)
 	{
-		SD_WriteBuffer(hlog->hvsd, hlog->hvsd->log_file_path, (void*)buffer, hlog->hbuffer.save_len);
+		memcpy(hlog->sd_buffer + hlog->sd_len, tx_buffer, hlog->tx_len);
+		hlog->sd_len += hlog->tx_len;
 	}
 
-	// Write to UART
+	// Write to UART, completed in Log_UART_TxCplt
 	if (hlog->huart != NULL)
 	{
-		HAL_UART_Transmit(hlog->huart, (uint8_t*)buffer, hlog->hbuffer.save_len, 100);
+		hlog->uart_busy = 1;
+		if (HAL_UART_Transmit_DMA(hlog->huart, tx_buffer, hlog->tx_len) != HAL_OK)
+		{
+			hlog->uart_busy = 0;
+		}
+	}
+
+	// Write to USB CDC (if host is connected and reading), completed in Log_CDC_TxCplt
+	if (!hlog->cdc_disabled && !hlog->cdc_busy)
+	{
+		hlog->cdc_stalled = 0;
+		hlog->cdc_busy = 1;
+		hlog->cdc_index = hlog->tx_index;
+		if (CDC_Transmit_FS(tx_buffer, hlog->tx_len) != USBD_OK)
+		{
+			hlog->cdc_busy = 0;
+		}
+	}
+}
+
+// Append batch to log file
+void Log_Save(Log_t *hlog)
+{
+	hlog->last_write = HAL_GetTick();
+	if (hlog->hvsd == NULL || hlog->hvsd->log_file_path[0] == '\0' || hlog->sd_len == 0)
+	{
+		return;
 	}
 
-	// Write to USB CDC
-	CDC_Transmit_FS((uint8_t*)buffer, hlog->hbuffer.save_len);
+	uint32_t sd_len = hlog->sd_len;
+	hlog->sd_len = 0;
+	if (SD_WriteBuffer(hlog->hvsd, hlog->hvsd->log_file_path, hlog->sd_buffer, sd_len) != HAL_OK)
+	{
+		// Do not retry, the error message would be logged again
+		hlog->hvsd = NULL;
+		printf("(%lu) WARNING: Log_Save: Log file disabled\r\n", HAL_GetTick());
+	}
+}
+
+// Call from HAL_UART_TxCpltCallback
+void Log_UART_TxCplt(Log_t *hlog)
+{
+	hlog->uart_busy = 0;
+}
+
+// Call from CDC_TxCpltCallback
+void Log_CDC_TxCplt(Log_t *hlog)
+{
+	hlog->cdc_busy = 0;
+	hlog->cdc_stalled = 0;
 }
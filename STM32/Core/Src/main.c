@@ -19,24 +19,44 @@
 #include "usbd_cdc_if.h"
 #include "platform.h"
 #include "log.h"
+#include "trace.h"
 #include "sd.h"
 #include "config.h"
 #include "data_points.h"
 #include "debug_tests.h"
 #include "adxl.h"
 #include "nmea.h"
+#include "track.h"
+#include "stream.h"
+#include "msc.h"
+#include "command.h"
 #include "fir.h"
 #include "fir_taps.h"
+#include "psd.h"
+#include "envelope.h"
+#include "stats.h"
+#include "trigger.h"
 #include "double_buffering.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
 /* USER CODE BEGIN PTD */
+// Boot steps in order of execution, duration of each step is logged
+typedef enum
+{
+	BOOT_PERIPHERALS,
+	BOOT_GNSS,
+	BOOT_SD,
+	BOOT_CONFIG,
+	BOOT_SAMPLING,
+	BOOT_DIR,
+	BOOT_START,
+	BOOT_STEP_COUNT
+} Main_Boot_Step_t;
 /* USER CODE END PTD */
 
 /* Private define ------------------------------------------------------------*/
 /* USER CODE BEGIN PD */
-#define PUTCHAR_PROTOTYPE int __io_putchar(int ch)
 /* USER CODE END PD */
 
 /* Private macro -------------------------------------------------------------*/
@@ -66,27 +86,44 @@ UART_HandleTypeDef huart1;
 UART_HandleTypeDef huart3;
 DMA_HandleTypeDef hdma_uart7_rx;
 DMA_HandleTypeDef hdma_usart1_rx;
+DMA_HandleTypeDef hdma_usart3_tx;
 
 /* USER CODE BEGIN PV */
 Log_t hlog; // Logger
+Trace_t htrace; // Binary trace log
 Vera_SD_t hvsd1; // SD card
 ADXL_t hadxl; // MEMS sensor ADXL-357
 NMEA_t hnmea; // GNSS module Navilock 62528
+Track_t htrack; // Track distance estimation
+Stream_t hstream; // Live streaming via USB CDC
+MSC_t hmsc; // USB mass storage mode after capture
+Command_t hcommand; // Host commands via USB CDC
+extern USBD_HandleTypeDef hUsbDeviceFS;
 FIR_t hfir_pz[PIEZO_COUNT_MAX]; // FIR filters for ADC channels
+Psd_t hpsd; // Power spectral density of acceleration channels
+Envelope_t henvelope; // Envelope analysis of piezo channels (impacts per wheel revolution)
+Stats_t hstats; // Statistics of each acceleration buffer
+Trigger_t htrigger; // Triggered capture (event windows)
 Double_Buffer_t hbuffer_a, hbuffer_p; // Manages double buffering flags for acceleration and position buffers
 
+const char *boot_step_names[BOOT_STEP_COUNT] = { "peripherals", "gnss", "sd", "config", "sampling", "dir", "start" };
+uint32_t boot_step_end[BOOT_STEP_COUNT]; // Time at end of each boot step
 uint32_t last_page_change = 0; // Time of last call to SD_NewPage
+uint32_t button_last_pressed = 0; // Stop button is ignored until released for BUTTON_DEBOUNCE_DURATION
 volatile uint8_t capture_running = 0; // 0: Not running, 1: running
+volatile uint8_t capture_paused = 0; // 1: Acceleration sampling paused by host command (timestamps continue)
+volatile uint8_t a_buffer_restart = 0; // 1: Next tick fills current data point (after pause or reconfiguration)
 volatile uint32_t ticks_counter = 0; // Increments with each acceleration data point
 uint32_t time_p_inc = 0; // When a valid NMEA packet is received, this is set to end time of current data point (NMEA_PACKET_MERGE_DURATION)
 uint32_t time_p_last = 0; // Time of last NMEA packet
 uint32_t time_p_last_lock = 0; // Time of last NMEA packet with valid position
+uint32_t time_gnss_save = 0; // Time of last GNSS warm start save
+NMEA_WarmStart_t gnss_state; // Last known GNSS state for warm start
 
 volatile uint16_t pz_dma_buffer[PIEZO_COUNT_MAX * OVERSAMPLING_RATIO_MAX]; // DMA buffer for piezo ADC data, stores n samples (where n is the oversampling ratio)
 
-// Double buffering arrays and pointers to current element
-volatile a_data_point_t a_buffer_1[A_BUFFER_LEN_MAX];
-volatile a_data_point_t a_buffer_2[A_BUFFER_LEN_MAX];
+// Double buffering arrays and pointers to current element (acceleration: two buffers of A_BUFFER_LEN_MAX or ring of trigger blocks)
+volatile a_data_point_t a_buffer[2 * A_BUFFER_LEN_MAX];
 volatile a_data_point_t *a_current_data_point;
 volatile p_data_point_t p_buffer_1[P_BUFFER_LEN_MAX];
 volatile p_data_point_t p_buffer_2[P_BUFFER_LEN_MAX];
@@ -95,6 +132,7 @@ volatile p_data_point_t *p_current_data_point;
 // Flags for current data point (allow for atomic set operations in IRQ's)
 volatile uint8_t flag_complete_a_mems = 0;
 volatile uint8_t flag_complete_a_pz = 0;
+volatile uint8_t flag_complete_a_distance = 0;
 volatile uint8_t flag_complete_p_position = 0;
 volatile uint8_t flag_complete_p_speed = 0;
 volatile uint8_t flag_complete_p_altitude = 0;
@@ -119,8 +157,25 @@ void Main_Save_a_Buffer(volatile a_data_point_t *buffer);
 void Main_Save_p_Buffer(volatile p_data_point_t *buffer);
 void Main_Double_Buffer_Loop();
 void Main_NMEA_Loop();
+void Main_NMEA_Date(NMEA_Data_t *data);
+void Main_GNSS_Load();
+void Main_GNSS_Save(uint8_t request_database);
 void Main_Increment_a_Buffer();
 void Main_Increment_p_Buffer();
+HAL_StatusTypeDef Main_Sampling_Init();
+HAL_StatusTypeDef Main_Sampling_Start();
+void Main_Sampling_Stop();
+void Main_Update_Headers();
+void Main_Command_Loop();
+void Main_Command_Set(char *args);
+void Main_Command_Save();
+void Main_Command_Stats();
+void Main_Trigger_Thresholds();
+void Main_Capture_Pause();
+void Main_Capture_Resume();
+void Main_Boot_Step(Main_Boot_Step_t step);
+uint32_t Main_Page_Duration();
+int Main_Boot_Format(char *buffer, uint32_t size);
 /* USER CODE END PFP */
 
 /* Private user code ---------------------------------------------------------*/
@@ -179,17 +234,10 @@ int main(void)
 	}
 #endif
 
-	// Boot blink sequence
-	for (uint8_t i = 0; i < 3; i++)
-	{
-		HAL_GPIO_WritePin(LED_GNSS_LOCK, i == 0 ? GPIO_PIN_SET : GPIO_PIN_RESET);
-		HAL_GPIO_WritePin(LED_ACTIVE, i == 1 ? GPIO_PIN_SET : GPIO_PIN_RESET);
-		HAL_GPIO_WritePin(LED_ERROR, i == 2 ? GPIO_PIN_SET : GPIO_PIN_RESET);
-		HAL_Delay(125);
-	}
-	HAL_GPIO_WritePin(LED_GNSS_LOCK, GPIO_PIN_RESET);
-	HAL_GPIO_WritePin(LED_ACTIVE, GPIO_PIN_RESET);
-	HAL_GPIO_WritePin(LED_ERROR, GPIO_PIN_RESET);
+	// All LEDs on while booting (LED test), capture start is indicated by "Active" LED only
+	HAL_GPIO_WritePin(LED_GNSS_LOCK, GPIO_PIN_SET);
+	HAL_GPIO_WritePin(LED_ACTIVE, GPIO_PIN_SET);
+	HAL_GPIO_WritePin(LED_ERROR, GPIO_PIN_SET);
 	HAL_GPIO_WritePin(Debug1_GPIO_Port, Debug1_Pin, GPIO_PIN_RESET);
 	HAL_GPIO_WritePin(Debug2_GPIO_Port, Debug2_Pin, GPIO_PIN_RESET);
 
@@ -201,24 +249,40 @@ int main(void)
 		HAL_GPIO_TogglePin(LED_GNSS_LOCK);
 	}
 
-	// Provide some time to connect virtual COM port
-	HAL_Delay(2500);
+	// No delay for connecting virtual COM port, boot messages are kept in log file and boot durations are queried with "stats" command
 
 	// Init logger
 	hlog.huart = &huart3;
 	hlog.hvsd = &hvsd1;
-	hlog.flush_timeout = 100;
+	hlog.flush_timeout = 1000;
 	Log_Init(&hlog);
+	htrace.hvsd = &hvsd1;
+	htrace.flush_timeout = 1000;
+	Trace_Init(&htrace);
 
 	printf("\r\n\r\n(%lu) Booting...\r\n", HAL_GetTick());
+	Main_Boot_Step(BOOT_PERIPHERALS);
 
 #if DEBUG_TEST_FAST_BOOT
 	Debug_test_fast_boot(&hadc1, &htim2, &htim3, (uint16_t*)pz_dma_buffer);
 	capture_running = 1;
+	Log_Flush(&hlog);
 	while (1)
 		;
 #endif
 
+	// Initialize Navilock 62528 first, the module boots while SD card and sampling are initialized (configured in NMEA_Loop)
+	hnmea.huart = &NMEA_HUART;
+	hnmea.baud = 115200;
+	hnmea.tx_timeout = 1000;
+	hnmea.rx_timeout = 1000;
+	hnmea.sampling_rate = default_config.p_sampling_rate;
+	if (NMEA_Init(&hnmea) == HAL_ERROR)
+	{
+		Error_Handler();
+	}
+	Main_Boot_Step(BOOT_GNSS);
+
 	// Init SD card
 	hvsd1.Detect_GPIO_Port = uSD_Detect_GPIO_Port;
 	hvsd1.Detect_Pin = uSD_Detect_Pin;
@@ -230,33 +294,35 @@ int main(void)
 		Error_Handler();
 	}
 	printf("(%lu) SD card initialized\r\n", HAL_GetTick());
+	Main_Boot_Step(BOOT_SD);
 
 	// Load default configuration
 	Config_Default();
 #if LOAD_CONFIG
 	// Load configuration from SD card
-	char config_buffer[500];
 	if (SD_FileExists(&hvsd1, CONFIG_FILE_PATH))
 	{
 		printf("(%lu) Config found, reading...\r\n", HAL_GetTick());
-		UINT config_buffer_size = 0;
-		if (SD_ReadBuffer(&hvsd1, CONFIG_FILE_PATH, config_buffer, sizeof(config_buffer), &config_buffer_size) != HAL_OK)
-		{
-			Error_Handler();
-		}
-		if (config_buffer_size < sizeof(config_buffer))
-		{
-			config_buffer[config_buffer_size] = '\0';
-			Config_Load(config_buffer, strlen(config_buffer));
-		}
-		else
+		// Parse file in chunks, no size limit
+		char config_chunk[512];
+		Config_Parser_t config_parser = { 0 };
+		FSIZE_t config_offset = 0;
+		UINT config_chunk_size;
+		do
 		{
-			printf("(%lu) Config file too large, using default\r\n", HAL_GetTick());
-		}
+			if (SD_ReadBufferAt(&hvsd1, CONFIG_FILE_PATH, config_offset, config_chunk, sizeof(config_chunk), &config_chunk_size) != HAL_OK)
+			{
+				Error_Handler();
+			}
+			Config_Parse(&config_parser, config_chunk, config_chunk_size);
+			config_offset += config_chunk_size;
+		} while (config_chunk_size == sizeof(config_chunk));
+		Config_Parse_End(&config_parser);
 	}
 	else
 	{
 		printf("(%lu) No config found, writing default...\r\n", HAL_GetTick());
+		char config_buffer[CONFIG_SAVE_LEN];
 		Config_Save(config_buffer, sizeof(config_buffer));
 		if (SD_TouchFile(&hvsd1, CONFIG_FILE_PATH) != HAL_OK)
 		{
@@ -271,79 +337,28 @@ int main(void)
 #if !DEBUG_TEST_NO_CONFIG_LOG
 	Debug_test_print_config();
 #endif
+	Main_Boot_Step(BOOT_CONFIG);
 
-	// Initialize based on config
-	if (Config_Init(&hadc1, &htim2, &htim3) != HAL_OK)
+	// Initialize timers, ADC, buffers, ADXL357, track distance estimation and FIR filters based on config
+	if (Main_Sampling_Init() != HAL_OK)
 	{
 		Error_Handler();
 	}
 	printf("(%lu) Configuration loaded\r\n", HAL_GetTick());
+	Main_Boot_Step(BOOT_SAMPLING);
 
-	// Init acceleration data double buffering
-	hbuffer_a.buffer_len = config.a_buffer_len;
-	hbuffer_a.buffer_1 = a_buffer_1;
-	hbuffer_a.buffer_2 = a_buffer_2;
-	hbuffer_a.element_size = sizeof(a_data_point_t);
-	Double_Buffer_Init(&hbuffer_a);
-	a_current_data_point = Double_Buffer_Current(&hbuffer_a);
+	// Initialize live streaming (started by host)
+	hstream.sampling_rate = config.a_sampling_rate;
+	hstream.piezo_count = config.piezo_count;
+	hstream.oversampling_ratio = config.oversampling_ratio;
+	Stream_Init(&hstream);
 
-	// Init position data double buffering
-	hbuffer_p.buffer_len = config.p_buffer_len;
-	hbuffer_p.buffer_1 = p_buffer_1;
-	hbuffer_p.buffer_2 = p_buffer_2;
-	hbuffer_p.element_size = sizeof(p_data_point_t);
-	Double_Buffer_Init(&hbuffer_p);
-	p_current_data_point = Double_Buffer_Current(&hbuffer_p);
-
-	// Initialize ADXL357
-	hadxl.hspi = &ADXL_SPI;
-	hadxl.sampling_rate = config.a_sampling_rate;
-	hadxl.acceleration_range = config.adxl_range;
-	hadxl.timeout = 100;
-	hadxl.CS_GPIO_Port = ADXL_CS_GPIO_Port;
-	hadxl.CS_Pin = ADXL_CS_Pin;
-	if (ADXL_Init(&hadxl) == HAL_ERROR)
-	{
-		Error_Handler();
-	}
+	// Initialize command channel (commands are processed once capture is running)
+	Command_Init(&hcommand);
 
-	// Initialize Navilock 62528
-	hnmea.huart = &NMEA_HUART;
-	hnmea.baud = 115200;
-	hnmea.tx_timeout = 1000;
-	hnmea.rx_timeout = 1000;
+	// Load saved GNSS state for warm start (sent once GNSS module is configured)
 	hnmea.sampling_rate = config.p_sampling_rate;
-	if (NMEA_Init(&hnmea) == HAL_ERROR)
-	{
-		Error_Handler();
-	}
-
-	// Wait for GNSS date if configured
-	if (!config.boot_without_date)
-	{
-		NMEA_Data_t gnss_data = NMEA_GetDate(&hnmea);
-		if (gnss_data.date_valid)
-		{
-			// Received valid date
-			hvsd1.date_year = gnss_data.year + 2000;
-			hvsd1.date_month = gnss_data.month;
-			hvsd1.date_day = gnss_data.day;
-			printf("(%lu) GNSS date: %04hu-%02u-%02u", HAL_GetTick(), hvsd1.date_year, hvsd1.date_month, hvsd1.date_day);
-			if (gnss_data.time_valid)
-			{
-				// Received valid time
-				printf(" UTC time: %02u:%02u:%06.3f\r\n", gnss_data.hour, gnss_data.minute, gnss_data.second);
-			}
-			else
-			{
-				printf("\r\n");
-			}
-		}
-		else
-		{
-			printf("(%lu) WARNING: No GNSS date received, saving as %04hu_%02u_%02u\r\n", HAL_GetTick(), hvsd1.date_year, hvsd1.date_month, hvsd1.date_day);
-		}
-	}
+	Main_GNSS_Load();
 
 	// Create directory, initialize files
 	if (SD_InitDir(&hvsd1) != HAL_OK)
@@ -357,6 +372,7 @@ int main(void)
 			printf("(%lu) ERROR: main: Create error dir (\"%s\") failed, is the SD card read-only?\r\n", HAL_GetTick(), hvsd1.dir_path);
 			// Creating date-based directory failed and creating fallback directory failed, appearently no write access to the SD card
 			Error_Handler();
+			Log_Flush(&hlog);
 			while (1)
 				;
 		}
@@ -366,24 +382,19 @@ int main(void)
 			printf("(%lu) ERROR: main: SD_UpdateFilepaths failed, is the SD card read-only?\r\n", HAL_GetTick());
 			// Creating files in directory failed, appearently files can not be written to the SD card
 			Error_Handler();
+			Log_Flush(&hlog);
 			while (1)
 				;
 		}
 	}
-	printf("(%lu) Writing dir \"%s\"\r\n", HAL_GetTick(), hvsd1.dir_path);
-
-	// Init digital FIR filter
-	if (config.fir_type > 0)
+	else if (!config.boot_without_date)
 	{
-		for (uint8_t i_ch = 0; i_ch < config.piezo_count; i_ch++)
-		{
-			// Copy FIR taps (selected in config file) to taps array of filter instance
-			memcpy(hfir_pz[i_ch].Taps, fir_taps_types[config.fir_type], fir_taps_lens[config.fir_type] * sizeof(q15_t));
-			// Set filter taps count
-			hfir_pz[i_ch].Nt = fir_taps_lens[config.fir_type];
-			FIR_Init(&hfir_pz[i_ch]);
-		}
+		// Capture starts without date, directory is renamed when GNSS date is received
+		hvsd1.dir_provisional = 1;
+		printf("(%lu) Waiting for GNSS date in background (timeout after %i s)...\r\n", HAL_GetTick(), NMEA_DATE_WAIT_DURATION / 1000);
 	}
+	printf("(%lu) Writing dir \"%s\"\r\n", HAL_GetTick(), hvsd1.dir_path);
+	Main_Boot_Step(BOOT_DIR);
 
 	a_current_data_point->timestamp = 0;
 	p_current_data_point->timestamp = 0;
@@ -392,53 +403,45 @@ int main(void)
 	Debug_test_FIR_frequency_sweep(&hfir_pz[0]);
 #endif
 
+#if DEBUG_TEST_NMEA_BENCHMARK
+	Debug_test_NMEA_benchmark(&hnmea);
+#endif
+
+#if DEBUG_TEST_NMEA_RESTART
+	Debug_test_NMEA_restart(&hnmea);
+#endif
+
 #if DEBUG_TEST_FIR_DAC
 	HAL_DAC_Start(&hdac, DAC_CHANNEL_2);
 #endif
 
-	// If button is still held down (for SD card formatting), wait for release. Otherwise capture is stopped immediately
-	while (HAL_GPIO_ReadPin(USER_Btn_GPIO_Port, USER_Btn_Pin) == GPIO_PIN_SET)
-		;
-	// Debounce delay
-	HAL_Delay(250);
-
-	// Start piezo ADC
-	if (HAL_ADC_Start_DMA(&hadc1, (uint32_t*)pz_dma_buffer, config.piezo_count * config.oversampling_ratio) == HAL_ERROR)
+	// Start piezo ADC, oversampling timer and regular sampling timer
+	if (Main_Sampling_Start() != HAL_OK)
 	{
-		printf("(%lu) ERROR: main: ADC1 HAL_ADC_Start_DMA failed\r\n", HAL_GetTick());
-		Error_Handler();
-	}
-	// Start oversampling timer
-	if (HAL_TIM_Base_Start_IT(&htim2) == HAL_ERROR)
-	{
-		printf("(%lu) ERROR: main: HAL_TIM_Base_Start_IT failed\r\n", HAL_GetTick());
-		Error_Handler();
-	}
-	// Start regular sampling timer
-	if (HAL_TIM_Base_Start_IT(&htim3) == HAL_ERROR)
-	{
-		printf("(%lu) ERROR: main: HAL_TIM_Base_Start_IT failed\r\n", HAL_GetTick());
 		Error_Handler();
 	}
 
+	Main_Boot_Step(BOOT_START);
+
 	uint32_t boot_duration = HAL_GetTick();
-	printf("(%lu) Capture started\r\n", boot_duration);
-	HAL_Delay(hlog.flush_timeout);
+	char boot_steps[150];
+	Main_Boot_Format(boot_steps, sizeof(boot_steps));
+	printf("(%lu) Capture started (boot: %s)\r\n", boot_duration, boot_steps);
 	Log_Loop(&hlog);
 
 	// Write file headers
 	hvsd1.a_header.version = VERSION;
-	hvsd1.a_header.a_buffer_len = config.a_buffer_len;
-	hvsd1.a_header.a_sampling_rate = config.a_sampling_rate;
 	hvsd1.a_header.boot_duration = boot_duration;
-	hvsd1.a_header.fir_taps_len = fir_taps_lens[config.fir_type];
-	hvsd1.a_header.oversampling_ratio = config.oversampling_ratio;
 	hvsd1.a_header.piezo_count_max = PIEZO_COUNT_MAX;
-	hvsd1.a_header.piezo_count = config.piezo_count;
 	hvsd1.p_header.version = VERSION;
-	hvsd1.p_header.p_buffer_len = config.p_buffer_len;
-	hvsd1.p_header.p_sampling_rate = config.p_sampling_rate;
 	hvsd1.p_header.boot_duration = boot_duration;
+	hvsd1.f_header.version = PSD_VERSION;
+	hvsd1.f_header.boot_duration = boot_duration;
+	hvsd1.h_header.version = ENVELOPE_VERSION;
+	hvsd1.h_header.boot_duration = boot_duration;
+	hvsd1.s_header.version = STATS_VERSION;
+	hvsd1.s_header.boot_duration = boot_duration;
+	Main_Update_Headers();
 	hvsd1.p_header.year = hvsd1.date_year;
 	hvsd1.p_header.month = hvsd1.date_month;
 	hvsd1.p_header.day = hvsd1.date_day;
@@ -453,8 +456,12 @@ int main(void)
 #if DEBUG_TEST_PRINT_NEW_PAGE
 	printf("(%lu) Page %li (\"%s\", \"%s\")\r\n", HAL_GetTick(), hvsd1.page_num, hvsd1.a_file_path, hvsd1.p_file_path);
 #endif
-	// Activate LED
+	// Activate LED (end of LED test)
+	HAL_GPIO_WritePin(LED_GNSS_LOCK, GPIO_PIN_RESET);
+	HAL_GPIO_WritePin(LED_ERROR, GPIO_PIN_RESET);
 	HAL_GPIO_WritePin(LED_ACTIVE, GPIO_PIN_SET);
+	// If button is still held down (for SD card formatting), it is ignored until released. Otherwise capture is stopped immediately
+	button_last_pressed = HAL_GetTick();
 	capture_running = 1;
 	/* USER CODE END 2 */
 
@@ -483,39 +490,78 @@ int main(void)
 
 		// Process double buffering (save buffers to file)
 		Main_Double_Buffer_Loop();
-		// Process NMEA packets (parse line from circular buffer to p_data_point_t)
+		// Configure GNSS module (non-blocking)
+		NMEA_Loop(&hnmea);
+		// Process NMEA packets (parse line from line queue to p_data_point_t)
 		Main_NMEA_Loop();
-		// Write to log (UART, USB CDC, log file)
+		// Save GNSS state for warm start periodically
+		if (HAL_GetTick() - time_gnss_save > NMEA_WARM_START_SAVE_INTERVAL && gnss_state.position_valid)
+		{
+			Main_GNSS_Save(1);
+			time_gnss_save = HAL_GetTick();
+		}
+		if (NMEA_DatabaseComplete(&hnmea))
+		{
+			SD_WriteFile(&hvsd1, GNSS_DBD_FILE_PATH, (void*)hnmea.dbd_buffer, hnmea.dbd_len);
+		}
+		// Host commands via USB CDC
+		Main_Command_Loop();
+		// Live streaming via USB CDC
+		Stream_Loop(&hstream);
+		hlog.cdc_disabled = hstream.active;
+		// Write to log (UART, USB CDC, log file) and trace file
 		Log_Loop(&hlog);
+		Trace_Loop(&htrace);
 
 		// Create new file after page_duration
-		if (HAL_GetTick() - last_page_change > config.page_duration_ms)
+		if (HAL_GetTick() - last_page_change > Main_Page_Duration())
 		{
+			Envelope_Flush(&henvelope);
+			Stats_Flush(&hstats);
 			SD_NewPage(&hvsd1);
 #if DEBUG_TEST_PRINT_NEW_PAGE
-			printf("(%lu) Page %li (\"%s\", \"%s\")\r\n", HAL_GetTick(), hvsd1.page_num, hvsd1.a_file_path, hvsd1.p_file_path);
+			TRACE(TRACE_PAGE, hvsd1.page_num);
 #endif
 			last_page_change = HAL_GetTick();
 		}
 
 		DEBUG_MAIN_LOOP
 
-		// Poll stop button
+		// Poll stop button (debounced)
 		if (HAL_GPIO_ReadPin(USER_Btn_GPIO_Port, USER_Btn_Pin) == GPIO_PIN_SET)
 		{
-			capture_running = 0;
+			if (HAL_GetTick() - button_last_pressed > BUTTON_DEBOUNCE_DURATION)
+			{
+				capture_running = 0;
+			}
+			button_last_pressed = HAL_GetTick();
 		}
 	}
 
 	// Stop sampling timers and ADC
-	HAL_TIM_Base_Stop_IT(&htim2);
-	HAL_TIM_Base_Stop_IT(&htim3);
-	HAL_ADC_Stop_IT(&hadc1);
+	Main_Sampling_Stop();
 
 	// Save remaining data
 	Double_Buffer_Flush(&hbuffer_a);
 	Double_Buffer_Flush(&hbuffer_p);
 	Main_Double_Buffer_Loop();
+	Trigger_Flush(&htrigger);
+	Envelope_Flush(&henvelope);
+	Stats_Flush(&hstats);
+
+	// Save GNSS state and navigation database for warm start, stop GNSS module
+	if (gnss_state.position_valid)
+	{
+		Main_GNSS_Save(1);
+		while (hnmea.dbd_receiving)
+		{
+			if (NMEA_DatabaseComplete(&hnmea))
+			{
+				SD_WriteFile(&hvsd1, GNSS_DBD_FILE_PATH, (void*)hnmea.dbd_buffer, hnmea.dbd_len);
+			}
+		}
+	}
+	NMEA_Stop(&hnmea);
 
 	// Deactivate LEDs
 	HAL_GPIO_WritePin(LED_GNSS_LOCK, GPIO_PIN_RESET);
@@ -524,9 +570,31 @@ int main(void)
 	printf("(%lu) Capture stopped (\"%s\")\r\n", HAL_GetTick(), hvsd1.dir_path);
 
 	// Uninit
+	Trace_Uninit(&htrace);
 	Log_Uninit(&hlog);
 	SD_Uninit(&hvsd1);
 
+	// Provide SD card via USB until reset (log via UART only)
+	if (config.usb_mass_storage)
+	{
+		hlog.hvsd = NULL;
+		hlog.cdc_disabled = 1;
+		hmsc.pdev = &hUsbDeviceFS;
+		hmsc.pdrv = hvsd1.fatfs_path[0] - '0';
+		// Acceleration buffers are unused once capture is stopped
+		hmsc.buffer[0] = (uint8_t*)a_buffer;
+		hmsc.buffer[1] = (uint8_t*)a_buffer + MSC_BUFFER_SIZE;
+		if (MSC_Start(&hmsc) == HAL_OK)
+		{
+			printf("(%lu) USB mass storage mode\r\n", HAL_GetTick());
+		}
+		while (1)
+		{
+			MSC_Loop(&hmsc);
+			Log_Loop(&hlog);
+		}
+	}
+
 	// Stop running
 	while (1)
 		;
@@ -994,6 +1062,9 @@ static void MX_DMA_Init(void)
 	/* DMA1_Stream3_IRQn interrupt configuration */
 	HAL_NVIC_SetPriority(DMA1_Stream3_IRQn, 0, 0);
 	HAL_NVIC_EnableIRQ(DMA1_Stream3_IRQn);
+	/* DMA1_Stream4_IRQn interrupt configuration */
+	HAL_NVIC_SetPriority(DMA1_Stream4_IRQn, 3, 0);
+	HAL_NVIC_EnableIRQ(DMA1_Stream4_IRQn);
 	/* DMA2_Stream0_IRQn interrupt configuration */
 	HAL_NVIC_SetPriority(DMA2_Stream0_IRQn, 1, 1);
 	HAL_NVIC_EnableIRQ(DMA2_Stream0_IRQn);
@@ -1139,23 +1210,61 @@ static void MX_GPIO_Init(void)
 }
 
 /* USER CODE BEGIN 4 */
-// Called by printf, redirected to logger
-PUTCHAR_PROTOTYPE
+// Called by printf (stdout is line buffered), redirected to logger
+int _write(int file, char *ptr, int len)
 {
-	Log_Char(&hlog, ch);
-	return ch;
+	(void)file;
+	return Log_Write(&hlog, ptr, len);
+}
+
+// Log transmission completed
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart)
+{
+	if (huart->Instance == hlog.huart->Instance)
+	{
+		Log_UART_TxCplt(&hlog);
+	}
+	if (huart->Instance == hnmea.huart->Instance)
+	{
+		NMEA_TxCplt(&hnmea);
+	}
+}
+
+void CDC_TxCpltCallback(uint8_t *Buf, uint32_t Len)
+{
+	Log_CDC_TxCplt(&hlog);
+	Command_CDC_TxCplt(&hcommand, Buf);
+	Stream_CDC_TxCplt(&hstream, Buf);
+}
+
+void CDC_RxCallback(uint8_t *Buf, uint32_t Len)
+{
+	Command_Receive(&hcommand, Buf, Len);
+	Stream_Receive(&hstream, Buf, Len);
 }
 
 // Save an acceleration data array
 void Main_Save_a_Buffer(volatile a_data_point_t *buffer)
 {
-	if (SD_WriteBuffer(&hvsd1, hvsd1.a_file_path, (void*)buffer, hbuffer_a.save_len * sizeof(a_data_point_t)) != HAL_OK)
+	Stream_Write(&hstream, buffer, hbuffer_a.save_len);
+	if (htrigger.block_len > 0)
+	{
+		// Triggered capture: only event windows are saved
+		if (Trigger_Block(&htrigger, buffer, hbuffer_a.save_len) != HAL_OK)
+		{
+			Error_Handler();
+		}
+	}
+	else if (SD_WriteBuffer(&hvsd1, hvsd1.a_file_path, (void*)buffer, hbuffer_a.save_len * sizeof(a_data_point_t)) != HAL_OK)
 	{
 		Error_Handler();
 	}
+	Psd_Write(&hpsd, buffer, hbuffer_a.save_len);
+	Envelope_Write(&henvelope, buffer, hbuffer_a.save_len);
+	Stats_Write(&hstats, buffer, hbuffer_a.save_len);
 	if (config.print_acceleration_data)
 	{
-		Debug_test_print_a(buffer);
+		Debug_test_print_a(buffer, hbuffer_a.save_len);
 	}
 }
 
@@ -1171,27 +1280,38 @@ void Main_Save_p_Buffer(volatile p_data_point_t *buffer)
 // Handles saving data by double buffering
 void Main_Double_Buffer_Loop()
 {
-	// If a_buffer_1 is ready to save
+	// If hbuffer_a.buffer_1 is ready to save
 	if (hbuffer_a.flag_save_buffer_1)
 	{
 		DEBUG_A_BUFFER_1_SD
-		Main_Save_a_Buffer(a_buffer_1);
-		// Flag a_buffer_1 as saved
+		Main_Save_a_Buffer(hbuffer_a.buffer_1);
+		// Triggered capture: next block of ring, set before flag is cleared
+		if (htrigger.block_len > 0)
+		{
+			hbuffer_a.buffer_1 = Trigger_Next_Block(&htrigger);
+			__DMB();
+		}
+		// Flag hbuffer_a.buffer_1 as saved
 		hbuffer_a.flag_save_buffer_1 = 0;
 		DEBUG_A_BUFFER_1_SD
 	}
-	// If a_buffer_2 is ready to save
+	// If hbuffer_a.buffer_2 is ready to save
 	if (hbuffer_a.flag_save_buffer_2)
 	{
 		DEBUG_A_BUFFER_2_SD
-		Main_Save_a_Buffer(a_buffer_2);
-		// Flag a_buffer_2 as saved
+		Main_Save_a_Buffer(hbuffer_a.buffer_2);
+		if (htrigger.block_len > 0)
+		{
+			hbuffer_a.buffer_2 = Trigger_Next_Block(&htrigger);
+			__DMB();
+		}
+		// Flag hbuffer_a.buffer_2 as saved
 		hbuffer_a.flag_save_buffer_2 = 0;
 		DEBUG_A_BUFFER_2_SD
 	}
 	if (hbuffer_a.flag_overflow)
 	{
-		printf("(%lu) WARNING: main: a_buffer overflow\r\n", HAL_GetTick());
+		TRACE(TRACE_A_BUFFER_OVERFLOW);
 		hbuffer_a.flag_overflow = 0;
 	}
 
@@ -1215,17 +1335,23 @@ void Main_Double_Buffer_Loop()
 	}
 	if (hbuffer_p.flag_overflow)
 	{
-		printf("(%lu) WARNING: main: p_buffer overflow\r\n", HAL_GetTick());
+		TRACE(TRACE_P_BUFFER_OVERFLOW);
 		hbuffer_p.flag_overflow = 0;
 	}
 }
 
-// Parse circular buffered NMEA packets
+// Parse queued NMEA packets
 void Main_NMEA_Loop()
 {
 	NMEA_Data_t data;
 	while (NMEA_ProcessLine(&hnmea, &data))
 	{
+		// Move provisional dir to dir of received date
+		if (data.date_valid && hvsd1.dir_provisional)
+		{
+			Main_NMEA_Date(&data);
+		}
+
 		uint8_t any_valid = 0;
 		if (data.position_valid)
 		{
@@ -1234,6 +1360,9 @@ void Main_NMEA_Loop()
 			flag_complete_p_position = 1;
 			p_current_data_point->lat = data.lat;
 			p_current_data_point->lon = data.lon;
+			gnss_state.position_valid = 1;
+			gnss_state.lat = (int32_t)(data.lat * 1e7f);
+			gnss_state.lon = (int32_t)(data.lon * 1e7f);
 
 			// Activate GNSS lock LED
 			if (HAL_GetTick() - hvsd1.a_header.boot_duration > 4000 + hvsd1.dir_num * 400)
@@ -1246,12 +1375,15 @@ void Main_NMEA_Loop()
 			any_valid = 1;
 			flag_complete_p_speed = 1;
 			p_current_data_point->speed = data.speed_kmh;
+			Track_SetSpeed(&htrack, data.speed_kmh);
+			Trigger_SetSpeed(&htrigger, data.speed_kmh);
 		}
 		if (data.altitude_valid)
 		{
 			any_valid = 1;
 			flag_complete_p_altitude = 1;
 			p_current_data_point->altitude = data.altitude;
+			gnss_state.altitude = (int32_t)(data.altitude * 100.0f);
 		}
 		if (data.time_valid)
 		{
@@ -1260,6 +1392,16 @@ void Main_NMEA_Loop()
 			p_current_data_point->gnss_hour = data.hour;
 			p_current_data_point->gnss_minute = data.minute;
 			p_current_data_point->gnss_second = data.second;
+			if (data.date_valid)
+			{
+				gnss_state.time_valid = 1;
+				gnss_state.year = data.year + 2000;
+				gnss_state.month = data.month;
+				gnss_state.day = data.day;
+				gnss_state.hour = data.hour;
+				gnss_state.minute = data.minute;
+				gnss_state.second = data.second;
+			}
 		}
 		if (any_valid)
 		{
@@ -1280,16 +1422,22 @@ void Main_NMEA_Loop()
 		time_p_inc = 0;
 		Main_Increment_p_Buffer();
 	}
+	// Keep provisional dir if no date is received
+	if (hvsd1.dir_provisional && HAL_GetTick() - hvsd1.a_header.boot_duration > NMEA_DATE_WAIT_DURATION)
+	{
+		printf("(%lu) WARNING: No GNSS date received, saving as %04hu_%02u_%02u\r\n", HAL_GetTick(), hvsd1.date_year, hvsd1.date_month, hvsd1.date_day);
+		hvsd1.dir_provisional = 0;
+	}
 	// Warning if no NMEA data
 	if (HAL_GetTick() - time_p_last > NMEA_NO_PACKET_DURATION && time_p_last != 0)
 	{
-		printf("(%lu) WARNING: No NMEA data\r\n", HAL_GetTick());
+		TRACE(TRACE_NMEA_NO_DATA);
 		time_p_last = 0;
 	}
 	// Warning if no position lock
 	if (HAL_GetTick() - time_p_last_lock > NMEA_NO_PACKET_DURATION && time_p_last_lock != 0)
 	{
-		printf("(%lu) WARNING: No position lock\r\n", HAL_GetTick());
+		TRACE(TRACE_NMEA_NO_LOCK);
 		// Deactivate GNSS lock LED
 		if (HAL_GetTick() - hvsd1.a_header.boot_duration > 4000 + hvsd1.dir_num * 400)
 		{
@@ -1299,13 +1447,85 @@ void Main_NMEA_Loop()
 	}
 }
 
+// Received first valid GNSS date, rename provisional dir
+void Main_NMEA_Date(NMEA_Data_t *data)
+{
+	hvsd1.dir_provisional = 0;
+	if (data->time_valid)
+	{
+		// Received valid time
+		TRACE(TRACE_GNSS_DATE_TIME, data->year + 2000, data->month, data->day, data->hour, data->minute, data->second);
+	}
+	else
+	{
+		TRACE(TRACE_GNSS_DATE, data->year + 2000, data->month, data->day);
+	}
+	if (SD_RenameDir(&hvsd1, data->year + 2000, data->month, data->day) == HAL_OK)
+	{
+		printf("(%lu) Writing dir \"%s\"\r\n", HAL_GetTick(), hvsd1.dir_path);
+	}
+}
+
+// Load GNSS state and navigation database saved by Main_GNSS_Save
+void Main_GNSS_Load()
+{
+	UINT size_read;
+	if (SD_FileExists(&hvsd1, GNSS_STATE_FILE_PATH))
+	{
+		NMEA_WarmStart_t warm_start;
+		if (SD_ReadBuffer(&hvsd1, GNSS_STATE_FILE_PATH, &warm_start, sizeof(warm_start), &size_read) == HAL_OK && size_read == sizeof(warm_start) && warm_start.version == NMEA_WARM_START_VERSION)
+		{
+			hnmea.warm_start = warm_start;
+			printf("(%lu) GNSS warm start: %.5f, %.5f\r\n", HAL_GetTick(), warm_start.lat * 1e-7f, warm_start.lon * 1e-7f);
+		}
+	}
+	if (SD_FileExists(&hvsd1, GNSS_DBD_FILE_PATH))
+	{
+		if (SD_ReadBuffer(&hvsd1, GNSS_DBD_FILE_PATH, (void*)hnmea.dbd_buffer, NMEA_DBD_BUFFER_SIZE, &size_read) == HAL_OK)
+		{
+			// Truncated database is not sent (file larger than dbd_buffer)
+			uint8_t next_byte;
+			UINT size_next = 0;
+			if (size_read == NMEA_DBD_BUFFER_SIZE
+					&& SD_ReadBufferAt(&hvsd1, GNSS_DBD_FILE_PATH, NMEA_DBD_BUFFER_SIZE, &next_byte, 1, &size_next) == HAL_OK && size_next > 0)
+			{
+				printf("(%lu) WARNING: GNSS navigation database exceeds buffer (%u bytes), not sent\r\n", HAL_GetTick(), NMEA_DBD_BUFFER_SIZE);
+			}
+			else
+			{
+				hnmea.dbd_len = size_read;
+			}
+		}
+	}
+}
+
+// Save last known GNSS state, navigation database is saved in main loop once received
+void Main_GNSS_Save(uint8_t request_database)
+{
+	gnss_state.version = NMEA_WARM_START_VERSION;
+	SD_WriteFile(&hvsd1, GNSS_STATE_FILE_PATH, &gnss_state, sizeof(gnss_state));
+	if (request_database)
+	{
+		NMEA_RequestDatabase(&hnmea);
+	}
+}
+
 // Next acceleration data point
 void Main_Increment_a_Buffer()
 {
+	// First data point after pause or reconfiguration is filled by this tick
+	if (a_buffer_restart)
+	{
+		a_buffer_restart = 0;
+		a_current_data_point->timestamp = ticks_counter;
+		return;
+	}
+
 	// Merge complete bits of last data point
 	a_current_data_point->complete |= (1 << A_COMPLETE_TIMESTAMP)
 		| (flag_complete_a_mems << A_COMPLETE_MEMS)
-		| (flag_complete_a_pz << A_COMPLETE_PZ);
+		| (flag_complete_a_pz << A_COMPLETE_PZ)
+		| (flag_complete_a_distance << A_COMPLETE_DISTANCE);
 
 	if (ticks_counter > 1)
 	{
@@ -1341,6 +1561,427 @@ void Main_Increment_p_Buffer()
 	p_current_data_point->timestamp = ticks_counter;
 }
 
+// Initialize timers, ADC, double buffers, ADXL357, track distance estimation and FIR filters based on config (sampling stopped)
+HAL_StatusTypeDef Main_Sampling_Init()
+{
+	HAL_StatusTypeDef status = HAL_OK;
+	if (Config_Init(&hadc1, &htim2, &htim3) != HAL_OK)
+	{
+		status = HAL_ERROR;
+	}
+
+	// Init triggered capture (ring of blocks in acceleration buffers)
+	htrigger.hvsd = &hvsd1;
+	htrigger.ring = a_buffer;
+	htrigger.ring_len = 2 * A_BUFFER_LEN_MAX;
+	htrigger.block_len = config.trigger_mode ? config.trigger_block_len : 0;
+	htrigger.sampling_rate = config.a_sampling_rate;
+	htrigger.piezo_count = config.piezo_count;
+	htrigger.pre_ms = config.trigger_pre_ms;
+	htrigger.post_ms = config.trigger_post_ms;
+	Main_Trigger_Thresholds();
+	if (Trigger_Init(&htrigger) == HAL_ERROR)
+	{
+		status = HAL_ERROR;
+	}
+
+	// Init acceleration data double buffering
+	if (htrigger.block_len > 0)
+	{
+		hbuffer_a.buffer_len = htrigger.block_len;
+		hbuffer_a.buffer_1 = Trigger_Next_Block(&htrigger);
+		hbuffer_a.buffer_2 = Trigger_Next_Block(&htrigger);
+	}
+	else
+	{
+		hbuffer_a.buffer_len = config.a_buffer_len;
+		hbuffer_a.buffer_1 = a_buffer;
+		hbuffer_a.buffer_2 = a_buffer + A_BUFFER_LEN_MAX;
+	}
+	hbuffer_a.element_size = sizeof(a_data_point_t);
+	Double_Buffer_Init(&hbuffer_a);
+	a_current_data_point = Double_Buffer_Current(&hbuffer_a);
+
+	// Init position data double buffering
+	hbuffer_p.buffer_len = config.p_buffer_len;
+	hbuffer_p.buffer_1 = p_buffer_1;
+	hbuffer_p.buffer_2 = p_buffer_2;
+	hbuffer_p.element_size = sizeof(p_data_point_t);
+	Double_Buffer_Init(&hbuffer_p);
+	p_current_data_point = Double_Buffer_Current(&hbuffer_p);
+
+	// Initialize ADXL357
+	hadxl.hspi = &ADXL_SPI;
+	hadxl.sampling_rate = config.a_sampling_rate;
+	hadxl.acceleration_range = config.adxl_range;
+	hadxl.timeout = 100;
+	hadxl.CS_GPIO_Port = ADXL_CS_GPIO_Port;
+	hadxl.CS_Pin = ADXL_CS_Pin;
+	if (ADXL_Init(&hadxl) == HAL_ERROR)
+	{
+		status = HAL_ERROR;
+	}
+
+	// Initialize track distance estimation
+	htrack.sampling_rate = config.a_sampling_rate;
+	htrack.acceleration_range = config.adxl_range;
+	htrack.axis = config.track_axis;
+	if (Track_Init(&htrack) == HAL_ERROR)
+	{
+		status = HAL_ERROR;
+	}
+
+	// Init digital FIR filter
+	if (config.fir_type > 0)
+	{
+		for (uint8_t i_ch = 0; i_ch < config.piezo_count; i_ch++)
+		{
+			// Copy FIR taps (selected in config file) to taps array of filter instance
+			memcpy(hfir_pz[i_ch].Taps, fir_taps_types[config.fir_type], fir_taps_lens[config.fir_type] * sizeof(q15_t));
+			// Set filter taps count
+			hfir_pz[i_ch].Nt = fir_taps_lens[config.fir_type];
+			FIR_Init(&hfir_pz[i_ch]);
+		}
+	}
+
+	// Init power spectral density
+	hpsd.hvsd = &hvsd1;
+	hpsd.sampling_rate = config.a_sampling_rate;
+	hpsd.piezo_count = config.piezo_count;
+	hpsd.segment_len = config.psd_segment_len;
+	hpsd.average_count = config.psd_average_count;
+	if (Psd_Init(&hpsd) == HAL_ERROR)
+	{
+		status = HAL_ERROR;
+	}
+
+	// Init envelope analysis
+	henvelope.hvsd = &hvsd1;
+	henvelope.sampling_rate = config.a_sampling_rate;
+	henvelope.piezo_count = config.piezo_count;
+	henvelope.band_low = config.envelope_band_low;
+	henvelope.band_high = config.envelope_band_high;
+	henvelope.impact_ratio = config.envelope_impact_ratio;
+	henvelope.circumference = PI * config.wheel_diameter_mm / 1000.0f;
+	if (Envelope_Init(&henvelope) == HAL_ERROR)
+	{
+		status = HAL_ERROR;
+	}
+
+	// Init block statistics
+	hstats.hvsd = &hvsd1;
+	hstats.enabled = config.block_stats;
+	hstats.piezo_count = config.piezo_count;
+	Stats_Init(&hstats);
+	return status;
+}
+
+// Start piezo ADC, oversampling timer and regular sampling timer
+HAL_StatusTypeDef Main_Sampling_Start()
+{
+	if (HAL_ADC_Start_DMA(&hadc1, (uint32_t*)pz_dma_buffer, config.piezo_count * config.oversampling_ratio) == HAL_ERROR)
+	{
+		printf("(%lu) ERROR: Main_Sampling_Start: ADC1 HAL_ADC_Start_DMA failed\r\n", HAL_GetTick());
+		return HAL_ERROR;
+	}
+	if (HAL_TIM_Base_Start_IT(&htim2) == HAL_ERROR)
+	{
+		printf("(%lu) ERROR: Main_Sampling_Start: TIM2 HAL_TIM_Base_Start_IT failed\r\n", HAL_GetTick());
+		return HAL_ERROR;
+	}
+	if (HAL_TIM_Base_Start_IT(&htim3) == HAL_ERROR)
+	{
+		printf("(%lu) ERROR: Main_Sampling_Start: TIM3 HAL_TIM_Base_Start_IT failed\r\n", HAL_GetTick());
+		return HAL_ERROR;
+	}
+	return HAL_OK;
+}
+
+void Main_Sampling_Stop()
+{
+	HAL_TIM_Base_Stop_IT(&htim2);
+	HAL_TIM_Base_Stop_IT(&htim3);
+	HAL_ADC_Stop_DMA(&hadc1);
+}
+
+// Copy config to file headers (written with next page)
+void Main_Update_Headers()
+{
+	hvsd1.a_header.a_buffer_len = hbuffer_a.buffer_len;
+	hvsd1.a_header.a_sampling_rate = config.a_sampling_rate;
+	hvsd1.a_header.fir_taps_len = fir_taps_lens[config.fir_type];
+	hvsd1.a_header.oversampling_ratio = config.oversampling_ratio;
+	hvsd1.a_header.piezo_count = config.piezo_count;
+	hvsd1.p_header.p_buffer_len = config.p_buffer_len;
+	hvsd1.p_header.p_sampling_rate = config.p_sampling_rate;
+	hvsd1.f_header.a_sampling_rate = config.a_sampling_rate;
+	hvsd1.f_header.segment_len = hpsd.active ? config.psd_segment_len : 0;
+	hvsd1.f_header.average_count = config.psd_average_count;
+	hvsd1.f_header.channel_count = hpsd.channel_count;
+	hvsd1.h_header.a_sampling_rate = config.a_sampling_rate;
+	hvsd1.h_header.band_low = henvelope.active ? config.envelope_band_low : 0;
+	hvsd1.h_header.band_high = config.envelope_band_high;
+	hvsd1.h_header.wheel_diameter = config.wheel_diameter_mm;
+	hvsd1.h_header.impact_ratio = config.envelope_impact_ratio;
+	hvsd1.h_header.channel_count = config.piezo_count;
+	hvsd1.s_header.a_sampling_rate = config.a_sampling_rate;
+	hvsd1.s_header.channel_count = hstats.channel_count;
+}
+
+// Process host commands received via USB CDC
+void Main_Command_Loop()
+{
+	char *args;
+	switch (Command_Loop(&hcommand, &args))
+	{
+	case COMMAND_SET:
+		Main_Command_Set(args);
+		break;
+	case COMMAND_SAVE:
+		Main_Command_Save();
+		break;
+	case COMMAND_START:
+		Main_Capture_Resume();
+		printf("(%lu) Capture resumed by host\r\n", HAL_GetTick());
+		Command_Reply(&hcommand, COMMAND_STATUS_OK, "Capture running");
+		break;
+	case COMMAND_STOP:
+		Main_Capture_Pause();
+		printf("(%lu) Capture paused by host\r\n", HAL_GetTick());
+		Command_Reply(&hcommand, COMMAND_STATUS_OK, "Capture paused");
+		break;
+	case COMMAND_PAGE:
+		Envelope_Flush(&henvelope);
+		Stats_Flush(&hstats);
+		SD_NewPage(&hvsd1);
+		last_page_change = HAL_GetTick();
+		Command_Reply(&hcommand, COMMAND_STATUS_OK, "Page %li", hvsd1.page_num);
+		break;
+	case COMMAND_STATS:
+		Main_Command_Stats();
+		break;
+	default:
+		break;
+	}
+}
+
+// Change config ("key=value ..."), quiesce sampling and reinitialize if sampling parameters changed
+void Main_Command_Set(char *args)
+{
+	// Validate all values on copy, config stays unchanged on error
+	config_t config_new = config;
+	char error[CONFIG_TOKEN_LEN_MAX + 48];
+	if (Config_Update(&config_new, args, error, sizeof(error)) != HAL_OK)
+	{
+		Command_Reply(&hcommand, COMMAND_STATUS_ERROR, "%s", error);
+		return;
+	}
+	config_t config_old = config;
+	config = config_new;
+
+	// GNSS module is configured once at boot
+	if (config.p_sampling_rate != config_old.p_sampling_rate)
+	{
+		config = config_old;
+		Command_Reply(&hcommand, COMMAND_STATUS_ERROR, "p_sampling_rate can only be changed in config file (restart required)");
+		return;
+	}
+
+	// Other values are used directly
+	if (config.piezo_count == config_old.piezo_count && config.fir_type == config_old.fir_type && config.adxl_range == config_old.adxl_range
+		&& config.a_sampling_rate == config_old.a_sampling_rate && config.oversampling_ratio == config_old.oversampling_ratio
+		&& config.a_buffer_len == config_old.a_buffer_len && config.p_buffer_len == config_old.p_buffer_len && config.track_axis == config_old.track_axis
+		&& config.psd_segment_len == config_old.psd_segment_len && config.psd_average_count == config_old.psd_average_count
+		&& config.trigger_mode == config_old.trigger_mode && config.trigger_block_len == config_old.trigger_block_len
+		&& config.trigger_pre_ms == config_old.trigger_pre_ms && config.trigger_post_ms == config_old.trigger_post_ms
+		&& config.envelope_band_low == config_old.envelope_band_low && config.envelope_band_high == config_old.envelope_band_high
+		&& config.envelope_impact_ratio == config_old.envelope_impact_ratio && config.wheel_diameter_mm == config_old.wheel_diameter_mm
+		&& config.block_stats == config_old.block_stats)
+	{
+		Main_Trigger_Thresholds();
+		Command_Reply(&hcommand, COMMAND_STATUS_OK, "Config changed");
+		return;
+	}
+
+	uint32_t start = HAL_GetTick();
+	uint32_t ticks_start = ticks_counter;
+	uint8_t paused = capture_paused;
+
+	// Quiesce sampling (ADXL357 transfer of last tick completes), save data sampled with previous config
+	Main_Sampling_Stop();
+	capture_paused = 1;
+	HAL_Delay(1);
+	Main_Double_Buffer_Loop();
+	Double_Buffer_Flush(&hbuffer_a);
+	Double_Buffer_Flush(&hbuffer_p);
+	Main_Double_Buffer_Loop();
+	Trigger_Flush(&htrigger);
+	Envelope_Flush(&henvelope);
+	Stats_Flush(&hstats);
+	// Frame format of stream depends on config, restarted by host
+	Stream_Stop(&hstream);
+	hstream.sampling_rate = config.a_sampling_rate;
+	hstream.piezo_count = config.piezo_count;
+	hstream.oversampling_ratio = config.oversampling_ratio;
+
+	// Reinitialize, restore previous config if it fails
+	HAL_StatusTypeDef status = Main_Sampling_Init();
+	if (status != HAL_OK)
+	{
+		config = config_old;
+		hstream.sampling_rate = config.a_sampling_rate;
+		hstream.piezo_count = config.piezo_count;
+		hstream.oversampling_ratio = config.oversampling_ratio;
+		if (Main_Sampling_Init() != HAL_OK)
+		{
+			Error_Handler();
+		}
+	}
+
+	// New page with headers of new config
+	Main_Update_Headers();
+	SD_NewPage(&hvsd1);
+	last_page_change = HAL_GetTick();
+
+	// Timestamps continue as if sampled during reconfiguration
+	ticks_counter = ticks_start + (HAL_GetTick() - start) * config.a_sampling_rate / 1000;
+	p_current_data_point->timestamp = ticks_counter;
+	if (Main_Sampling_Start() != HAL_OK)
+	{
+		Error_Handler();
+	}
+	if (!paused)
+	{
+		Main_Capture_Resume();
+	}
+
+	if (status != HAL_OK)
+	{
+		Command_Reply(&hcommand, COMMAND_STATUS_ERROR, "Reconfiguration failed, previous config restored");
+		return;
+	}
+	printf("(%lu) Reconfigured in %lu ms (page %li)\r\n", HAL_GetTick(), HAL_GetTick() - start, hvsd1.page_num);
+	Command_Reply(&hcommand, COMMAND_STATUS_OK, "Reconfigured in %lu ms (page %li)", HAL_GetTick() - start, hvsd1.page_num);
+}
+
+// Write current config to config file
+void Main_Command_Save()
+{
+	char config_buffer[CONFIG_SAVE_LEN];
+	Config_Save(config_buffer, sizeof(config_buffer));
+	if (SD_WriteFile(&hvsd1, CONFIG_FILE_PATH, config_buffer, strlen(config_buffer)) != HAL_OK)
+	{
+		Command_Reply(&hcommand, COMMAND_STATUS_ERROR, "Writing \"%s\" failed", CONFIG_FILE_PATH);
+		return;
+	}
+	Command_Reply(&hcommand, COMMAND_STATUS_OK, "Config saved to \"%s\"", CONFIG_FILE_PATH);
+}
+
+// Reply with status and counters ("key=value" lines)
+void Main_Command_Stats()
+{
+	char boot_steps[150];
+	Main_Boot_Format(boot_steps, sizeof(boot_steps));
+	Command_Reply(&hcommand, COMMAND_STATUS_OK,
+			"uptime_ms=%lu\r\ncapture=%s\r\ndir=%s\r\npage=%li\r\nticks=%lu\r\ngnss_position_valid=%u\r\nlast_lock_ms=%lu\r\n"
+			"stream_active=%u\r\nstream_frames=%u\r\nstream_dropped_points=%lu\r\n"
+			"psd_active=%u\r\npsd_spectra=%lu\r\npsd_cycles_max=%lu\r\npsd_load_permille=%u\r\npsd_gaps=%lu\r\n"
+			"trigger_events=%lu\r\ntrigger_event_active=%u\r\ntrigger_blocks_saved=%lu\r\ntrigger_blocks_total=%lu\r\n"
+			"trigger_last_peak=%.0f\r\ntrigger_last_rms=%.0f\r\ntrigger_last_kurtosis=%.2f\r\n"
+			"envelope_active=%u\r\nenvelope_records=%lu\r\nenvelope_impacts=%lu\r\nenvelope_cycles_max=%lu\r\nenvelope_load_permille=%u\r\n"
+			"stats_records=%lu\r\nstats_clipped=%lu\r\n"
+			"log_dropped=%lu\r\ntrace_dropped=%lu\r\nnmea_lines_dropped=%lu\r\ncommand_rx_errors=%lu\r\nboot_ms=%lu\r\nboot_steps=%s\r\n",
+			HAL_GetTick(), capture_paused ? "paused" : "running", hvsd1.dir_path, hvsd1.page_num, ticks_counter, gnss_state.position_valid, HAL_GetTick() - time_p_last_lock,
+			hstream.active, hstream.sequence, hstream.dropped_points,
+			hpsd.active, hpsd.spectrum_count, hpsd.cycles_max, hpsd.load, hpsd.gaps,
+			htrigger.event_count, htrigger.event_active, htrigger.blocks_saved, htrigger.blocks_total,
+			htrigger.block_peak, htrigger.block_rms, htrigger.block_kurtosis,
+			henvelope.active, henvelope.record_count, henvelope.impact_count, henvelope.cycles_max, henvelope.load,
+			hstats.record_count, hstats.clipped_count,
+			hlog.ring.dropped_entries, htrace.ring.dropped_entries, hnmea.line_ring.dropped_entries, hcommand.rx_errors, hvsd1.a_header.boot_duration, boot_steps);
+}
+
+// Copy trigger thresholds from config (applied without reinitialization)
+void Main_Trigger_Thresholds()
+{
+	htrigger.piezo_peak = config.trigger_piezo_peak;
+	htrigger.mems_rms = config.trigger_mems_rms;
+	htrigger.kurtosis = config.trigger_kurtosis;
+	htrigger.speed_min = config.trigger_speed_min;
+	htrigger.speed_max = config.trigger_speed_max;
+}
+
+// Stop storing acceleration data (timer keeps running for timestamps), save sampled data
+void Main_Capture_Pause()
+{
+	if (capture_paused)
+	{
+		return;
+	}
+	capture_paused = 1;
+	HAL_GPIO_WritePin(LED_ACTIVE, GPIO_PIN_RESET);
+	Main_Double_Buffer_Loop();
+	Double_Buffer_Flush(&hbuffer_a);
+	Main_Double_Buffer_Loop();
+}
+
+void Main_Capture_Resume()
+{
+	if (!capture_paused)
+	{
+		return;
+	}
+	// Continue with cleared data point at current buffer position
+	a_current_data_point = Double_Buffer_Current(&hbuffer_a);
+	memset((void*)a_current_data_point, 0, sizeof(a_data_point_t));
+	a_buffer_restart = 1;
+	capture_paused = 0;
+	HAL_GPIO_WritePin(LED_ACTIVE, GPIO_PIN_SET);
+}
+
+// Duration of a page in milliseconds (page_duration_ms, limited by maximum file size on FAT32 volumes)
+uint32_t Main_Page_Duration()
+{
+	uint32_t duration = config.page_duration_ms != 0 ? config.page_duration_ms : UINT32_MAX;
+	if (hvsd1.fatfs->fs_type != FS_EXFAT)
+	{
+		// Keep one full buffer as margin
+		uint64_t bytes_per_second = (uint64_t)config.a_sampling_rate * sizeof(a_data_point_t);
+		uint64_t duration_max = (SD_FAT32_FILE_SIZE_MAX - sizeof(a_data_header_t) - config.a_buffer_len * sizeof(a_data_point_t)) * 1000 / bytes_per_second;
+		if (duration_max < duration)
+		{
+			duration = duration_max;
+		}
+	}
+	return duration;
+}
+
+// Record end of boot step
+void Main_Boot_Step(Main_Boot_Step_t step)
+{
+	boot_step_end[step] = HAL_GetTick();
+	// Output boot messages without waiting, main loop drains the log once capture is running
+	Log_Loop(&hlog);
+}
+
+// Format duration of each boot step ("peripherals 12 ms, gnss 0 ms, ...")
+int Main_Boot_Format(char *buffer, uint32_t size)
+{
+	int len = 0;
+	buffer[0] = '\0';
+	for (uint8_t i = 0; i < BOOT_STEP_COUNT && len < (int)size; i++)
+	{
+		uint32_t duration = boot_step_end[i] - (i > 0 ? boot_step_end[i - 1] : 0);
+		int n = snprintf(buffer + len, size - len, "%s%s %lu ms", i > 0 ? ", " : "", boot_step_names[i], duration);
+		if (n < 0)
+		{
+			break;
+		}
+		len += n;
+	}
+	return len;
+}
+
 void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim)
 {
 	// Regular sampling timer
@@ -1348,7 +1989,7 @@ void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim)
 	{
 		DEBUG_A_TIMER
 
-		if (capture_running)
+		if (capture_running && !capture_paused)
 		{
 			// Increment data point index
 			Main_Increment_a_Buffer();
@@ -1358,9 +1999,14 @@ void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim)
 			// Request MEMS acceleration data
 			if (ADXL_RequestData(&hadxl) == HAL_ERROR)
 			{
-				printf("(%lu) WARNING: ADXL_RequestData: TxRx failed\r\n", HAL_GetTick());
+				TRACE(TRACE_ADXL_REQUEST_FAILED);
 			}
 		}
+		else if (capture_running)
+		{
+			// Timestamps continue while paused
+			ticks_counter++;
+		}
 
 		DEBUG_A_TIMER
 	}
@@ -1375,6 +2021,9 @@ void HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef *hadc)
 		{
 			DEBUG_ADC_PZ_CONV
 
+			// Stream raw ADC samples before filtering (if requested by host)
+			Stream_Write_Raw(&hstream, pz_dma_buffer);
+
 			// Put n samples into filter input for each channel (where n is the oversampling ratio)
 			for (uint8_t i_sample = 0; i_sample < config.oversampling_ratio; i_sample++)
 			{
@@ -1423,6 +2072,11 @@ void HAL_SPI_TxRxCpltCallback(SPI_HandleTypeDef *hspi)
 		a_current_data_point->temp_mems1 = adxl_data.temp;
 		flag_complete_a_mems = adxl_data.data_valid;
 
+		// Track distance from longitudinal acceleration (fused with GNSS speed)
+		int32_t xyz[3] = { adxl_data.x, adxl_data.y, adxl_data.z };
+		a_current_data_point->distance = Track_Update(&htrack, adxl_data.data_valid ? xyz : NULL);
+		flag_complete_a_distance = htrack.initialized;
+
 		DEBUG_ADXL_PROCESS
 	}
 }
@@ -1433,11 +2087,8 @@ void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart)
 	{
 		DEBUG_NMEA_PROCESS
 
-		// NMEA DMA buffer full, redirected to NMEA handler functions
-		if (NMEA_ProcessDMABuffer(&hnmea) == HAL_ERROR)
-		{
-			Error_Handler();
-		}
+		// NMEA DMA buffer full, redirected to NMEA handler functions (errors are traced)
+		NMEA_ProcessDMABuffer(&hnmea);
 
 		DEBUG_NMEA_PROCESS
 	}
@@ -1454,6 +2105,11 @@ void Error_Handler(void)
 	/* User can add their own implementation to report the HAL error return state */
 	HAL_GPIO_WritePin(LED_ERROR, GPIO_PIN_SET);
 	printf("(%lu) Fatal Error, but attempting to continue\r\n", HAL_GetTick());
+	// Output error messages before a following halt (HAL_GetTick does not advance in interrupts)
+	if (__get_IPSR() == 0)
+	{
+		Log_Flush(&hlog);
+	}
 	// Uncomment to stop system on error (do not attempt to continue)
 	/*
 	 SD_FlushLog();
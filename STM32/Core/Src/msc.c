@@ -0,0 +1,558 @@
+/*
+ * Copyright (c) 2024 Mirco Heitmann
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ * msc.c
+ *
+ * USB mass storage mode (Bulk-Only Transport, SCSI) exposing the SD card while capture is stopped
+ *
+ * USB callbacks only set flags, commands are executed in MSC_Loop (main context) because SD transfers
+ * wait for SDMMC DMA interrupts. READ(10)/WRITE(10) use multi-block transfers of the FatFs SD driver
+ * with two buffers: the next chunk is read from (written to) the SD card while the previous chunk is
+ * transmitted (received) via USB.
+ */
+
+#include "msc.h"
+
+// Internal status of MSC_Command: reset or disconnect, no CSW is sent
+#define MSC_CSW_ABORTED 0xFF
+
+extern uint8_t USBD_FS_DeviceDesc[USB_LEN_DEV_DESC];
+
+uint8_t MSC_USB_Init(USBD_HandleTypeDef *pdev, uint8_t cfgidx);
+uint8_t MSC_USB_DeInit(USBD_HandleTypeDef *pdev, uint8_t cfgidx);
+uint8_t MSC_USB_Setup(USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *req);
+uint8_t MSC_USB_DataIn(USBD_HandleTypeDef *pdev, uint8_t epnum);
+uint8_t MSC_USB_DataOut(USBD_HandleTypeDef *pdev, uint8_t epnum);
+uint8_t *MSC_USB_GetConfigDesc(uint16_t *length);
+uint8_t *MSC_USB_GetDeviceQualifierDesc(uint16_t *length);
+void MSC_Command(MSC_t *hmsc);
+uint8_t MSC_Read(MSC_t *hmsc, uint32_t *data_len);
+uint8_t MSC_Write(MSC_t *hmsc, uint32_t *data_len);
+uint8_t MSC_Response(MSC_t *hmsc, uint32_t len, uint32_t alloc_len, uint32_t *data_len);
+uint8_t MSC_Fail(MSC_t *hmsc, uint8_t sense_key, uint8_t sense_asc);
+void MSC_Transmit(MSC_t *hmsc, uint8_t *buffer, uint32_t len);
+void MSC_Receive(MSC_t *hmsc, uint8_t *buffer, uint32_t len);
+HAL_StatusTypeDef MSC_Wait(MSC_t *hmsc, volatile uint8_t *flag);
+
+USBD_ClassTypeDef USBD_MSC_SD =
+{
+	MSC_USB_Init,
+	MSC_USB_DeInit,
+	MSC_USB_Setup,
+	NULL,
+	NULL,
+	MSC_USB_DataIn,
+	MSC_USB_DataOut,
+	NULL,
+	NULL,
+	NULL,
+	MSC_USB_GetConfigDesc,
+	MSC_USB_GetConfigDesc,
+	MSC_USB_GetConfigDesc,
+	MSC_USB_GetDeviceQualifierDesc,
+};
+
+__ALIGN_BEGIN static uint8_t msc_config_desc[MSC_CONFIG_DESC_SIZE] __ALIGN_END =
+{
+	// Configuration
+	0x09, USB_DESC_TYPE_CONFIGURATION, MSC_CONFIG_DESC_SIZE, 0x00,
+	0x01, // bNumInterfaces
+	0x01, // bConfigurationValue
+	0x00, // iConfiguration
+#if (USBD_SELF_POWERED == 1U)
+	0xC0, // bmAttributes: self powered
+#else
+	0x80, // bmAttributes: bus powered
+#endif
+	USBD_MAX_POWER,
+	// Interface: mass storage, SCSI transparent command set, Bulk-Only Transport
+	0x09, USB_DESC_TYPE_INTERFACE, 0x00, 0x00, 0x02, 0x08, 0x06, 0x50, 0x00,
+	// Endpoints
+	0x07, USB_DESC_TYPE_ENDPOINT, MSC_EP_IN, USBD_EP_TYPE_BULK, LOBYTE(MSC_PACKET_SIZE), HIBYTE(MSC_PACKET_SIZE), 0x00,
+	0x07, USB_DESC_TYPE_ENDPOINT, MSC_EP_OUT, USBD_EP_TYPE_BULK, LOBYTE(MSC_PACKET_SIZE), HIBYTE(MSC_PACKET_SIZE), 0x00,
+};
+
+__ALIGN_BEGIN static uint8_t msc_device_qualifier_desc[USB_LEN_DEV_QUALIFIER_DESC] __ALIGN_END =
+{
+	USB_LEN_DEV_QUALIFIER_DESC, USB_DESC_TYPE_DEVICE_QUALIFIER, 0x00, 0x02, 0x00, 0x00, 0x00, MSC_PACKET_SIZE, 0x01, 0x00,
+};
+
+// Handle of USB callbacks
+static MSC_t *msc_handle = NULL;
+
+// Re-enumerate USB device as mass storage device, call after file system is unmounted
+HAL_StatusTypeDef MSC_Start(MSC_t *hmsc)
+{
+	if (hmsc->buffer[0] == NULL || hmsc->buffer[1] == NULL)
+	{
+		printf("(%lu) ERROR: MSC_Start: No transfer buffers\r\n", HAL_GetTick());
+		return HAL_ERROR;
+	}
+
+	// Init struct
+	msc_handle = hmsc;
+	hmsc->flag_reset = 0;
+	hmsc->flag_rx = 0;
+	hmsc->flag_tx = 0;
+	hmsc->flag_clear_halt = 0;
+	hmsc->halted = 0;
+	hmsc->cbw_armed = 0;
+	hmsc->sense_key = MSC_SENSE_NO_SENSE;
+	hmsc->sense_asc = 0;
+
+	// SD card (reported as not present if it fails)
+	hmsc->ready = 0;
+	hmsc->block_count = 0;
+	if ((disk_status(hmsc->pdrv) & STA_NOINIT) == 0 || (disk_initialize(hmsc->pdrv) & STA_NOINIT) == 0)
+	{
+		if (disk_ioctl(hmsc->pdrv, GET_SECTOR_COUNT, &hmsc->block_count) == RES_OK && hmsc->block_count > 0)
+		{
+			hmsc->ready = 1;
+		}
+	}
+	if (!hmsc->ready)
+	{
+		printf("(%lu) WARNING: MSC_Start: SD card not ready\r\n", HAL_GetTick());
+	}
+
+	// Device class is defined by interface, different product ID so the host does not load the CDC driver
+	USBD_Stop(hmsc->pdev);
+	USBD_DeInit(hmsc->pdev);
+	USBD_FS_DeviceDesc[4] = 0x00; // bDeviceClass
+	USBD_FS_DeviceDesc[5] = 0x00; // bDeviceSubClass
+	USBD_FS_DeviceDesc[6] = 0x00; // bDeviceProtocol
+	USBD_FS_DeviceDesc[10] = LOBYTE(MSC_PID);
+	USBD_FS_DeviceDesc[11] = HIBYTE(MSC_PID);
+	if (USBD_Init(hmsc->pdev, &FS_Desc, DEVICE_FS) != USBD_OK || USBD_RegisterClass(hmsc->pdev, &USBD_MSC_SD) != USBD_OK || USBD_Start(hmsc->pdev) != USBD_OK)
+	{
+		printf("(%lu) ERROR: MSC_Start: USB init failed\r\n", HAL_GetTick());
+		return HAL_ERROR;
+	}
+
+	return HAL_OK;
+}
+
+// Receive and execute SCSI commands, call regularly from main loop
+void MSC_Loop(MSC_t *hmsc)
+{
+	// Host reset (BOT reset or new configuration)
+	if (hmsc->flag_reset)
+	{
+		hmsc->flag_reset = 0;
+		hmsc->cbw_armed = 0;
+		USBD_LL_FlushEP(hmsc->pdev, MSC_EP_IN);
+		USBD_LL_FlushEP(hmsc->pdev, MSC_EP_OUT);
+	}
+	if (hmsc->pdev->dev_state != USBD_STATE_CONFIGURED || hmsc->halted)
+	{
+		return;
+	}
+
+	// Wait for command block wrapper (received into 64 byte buffer, host may send a full packet)
+	if (!hmsc->cbw_armed)
+	{
+		hmsc->cbw_armed = 1;
+		MSC_Receive(hmsc, hmsc->response, MSC_PACKET_SIZE);
+	}
+	if (!hmsc->flag_rx)
+	{
+		return;
+	}
+	hmsc->flag_rx = 0;
+	hmsc->cbw_armed = 0;
+	memcpy(&hmsc->cbw, hmsc->response, MSC_CBW_LEN);
+
+	// Invalid CBW: endpoints stay stalled until reset recovery
+	if (hmsc->rx_len != MSC_CBW_LEN || hmsc->cbw.signature != MSC_CBW_SIGNATURE || hmsc->cbw.lun != 0 || hmsc->cbw.cb_length < 1 || hmsc->cbw.cb_length > 16)
+	{
+		hmsc->halted = 1;
+		USBD_LL_StallEP(hmsc->pdev, MSC_EP_IN);
+		USBD_LL_StallEP(hmsc->pdev, MSC_EP_OUT);
+		return;
+	}
+
+	MSC_Command(hmsc);
+}
+
+// Execute command of CBW (data phase and status)
+void MSC_Command(MSC_t *hmsc)
+{
+	uint8_t *cb = hmsc->cbw.cb;
+	uint8_t *r = hmsc->response;
+	uint32_t data_len = 0;
+	uint8_t status;
+
+	memset(r, 0, sizeof(hmsc->response));
+	switch (cb[0])
+	{
+	case MSC_SCSI_TEST_UNIT_READY:
+		status = hmsc->ready ? MSC_CSW_PASSED : MSC_Fail(hmsc, MSC_SENSE_NOT_READY, MSC_ASC_MEDIUM_NOT_PRESENT);
+		break;
+	case MSC_SCSI_REQUEST_SENSE:
+		// Fixed format sense data
+		r[0] = 0x70;
+		r[2] = hmsc->sense_key;
+		r[7] = 10;
+		r[12] = hmsc->sense_asc;
+		hmsc->sense_key = MSC_SENSE_NO_SENSE;
+		hmsc->sense_asc = 0;
+		status = MSC_Response(hmsc, 18, cb[4], &data_len);
+		break;
+	case MSC_SCSI_INQUIRY:
+		if (cb[1] & 0x01)
+		{
+			// Vital product data: no pages
+			status = MSC_Response(hmsc, 4, (cb[3] << 8) | cb[4], &data_len);
+			break;
+		}
+		r[0] = 0x00; // Direct access block device
+		r[1] = 0x80; // Removable
+		r[2] = 0x02;
+		r[3] = 0x02;
+		r[4] = 36 - 5;
+		memcpy(r + 8, "VERA    ", 8);
+		memcpy(r + 16, "SD Card         ", 16);
+		memcpy(r + 32, "0001", 4);
+		status = MSC_Response(hmsc, 36, (cb[3] << 8) | cb[4], &data_len);
+		break;
+	case MSC_SCSI_MODE_SENSE6:
+		r[0] = 3;
+		status = MSC_Response(hmsc, 4, cb[4], &data_len);
+		break;
+	case MSC_SCSI_MODE_SENSE10:
+		r[1] = 6;
+		status = MSC_Response(hmsc, 8, (cb[7] << 8) | cb[8], &data_len);
+		break;
+	case MSC_SCSI_READ_FORMAT_CAPACITIES:
+		if (!hmsc->ready)
+		{
+			status = MSC_Fail(hmsc, MSC_SENSE_NOT_READY, MSC_ASC_MEDIUM_NOT_PRESENT);
+			break;
+		}
+		r[3] = 8;
+		r[4] = hmsc->block_count >> 24;
+		r[5] = hmsc->block_count >> 16;
+		r[6] = hmsc->block_count >> 8;
+		r[7] = hmsc->block_count;
+		r[8] = 0x02; // Formatted media
+		r[10] = MSC_BLOCK_SIZE >> 8;
+		r[11] = MSC_BLOCK_SIZE & 0xFF;
+		status = MSC_Response(hmsc, 12, (cb[7] << 8) | cb[8], &data_len);
+		break;
+	case MSC_SCSI_READ_CAPACITY10:
+		if (!hmsc->ready)
+		{
+			status = MSC_Fail(hmsc, MSC_SENSE_NOT_READY, MSC_ASC_MEDIUM_NOT_PRESENT);
+			break;
+		}
+		r[0] = (hmsc->block_count - 1) >> 24;
+		r[1] = (hmsc->block_count - 1) >> 16;
+		r[2] = (hmsc->block_count - 1) >> 8;
+		r[3] = hmsc->block_count - 1;
+		r[6] = MSC_BLOCK_SIZE >> 8;
+		r[7] = MSC_BLOCK_SIZE & 0xFF;
+		status = MSC_Response(hmsc, 8, 8, &data_len);
+		break;
+	case MSC_SCSI_READ10:
+		status = MSC_Read(hmsc, &data_len);
+		break;
+	case MSC_SCSI_WRITE10:
+		status = MSC_Write(hmsc, &data_len);
+		break;
+	case MSC_SCSI_START_STOP_UNIT:
+	case MSC_SCSI_ALLOW_MEDIUM_REMOVAL:
+	case MSC_SCSI_VERIFY10:
+		status = MSC_CSW_PASSED;
+		break;
+	default:
+		status = MSC_Fail(hmsc, MSC_SENSE_ILLEGAL_REQUEST, MSC_ASC_INVALID_COMMAND);
+		break;
+	}
+	if (status == MSC_CSW_ABORTED)
+	{
+		return;
+	}
+
+	// Host expects more data than transferred: terminate data phase by stall (unless ended by short packet)
+	uint8_t dir_in = (hmsc->cbw.flags & 0x80) != 0;
+	if (data_len < hmsc->cbw.data_length && (!dir_in || data_len % MSC_PACKET_SIZE == 0))
+	{
+		hmsc->flag_clear_halt = 0;
+		USBD_LL_StallEP(hmsc->pdev, dir_in ? MSC_EP_IN : MSC_EP_OUT);
+		if (MSC_Wait(hmsc, &hmsc->flag_clear_halt) != HAL_OK)
+		{
+			return;
+		}
+	}
+
+	// Command status wrapper
+	hmsc->csw.signature = MSC_CSW_SIGNATURE;
+	hmsc->csw.tag = hmsc->cbw.tag;
+	hmsc->csw.residue = hmsc->cbw.data_length - data_len;
+	hmsc->csw.status = status;
+	MSC_Transmit(hmsc, (uint8_t*)&hmsc->csw, MSC_CSW_LEN);
+	MSC_Wait(hmsc, &hmsc->flag_tx);
+}
+
+// READ(10): read chunks of sectors from SD card, transmit previous chunk meanwhile
+uint8_t MSC_Read(MSC_t *hmsc, uint32_t *data_len)
+{
+	uint8_t *cb = hmsc->cbw.cb;
+	uint32_t lba = (cb[2] << 24) | (cb[3] << 16) | (cb[4] << 8) | cb[5];
+	uint32_t blocks = (cb[7] << 8) | cb[8];
+	if (!hmsc->ready)
+	{
+		return MSC_Fail(hmsc, MSC_SENSE_NOT_READY, MSC_ASC_MEDIUM_NOT_PRESENT);
+	}
+	if (lba + blocks > hmsc->block_count || lba + blocks < lba)
+	{
+		return MSC_Fail(hmsc, MSC_SENSE_ILLEGAL_REQUEST, MSC_ASC_ADDRESS_OUT_OF_RANGE);
+	}
+	if (!(hmsc->cbw.flags & 0x80) || blocks * MSC_BLOCK_SIZE > hmsc->cbw.data_length)
+	{
+		return MSC_Fail(hmsc, MSC_SENSE_ILLEGAL_REQUEST, MSC_ASC_INVALID_COMMAND);
+	}
+
+	uint8_t i_buffer = 0;
+	uint8_t tx_pending = 0;
+	uint8_t status = MSC_CSW_PASSED;
+	while (blocks > 0)
+	{
+		uint32_t count = blocks < MSC_BUFFER_SECTORS ? blocks : MSC_BUFFER_SECTORS;
+		if (disk_read(hmsc->pdrv, hmsc->buffer[i_buffer], lba, count) != RES_OK)
+		{
+			status = MSC_Fail(hmsc, MSC_SENSE_MEDIUM_ERROR, MSC_ASC_READ_ERROR);
+			break;
+		}
+		if (tx_pending && MSC_Wait(hmsc, &hmsc->flag_tx) != HAL_OK)
+		{
+			return MSC_CSW_ABORTED;
+		}
+		MSC_Transmit(hmsc, hmsc->buffer[i_buffer], count * MSC_BLOCK_SIZE);
+		tx_pending = 1;
+		*data_len += count * MSC_BLOCK_SIZE;
+		lba += count;
+		blocks -= count;
+		i_buffer ^= 1;
+	}
+	if (tx_pending && MSC_Wait(hmsc, &hmsc->flag_tx) != HAL_OK)
+	{
+		return MSC_CSW_ABORTED;
+	}
+	return status;
+}
+
+// WRITE(10): receive chunks of sectors, write previous chunk to SD card meanwhile
+uint8_t MSC_Write(MSC_t *hmsc, uint32_t *data_len)
+{
+	uint8_t *cb = hmsc->cbw.cb;
+	uint32_t lba = (cb[2] << 24) | (cb[3] << 16) | (cb[4] << 8) | cb[5];
+	uint32_t blocks = (cb[7] << 8) | cb[8];
+	if (!hmsc->ready)
+	{
+		return MSC_Fail(hmsc, MSC_SENSE_NOT_READY, MSC_ASC_MEDIUM_NOT_PRESENT);
+	}
+	if (lba + blocks > hmsc->block_count || lba + blocks < lba)
+	{
+		return MSC_Fail(hmsc, MSC_SENSE_ILLEGAL_REQUEST, MSC_ASC_ADDRESS_OUT_OF_RANGE);
+	}
+	if ((hmsc->cbw.flags & 0x80) || blocks * MSC_BLOCK_SIZE > hmsc->cbw.data_length)
+	{
+		return MSC_Fail(hmsc, MSC_SENSE_ILLEGAL_REQUEST, MSC_ASC_INVALID_COMMAND);
+	}
+
+	uint8_t i_buffer = 0;
+	uint8_t status = MSC_CSW_PASSED;
+	uint32_t count = blocks < MSC_BUFFER_SECTORS ? blocks : MSC_BUFFER_SECTORS;
+	if (count > 0)
+	{
+		MSC_Receive(hmsc, hmsc->buffer[i_buffer], count * MSC_BLOCK_SIZE);
+	}
+	while (blocks > 0)
+	{
+		if (MSC_Wait(hmsc, &hmsc->flag_rx) != HAL_OK)
+		{
+			return MSC_CSW_ABORTED;
+		}
+		*data_len += count * MSC_BLOCK_SIZE;
+		uint32_t next_count = blocks - count < MSC_BUFFER_SECTORS ? blocks - count : MSC_BUFFER_SECTORS;
+		if (next_count > 0)
+		{
+			MSC_Receive(hmsc, hmsc->buffer[i_buffer ^ 1], next_count * MSC_BLOCK_SIZE);
+		}
+		// After a write error the remaining data is received but discarded
+		if (status == MSC_CSW_PASSED && disk_write(hmsc->pdrv, hmsc->buffer[i_buffer], lba, count) != RES_OK)
+		{
+			status = MSC_Fail(hmsc, MSC_SENSE_MEDIUM_ERROR, MSC_ASC_WRITE_FAULT);
+		}
+		lba += count;
+		blocks -= count;
+		count = next_count;
+		i_buffer ^= 1;
+	}
+	return status;
+}
+
+// Transmit response of len bytes (limited by allocation length of command and host)
+uint8_t MSC_Response(MSC_t *hmsc, uint32_t len, uint32_t alloc_len, uint32_t *data_len)
+{
+	len = len < alloc_len ? len : alloc_len;
+	len = len < hmsc->cbw.data_length ? len : hmsc->cbw.data_length;
+	if (len == 0)
+	{
+		return MSC_CSW_PASSED;
+	}
+	MSC_Transmit(hmsc, hmsc->response, len);
+	if (MSC_Wait(hmsc, &hmsc->flag_tx) != HAL_OK)
+	{
+		return MSC_CSW_ABORTED;
+	}
+	*data_len = len;
+	return MSC_CSW_PASSED;
+}
+
+// Store sense data for REQUEST SENSE, returns failed status
+uint8_t MSC_Fail(MSC_t *hmsc, uint8_t sense_key, uint8_t sense_asc)
+{
+	hmsc->sense_key = sense_key;
+	hmsc->sense_asc = sense_asc;
+	return MSC_CSW_FAILED;
+}
+
+void MSC_Transmit(MSC_t *hmsc, uint8_t *buffer, uint32_t len)
+{
+	hmsc->flag_tx = 0;
+	USBD_LL_Transmit(hmsc->pdev, MSC_EP_IN, buffer, len);
+}
+
+void MSC_Receive(MSC_t *hmsc, uint8_t *buffer, uint32_t len)
+{
+	hmsc->flag_rx = 0;
+	USBD_LL_PrepareReceive(hmsc->pdev, MSC_EP_OUT, buffer, len);
+}
+
+// Wait for flag set in USB IRQ, HAL_ERROR on reset, disconnect or timeout
+HAL_StatusTypeDef MSC_Wait(MSC_t *hmsc, volatile uint8_t *flag)
+{
+	uint32_t start = HAL_GetTick();
+	while (!*flag)
+	{
+		if (hmsc->flag_reset || hmsc->pdev->dev_state != USBD_STATE_CONFIGURED || HAL_GetTick() - start > MSC_TIMEOUT)
+		{
+			return HAL_ERROR;
+		}
+	}
+	*flag = 0;
+	return HAL_OK;
+}
+
+// USB class callbacks (USB IRQ)
+
+uint8_t MSC_USB_Init(USBD_HandleTypeDef *pdev, uint8_t cfgidx)
+{
+	UNUSED(cfgidx);
+	USBD_LL_OpenEP(pdev, MSC_EP_IN, USBD_EP_TYPE_BULK, MSC_PACKET_SIZE);
+	pdev->ep_in[MSC_EP_IN & 0xFU].is_used = 1U;
+	USBD_LL_OpenEP(pdev, MSC_EP_OUT, USBD_EP_TYPE_BULK, MSC_PACKET_SIZE);
+	pdev->ep_out[MSC_EP_OUT & 0xFU].is_used = 1U;
+	msc_handle->halted = 0;
+	msc_handle->flag_reset = 1;
+	return (uint8_t)USBD_OK;
+}
+
+uint8_t MSC_USB_DeInit(USBD_HandleTypeDef *pdev, uint8_t cfgidx)
+{
+	UNUSED(cfgidx);
+	USBD_LL_CloseEP(pdev, MSC_EP_IN);
+	pdev->ep_in[MSC_EP_IN & 0xFU].is_used = 0U;
+	USBD_LL_CloseEP(pdev, MSC_EP_OUT);
+	pdev->ep_out[MSC_EP_OUT & 0xFU].is_used = 0U;
+	msc_handle->flag_reset = 1;
+	return (uint8_t)USBD_OK;
+}
+
+uint8_t MSC_USB_Setup(USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *req)
+{
+	static uint8_t max_lun = 0;
+	static uint16_t status_info = 0;
+	static uint8_t alt_setting = 0;
+
+	switch (req->bmRequest & USB_REQ_TYPE_MASK)
+	{
+	case USB_REQ_TYPE_CLASS:
+		if (req->bRequest == MSC_BOT_GET_MAX_LUN && req->wValue == 0 && req->wLength == 1 && (req->bmRequest & 0x80))
+		{
+			USBD_CtlSendData(pdev, &max_lun, 1);
+			return (uint8_t)USBD_OK;
+		}
+		if (req->bRequest == MSC_BOT_RESET && req->wValue == 0 && req->wLength == 0 && !(req->bmRequest & 0x80))
+		{
+			// Reset recovery, command in progress is aborted by MSC_Loop
+			msc_handle->halted = 0;
+			msc_handle->flag_reset = 1;
+			return (uint8_t)USBD_OK;
+		}
+		break;
+	case USB_REQ_TYPE_STANDARD:
+		switch (req->bRequest)
+		{
+		case USB_REQ_GET_STATUS:
+			USBD_CtlSendData(pdev, (uint8_t*)&status_info, 2);
+			return (uint8_t)USBD_OK;
+		case USB_REQ_GET_INTERFACE:
+			USBD_CtlSendData(pdev, &alt_setting, 1);
+			return (uint8_t)USBD_OK;
+		case USB_REQ_SET_INTERFACE:
+			return (uint8_t)USBD_OK;
+		case USB_REQ_CLEAR_FEATURE:
+			if (msc_handle->halted)
+			{
+				// Invalid CBW, stall again until reset recovery
+				USBD_LL_StallEP(pdev, LOBYTE(req->wIndex));
+			}
+			else
+			{
+				msc_handle->flag_clear_halt = 1;
+			}
+			return (uint8_t)USBD_OK;
+		default:
+			break;
+		}
+		break;
+	default:
+		break;
+	}
+	USBD_CtlError(pdev, req);
+	return (uint8_t)USBD_FAIL;
+}
+
+uint8_t MSC_USB_DataIn(USBD_HandleTypeDef *pdev, uint8_t epnum)
+{
+	UNUSED(pdev);
+	UNUSED(epnum);
+	msc_handle->flag_tx = 1;
+	return (uint8_t)USBD_OK;
+}
+
+uint8_t MSC_USB_DataOut(USBD_HandleTypeDef *pdev, uint8_t epnum)
+{
+	msc_handle->rx_len = USBD_LL_GetRxDataSize(pdev, epnum);
+	msc_handle->flag_rx = 1;
+	return (uint8_t)USBD_OK;
+}
+
+uint8_t *MSC_USB_GetConfigDesc(uint16_t *length)
+{
+	*length = sizeof(msc_config_desc);
+	return msc_config_desc;
+}
+
+uint8_t *MSC_USB_GetDeviceQualifierDesc(uint16_t *length)
+{
+	*length = sizeof(msc_device_qualifier_desc);
+	return msc_device_qualifier_desc;
+}
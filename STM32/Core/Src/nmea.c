@@ -12,25 +12,76 @@
 
 #include "nmea.h"
 
+// Packet formats (f: fixed-point decimal, i: decimal integer, x: hexadecimal integer, c: single char)
 const char nmea_pformat_rmc[] = "fcfcfcffifcc";
 const char nmea_pformat_gga[] = "ffcfcciffcfcfi";
 const char nmea_pformat_gll[] = "fcfcfcc";
 const char nmea_pformat_vtg[] = "fcfcfcfcc";
+const char nmea_pformat_gsa[] = "ciiiiiiiiiiiiifffx";
+// GSV with less than 4 satellites has signal ID in place of the next satellite, only num_SV is used
+const char nmea_pformat_gsv[] = "iiiiiiiiiiiiiiiiiiix";
 
-void NMEA_ParsePacket(NMEA_t *hnmea, void *packet_buffer, const char format[]);
-uint8_t NMEA_ChecksumValid(NMEA_t *hnmea);
-uint8_t NMEA_Hex2Dec(char c);
+// Powers of 10 for fixed-point conversion
+const uint32_t nmea_pow10[NMEA_FIXED_DECIMALS_MAX + 1] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000 };
+
+typedef union
+{
+	NMEA_Packet_RMC_t rmc;
+	NMEA_Packet_GGA_t gga;
+	NMEA_Packet_GLL_t gll;
+	NMEA_Packet_VTG_t vtg;
+	NMEA_Packet_GSA_t gsa;
+	NMEA_Packet_GSV_t gsv;
+} NMEA_Packet_t;
+
+uint8_t NMEA_HandleRMC(NMEA_t *hnmea, NMEA_Data_t *data, NMEA_Packet_t *packet);
+uint8_t NMEA_HandleGGA(NMEA_t *hnmea, NMEA_Data_t *data, NMEA_Packet_t *packet);
+uint8_t NMEA_HandleGLL(NMEA_t *hnmea, NMEA_Data_t *data, NMEA_Packet_t *packet);
+uint8_t NMEA_HandleVTG(NMEA_t *hnmea, NMEA_Data_t *data, NMEA_Packet_t *packet);
+uint8_t NMEA_HandleGSA(NMEA_t *hnmea, NMEA_Data_t *data, NMEA_Packet_t *packet);
+uint8_t NMEA_HandleGSV(NMEA_t *hnmea, NMEA_Data_t *data, NMEA_Packet_t *packet);
+
+typedef struct
+{
+	char id[3];
+	const char *format;
+	uint8_t (*handler)(NMEA_t *hnmea, NMEA_Data_t *data, NMEA_Packet_t *packet);
+} NMEA_Sentence_t;
+
+// Supported sentences, selected by sentence ID after talker ID
+const NMEA_Sentence_t nmea_sentences[] = {
+	{ { 'R', 'M', 'C' }, nmea_pformat_rmc, NMEA_HandleRMC },
+	{ { 'G', 'G', 'A' }, nmea_pformat_gga, NMEA_HandleGGA },
+	{ { 'V', 'T', 'G' }, nmea_pformat_vtg, NMEA_HandleVTG },
+	{ { 'G', 'S', 'A' }, nmea_pformat_gsa, NMEA_HandleGSA },
+	{ { 'G', 'S', 'V' }, nmea_pformat_gsv, NMEA_HandleGSV },
+	{ { 'G', 'L', 'L' }, nmea_pformat_gll, NMEA_HandleGLL },
+};
+#define NMEA_SENTENCES_COUNT (sizeof(nmea_sentences) / sizeof(NMEA_Sentence_t))
+
+HAL_StatusTypeDef NMEA_Transmit(NMEA_t *hnmea, uint8_t *data, uint16_t len);
+uint8_t NMEA_TxBusy(NMEA_t *hnmea);
+void NMEA_ProcessUBXChar(NMEA_t *hnmea, uint8_t c);
+uint8_t NMEA_TxAiding(NMEA_t *hnmea);
+uint8_t NMEA_Tokenize(const char *line, NMEA_Tokens_t *tokens);
+void NMEA_ParsePacket(const char *line, const NMEA_Tokens_t *tokens, void *packet_buffer, const char format[]);
+NMEA_Fixed_t NMEA_ParseFixed(const char *s);
+int32_t NMEA_ParseInt(const char *s, uint8_t base);
+float NMEA_FixedToFloat(NMEA_Fixed_t f);
 void NMEA_Dec2Hex(uint8_t dec, char *c1, char *c2);
-void NMEA_ConvertTime(NMEA_Data_t *data, float time);
+void NMEA_ConvertTime(NMEA_Data_t *data, NMEA_Fixed_t time);
 void NMEA_ConvertDate(NMEA_Data_t *data, int32_t date);
-void NMEA_ConvertLatLon(NMEA_Data_t *data, float lat, char lat_dir, float lon, char lon_dir);
+float NMEA_ConvertDegrees(NMEA_Fixed_t deg_min, char dir);
 
-// Transmit PUBX protocol
+// Transmit PUBX protocol (without blocking)
 HAL_StatusTypeDef NMEA_TxPUBX(NMEA_t *hnmea, char *msg_buffer)
 {
-	char tx_buffer[100];
+	// Wait for previous transmission of tx_buffer (NMEA_Loop only sends once it is completed)
+	while (NMEA_TxBusy(hnmea))
+		;
+	char *tx_buffer = (char*)hnmea->tx_buffer;
 	// Put message into packet format
-	sprintf(tx_buffer, "$PUBX,%s*00\r\n", msg_buffer);
+	snprintf(tx_buffer, NMEA_TX_BUFFER_SIZE, "$PUBX,%s*00\r\n", msg_buffer);
 	// Calculate checksum
 	uint32_t tx_len = strlen(tx_buffer);
 	uint8_t checksum = 0;
@@ -41,19 +92,24 @@ HAL_StatusTypeDef NMEA_TxPUBX(NMEA_t *hnmea, char *msg_buffer)
 	// Write checksum as hexadecimal into packet
 	NMEA_Dec2Hex(checksum, &tx_buffer[tx_len - 4], &tx_buffer[tx_len - 3]);
 	// Transmit packet
-	if (HAL_UART_Transmit(hnmea->huart, (uint8_t*)tx_buffer, tx_len, hnmea->tx_timeout) == HAL_ERROR)
-	{
-		return HAL_ERROR;
-	}
-	return HAL_OK;
+	return NMEA_Transmit(hnmea, (uint8_t*)tx_buffer, tx_len);
 }
 
-// Transmit UBX protocol
+// Transmit UBX protocol (without blocking)
 HAL_StatusTypeDef NMEA_TxUBX(NMEA_t *hnmea, uint32_t header, void *packet, size_t packet_size)
 {
-	// Protocol header
-	uint8_t tx_buffer[100] = { 0xB5, 0x62 };
 	uint32_t tx_len = packet_size + 8;
+	if (tx_len > NMEA_TX_BUFFER_SIZE)
+	{
+		return HAL_ERROR;
+	}
+	// Wait for previous transmission of tx_buffer (NMEA_Loop only sends once it is completed)
+	while (NMEA_TxBusy(hnmea))
+		;
+	// Protocol header
+	uint8_t *tx_buffer = hnmea->tx_buffer;
+	tx_buffer[0] = 0xB5;
+	tx_buffer[1] = 0x62;
 	// Packet header
 	*(uint32_t*)(tx_buffer + 2) = header;
 	// Packet content
@@ -68,73 +124,186 @@ HAL_StatusTypeDef NMEA_TxUBX(NMEA_t *hnmea, uint32_t header, void *packet, size_
 	}
 	// Save transmitted header for received checksum
 	hnmea->last_ubx_header = header & 0xFFFF;
-	if (HAL_UART_Transmit(hnmea->huart, tx_buffer, tx_len, hnmea->tx_timeout) == HAL_ERROR)
+	return NMEA_Transmit(hnmea, tx_buffer, tx_len);
+}
+
+// Start interrupt-driven transmission, data must be kept until NMEA_TxCplt
+HAL_StatusTypeDef NMEA_Transmit(NMEA_t *hnmea, uint8_t *data, uint16_t len)
+{
+	while (NMEA_TxBusy(hnmea))
+		;
+	// Aiding packets (class UBX-MGA) are acknowledged by UBX-MGA-ACK (enabled in NMEA_STATE_RATE)
+	hnmea->mga_ack = NMEA_UBX_ACK_NONE;
+	hnmea->mga_msg_id = len >= 8 && data[0] == 0xB5 && data[2] == 0x13 ? data[3] : 0;
+	hnmea->tx_busy = 1;
+	hnmea->tx_start = HAL_GetTick();
+	if (HAL_UART_Transmit_IT(hnmea->huart, data, len) != HAL_OK)
 	{
+		hnmea->tx_busy = 0;
 		return HAL_ERROR;
 	}
 	return HAL_OK;
 }
 
-// Receive ACK in UBX protocol
-HAL_StatusTypeDef NMEA_RxAckUBX(NMEA_t *hnmea)
+// Returns 1 while a transmission is in progress, aborts transmissions not completed within tx_timeout
+uint8_t NMEA_TxBusy(NMEA_t *hnmea)
 {
-	// Wait for protocol header
-	uint8_t header = 0;
-	for (uint32_t i = 0; i < 100; i++)
+	if (hnmea->tx_busy && HAL_GetTick() - hnmea->tx_start > hnmea->tx_timeout)
 	{
-		HAL_UART_Receive(hnmea->huart, &header, sizeof(uint8_t), 10);
-		if (header == 0xB5)
-		{
-			HAL_UART_Receive(hnmea->huart, &header, sizeof(uint8_t), 10);
-			if (header == 0x62)
-			{
-				break;
-			}
-		}
-		header = 0;
-	}
-	if (header == 0)
-	{
-		return HAL_ERROR;
+		HAL_UART_AbortTransmit(hnmea->huart);
+		hnmea->tx_busy = 0;
+		printf("(%lu) WARNING: NMEA_TxBusy: Transmission not completed within %lu ms, aborted\r\n", HAL_GetTick(), hnmea->tx_timeout);
 	}
-	// Receive 8 bytes as 4 * uint16
-	uint16_t rx_buffer[8 / 2];
-	if (HAL_UART_Receive(hnmea->huart, (uint8_t*)rx_buffer, sizeof(rx_buffer), hnmea->rx_timeout) == HAL_ERROR)
+	return hnmea->tx_busy;
+}
+
+// Call from HAL_UART_TxCpltCallback
+void NMEA_TxCplt(NMEA_t *hnmea)
+{
+	hnmea->tx_busy = 0;
+}
+
+// Track UBX packets (B5 62 class ID length payload CK_A CK_B) in received byte stream
+void NMEA_ProcessUBXChar(NMEA_t *hnmea, uint8_t c)
+{
+	// Wait for sync chars
+	if ((hnmea->ubx_rx_index == 0 && c != 0xB5) || (hnmea->ubx_rx_index == 1 && c != 0x62))
 	{
-		return HAL_ERROR;
+		hnmea->ubx_rx_index = 0;
+		return;
 	}
-	// Check if ACK/NAK
-	if (rx_buffer[0] != 0x0105)
+	volatile uint8_t *rx_buffer = hnmea->ubx_rx_buffer;
+	rx_buffer[hnmea->ubx_rx_index++] = c;
+	if (hnmea->ubx_rx_index < 6)
 	{
-		// NAK: rx_buffer[0] == 0x0005
-		return HAL_ERROR;
+		return;
 	}
-	// Check length
-	if (rx_buffer[1] != 2)
+	// Wait for complete packet, discard packets exceeding buffer
+	uint32_t packet_size = (rx_buffer[4] | (rx_buffer[5] << 8)) + 8;
+	if (packet_size > NMEA_UBX_RX_BUFFER_SIZE)
 	{
-		return HAL_ERROR;
+		hnmea->ubx_rx_index = 0;
+		return;
 	}
-	// Check if corresponding ACK for transmitted message
-	if (rx_buffer[2] != hnmea->last_ubx_header)
+	if (hnmea->ubx_rx_index < packet_size)
 	{
-		return HAL_ERROR;
+		return;
 	}
+	hnmea->ubx_rx_index = 0;
+
 	// Check checksum
 	uint8_t ck_a = 0, ck_b = 0;
-	for (uint8_t i = 0; i < sizeof(rx_buffer) - 2; i++)
+	for (uint16_t i = 2; i < packet_size - 2; i++)
 	{
-		ck_a += ((uint8_t*)rx_buffer)[i];
+		ck_a += rx_buffer[i];
 		ck_b += ck_a;
 	}
-	if ((rx_buffer[3] & 0xFF) != ck_a)
+	if (rx_buffer[packet_size - 2] != ck_a || rx_buffer[packet_size - 1] != ck_b)
 	{
-		return HAL_ERROR;
+		return;
 	}
-	if ((rx_buffer[3] >> 8) != ck_b)
+
+	uint16_t class_id = rx_buffer[2] | (rx_buffer[3] << 8);
+	// ACK/NAK for transmitted message
+	if (rx_buffer[2] == 0x05 && packet_size == 10)
 	{
-		return HAL_ERROR;
+		if ((rx_buffer[6] | (rx_buffer[7] << 8)) == hnmea->last_ubx_header)
+		{
+			hnmea->ubx_ack = rx_buffer[3] == 0x01 ? NMEA_UBX_ACK : NMEA_UBX_NAK;
+		}
 	}
-	return HAL_OK;
+	// Acknowledgement of aiding packet
+	else if (class_id == (NMEA_UBX_MGA_ACK_HEADER & 0xFFFF) && packet_size == 16)
+	{
+		if (rx_buffer[9] == hnmea->mga_msg_id)
+		{
+			hnmea->mga_ack = rx_buffer[6] == 0x01 ? NMEA_UBX_ACK : NMEA_UBX_NAK;
+		}
+	}
+	// Navigation database dump, stored as received to be sent back on next boot
+	else if (class_id == (NMEA_UBX_MGA_DBD_HEADER & 0xFFFF) && hnmea->dbd_receiving)
+	{
+		if (hnmea->dbd_len + packet_size <= NMEA_DBD_BUFFER_SIZE)
+		{
+			for (uint16_t i = 0; i < packet_size; i++)
+			{
+				hnmea->dbd_buffer[hnmea->dbd_len + i] = rx_buffer[i];
+			}
+			hnmea->dbd_len += packet_size;
+		}
+		else
+		{
+			// Incomplete database must not be saved, counted to report in NMEA_DatabaseComplete
+			hnmea->dbd_dropped += packet_size;
+		}
+		hnmea->dbd_last_rx = HAL_GetTick();
+	}
+}
+
+// Send next warm start packet: saved position (and time) as UBX-MGA-INI, then navigation database as received (UBX-MGA-DBD), returns 0 once all are sent
+uint8_t NMEA_TxAiding(NMEA_t *hnmea)
+{
+	NMEA_WarmStart_t *warm_start = &hnmea->warm_start;
+	if (hnmea->aiding_step == 0)
+	{
+		hnmea->aiding_step++;
+		if (warm_start->position_valid)
+		{
+			NMEA_UBX_MGA_INI_POS_LLH_t ubx_pos = {
+				.type = 0x01,
+				.lat = warm_start->lat,
+				.lon = warm_start->lon,
+				.alt = warm_start->altitude,
+				.posAcc = NMEA_AIDING_POS_ACC,
+			};
+			if (NMEA_TxUBX(hnmea, NMEA_UBX_MGA_INI_POS_LLH_HEADER, &ubx_pos, sizeof(ubx_pos)) == HAL_ERROR)
+			{
+				printf("(%lu) WARNING: NMEA_TxAiding: NMEA_TxUBX failed\r\n", HAL_GetTick());
+			}
+			return 1;
+		}
+	}
+#if NMEA_AIDING_TIME_ACC
+	if (hnmea->aiding_step == 1)
+	{
+		hnmea->aiding_step++;
+		if (warm_start->time_valid)
+		{
+			NMEA_UBX_MGA_INI_TIME_UTC_t ubx_time = {
+				.type = 0x10,
+				.leapSecs = -128,
+				.year = warm_start->year,
+				.month = warm_start->month,
+				.day = warm_start->day,
+				.hour = warm_start->hour,
+				.minute = warm_start->minute,
+				.second = (uint8_t)warm_start->second,
+				.tAccS = NMEA_AIDING_TIME_ACC,
+			};
+			if (NMEA_TxUBX(hnmea, NMEA_UBX_MGA_INI_TIME_UTC_HEADER, &ubx_time, sizeof(ubx_time)) == HAL_ERROR)
+			{
+				printf("(%lu) WARNING: NMEA_TxAiding: NMEA_TxUBX failed\r\n", HAL_GetTick());
+			}
+			return 1;
+		}
+	}
+#endif
+	// One UBX-MGA-DBD packet, transmitted from dbd_buffer
+	if (hnmea->dbd_tx_index + 8 <= hnmea->dbd_len)
+	{
+		uint8_t *packet = (uint8_t*)hnmea->dbd_buffer + hnmea->dbd_tx_index;
+		uint32_t packet_size = (packet[4] | (packet[5] << 8)) + 8;
+		if (hnmea->dbd_tx_index + packet_size <= hnmea->dbd_len)
+		{
+			if (NMEA_Transmit(hnmea, packet, packet_size) == HAL_ERROR)
+			{
+				printf("(%lu) WARNING: NMEA_TxAiding: NMEA_Transmit failed\r\n", HAL_GetTick());
+			}
+			hnmea->dbd_tx_index += packet_size;
+			return 1;
+		}
+	}
+	return 0;
 }
 
 HAL_StatusTypeDef NMEA_Init(NMEA_t *hnmea)
@@ -159,81 +328,259 @@ HAL_StatusTypeDef NMEA_Init(NMEA_t *hnmea)
 
 	// Init struct
 	hnmea->rx_buffer_write_index = 0;
-	hnmea->circular_read_index = 0;
-	hnmea->circular_write_index = 0;
-	hnmea->last_ubx_header = 0;
-
-	// Delay to let GNSS-module boot
-	HAL_Delay(1000);
-
-	// Set baud rate
-	char pubx_buffer[100];
-	uint16_t inProto = 0b000011; // Module should accept NMEA and UBX via UART
-	uint16_t outProto = 0b000010; // Module should transmit NMEA via UART
-	sprintf(pubx_buffer, "41,1,%04hX,%04hX,%lu,0", inProto, outProto, hnmea->baud);
-	if (NMEA_TxPUBX(hnmea, pubx_buffer) == HAL_ERROR)
+	hnmea->tx_busy = 0;
+	hnmea->line_ring.buffer = hnmea->line_ring_buffer;
+	hnmea->line_ring.size = NMEA_LINE_RING_SIZE;
+	if (Ring_Buffer_Init(&hnmea->line_ring) != HAL_OK)
 	{
-		printf("(%lu) ERROR: NMEA_Init: NMEA_SendPUBX failed\r\n", HAL_GetTick());
 		return HAL_ERROR;
 	}
-	hnmea->huart->Init.BaudRate = hnmea->baud;
-	if (HAL_UART_Init(hnmea->huart) != HAL_OK)
+	hnmea->last_ubx_header = 0;
+	hnmea->last_rmc_time = -1;
+	memset(&hnmea->status, 0, sizeof(NMEA_Status_t));
+	hnmea->ubx_rx_index = 0;
+	hnmea->ubx_ack = NMEA_UBX_ACK_NONE;
+	memset(&hnmea->warm_start, 0, sizeof(NMEA_WarmStart_t));
+	hnmea->dbd_len = 0;
+	hnmea->dbd_dropped = 0;
+	hnmea->dbd_tx_index = 0;
+	hnmea->aiding_step = 0;
+	hnmea->mga_msg_id = 0;
+	hnmea->mga_ack = NMEA_UBX_ACK_NONE;
+	hnmea->aiding_rejected = 0;
+	hnmea->dbd_receiving = 0;
+
+	// Configuration continues in NMEA_Loop once the GNSS module has booted
+	hnmea->state = NMEA_STATE_BOOT;
+	hnmea->state_time = HAL_GetTick();
+
+	return HAL_OK;
+}
+
+// Non-blocking configuration of GNSS module, call regularly from main loop
+HAL_StatusTypeDef NMEA_Loop(NMEA_t *hnmea)
+{
+	switch (hnmea->state)
 	{
-		printf("(%lu) ERROR: NMEA_Init: HAL_UART_Init failed\r\n", HAL_GetTick());
-		return HAL_ERROR;
+	case NMEA_STATE_BOOT:
+		// Wait for GNSS module to boot
+		if (HAL_GetTick() - hnmea->state_time < NMEA_BOOT_DURATION)
+		{
+			break;
+		}
+
+		// Set baud rate
+		char pubx_buffer[100];
+		uint16_t inProto = 0b000011; // Module should accept NMEA and UBX via UART
+		uint16_t outProto = 0b000011; // Module should transmit NMEA and UBX (ACK) via UART
+		sprintf(pubx_buffer, "41,1,%04hX,%04hX,%lu,0", inProto, outProto, hnmea->baud);
+		if (NMEA_TxPUBX(hnmea, pubx_buffer) == HAL_ERROR)
+		{
+			printf("(%lu) ERROR: NMEA_Loop: NMEA_SendPUBX failed\r\n", HAL_GetTick());
+			hnmea->state = NMEA_STATE_ERROR;
+			return HAL_ERROR;
+		}
+		hnmea->state = NMEA_STATE_PORT;
+		break;
+	case NMEA_STATE_PORT:
+		// Wait for transmission at previous baud rate (completed in NMEA_TxCplt)
+		if (NMEA_TxBusy(hnmea))
+		{
+			break;
+		}
+		hnmea->huart->Init.BaudRate = hnmea->baud;
+		if (HAL_UART_Init(hnmea->huart) != HAL_OK)
+		{
+			printf("(%lu) ERROR: NMEA_Loop: HAL_UART_Init failed\r\n", HAL_GetTick());
+			hnmea->state = NMEA_STATE_ERROR;
+			return HAL_ERROR;
+		}
+
+		// Start receiving data
+		if (HAL_UART_Receive_DMA(hnmea->huart, (uint8_t*)&hnmea->dma_buffer, NMEA_DMA_BUFFER_SIZE) == HAL_ERROR)
+		{
+			printf("(%lu) ERROR: NMEA_Loop: HAL_UART_Receive_DMA failed\r\n", HAL_GetTick());
+			hnmea->state = NMEA_STATE_ERROR;
+			return HAL_ERROR;
+		}
+
+		hnmea->state = NMEA_STATE_BAUD;
+		hnmea->state_time = HAL_GetTick();
+		break;
+	case NMEA_STATE_BAUD:
+		// Wait for GNSS module to switch baud rate
+		if (HAL_GetTick() - hnmea->state_time < NMEA_BAUD_DURATION)
+		{
+			break;
+		}
+
+		// Set output data rate
+		NMEA_UBX_CFG_RATE_t ubx_rate = {
+			.measRate = 1000 / hnmea->sampling_rate,
+			.navRate = 1,
+			.timeRef = 0,
+		};
+		hnmea->ubx_ack = NMEA_UBX_ACK_NONE;
+		NMEA_TxUBX(hnmea, NMEA_UBX_CFG_RATE_HEADER, &ubx_rate, sizeof(ubx_rate));
+
+		hnmea->state = NMEA_STATE_RATE;
+		hnmea->state_time = HAL_GetTick();
+		break;
+	case NMEA_STATE_RATE:
+		// Wait for ACK (received in NMEA_ProcessDMABuffer)
+		if (hnmea->ubx_ack == NMEA_UBX_ACK_NONE && HAL_GetTick() - hnmea->state_time < hnmea->rx_timeout)
+		{
+			break;
+		}
+		if (hnmea->ubx_ack != NMEA_UBX_ACK)
+		{
+			printf("(%lu) WARNING: UBX-CFG-RATE not acknowledged\r\n", HAL_GetTick());
+		}
+		printf("(%lu) GNSS module configured\r\n", HAL_GetTick());
+
+		// Enable UBX-MGA-ACK for aiding, the receiver drops aiding sent faster than it is processed
+		NMEA_UBX_CFG_NAVX5_t ubx_navx5 = {
+			.version = 2,
+			.mask1 = NMEA_UBX_CFG_NAVX5_MASK1_ACK_AID,
+			.ackAiding = 1,
+		};
+		hnmea->ubx_ack = NMEA_UBX_ACK_NONE;
+		NMEA_TxUBX(hnmea, NMEA_UBX_CFG_NAVX5_HEADER, &ubx_navx5, sizeof(ubx_navx5));
+
+		hnmea->state = NMEA_STATE_NAVX5;
+		hnmea->state_time = HAL_GetTick();
+		break;
+	case NMEA_STATE_NAVX5:
+		// Wait for ACK (received in NMEA_ProcessDMABuffer)
+		if (hnmea->ubx_ack == NMEA_UBX_ACK_NONE && HAL_GetTick() - hnmea->state_time < hnmea->rx_timeout)
+		{
+			break;
+		}
+		if (hnmea->ubx_ack != NMEA_UBX_ACK)
+		{
+			printf("(%lu) WARNING: UBX-CFG-NAVX5 not acknowledged, aiding is paced by timeout\r\n", HAL_GetTick());
+		}
+
+		// GNSS stopped by NMEA_Stop at end of last capture stays stopped across MCU reset (no-op if running)
+		if (NMEA_Start(hnmea) == HAL_ERROR)
+		{
+			printf("(%lu) WARNING: NMEA_Loop: NMEA_Start failed\r\n", HAL_GetTick());
+		}
+
+		// Warm start with saved state and navigation database (set by caller after NMEA_Init)
+		hnmea->aiding_step = 0;
+		hnmea->aiding_rejected = 0;
+		hnmea->dbd_tx_index = 0;
+		hnmea->state = NMEA_STATE_AIDING;
+		hnmea->state_time = HAL_GetTick();
+		break;
+	case NMEA_STATE_AIDING:
+		// Send one packet once the previous one is transmitted and acknowledged (received in NMEA_ProcessDMABuffer)
+		if (NMEA_TxBusy(hnmea))
+		{
+			break;
+		}
+		if (hnmea->mga_msg_id != 0)
+		{
+			if (hnmea->mga_ack == NMEA_UBX_ACK_NONE && HAL_GetTick() - hnmea->state_time < NMEA_MGA_ACK_TIMEOUT)
+			{
+				break;
+			}
+			if (hnmea->mga_ack != NMEA_UBX_ACK)
+			{
+				hnmea->aiding_rejected++;
+			}
+			hnmea->mga_msg_id = 0;
+		}
+		if (NMEA_TxAiding(hnmea))
+		{
+			hnmea->state_time = HAL_GetTick();
+			break;
+		}
+		if (hnmea->dbd_tx_index > 0)
+		{
+			printf("(%lu) GNSS navigation database sent (%u bytes)\r\n", HAL_GetTick(), hnmea->dbd_tx_index);
+		}
+		if (hnmea->aiding_rejected > 0)
+		{
+			printf("(%lu) WARNING: %u GNSS aiding packets not acknowledged\r\n", HAL_GetTick(), hnmea->aiding_rejected);
+		}
+		hnmea->dbd_len = 0;
+		hnmea->state = NMEA_STATE_READY;
+		hnmea->state_time = HAL_GetTick();
+		break;
+	case NMEA_STATE_READY:
+	case NMEA_STATE_ERROR:
+		break;
 	}
-	HAL_Delay(250);
 
-	// Set output data rate
-	NMEA_UBX_CFG_RATE_t ubx_rate = {
-		.measRate = 1000 / hnmea->sampling_rate,
-		.navRate = 1,
-		.timeRef = 0,
-	};
-	NMEA_TxUBX(hnmea, NMEA_UBX_CFG_RATE_HEADER, &ubx_rate, sizeof(ubx_rate));
-	if (NMEA_RxAckUBX(hnmea) != HAL_OK)
+	return HAL_OK;
+}
+
+// Poll navigation database dump (UBX-MGA-DBD), packets are collected in dbd_buffer
+HAL_StatusTypeDef NMEA_RequestDatabase(NMEA_t *hnmea)
+{
+	if (hnmea->state != NMEA_STATE_READY)
 	{
-		printf("(%lu) WARNING: UBX-CFG-RATE not acknowledged\r\n", HAL_GetTick());
+		return HAL_BUSY;
 	}
-
-	// Start receiving data
-	if (HAL_UART_Receive_DMA(hnmea->huart, (uint8_t*)&hnmea->dma_buffer, NMEA_DMA_BUFFER_SIZE) == HAL_ERROR)
+	hnmea->dbd_len = 0;
+	hnmea->dbd_dropped = 0;
+	hnmea->dbd_last_rx = HAL_GetTick();
+	hnmea->dbd_receiving = 1;
+	if (NMEA_TxUBX(hnmea, NMEA_UBX_MGA_DBD_HEADER, NULL, 0) == HAL_ERROR)
 	{
-		printf("(%lu) ERROR: NMEA_Init: HAL_UART_Receive_DMA failed\r\n", HAL_GetTick());
+		hnmea->dbd_receiving = 0;
 		return HAL_ERROR;
 	}
-
 	return HAL_OK;
 }
 
-// Wait for GNSS date, return packet with valid date if received before timeout
-NMEA_Data_t NMEA_GetDate(NMEA_t *hnmea)
+// Returns 1 once after the requested database dump is complete (0 if it exceeded dbd_buffer)
+uint8_t NMEA_DatabaseComplete(NMEA_t *hnmea)
 {
-	printf("(%lu) Waiting for GNSS date (timeout after %i s)...\r\n", HAL_GetTick(), NMEA_DATE_WAIT_DURATION / 1000);
-
-	NMEA_Data_t data = {
-		.position_valid = 0,
-		.speed_valid = 0,
-		.altitude_valid = 0,
-		.date_valid = 0,
-		.time_valid = 0,
-	};
-	uint32_t time_end = HAL_GetTick() + NMEA_DATE_WAIT_DURATION;
-	while (HAL_GetTick() <= time_end)
+	if (!hnmea->dbd_receiving)
 	{
-		if (hnmea->circular_write_index != hnmea->circular_read_index)
+		return 0;
+	}
+	uint32_t duration = HAL_GetTick() - hnmea->dbd_last_rx;
+	if (hnmea->dbd_len > 0 && duration > NMEA_DBD_QUIET_DURATION)
+	{
+		hnmea->dbd_receiving = 0;
+		if (hnmea->dbd_dropped > 0)
 		{
-			if (NMEA_ProcessLine(hnmea, &data))
-			{
-				if (data.date_valid)
-				{
-					return data;
-				}
-			}
+			printf("(%lu) WARNING: GNSS navigation database exceeds buffer (%lu bytes dropped), not saved\r\n", HAL_GetTick(), hnmea->dbd_dropped);
+			hnmea->dbd_len = 0;
+			return 0;
 		}
+		return 1;
 	}
+	if (hnmea->dbd_len == 0 && duration > NMEA_DBD_TIMEOUT)
+	{
+		printf("(%lu) WARNING: No GNSS navigation database received\r\n", HAL_GetTick());
+		hnmea->dbd_receiving = 0;
+	}
+	return 0;
+}
 
-	return data;
+// Stop GNSS controlled (receiver keeps backup data for hot start if supplied)
+HAL_StatusTypeDef NMEA_Stop(NMEA_t *hnmea)
+{
+	NMEA_UBX_CFG_RST_t ubx_rst = {
+		.navBbrMask = UBX_RESET_BBR_HOT_START,
+		.resetMode = UBX_RESET_MODE_GNSS_STOP,
+	};
+	return NMEA_TxUBX(hnmea, NMEA_UBX_CFG_RST_HEADER, &ubx_rst, sizeof(ubx_rst));
+}
+
+// Start GNSS controlled (after NMEA_Stop)
+HAL_StatusTypeDef NMEA_Start(NMEA_t *hnmea)
+{
+	NMEA_UBX_CFG_RST_t ubx_rst = {
+		.navBbrMask = UBX_RESET_BBR_HOT_START,
+		.resetMode = UBX_RESET_MODE_GNSS_START,
+	};
+	return NMEA_TxUBX(hnmea, NMEA_UBX_CFG_RST_HEADER, &ubx_rst, sizeof(ubx_rst));
 }
 
 // Handle full DMA buffer
@@ -241,22 +588,26 @@ HAL_StatusTypeDef NMEA_ProcessDMABuffer(NMEA_t *hnmea)
 {
 	for (uint32_t i = 0; i < NMEA_DMA_BUFFER_SIZE; i++)
 	{
+		// UBX packets (ACK) are interleaved with NMEA lines
+		NMEA_ProcessUBXChar(hnmea, hnmea->dma_buffer[i]);
+
 		// If end of line
 		if (hnmea->dma_buffer[i] == '\n')
 		{
 			// If current line has content
 			if (hnmea->rx_buffer_write_index > 1)
 			{
-				// Copy finished current line to circular buffer and remove trailing \r
-				memcpy((void*)hnmea->circular_buffer[hnmea->circular_write_index].buffer, (void*)hnmea->rx_buffer, hnmea->rx_buffer_write_index - 1);
-				// Add string termination
-				hnmea->circular_buffer[hnmea->circular_write_index].buffer[hnmea->rx_buffer_write_index - 1] = '\0';
-				// Increment circular buffer index
-				hnmea->circular_write_index = (hnmea->circular_write_index + 1) % NMEA_CIRCULAR_BUFFER_SIZE;
-				// If incremented up to read index, there was a circular buffer overflow
-				if (hnmea->circular_write_index == hnmea->circular_read_index)
+				// Copy finished current line to line queue and remove trailing \r (dropped and counted if full)
+				uint32_t line_len = hnmea->rx_buffer_write_index - 1;
+				uint32_t entry_len = sizeof(NMEA_Line_t) + line_len + 1;
+				NMEA_Line_t *line = Ring_Buffer_Reserve(&hnmea->line_ring, entry_len);
+				if (line != NULL)
 				{
-					hnmea->overflow_circular_buffer = 1;
+					line->timestamp = hnmea->line_timestamp;
+					memcpy(line->buffer, (void*)hnmea->rx_buffer, line_len);
+					// Add string termination
+					line->buffer[line_len] = '\0';
+					Ring_Buffer_Commit(&hnmea->line_ring, entry_len);
 				}
 			}
 			// Reset to start of line buffer
@@ -269,8 +620,8 @@ HAL_StatusTypeDef NMEA_ProcessDMABuffer(NMEA_t *hnmea)
 			{
 				// Reset to start of line buffer
 				hnmea->rx_buffer_write_index = 0;
-				// Save timestamp of start of transmission in circular buffer
-				hnmea->circular_buffer[hnmea->circular_write_index].timestamp = HAL_GetTick();
+				// Save timestamp of start of transmission
+				hnmea->line_timestamp = HAL_GetTick();
 			}
 			// Write character to line buffer
 			hnmea->rx_buffer[hnmea->rx_buffer_write_index++] = hnmea->dma_buffer[i];
@@ -287,123 +638,218 @@ HAL_StatusTypeDef NMEA_ProcessDMABuffer(NMEA_t *hnmea)
 	// Keep receiving data
 	if (HAL_UART_Receive_DMA(hnmea->huart, (uint8_t*)&hnmea->dma_buffer, NMEA_DMA_BUFFER_SIZE) != HAL_OK)
 	{
-		printf("(%lu) ERROR: NMEA_ProcessChar: HAL_UART_Receive_DMA failed\r\n", HAL_GetTick());
+		TRACE(TRACE_NMEA_RX_DMA_FAILED);
 		return HAL_ERROR;
 	}
 
 	return HAL_OK;
 }
 
-// Process line from circular buffer, returns 1 if valid data was written
+// Process line from line queue, returns 1 if valid data was written
 uint8_t NMEA_ProcessLine(NMEA_t *hnmea, NMEA_Data_t *data)
 {
-	if (hnmea->circular_read_index == hnmea->circular_write_index)
+	// Report lines dropped by full queue
+	uint32_t dropped = Ring_Buffer_Dropped(&hnmea->line_ring);
+	if (dropped > 0)
+	{
+		TRACE(TRACE_NMEA_LINES_DROPPED, dropped, hnmea->line_ring.dropped_entries);
+	}
+
+	uint32_t entry_len;
+	NMEA_Line_t *line = Ring_Buffer_Peek(&hnmea->line_ring, &entry_len);
+	if (line == NULL)
 	{
 		return 0;
 	}
 
-	uint8_t any_valid = 0;
+	data->timestamp = line->timestamp;
+	uint8_t any_valid = NMEA_ParseLine(hnmea, line->buffer, data);
+
+	// Free entry in line queue
+	Ring_Buffer_Release(&hnmea->line_ring);
+
+	return any_valid;
+}
 
-	data->timestamp = hnmea->circular_buffer[hnmea->circular_read_index].timestamp;
+// Parse single NMEA line (without line ending), returns 1 if valid data was written
+uint8_t NMEA_ParseLine(NMEA_t *hnmea, const char *line, NMEA_Data_t *data)
+{
 	data->position_valid = 0;
 	data->speed_valid = 0;
 	data->altitude_valid = 0;
 	data->date_valid = 0;
 	data->time_valid = 0;
 
-	volatile char *line_buffer = hnmea->circular_buffer[hnmea->circular_read_index].buffer;
 	// If packet starting with GNSS talker ID
-	if (strncmp("$G", (char*)line_buffer, 2) == 0)
+	if (line[0] != '$' || line[1] != 'G' || line[2] == '\0')
 	{
-		// Get GNSS identifier from talker ID
-		data->talker = line_buffer[2];
+		return 0;
+	}
+	// Get GNSS identifier from talker ID
+	data->talker = line[2];
 
-		// If RMC packet
-		if (strncmp("RMC", (char*)line_buffer + 3, 3) == 0)
+	// Find sentence in table
+	const NMEA_Sentence_t *sentence = NULL;
+	for (uint8_t i = 0; i < NMEA_SENTENCES_COUNT; i++)
+	{
+		if (line[3] == nmea_sentences[i].id[0] && line[4] == nmea_sentences[i].id[1] && line[5] == nmea_sentences[i].id[2])
 		{
-			if (!NMEA_ChecksumValid(hnmea))
-			{
-				return 0;
-			}
+			sentence = &nmea_sentences[i];
+			break;
+		}
+	}
+	if (sentence == NULL)
+	{
+		return 0;
+	}
 
-			NMEA_Packet_RMC_t packet;
-			NMEA_ParsePacket(hnmea, &packet, nmea_pformat_rmc);
+	// Split fields and check checksum in one pass
+	NMEA_Tokens_t tokens;
+	if (!NMEA_Tokenize(line, &tokens))
+	{
+		return 0;
+	}
 
-			// Check if date valid
-			if (packet.date > 0)
-			{
-				any_valid = 1;
-				data->date_valid = 1;
-				NMEA_ConvertDate(data, packet.date);
-			}
-			// Check if time valid
-			if (packet.time > 0)
-			{
-				any_valid = 1;
-				data->time_valid = 1;
-				NMEA_ConvertTime(data, packet.time);
-			}
-			// Check if position and speed valid
-			if (packet.mode != NMEA_MODE_NOT_VALID)
-			{
-				any_valid = 1;
-				data->position_valid = 1;
-				NMEA_ConvertLatLon(data, packet.lat, packet.lat_dir, packet.lon, packet.lon_dir);
+	NMEA_Packet_t packet;
+	NMEA_ParsePacket(line, &tokens, &packet, sentence->format);
+	return sentence->handler(hnmea, data, &packet);
+}
 
-				data->speed_valid = 1;
-				data->speed_kmh = packet.speed_kn * 1.852f;
-			}
-		}
-		// If GGA packet
-		else if (strncmp("GGA", (char*)line_buffer + 3, 3) == 0)
-		{
-			if (!NMEA_ChecksumValid(hnmea))
-			{
-				return 0;
-			}
+uint8_t NMEA_HandleRMC(NMEA_t *hnmea, NMEA_Data_t *data, NMEA_Packet_t *packet)
+{
+	uint8_t any_valid = 0;
+	// Check if date valid
+	if (packet->rmc.date > 0)
+	{
+		any_valid = 1;
+		data->date_valid = 1;
+		NMEA_ConvertDate(data, packet->rmc.date);
+	}
+	// Check if time valid
+	if (packet->rmc.time.valid)
+	{
+		any_valid = 1;
+		data->time_valid = 1;
+		NMEA_ConvertTime(data, packet->rmc.time);
+		hnmea->last_rmc_time = packet->rmc.time.value;
+	}
+	// Check if position and speed valid
+	if (packet->rmc.mode != NMEA_MODE_NOT_VALID && packet->rmc.lat.valid && packet->rmc.lon.valid)
+	{
+		any_valid = 1;
+		data->position_valid = 1;
+		data->lat = NMEA_ConvertDegrees(packet->rmc.lat, packet->rmc.lat_dir);
+		data->lon = NMEA_ConvertDegrees(packet->rmc.lon, packet->rmc.lon_dir);
 
-			NMEA_Packet_GGA_t packet;
-			NMEA_ParsePacket(hnmea, &packet, nmea_pformat_gga);
+		data->speed_valid = 1;
+		data->speed_kmh = NMEA_FixedToFloat(packet->rmc.speed_kn) * 1.852f;
+	}
+	return any_valid;
+}
 
-			// If altitude valid
-			if (packet.altitude > 0)
-			{
-				any_valid = 1;
-				data->altitude_valid = 1;
-				data->altitude = packet.altitude;
-			}
-		}
+uint8_t NMEA_HandleGGA(NMEA_t *hnmea, NMEA_Data_t *data, NMEA_Packet_t *packet)
+{
+	// If altitude valid
+	if (packet->gga.altitude.valid && packet->gga.quality != '0')
+	{
+		data->altitude_valid = 1;
+		data->altitude = NMEA_FixedToFloat(packet->gga.altitude);
+		return 1;
+	}
+	return 0;
+}
+
+uint8_t NMEA_HandleGLL(NMEA_t *hnmea, NMEA_Data_t *data, NMEA_Packet_t *packet)
+{
+	// GLL is sent at end of each epoch, skip if RMC already provided the same epoch
+	if (!packet->gll.time.valid || packet->gll.time.value == hnmea->last_rmc_time)
+	{
+		return 0;
 	}
+	data->time_valid = 1;
+	NMEA_ConvertTime(data, packet->gll.time);
+	if (packet->gll.status == 'A' && packet->gll.mode != NMEA_MODE_NOT_VALID && packet->gll.lat.valid && packet->gll.lon.valid)
+	{
+		data->position_valid = 1;
+		data->lat = NMEA_ConvertDegrees(packet->gll.lat, packet->gll.lat_dir);
+		data->lon = NMEA_ConvertDegrees(packet->gll.lon, packet->gll.lon_dir);
+	}
+	return 1;
+}
 
-	// Increment circular buffer read index
-	hnmea->circular_read_index = (hnmea->circular_read_index + 1) % NMEA_CIRCULAR_BUFFER_SIZE;
+uint8_t NMEA_HandleVTG(NMEA_t *hnmea, NMEA_Data_t *data, NMEA_Packet_t *packet)
+{
+	// If speed valid
+	if (packet->vtg.mode != NMEA_MODE_NOT_VALID && packet->vtg.speed_kmh.valid)
+	{
+		data->speed_valid = 1;
+		data->speed_kmh = NMEA_FixedToFloat(packet->vtg.speed_kmh);
+		return 1;
+	}
+	return 0;
+}
 
-	return any_valid;
+uint8_t NMEA_HandleGSA(NMEA_t *hnmea, NMEA_Data_t *data, NMEA_Packet_t *packet)
+{
+	// Receiver status only, no data point values
+	hnmea->status.fix_type = packet->gsa.nav_mode;
+	hnmea->status.satellites_used = 0;
+	for (uint8_t i = 0; i < 12; i++)
+	{
+		if (packet->gsa.svid[i] != 0)
+		{
+			hnmea->status.satellites_used++;
+		}
+	}
+	hnmea->status.pdop = NMEA_FixedToFloat(packet->gsa.PDOP);
+	hnmea->status.hdop = NMEA_FixedToFloat(packet->gsa.HDOP);
+	return 0;
 }
 
-// Check checksum
-uint8_t NMEA_ChecksumValid(NMEA_t *hnmea)
+uint8_t NMEA_HandleGSV(NMEA_t *hnmea, NMEA_Data_t *data, NMEA_Packet_t *packet)
+{
+	// Receiver status only, no data point values
+	const char *talker = data->talker != '\0' ? strchr(NMEA_GSV_TALKERS, data->talker) : NULL;
+	if (talker == NULL)
+	{
+		return 0;
+	}
+	// Each constellation reports its own satellites
+	hnmea->status.satellites_in_view_talker[talker - NMEA_GSV_TALKERS] = packet->gsv.num_SV;
+	uint16_t sum = 0;
+	for (uint8_t i = 0; i < NMEA_GSV_TALKER_COUNT; i++)
+	{
+		sum += hnmea->status.satellites_in_view_talker[i];
+	}
+	hnmea->status.satellites_in_view = sum > UINT8_MAX ? UINT8_MAX : sum;
+	return 0;
+}
+
+// Check checksum and save start of each field, returns 1 if checksum is valid
+uint8_t NMEA_Tokenize(const char *line, NMEA_Tokens_t *tokens)
 {
-	volatile char *line_buffer = hnmea->circular_buffer[hnmea->circular_read_index].buffer;
 	uint8_t checksum_calc = 0;
-	for (uint16_t i = 1; line_buffer[i] != '\0'; i++)
+	tokens->field_count = 0;
+	for (uint16_t i = 1; line[i] != '\0'; i++)
 	{
 		// If end of data
-		if (line_buffer[i] == '*')
+		if (line[i] == '*')
 		{
-			// Read and check checksum
-			uint8_t checksum = NMEA_Hex2Dec(line_buffer[i + 1]) << 4 | NMEA_Hex2Dec(line_buffer[i + 2]);
-			if (checksum == checksum_calc)
-			{
-				return 1;
-			}
-			else
+			if (line[i + 1] == '\0' || line[i + 2] == '\0')
 			{
 				return 0;
 			}
+			// Read and check checksum
+			uint8_t checksum = NMEA_Hex2Dec(line[i + 1]) << 4 | NMEA_Hex2Dec(line[i + 2]);
+			return checksum == checksum_calc;
 		}
 		// Add to checksum calculation
-		checksum_calc ^= line_buffer[i];
+		checksum_calc ^= line[i];
+		// Field starts after each comma
+		if (line[i] == ',' && tokens->field_count < NMEA_FIELDS_MAX)
+		{
+			tokens->field_start[tokens->field_count++] = i + 1;
+		}
 	}
 	return 0;
 }
@@ -441,117 +887,128 @@ void NMEA_Dec2Hex(uint8_t dec, char *c1, char *c2)
 	}
 }
 
-// Parse packet data with given format string from circular buffer into struct
-void NMEA_ParsePacket(NMEA_t *hnmea, void *packet_buffer, const char format[])
+// Parse tokenized fields with given format string into struct
+void NMEA_ParsePacket(const char *line, const NMEA_Tokens_t *tokens, void *packet_buffer, const char format[])
 {
-	// Read from circular buffer
-	volatile char *line_buffer = hnmea->circular_buffer[hnmea->circular_read_index].buffer;
-	volatile char *line_pointer = line_buffer;
-	// Skip message header
-	while (*line_pointer != ',' && *line_pointer != '\0')
-	{
-		line_pointer++;
-	}
-	line_pointer++;
-
-	// Find end of string to compare against
-	volatile char *line_end_pointer = line_buffer + strlen((char*)line_buffer);
-	// Pointer to currently processed character
+	// Pointer to currently written member of struct
 	void *buffer_pointer = packet_buffer;
-	for (uint8_t i_format = 0; i_format < strlen(format) && line_pointer < line_end_pointer; i_format++)
+	for (uint8_t i_format = 0; format[i_format] != '\0'; i_format++)
 	{
-		// Pointer to end of strtol/strtof conversion
-		char *end_pointer;
+		// Missing fields (short packet) are parsed as empty
+		const char *field = i_format < tokens->field_count ? line + tokens->field_start[i_format] : "";
 		switch (format[i_format])
 		{
 		case 'i':
+		case 'x':
 			// If pointer is unaligned for data type
 			if ((uintptr_t)buffer_pointer % sizeof(int32_t) != 0)
 			{
 				// Align pointer (to match address of member in struct)
 				buffer_pointer += sizeof(int32_t) - (uintptr_t)buffer_pointer % sizeof(int32_t);
 			}
-			// Check if value is present (comma skips current value, moves on to next value immediately)
-			if (*line_pointer != ',')
-			{
-				*(int32_t*)buffer_pointer = strtol((char*)line_pointer, &end_pointer, 10);
-				line_pointer = end_pointer;
-			}
-			else
-			{
-				*(int32_t*)buffer_pointer = 0;
-			}
-			line_pointer++;
-			buffer_pointer += sizeof(int32_t);
-			break;
-		case 'x':
-			if ((uintptr_t)buffer_pointer % sizeof(int32_t) != 0)
-			{
-				buffer_pointer += sizeof(int32_t) - (uintptr_t)buffer_pointer % sizeof(int32_t);
-			}
-			if (*line_pointer != ',')
-			{
-				*(int32_t*)buffer_pointer = strtol((char*)line_pointer, &end_pointer, 16);
-				line_pointer = end_pointer;
-			}
-			else
-			{
-				*(int32_t*)buffer_pointer = 0;
-			}
-			line_pointer++;
+			*(int32_t*)buffer_pointer = NMEA_ParseInt(field, format[i_format] == 'x' ? 16 : 10);
 			buffer_pointer += sizeof(int32_t);
 			break;
 		case 'f':
-			if ((uintptr_t)buffer_pointer % sizeof(float) != 0)
-			{
-				buffer_pointer += sizeof(float) - (uintptr_t)buffer_pointer % sizeof(float);
-			}
-			if (*line_pointer != ',')
-			{
-				*(float*)buffer_pointer = strtof((char*)line_pointer, &end_pointer);
-				line_pointer = end_pointer;
-			}
-			else
+			if ((uintptr_t)buffer_pointer % _Alignof(NMEA_Fixed_t) != 0)
 			{
-				*(float*)buffer_pointer = 0;
+				buffer_pointer += _Alignof(NMEA_Fixed_t) - (uintptr_t)buffer_pointer % _Alignof(NMEA_Fixed_t);
 			}
-			line_pointer++;
-			buffer_pointer += sizeof(float);
+			*(NMEA_Fixed_t*)buffer_pointer = NMEA_ParseFixed(field);
+			buffer_pointer += sizeof(NMEA_Fixed_t);
 			break;
 		case 'c':
-			if (*line_pointer != ',')
-			{
-				// Get single char from packet
-				*(char*)buffer_pointer = *line_pointer;
-				line_pointer++;
-			}
-			else
-			{
-				*(char*)buffer_pointer = '\0';
-			}
-			line_pointer++;
+			// Get single char from packet (empty field as '\0')
+			*(char*)buffer_pointer = (*field != ',' && *field != '*') ? *field : '\0';
 			buffer_pointer += sizeof(char);
 			break;
 		default:
 			printf("(%lu) WARNING: NMEA_ParsePacket: Unknown format %c\r\n", HAL_GetTick(), format[i_format]);
-			// Ignore all values until next value (',') or end of buffer ('\0')
-			while (*line_pointer != ',' && *line_pointer != '\0')
+			buffer_pointer++;
+			break;
+		}
+	}
+}
+
+// Parse decimal number up to next field (',' or '*') into fixed-point without float conversion
+NMEA_Fixed_t NMEA_ParseFixed(const char *s)
+{
+	NMEA_Fixed_t f = { .value = 0, .decimals = 0, .valid = 0 };
+	uint8_t negative = 0, fraction = 0;
+	if (*s == '-')
+	{
+		negative = 1;
+		s++;
+	}
+	for (; *s != ',' && *s != '*' && *s != '\0'; s++)
+	{
+		if (*s == '.')
+		{
+			fraction = 1;
+			continue;
+		}
+		if (*s < '0' || *s > '9')
+		{
+			break;
+		}
+		// Drop decimals which would overflow value
+		if (f.value > (INT32_MAX - 9) / 10 || (fraction && f.decimals >= NMEA_FIXED_DECIMALS_MAX))
+		{
+			if (fraction)
 			{
-				line_pointer++;
+				continue;
 			}
-			line_pointer++;
-			buffer_pointer++;
 			break;
 		}
+		f.value = f.value * 10 + (*s - '0');
+		f.decimals += fraction;
+		f.valid = 1;
+	}
+	if (negative)
+	{
+		f.value = -f.value;
+	}
+	return f;
+}
+
+// Parse integer up to next field (',' or '*'), returns 0 for empty field
+int32_t NMEA_ParseInt(const char *s, uint8_t base)
+{
+	int32_t value = 0;
+	uint8_t negative = 0;
+	if (*s == '-')
+	{
+		negative = 1;
+		s++;
+	}
+	for (; *s != ',' && *s != '*' && *s != '\0'; s++)
+	{
+		if (base == 10 && (*s < '0' || *s > '9'))
+		{
+			break;
+		}
+		if (base == 16 && !((*s >= '0' && *s <= '9') || (*s >= 'A' && *s <= 'F') || (*s >= 'a' && *s <= 'f')))
+		{
+			break;
+		}
+		value = value * base + NMEA_Hex2Dec(*s);
 	}
+	return negative ? -value : value;
+}
+
+float NMEA_FixedToFloat(NMEA_Fixed_t f)
+{
+	return (float)f.value / (float)nmea_pow10[f.decimals];
 }
 
-// Convert time from NMEA float format to NMEA_Data_t hour/minute/second
-void NMEA_ConvertTime(NMEA_Data_t *data, float time)
+// Convert time from NMEA fixed-point format (hhmmss.ss) to NMEA_Data_t hour/minute/second
+void NMEA_ConvertTime(NMEA_Data_t *data, NMEA_Fixed_t time)
 {
-	data->hour = (uint32_t)time / 10000;
-	data->minute = ((uint32_t)time / 100) % 100;
-	data->second = fmod(time, 100);
+	uint32_t unit = nmea_pow10[time.decimals];
+	uint32_t hhmmss = time.value / unit;
+	data->hour = hhmmss / 10000;
+	data->minute = (hhmmss / 100) % 100;
+	data->second = (hhmmss % 100) + (float)(time.value % unit) / (float)unit;
 }
 
 // Convert date from NMEA integer format to NMEA_Data_t day/month/year
@@ -562,27 +1019,19 @@ void NMEA_ConvertDate(NMEA_Data_t *data, int32_t date)
 	data->year = date % 100;
 }
 
-// Convert coordinates from NMEA float/char format to NMEA_Data_t signed true degrees
-void NMEA_ConvertLatLon(NMEA_Data_t *data, float lat, char lat_dir, float lon, char lon_dir)
+// Convert coordinate from NMEA fixed-point/char format ((d)ddmm.mmmmm) to signed true degrees
+float NMEA_ConvertDegrees(NMEA_Fixed_t deg_min, char dir)
 {
-	lat /= 100.0f;
-	lon /= 100.0f;
-
-	int lat_deg = (int)lat;
-	int lon_deg = (int)lon;
-	float lat_minutes = lat - lat_deg;
-	float lon_minutes = lon - lon_deg;
-	// Convert degrees and minutes to true degrees
-	data->lat = lat_deg + lat_minutes / 0.6f;
-	data->lon = lon_deg + lon_minutes / 0.6f;
+	uint32_t unit = nmea_pow10[deg_min.decimals];
+	int32_t deg = deg_min.value / unit / 100;
+	// Minutes remain as fixed-point integer, only final division in float
+	int32_t minutes = deg_min.value - deg * 100 * (int32_t)unit;
+	float degrees = deg + (float)minutes / (60.0f * unit);
 
 	// Convert direction to sign
-	if (lat_dir == 'S')
-	{
-		data->lat *= -1;
-	}
-	if (lon_dir == 'W')
+	if (dir == 'S' || dir == 'W')
 	{
-		data->lon *= -1;
+		degrees *= -1;
 	}
+	return degrees;
 }
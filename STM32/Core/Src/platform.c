@@ -0,0 +1,32 @@
+/*
+ * Copyright (c) 2024 Mirco Heitmann
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ * platform.c
+ *
+ * Processing time measurement with the DWT cycle counter (spectrum, envelope analysis, debug tests)
+ */
+
+#include "platform.h"
+
+// Enable DWT cycle counter (DWT->CYCCNT keeps running, it is not reset)
+void Platform_Cycles_Enable(void)
+{
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->LAR = 0xC5ACCE55;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+// Update processing time of buffer with len data points and load (per mille of buffer duration), returns 1 if load exceeds load_max (%)
+uint8_t Platform_Load(uint32_t cycles, uint32_t sampling_rate, uint32_t len, uint16_t load_max, uint32_t *cycles_max, uint16_t *load)
+{
+	if (cycles > *cycles_max)
+	{
+		*cycles_max = cycles;
+	}
+	*load = (uint64_t)cycles * sampling_rate * 1000 / ((uint64_t)SystemCoreClock * len);
+	return *load > load_max * 10;
+}
@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) 2024 Mirco Heitmann
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ * psd.c
+ *
+ * Power spectral density of acceleration channels (Welch's method), written to spectrum files (f_X.bin, read by Python/vera_psd.py)
+ *
+ * Saved acceleration buffers are processed in the main loop: segments of psd_segment_len samples (overlapped by half) are
+ * detrended (mean), windowed (Hann) and transformed (CMSIS real FFT), the power of psd_average_count segments is averaged
+ * and appended to the spectrum file of the current page. Processing time is measured with the DWT cycle counter.
+ */
+
+#include "psd.h"
+
+void Psd_Segment(Psd_t *hpsd);
+void Psd_Save(Psd_t *hpsd);
+
+HAL_StatusTypeDef Psd_Init(Psd_t *hpsd)
+{
+	// Init struct
+	hpsd->active = 0;
+	hpsd->channel_count = 3 + hpsd->piezo_count;
+	hpsd->bin_count = hpsd->segment_len / 2 + 1;
+	hpsd->segment_fill = 0;
+	hpsd->power_count = 0;
+	hpsd->cycles = 0;
+	hpsd->cycles_max = 0;
+	hpsd->load = 0;
+	hpsd->spectrum_count = 0;
+	hpsd->gaps = 0;
+	memset(hpsd->power, 0, sizeof(hpsd->power));
+
+	if (hpsd->segment_len == 0)
+	{
+		return HAL_OK;
+	}
+	if (hpsd->segment_len > PSD_SEGMENT_LEN_MAX || arm_rfft_fast_init_f32(&hpsd->fft, hpsd->segment_len) != ARM_MATH_SUCCESS)
+	{
+		printf("(%lu) ERROR: Psd_Init: Segment length %u not supported (power of two, 32 to %u)\r\n", HAL_GetTick(), hpsd->segment_len, PSD_SEGMENT_LEN_MAX);
+		return HAL_ERROR;
+	}
+
+	// Periodic Hann window, scale of one-sided density: 2 / (fs * sum(w^2))
+	float window_power = 0;
+	for (uint16_t i = 0; i < hpsd->segment_len; i++)
+	{
+		hpsd->window[i] = 0.5f - 0.5f * arm_cos_f32(2 * PI * i / hpsd->segment_len);
+		window_power += hpsd->window[i] * hpsd->window[i];
+	}
+	hpsd->scale = 2.0f / (hpsd->sampling_rate * window_power);
+
+	Platform_Cycles_Enable();
+
+	hpsd->active = 1;
+	return HAL_OK;
+}
+
+// Process saved acceleration buffer, call from main loop
+void Psd_Write(Psd_t *hpsd, volatile a_data_point_t *buffer, uint32_t len)
+{
+	if (!hpsd->active || len == 0)
+	{
+		return;
+	}
+	uint32_t start = DWT->CYCCNT;
+	hpsd->cycles_write = 0;
+
+	uint16_t hop = hpsd->segment_len / 2;
+	for (uint32_t i = 0; i < len; i++)
+	{
+		// Segments are continuous, restart after pause
+		if (hpsd->segment_fill > 0 && buffer[i].timestamp != hpsd->next_timestamp)
+		{
+			hpsd->segment_fill = 0;
+			hpsd->gaps++;
+		}
+		if (hpsd->segment_fill == 0)
+		{
+			hpsd->segment_timestamp = buffer[i].timestamp;
+		}
+		hpsd->next_timestamp = buffer[i].timestamp + 1;
+
+		uint16_t n = hpsd->segment_fill;
+		for (uint8_t i_axis = 0; i_axis < 3; i_axis++)
+		{
+			hpsd->segment[i_axis][n] = buffer[i].xyz_mems1[i_axis];
+		}
+		for (uint8_t i_pz = 0; i_pz < hpsd->piezo_count; i_pz++)
+		{
+			hpsd->segment[3 + i_pz][n] = buffer[i].a_piezo[i_pz];
+		}
+		hpsd->segment_fill++;
+
+		if (hpsd->segment_fill == hpsd->segment_len)
+		{
+			Psd_Segment(hpsd);
+			// Second half is first half of next segment
+			for (uint8_t i_ch = 0; i_ch < hpsd->channel_count; i_ch++)
+			{
+				memcpy(hpsd->segment[i_ch], &hpsd->segment[i_ch][hop], hop * sizeof(float));
+			}
+			hpsd->segment_fill = hop;
+			hpsd->segment_timestamp += hop;
+		}
+	}
+
+	// Load relative to buffer duration (without SD writes), spectrum is disabled if capture can not keep up
+	hpsd->cycles = DWT->CYCCNT - start - hpsd->cycles_write;
+	if (Platform_Load(hpsd->cycles, hpsd->sampling_rate, len, PSD_LOAD_MAX, &hpsd->cycles_max, &hpsd->load))
+	{
+		printf("(%lu) WARNING: Psd_Write: Load %u.%u %% exceeds %u %%, spectrum disabled\r\n", HAL_GetTick(), hpsd->load / 10, hpsd->load % 10, PSD_LOAD_MAX);
+		hpsd->active = 0;
+	}
+}
+
+// Add power of full segment, save spectrum after average_count segments
+void Psd_Segment(Psd_t *hpsd)
+{
+	if (hpsd->power_count == 0)
+	{
+		hpsd->power_timestamp = hpsd->segment_timestamp;
+	}
+
+	uint16_t n = hpsd->segment_len;
+	for (uint8_t i_ch = 0; i_ch < hpsd->channel_count; i_ch++)
+	{
+		// Remove mean, apply window (FFT input is overwritten by arm_rfft_fast_f32)
+		float32_t mean;
+		arm_mean_f32(hpsd->segment[i_ch], n, &mean);
+		arm_offset_f32(hpsd->segment[i_ch], -mean, hpsd->fft_in, n);
+		arm_mult_f32(hpsd->fft_in, hpsd->window, hpsd->fft_in, n);
+		arm_rfft_fast_f32(&hpsd->fft, hpsd->fft_in, hpsd->fft_out, 0);
+
+		// Output: [DC][Nyquist][re 1][im 1]...[re n/2-1][im n/2-1], power of bins 1 to n/2-1 is computed in fft_in
+		float *power = hpsd->power[i_ch];
+		power[0] += hpsd->fft_out[0] * hpsd->fft_out[0];
+		power[n / 2] += hpsd->fft_out[1] * hpsd->fft_out[1];
+		arm_cmplx_mag_squared_f32(&hpsd->fft_out[2], hpsd->fft_in, n / 2 - 1);
+		arm_add_f32(&power[1], hpsd->fft_in, &power[1], n / 2 - 1);
+	}
+
+	hpsd->power_count++;
+	if (hpsd->power_count == hpsd->average_count)
+	{
+		Psd_Save(hpsd);
+		hpsd->power_count = 0;
+		memset(hpsd->power, 0, sizeof(hpsd->power));
+	}
+}
+
+// Append averaged spectrum to spectrum file of current page
+void Psd_Save(Psd_t *hpsd)
+{
+	f_data_point_t *header = (f_data_point_t*)hpsd->record;
+	header->timestamp = hpsd->power_timestamp;
+	header->segment_count = hpsd->power_count;
+	header->bin_count = hpsd->bin_count;
+
+	int16_t *bins = (int16_t*)(hpsd->record + sizeof(f_data_point_t));
+	float scale = hpsd->scale / hpsd->power_count;
+	for (uint8_t i_ch = 0; i_ch < hpsd->channel_count; i_ch++)
+	{
+		for (uint16_t i = 0; i < hpsd->bin_count; i++)
+		{
+			// DC and Nyquist are not doubled (one-sided density)
+			float density = hpsd->power[i_ch][i] * scale;
+			if (i == 0 || i == hpsd->bin_count - 1)
+			{
+				density *= 0.5f;
+			}
+			float db = density > 0 ? 1000.0f * log10f(density) : PSD_DB_MIN;
+			*bins++ = db < PSD_DB_MIN ? PSD_DB_MIN : (db > INT16_MAX ? INT16_MAX : (int16_t)lroundf(db));
+		}
+	}
+	hpsd->spectrum_count++;
+
+	if (hpsd->hvsd == NULL || hpsd->hvsd->f_file_path[0] == '\0')
+	{
+		return;
+	}
+	uint32_t size = (uint8_t*)bins - hpsd->record;
+	uint32_t start = DWT->CYCCNT;
+	if (SD_WriteBuffer(hpsd->hvsd, hpsd->hvsd->f_file_path, hpsd->record, size) != HAL_OK)
+	{
+		printf("(%lu) ERROR: Psd_Save: Writing spectrum failed, spectrum disabled\r\n", HAL_GetTick());
+		hpsd->active = 0;
+	}
+	hpsd->cycles_write += DWT->CYCCNT - start;
+}
@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2024 Mirco Heitmann
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ * ring_buffer.c
+ *
+ * Lock-free single-producer/single-consumer ring buffer with variable-length entries
+ *
+ * Each entry is stored contiguously as [length][data], padded to 4 bytes. If an entry does not fit
+ * before the end of the buffer, the remaining space is marked with RING_BUFFER_WRAP and the entry
+ * starts at the beginning. Producer and consumer may run in different contexts (IRQ and main loop),
+ * data memory barriers order the entry contents before the published indices.
+ */
+
+#include "ring_buffer.h"
+
+HAL_StatusTypeDef Ring_Buffer_Init(Ring_Buffer_t *hring)
+{
+	// Check size (power of two for masking free-running indices) and alignment
+	if (hring->buffer == NULL || hring->size < 2 * RING_BUFFER_HEADER_SIZE || (hring->size & (hring->size - 1)) != 0 || ((uintptr_t)hring->buffer & 3) != 0)
+	{
+		printf("(%lu) ERROR: Ring_Buffer_Init: Invalid buffer (size %lu)\r\n", HAL_GetTick(), hring->size);
+		return HAL_ERROR;
+	}
+
+	// Init struct
+	hring->head = 0;
+	hring->tail = 0;
+	hring->reserve_skip = 0;
+	hring->dropped_entries = 0;
+	hring->dropped_bytes = 0;
+	hring->dropped_reported = 0;
+
+	return HAL_OK;
+}
+
+// Producer: returns contiguous space for entry of len bytes, NULL if full (entry is counted as dropped)
+void *Ring_Buffer_Reserve(Ring_Buffer_t *hring, uint32_t len)
+{
+	uint32_t entry_size = RING_BUFFER_HEADER_SIZE + RING_BUFFER_ALIGN(len);
+	uint32_t head = hring->head;
+	uint32_t tail = hring->tail;
+	// Read tail before overwriting memory released by consumer
+	__DMB();
+	uint32_t free = hring->size - (head - tail);
+	uint32_t pos = head & (hring->size - 1);
+	uint32_t contiguous = hring->size - pos;
+
+	// Skip end of buffer if entry does not fit
+	uint32_t skip = entry_size > contiguous ? contiguous : 0;
+	if (entry_size + skip > free)
+	{
+		hring->dropped_entries++;
+		hring->dropped_bytes += len;
+		return NULL;
+	}
+	if (skip > 0)
+	{
+		*(volatile uint32_t*)(hring->buffer + pos) = RING_BUFFER_WRAP;
+		pos = 0;
+	}
+	hring->reserve_skip = skip;
+
+	return (void*)(hring->buffer + pos + RING_BUFFER_HEADER_SIZE);
+}
+
+// Producer: publish entry reserved by Ring_Buffer_Reserve
+void Ring_Buffer_Commit(Ring_Buffer_t *hring, uint32_t len)
+{
+	uint32_t pos = (hring->head + hring->reserve_skip) & (hring->size - 1);
+	*(volatile uint32_t*)(hring->buffer + pos) = len;
+	// Entry must be visible before the new head
+	__DMB();
+	hring->head += hring->reserve_skip + RING_BUFFER_HEADER_SIZE + RING_BUFFER_ALIGN(len);
+}
+
+// Producer: copy entry into buffer, returns 0 if dropped
+uint8_t Ring_Buffer_Write(Ring_Buffer_t *hring, const void *data, uint32_t len)
+{
+	void *entry = Ring_Buffer_Reserve(hring, len);
+	if (entry == NULL)
+	{
+		return 0;
+	}
+	memcpy(entry, data, len);
+	Ring_Buffer_Commit(hring, len);
+	return 1;
+}
+
+// Consumer: returns oldest entry and its length, NULL if empty
+void *Ring_Buffer_Peek(Ring_Buffer_t *hring, uint32_t *len)
+{
+	uint32_t tail = hring->tail;
+	if (tail == hring->head)
+	{
+		return NULL;
+	}
+	// Read head before entry contents
+	__DMB();
+	uint32_t pos = tail & (hring->size - 1);
+	uint32_t entry_len = *(volatile uint32_t*)(hring->buffer + pos);
+	if (entry_len == RING_BUFFER_WRAP)
+	{
+		// Entry starts at beginning of buffer (wrap marker and entry are published together)
+		hring->tail = tail + hring->size - pos;
+		pos = 0;
+		entry_len = *(volatile uint32_t*)hring->buffer;
+	}
+	*len = entry_len;
+	return (void*)(hring->buffer + pos + RING_BUFFER_HEADER_SIZE);
+}
+
+// Consumer: free entry returned by Ring_Buffer_Peek
+void Ring_Buffer_Release(Ring_Buffer_t *hring)
+{
+	uint32_t tail = hring->tail;
+	uint32_t len = *(volatile uint32_t*)(hring->buffer + (tail & (hring->size - 1)));
+	// Entry must be read completely before producer may overwrite it
+	__DMB();
+	hring->tail = tail + RING_BUFFER_HEADER_SIZE + RING_BUFFER_ALIGN(len);
+}
+
+// Number of used bytes (including headers)
+uint32_t Ring_Buffer_Used(Ring_Buffer_t *hring)
+{
+	return hring->head - hring->tail;
+}
+
+// Consumer: returns number of entries dropped since last call
+uint32_t Ring_Buffer_Dropped(Ring_Buffer_t *hring)
+{
+	uint32_t dropped_entries = hring->dropped_entries;
+	uint32_t dropped = dropped_entries - hring->dropped_reported;
+	hring->dropped_reported = dropped_entries;
+	return dropped;
+}
@@ -12,11 +12,23 @@
 
 #include "sd.h"
 
+// Comparable date
+#define SD_DATE(year, month, day) (((uint32_t)(year) << 16) | ((uint32_t)(month) << 8) | (uint32_t)(day))
+
+uint32_t SD_NextDirNum(Vera_SD_t *hsd);
+HAL_StatusTypeDef SD_Index_Load(Vera_SD_t *hsd);
+HAL_StatusTypeDef SD_Index_Rebuild(Vera_SD_t *hsd);
+uint32_t SD_Index_NextDirNum(Vera_SD_t *hsd);
+void SD_Index_Update_Last(SD_Index_Header_t *index, uint16_t year, uint8_t month, uint8_t day, uint32_t dir_num);
+void SD_Index_Add(Vera_SD_t *hsd);
+void SD_Index_Save(Vera_SD_t *hsd);
+
 HAL_StatusTypeDef SD_Init(Vera_SD_t *hsd, uint8_t do_format)
 {
 	// Init struct
 	hsd->dir_num = 0;
 	hsd->page_num = 0;
+	hsd->dir_provisional = 0;
 	hsd->date_year = 0;
 	hsd->date_month = 0;
 	hsd->date_day = 0;
@@ -24,7 +36,16 @@ HAL_StatusTypeDef SD_Init(Vera_SD_t *hsd, uint8_t do_format)
 	hsd->dir_path[0] = '\0';
 	hsd->a_file_path[0] = '\0';
 	hsd->p_file_path[0] = '\0';
+	hsd->f_file_path[0] = '\0';
+	hsd->h_file_path[0] = '\0';
+	hsd->s_file_path[0] = '\0';
 	hsd->log_file_path[0] = '\0';
+	hsd->trace_file_path[0] = '\0';
+	hsd->events_file_path[0] = '\0';
+
+	hsd->index_valid = 0;
+	memset(&hsd->index_run, 0, sizeof(SD_Index_Entry_t));
+	hsd->index_run_num = 0;
 
 	// Check if SD card detected
 	if (HAL_GPIO_ReadPin(hsd->Detect_GPIO_Port, hsd->Detect_Pin) == GPIO_PIN_SET)
@@ -44,11 +65,14 @@ HAL_StatusTypeDef SD_Init(Vera_SD_t *hsd, uint8_t do_format)
 		printf("(%lu) Formatting SD card...\r\n", HAL_GetTick());
 		// Formatting working buffer
 		uint8_t rtext[_MAX_SS];
-		if (f_mkfs(hsd->fatfs_path, FM_ANY, 0, rtext, sizeof(rtext)) != FR_OK)
+		// exFAT: no 4 GB file size limit, contiguous files are written without FAT updates (only allocation bitmap)
+		if (f_mkfs(hsd->fatfs_path, FM_EXFAT, SD_FORMAT_CLUSTER_SIZE, rtext, sizeof(rtext)) != FR_OK)
 		{
 			printf("(%lu) ERROR: SD_Init: Failed to create FAT volume (can be caused by code generation)\r\n", HAL_GetTick());
 			return HAL_ERROR;
 		}
+		printf("(%lu) SD card formatted (exFAT, cluster %lu kB, allocation unit %lu kB)\r\n", HAL_GetTick(), (uint32_t)SD_FORMAT_CLUSTER_SIZE / 1024,
+				BSP_SD_GetEraseBlockSize() * BLOCKSIZE / 1024);
 	}
 
 	return HAL_OK;
@@ -56,17 +80,79 @@ HAL_StatusTypeDef SD_Init(Vera_SD_t *hsd, uint8_t do_format)
 
 // Create new measurement directory
 HAL_StatusTypeDef SD_InitDir(Vera_SD_t *hsd)
+{
+	// Next "num" from index file, index is rebuilt by scanning the root dir if missing or invalid
+	if (SD_Index_Load(hsd) != HAL_OK)
+	{
+		SD_Index_Rebuild(hsd);
+	}
+	hsd->dir_num = SD_Index_NextDirNum(hsd);
+	if (hsd->dir_num == 0)
+	{
+		return HAL_ERROR;
+	}
+
+	// Set new dir path
+	sprintf(hsd->dir_path, DIR_FORMAT, hsd->date_year, hsd->date_month, hsd->date_day, hsd->dir_num);
+	// Create new dir
+	FRESULT res = f_mkdir(hsd->dir_path);
+	if (res == FR_EXIST)
+	{
+		// Index does not match root dir (e.g. directories copied to card), increment "num" above highest found value
+		printf("(%lu) WARNING: SD_Init: Dir \"%s\" exists, index outdated\r\n", HAL_GetTick(), hsd->dir_path);
+		hsd->dir_num = SD_NextDirNum(hsd);
+		if (hsd->dir_num == 0)
+		{
+			return HAL_ERROR;
+		}
+		sprintf(hsd->dir_path, DIR_FORMAT, hsd->date_year, hsd->date_month, hsd->date_day, hsd->dir_num);
+		res = f_mkdir(hsd->dir_path);
+	}
+	if (res != FR_OK)
+	{
+		printf("(%lu) ERROR: SD_Init: Create dir (\"%s\") failed\r\n", HAL_GetTick(), hsd->dir_path);
+		return HAL_ERROR;
+	}
+
+	// Set new log file path
+	sprintf(hsd->log_file_path, LOG_FILE_FORMAT, hsd->date_year, hsd->date_month, hsd->date_day, hsd->dir_num);
+	// Create log file
+	if (SD_TouchFile(hsd, hsd->log_file_path) != HAL_OK)
+	{
+		printf("(%lu) ERROR: SD_Init: Log file (\"%s\") touch failed\r\n", HAL_GetTick(), hsd->log_file_path);
+		return HAL_ERROR;
+	}
+
+	// Set new trace file path
+	sprintf(hsd->trace_file_path, TRACE_FILE_FORMAT, hsd->date_year, hsd->date_month, hsd->date_day, hsd->dir_num);
+	// Create trace file
+	if (SD_TouchFile(hsd, hsd->trace_file_path) != HAL_OK)
+	{
+		printf("(%lu) ERROR: SD_Init: Trace file (\"%s\") touch failed\r\n", HAL_GetTick(), hsd->trace_file_path);
+		return HAL_ERROR;
+	}
+	// Set event file path (created with first event)
+	sprintf(hsd->events_file_path, EVENTS_FILE_FORMAT, hsd->date_year, hsd->date_month, hsd->date_day, hsd->dir_num);
+
+	// Add run to index
+	SD_Index_Add(hsd);
+
+	return HAL_OK;
+}
+
+// Find next free "num" of directories for current date (0 if root dir can't be read)
+uint32_t SD_NextDirNum(Vera_SD_t *hsd)
 {
 	// Open root dir
 	DIR dir_root;
 	if (f_opendir(&dir_root, "") != FR_OK)
 	{
 		printf("(%lu) ERROR: SD_Init: Root dir open failed (can be caused by code generation)\r\n", HAL_GetTick());
-		return HAL_ERROR;
+		return 0;
 	}
 	// Iterate root dir
 	FILINFO file_info;
-	hsd->dir_num = 0;
+	uint32_t dir_num = 0;
 	while (f_readdir(&dir_root, &file_info) == FR_OK)
 	{
 		if (file_info.fname[0] == '\0')
@@ -83,36 +169,264 @@ HAL_StatusTypeDef SD_InitDir(Vera_SD_t *hsd)
 			if (test_y == hsd->date_year && test_m == hsd->date_month && test_d == hsd->date_day)
 			{
 				// Find maximum "num" for current date
-				hsd->dir_num = test_num > hsd->dir_num ? test_num : hsd->dir_num;
+				dir_num = test_num > dir_num ? test_num : dir_num;
 			}
 		}
 	}
 	f_closedir(&dir_root);
-	// Increment "num" above highest found value
-	hsd->dir_num++;
+	return dir_num + 1;
+}
 
-	// Set new dir path
+// Move provisional measurement directory (no date) to directory of given date, files are kept
+HAL_StatusTypeDef SD_RenameDir(Vera_SD_t *hsd, uint16_t year, uint8_t month, uint8_t day)
+{
+	TCHAR old_dir_path[PATH_LEN];
+	strcpy(old_dir_path, hsd->dir_path);
+	uint16_t old_year = hsd->date_year;
+	uint8_t old_month = hsd->date_month, old_day = hsd->date_day;
+	uint32_t old_dir_num = hsd->dir_num;
+
+	hsd->date_year = year;
+	hsd->date_month = month;
+	hsd->date_day = day;
+	hsd->dir_num = SD_Index_NextDirNum(hsd);
 	sprintf(hsd->dir_path, DIR_FORMAT, hsd->date_year, hsd->date_month, hsd->date_day, hsd->dir_num);
-	// Create new dir
-	FRESULT res;
-	if ((res = f_mkdir(hsd->dir_path)) != FR_OK)
+	FRESULT res = hsd->dir_num != 0 ? f_rename(old_dir_path, hsd->dir_path) : FR_NO_PATH;
+	if (res == FR_EXIST)
 	{
-		printf("(%lu) ERROR: SD_Init: Create dir (\"%s\") failed\r\n", HAL_GetTick(), hsd->dir_path);
+		// Index does not match root dir, increment "num" above highest found value
+		printf("(%lu) WARNING: SD_RenameDir: Dir \"%s\" exists, index outdated\r\n", HAL_GetTick(), hsd->dir_path);
+		hsd->dir_num = SD_NextDirNum(hsd);
+		sprintf(hsd->dir_path, DIR_FORMAT, hsd->date_year, hsd->date_month, hsd->date_day, hsd->dir_num);
+		res = hsd->dir_num != 0 ? f_rename(old_dir_path, hsd->dir_path) : FR_NO_PATH;
+	}
+	if (res != FR_OK)
+	{
+		printf("(%lu) ERROR: SD_RenameDir: Rename dir (\"%s\" -> \"%s\") failed\r\n", HAL_GetTick(), old_dir_path, hsd->dir_path);
+		// Keep writing to old dir
+		strcpy(hsd->dir_path, old_dir_path);
+		hsd->date_year = old_year;
+		hsd->date_month = old_month;
+		hsd->date_day = old_day;
+		hsd->dir_num = old_dir_num;
 		return HAL_ERROR;
 	}
 
-	// Set new log file path
+	// Update index entry of run
+	if (hsd->index_run.dir_num != 0)
+	{
+		hsd->index_run.year = hsd->date_year;
+		hsd->index_run.month = hsd->date_month;
+		hsd->index_run.day = hsd->date_day;
+		hsd->index_run.dir_num = hsd->dir_num;
+		SD_Index_Update_Last(&hsd->index, hsd->date_year, hsd->date_month, hsd->date_day, hsd->dir_num);
+		SD_Index_Save(hsd);
+	}
+
+	// Update paths to renamed dir
 	sprintf(hsd->log_file_path, LOG_FILE_FORMAT, hsd->date_year, hsd->date_month, hsd->date_day, hsd->dir_num);
-	// Create log file
-	if (SD_TouchFile(hsd, hsd->log_file_path) != HAL_OK)
+	sprintf(hsd->trace_file_path, TRACE_FILE_FORMAT, hsd->date_year, hsd->date_month, hsd->date_day, hsd->dir_num);
+	sprintf(hsd->events_file_path, EVENTS_FILE_FORMAT, hsd->date_year, hsd->date_month, hsd->date_day, hsd->dir_num);
+	sprintf(hsd->a_file_path, A_FILE_FORMAT, hsd->date_year, hsd->date_month, hsd->date_day, hsd->dir_num, hsd->page_num);
+	sprintf(hsd->p_file_path, P_FILE_FORMAT, hsd->date_year, hsd->date_month, hsd->date_day, hsd->dir_num, hsd->page_num);
+	if (hsd->f_file_path[0] != '\0')
 	{
-		printf("(%lu) ERROR: SD_Init: Log file (\"%s\") touch failed\r\n", HAL_GetTick(), hsd->log_file_path);
+		sprintf(hsd->f_file_path, F_FILE_FORMAT, hsd->date_year, hsd->date_month, hsd->date_day, hsd->dir_num, hsd->page_num);
+	}
+	if (hsd->h_file_path[0] != '\0')
+	{
+		sprintf(hsd->h_file_path, H_FILE_FORMAT, hsd->date_year, hsd->date_month, hsd->date_day, hsd->dir_num, hsd->page_num);
+	}
+	if (hsd->s_file_path[0] != '\0')
+	{
+		sprintf(hsd->s_file_path, S_FILE_FORMAT, hsd->date_year, hsd->date_month, hsd->date_day, hsd->dir_num, hsd->page_num);
+	}
+
+	// Update date in headers of already written position files
+	hsd->p_header.year = hsd->date_year;
+	hsd->p_header.month = hsd->date_month;
+	hsd->p_header.day = hsd->date_day;
+	TCHAR p_file_path[PATH_LEN];
+	for (uint32_t page = 1; page <= hsd->page_num; page++)
+	{
+		sprintf(p_file_path, P_FILE_FORMAT, hsd->date_year, hsd->date_month, hsd->date_day, hsd->dir_num, page);
+		if (SD_WriteBufferAt(hsd, p_file_path, 0, (void*)&hsd->p_header, sizeof(p_data_header_t)) != HAL_OK)
+		{
+			return HAL_ERROR;
+		}
+	}
+
+	return HAL_OK;
+}
+
+// Read index file header, returns HAL_ERROR if missing or invalid
+HAL_StatusTypeDef SD_Index_Load(Vera_SD_t *hsd)
+{
+	hsd->index_valid = 0;
+	FILINFO file_info;
+	if (f_stat(INDEX_FILE_PATH, &file_info) != FR_OK)
+	{
+		printf("(%lu) No index found\r\n", HAL_GetTick());
+		return HAL_ERROR;
+	}
+
+	UINT size_read;
+	if (SD_ReadBuffer(hsd, INDEX_FILE_PATH, &hsd->index, sizeof(SD_Index_Header_t), &size_read) != HAL_OK)
+	{
+		return HAL_ERROR;
+	}
+	// Trailing entry without updated header (power loss while adding run) is overwritten by next run
+	if (size_read != sizeof(SD_Index_Header_t) || hsd->index.magic != SD_INDEX_MAGIC || hsd->index.version != SD_INDEX_VERSION
+			|| hsd->index.entry_size != sizeof(SD_Index_Entry_t) || file_info.fsize < sizeof(SD_Index_Header_t) + (FSIZE_t)hsd->index.run_count * sizeof(SD_Index_Entry_t))
+	{
+		printf("(%lu) WARNING: SD_Index_Load: Index file invalid\r\n", HAL_GetTick());
+		return HAL_ERROR;
+	}
+
+	hsd->index_valid = 1;
+	return HAL_OK;
+}
+
+// Create index file of all measurement directories in root dir
+HAL_StatusTypeDef SD_Index_Rebuild(Vera_SD_t *hsd)
+{
+	printf("(%lu) Rebuilding index...\r\n", HAL_GetTick());
+	memset(&hsd->index, 0, sizeof(SD_Index_Header_t));
+	hsd->index.magic = SD_INDEX_MAGIC;
+	hsd->index.version = SD_INDEX_VERSION;
+	hsd->index.entry_size = sizeof(SD_Index_Entry_t);
+
+	// Header is completed after scan
+	if (SD_WriteFile(hsd, INDEX_FILE_PATH, &hsd->index, sizeof(SD_Index_Header_t)) != HAL_OK)
+	{
+		return HAL_ERROR;
+	}
+	DIR dir_root;
+	if (f_opendir(&dir_root, "") != FR_OK)
+	{
+		printf("(%lu) ERROR: SD_Index_Rebuild: Root dir open failed\r\n", HAL_GetTick());
 		return HAL_ERROR;
 	}
 
+	// Add entry for each directory name in DIR_FORMAT
+	SD_Index_Entry_t entries[SD_INDEX_REBUILD_ENTRIES];
+	uint32_t entry_count = 0;
+	FILINFO file_info;
+	HAL_StatusTypeDef status = HAL_OK;
+	while (status == HAL_OK && f_readdir(&dir_root, &file_info) == FR_OK && file_info.fname[0] != '\0')
+	{
+		SD_Index_Entry_t *entry = &entries[entry_count];
+		memset(entry, 0, sizeof(SD_Index_Entry_t));
+		if (!(file_info.fattrib & AM_DIR) || sscanf(file_info.fname, DIR_FORMAT, &entry->year, &entry->month, &entry->day, &entry->dir_num) != 4)
+		{
+			continue;
+		}
+		entry->flags = SD_INDEX_FLAG_SCANNED;
+		SD_Index_Update_Last(&hsd->index, entry->year, entry->month, entry->day, entry->dir_num);
+		hsd->index.run_count++;
+		if (++entry_count == SD_INDEX_REBUILD_ENTRIES)
+		{
+			status = SD_WriteBuffer(hsd, INDEX_FILE_PATH, entries, entry_count * sizeof(SD_Index_Entry_t));
+			entry_count = 0;
+		}
+	}
+	f_closedir(&dir_root);
+	if (status == HAL_OK)
+	{
+		status = SD_WriteBuffer(hsd, INDEX_FILE_PATH, entries, entry_count * sizeof(SD_Index_Entry_t));
+	}
+	if (status == HAL_OK)
+	{
+		status = SD_WriteBufferAt(hsd, INDEX_FILE_PATH, 0, &hsd->index, sizeof(SD_Index_Header_t));
+	}
+	if (status != HAL_OK)
+	{
+		return HAL_ERROR;
+	}
+
+	printf("(%lu) Index rebuilt (%lu runs)\r\n", HAL_GetTick(), hsd->index.run_count);
+	hsd->index_valid = 1;
 	return HAL_OK;
 }
 
+// Next free "num" for current date from index (0 if root dir can't be read)
+uint32_t SD_Index_NextDirNum(Vera_SD_t *hsd)
+{
+	if (!hsd->index_valid)
+	{
+		return SD_NextDirNum(hsd);
+	}
+	uint32_t date = SD_DATE(hsd->date_year, hsd->date_month, hsd->date_day);
+	uint32_t last_date = SD_DATE(hsd->index.last_year, hsd->index.last_month, hsd->index.last_day);
+	if (date == 0)
+	{
+		return hsd->index.undated_dir_num + 1;
+	}
+	if (date == last_date)
+	{
+		return hsd->index.last_dir_num + 1;
+	}
+	if (date > last_date)
+	{
+		return 1;
+	}
+	// Date before latest date (e.g. card used with wrong date), highest "num" is not indexed
+	return SD_NextDirNum(hsd);
+}
+
+// Track highest "num" of latest date and of date 0000-00-00
+void SD_Index_Update_Last(SD_Index_Header_t *index, uint16_t year, uint8_t month, uint8_t day, uint32_t dir_num)
+{
+	uint32_t date = SD_DATE(year, month, day);
+	uint32_t last_date = SD_DATE(index->last_year, index->last_month, index->last_day);
+	if (date == 0)
+	{
+		index->undated_dir_num = dir_num > index->undated_dir_num ? dir_num : index->undated_dir_num;
+	}
+	else if (date > last_date || (date == last_date && dir_num > index->last_dir_num))
+	{
+		index->last_year = year;
+		index->last_month = month;
+		index->last_day = day;
+		index->last_dir_num = dir_num;
+	}
+}
+
+// Append entry for current directory to index
+void SD_Index_Add(Vera_SD_t *hsd)
+{
+	if (!hsd->index_valid)
+	{
+		return;
+	}
+	memset(&hsd->index_run, 0, sizeof(SD_Index_Entry_t));
+	hsd->index_run.year = hsd->date_year;
+	hsd->index_run.month = hsd->date_month;
+	hsd->index_run.day = hsd->date_day;
+	hsd->index_run.dir_num = hsd->dir_num;
+	hsd->index_run_num = hsd->index.run_count++;
+	SD_Index_Update_Last(&hsd->index, hsd->date_year, hsd->date_month, hsd->date_day, hsd->dir_num);
+	SD_Index_Save(hsd);
+}
+
+// Write entry of current directory and header to index file
+void SD_Index_Save(Vera_SD_t *hsd)
+{
+	if (!hsd->index_valid || hsd->index_run.dir_num == 0)
+	{
+		return;
+	}
+	// Entry first, header with run_count is only updated if the entry was written
+	FSIZE_t offset = sizeof(SD_Index_Header_t) + (FSIZE_t)hsd->index_run_num * sizeof(SD_Index_Entry_t);
+	if (SD_WriteBufferAt(hsd, INDEX_FILE_PATH, offset, &hsd->index_run, sizeof(SD_Index_Entry_t)) != HAL_OK
+			|| SD_WriteBufferAt(hsd, INDEX_FILE_PATH, 0, &hsd->index, sizeof(SD_Index_Header_t)) != HAL_OK)
+	{
+		// Do not retry, index is rebuilt on next boot if inconsistent
+		hsd->index_valid = 0;
+		printf("(%lu) WARNING: SD_Index_Save: Index file disabled\r\n", HAL_GetTick());
+	}
+}
+
 // Update paths of data files, create new files if needed
 HAL_StatusTypeDef SD_UpdateFilepaths(Vera_SD_t *hsd)
 {
@@ -131,6 +445,39 @@ HAL_StatusTypeDef SD_UpdateFilepaths(Vera_SD_t *hsd)
 		printf("(%lu) ERROR: SD_UpdateFilepaths: Pos. file (\"%s\") touch failed\r\n", HAL_GetTick(), hsd->p_file_path);
 		return HAL_ERROR;
 	}
+	// Spectrum file only if enabled
+	hsd->f_file_path[0] = '\0';
+	if (hsd->f_header.segment_len > 0)
+	{
+		sprintf(hsd->f_file_path, F_FILE_FORMAT, hsd->date_year, hsd->date_month, hsd->date_day, hsd->dir_num, hsd->page_num);
+		if (SD_TouchFile(hsd, hsd->f_file_path) != HAL_OK)
+		{
+			printf("(%lu) ERROR: SD_UpdateFilepaths: Spectrum file (\"%s\") touch failed\r\n", HAL_GetTick(), hsd->f_file_path);
+			return HAL_ERROR;
+		}
+	}
+	// Envelope file only if enabled
+	hsd->h_file_path[0] = '\0';
+	if (hsd->h_header.band_low > 0)
+	{
+		sprintf(hsd->h_file_path, H_FILE_FORMAT, hsd->date_year, hsd->date_month, hsd->date_day, hsd->dir_num, hsd->page_num);
+		if (SD_TouchFile(hsd, hsd->h_file_path) != HAL_OK)
+		{
+			printf("(%lu) ERROR: SD_UpdateFilepaths: Envelope file (\"%s\") touch failed\r\n", HAL_GetTick(), hsd->h_file_path);
+			return HAL_ERROR;
+		}
+	}
+	// Statistics file only if enabled
+	hsd->s_file_path[0] = '\0';
+	if (hsd->s_header.channel_count > 0)
+	{
+		sprintf(hsd->s_file_path, S_FILE_FORMAT, hsd->date_year, hsd->date_month, hsd->date_day, hsd->dir_num, hsd->page_num);
+		if (SD_TouchFile(hsd, hsd->s_file_path) != HAL_OK)
+		{
+			printf("(%lu) ERROR: SD_UpdateFilepaths: Statistics file (\"%s\") touch failed\r\n", HAL_GetTick(), hsd->s_file_path);
+			return HAL_ERROR;
+		}
+	}
 
 	return HAL_OK;
 }
@@ -153,11 +500,32 @@ HAL_StatusTypeDef SD_NewPage(Vera_SD_t *hsd)
 	{
 		return HAL_ERROR;
 	}
+	if (hsd->f_file_path[0] != '\0' && SD_WriteBuffer(hsd, hsd->f_file_path, (void*)&hsd->f_header, sizeof(f_data_header_t)) != HAL_OK)
+	{
+		return HAL_ERROR;
+	}
+	if (hsd->h_file_path[0] != '\0' && SD_WriteBuffer(hsd, hsd->h_file_path, (void*)&hsd->h_header, sizeof(h_data_header_t)) != HAL_OK)
+	{
+		return HAL_ERROR;
+	}
+	if (hsd->s_file_path[0] != '\0' && SD_WriteBuffer(hsd, hsd->s_file_path, (void*)&hsd->s_header, sizeof(s_data_header_t)) != HAL_OK)
+	{
+		return HAL_ERROR;
+	}
+	// Update index entry of run (kept up to date in case of power loss)
+	hsd->index_run.page_count = hsd->page_num;
+	hsd->index_run.duration_ms = HAL_GetTick() - hsd->a_header.boot_duration;
+	SD_Index_Save(hsd);
 	return HAL_OK;
 }
 
 HAL_StatusTypeDef SD_Uninit(Vera_SD_t *hsd)
 {
+	// Complete index entry of run
+	hsd->index_run.duration_ms = HAL_GetTick() - hsd->a_header.boot_duration;
+	hsd->index_run.flags |= SD_INDEX_FLAG_STOPPED;
+	SD_Index_Save(hsd);
+
 	f_close(hsd->fatfs_file);
 	f_mount(NULL, hsd->fatfs_path, 0);
 
@@ -222,6 +590,45 @@ HAL_StatusTypeDef SD_ReadBuffer(Vera_SD_t *hsd, TCHAR *path, void *data, UINT si
 	return HAL_OK;
 }
 
+// Read part of file at given offset into buffer (size_read < size at end of file)
+HAL_StatusTypeDef SD_ReadBufferAt(Vera_SD_t *hsd, TCHAR *path, FSIZE_t offset, void *data, UINT size, UINT *size_read)
+{
+	*size_read = 0;
+	if (size == 0)
+	{
+		return HAL_OK;
+	}
+
+	// Open file with read access
+	if (f_open(hsd->fatfs_file, path, FA_READ) != FR_OK)
+	{
+		printf("(%lu) ERROR: SD_ReadBufferAt: SD File \"%s\": file open failed\r\n", HAL_GetTick(), path);
+		return HAL_ERROR;
+	}
+
+	// Read data at offset
+	FRESULT res = f_lseek(hsd->fatfs_file, offset);
+	if (res == FR_OK)
+	{
+		res = f_read(hsd->fatfs_file, data, size, size_read);
+	}
+	if (res != FR_OK)
+	{
+		printf("(%lu) ERROR: SD_ReadBufferAt: SD File \"%s\": file read failed\r\n", HAL_GetTick(), path);
+		f_close(hsd->fatfs_file);
+		return HAL_ERROR;
+	}
+
+	// Close file
+	if (f_close(hsd->fatfs_file) != FR_OK)
+	{
+		printf("(%lu) ERROR: SD_ReadBufferAt: SD File \"%s\": file close failed\r\n", HAL_GetTick(), path);
+		return HAL_ERROR;
+	}
+
+	return HAL_OK;
+}
+
 // Write (append) buffer into file
 HAL_StatusTypeDef SD_WriteBuffer(Vera_SD_t *hsd, TCHAR *path, void *data, UINT size)
 {
@@ -257,3 +664,72 @@ HAL_StatusTypeDef SD_WriteBuffer(Vera_SD_t *hsd, TCHAR *path, void *data, UINT s
 
 	return HAL_OK;
 }
+
+// Write buffer into new file (replaces existing file)
+HAL_StatusTypeDef SD_WriteFile(Vera_SD_t *hsd, TCHAR *path, void *data, UINT size)
+{
+	// Create file, truncate if existing
+	if (f_open(hsd->fatfs_file, path, FA_CREATE_ALWAYS | FA_WRITE) != FR_OK)
+	{
+		printf("(%lu) ERROR: SD_WriteFile: SD File \"%s\": file open failed\r\n", HAL_GetTick(), path);
+		return HAL_ERROR;
+	}
+
+	// Write data
+	UINT bytes_written = 0;
+	FRESULT res = size > 0 ? f_write(hsd->fatfs_file, data, size, &bytes_written) : FR_OK;
+	if (res != FR_OK || bytes_written != size)
+	{
+		printf("(%lu) ERROR: SD_WriteFile: SD File \"%s\": file write failed (%hu / %u bytes)\r\n", HAL_GetTick(), path, bytes_written, size);
+		f_close(hsd->fatfs_file);
+		return HAL_ERROR;
+	}
+
+	// Close file
+	if (f_close(hsd->fatfs_file) != FR_OK)
+	{
+		printf("(%lu) ERROR: SD_WriteFile: SD File \"%s\": file close failed\r\n", HAL_GetTick(), path);
+		return HAL_ERROR;
+	}
+
+	return HAL_OK;
+}
+
+// Overwrite part of existing file at given offset
+HAL_StatusTypeDef SD_WriteBufferAt(Vera_SD_t *hsd, TCHAR *path, FSIZE_t offset, void *data, UINT size)
+{
+	if (size == 0)
+	{
+		return HAL_OK;
+	}
+
+	// Open existing file with write access
+	if (f_open(hsd->fatfs_file, path, FA_OPEN_EXISTING | FA_WRITE) != FR_OK)
+	{
+		printf("(%lu) ERROR: SD_WriteBufferAt: SD File \"%s\": file open failed\r\n", HAL_GetTick(), path);
+		return HAL_ERROR;
+	}
+
+	// Write data at offset
+	UINT bytes_written;
+	FRESULT res = f_lseek(hsd->fatfs_file, offset);
+	if (res == FR_OK)
+	{
+		res = f_write(hsd->fatfs_file, data, size, &bytes_written);
+	}
+	if (res != FR_OK || bytes_written != size)
+	{
+		printf("(%lu) ERROR: SD_WriteBufferAt: SD File \"%s\": file write failed\r\n", HAL_GetTick(), path);
+		f_close(hsd->fatfs_file);
+		return HAL_ERROR;
+	}
+
+	// Close file
+	if (f_close(hsd->fatfs_file) != FR_OK)
+	{
+		printf("(%lu) ERROR: SD_WriteBufferAt: SD File \"%s\": file close failed\r\n", HAL_GetTick(), path);
+		return HAL_ERROR;
+	}
+
+	return HAL_OK;
+}
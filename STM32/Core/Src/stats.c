@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2024 Mirco Heitmann
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ * stats.c
+ *
+ * Statistics of each acceleration buffer for all channels, written to statistics files (s_X.bin, read by Python/vera_stats.py)
+ *
+ * Every saved acceleration buffer (every block in triggered capture, including blocks not saved) is summarized per channel:
+ * min, max, mean, RMS and peak deviation without mean, kurtosis and number of samples at full scale. Records are buffered and
+ * appended to the statistics file of the current page, an overview of a run is read without parsing the acceleration files.
+ */
+
+#include "stats.h"
+
+int32_t Stats_Value(volatile a_data_point_t *dp, uint8_t i_ch);
+void Stats_Channel(Stats_t *hstats, s_data_channel_t *channel, volatile a_data_point_t *buffer, uint32_t len, uint8_t i_ch);
+HAL_StatusTypeDef Stats_Save_Records(Stats_t *hstats);
+
+HAL_StatusTypeDef Stats_Init(Stats_t *hstats)
+{
+	// Init struct
+	hstats->channel_count = hstats->enabled ? 3 + hstats->piezo_count : 0;
+	hstats->save_len = 0;
+	hstats->record_count = 0;
+	hstats->clipped_count = 0;
+	return HAL_OK;
+}
+
+// Summarize saved acceleration buffer, call from main loop
+void Stats_Write(Stats_t *hstats, volatile a_data_point_t *buffer, uint32_t len)
+{
+	if (hstats->channel_count == 0 || len == 0)
+	{
+		return;
+	}
+	uint32_t size = sizeof(s_data_point_t) + hstats->channel_count * sizeof(s_data_channel_t);
+	if (hstats->save_len + size > STATS_SAVE_LEN)
+	{
+		Stats_Save_Records(hstats);
+	}
+
+	s_data_point_t *point = (s_data_point_t*)(hstats->save_buffer + hstats->save_len);
+	point->timestamp = buffer[0].timestamp;
+	point->sample_count = len;
+	s_data_channel_t *channels = (s_data_channel_t*)(point + 1);
+	for (uint8_t i_ch = 0; i_ch < hstats->channel_count; i_ch++)
+	{
+		Stats_Channel(hstats, &channels[i_ch], buffer, len, i_ch);
+	}
+	hstats->save_len += size;
+	hstats->record_count++;
+}
+
+// Write buffered records to statistics file (before page change, capture stopped or reconfigured)
+HAL_StatusTypeDef Stats_Flush(Stats_t *hstats)
+{
+	return Stats_Save_Records(hstats);
+}
+
+// Value of channel (0-2: MEMS x, y, z, 3-7: piezo)
+int32_t Stats_Value(volatile a_data_point_t *dp, uint8_t i_ch)
+{
+	return i_ch < 3 ? dp->xyz_mems1[i_ch] : dp->a_piezo[i_ch - 3];
+}
+
+void Stats_Channel(Stats_t *hstats, s_data_channel_t *channel, volatile a_data_point_t *buffer, uint32_t len, uint8_t i_ch)
+{
+	// Range, mean and clipped samples
+	int32_t clip_low = i_ch < 3 ? -STATS_MEMS_CLIP : -STATS_PIEZO_CLIP;
+	int32_t clip_high = i_ch < 3 ? STATS_MEMS_CLIP : STATS_PIEZO_CLIP;
+	int32_t min = INT32_MAX, max = INT32_MIN;
+	int64_t sum = 0;
+	uint32_t clipped = 0;
+	for (uint32_t i = 0; i < len; i++)
+	{
+		int32_t value = Stats_Value(&buffer[i], i_ch);
+		min = value < min ? value : min;
+		max = value > max ? value : max;
+		sum += value;
+		clipped += value <= clip_low || value >= clip_high;
+	}
+	float mean = (float)sum / len;
+
+	// Moments without mean
+	float m2 = 0, m4 = 0, peak = 0;
+	for (uint32_t i = 0; i < len; i++)
+	{
+		float d = Stats_Value(&buffer[i], i_ch) - mean;
+		float d2 = d * d;
+		m2 += d2;
+		m4 += d2 * d2;
+		peak = fmaxf(peak, fabsf(d));
+	}
+
+	channel->min = min;
+	channel->max = max;
+	channel->mean = mean;
+	channel->rms = sqrtf(m2 / len);
+	channel->peak = peak;
+	channel->kurtosis = m2 > 0 ? m4 * len / (m2 * m2) : 0;
+	channel->clipped = clipped;
+	hstats->clipped_count += clipped;
+}
+
+// Write buffered records to statistics file of current page
+HAL_StatusTypeDef Stats_Save_Records(Stats_t *hstats)
+{
+	if (hstats->save_len == 0)
+	{
+		return HAL_OK;
+	}
+	if (hstats->hvsd == NULL || hstats->hvsd->s_file_path[0] == '\0')
+	{
+		hstats->save_len = 0;
+		return HAL_OK;
+	}
+	HAL_StatusTypeDef status = SD_WriteBuffer(hstats->hvsd, hstats->hvsd->s_file_path, hstats->save_buffer, hstats->save_len);
+	hstats->save_len = 0;
+	if (status != HAL_OK)
+	{
+		printf("(%lu) ERROR: Stats_Save_Records: Writing records failed, statistics disabled\r\n", HAL_GetTick());
+		hstats->channel_count = 0;
+	}
+	return status;
+}
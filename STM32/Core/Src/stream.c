@@ -0,0 +1,485 @@
+/*
+ * Copyright (c) 2024 Mirco Heitmann
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ * stream.c
+ *
+ * Live streaming of acceleration data or raw piezo ADC data via USB CDC (framed binary, decoded by Python/vera_stream.py)
+ *
+ * Selected channels of saved acceleration buffers are copied into a ring queue before the buffer is returned
+ * to sampling, one entry per frame. Entries are moved into frames in the main loop while a frame buffer is
+ * free, the next ready frame is transmitted from the TX complete callback, so packing and USB transfer overlap.
+ * If the host does not keep up, data points not fitting into the queue are dropped (counted in the frame header).
+ *
+ * Raw piezo data is copied from the ADC DMA buffer into the ring queue in the ADC IRQ and packed in the main
+ * loop as well. The benchmark sends pattern frames as fast as USB allows to measure the throughput.
+ */
+
+#include "stream.h"
+
+void Stream_Start(Stream_t *hstream, uint8_t type, uint8_t channels, uint16_t decimation);
+uint8_t Stream_Pack(Stream_t *hstream, uint8_t i_buffer);
+uint8_t Stream_Pack_Raw(Stream_t *hstream, uint8_t i_buffer);
+void Stream_Pack_Benchmark(Stream_t *hstream, uint8_t i_buffer);
+void Stream_Finish_Frame(Stream_t *hstream, uint8_t i_buffer, Stream_Frame_Header_t *header);
+void Stream_Transmit(Stream_t *hstream);
+
+void Stream_Init(Stream_t *hstream)
+{
+	// Provide default values
+	if (hstream->sampling_rate == 0)
+	{
+		hstream->sampling_rate = 4000;
+	}
+	if (hstream->piezo_count > PIEZO_COUNT_MAX)
+	{
+		hstream->piezo_count = PIEZO_COUNT_MAX;
+	}
+	if (hstream->oversampling_ratio == 0)
+	{
+		hstream->oversampling_ratio = 1;
+	}
+
+	// Init struct
+	hstream->active = 0;
+	hstream->flag_command = 0;
+	hstream->buffer_state[0] = STREAM_BUFFER_FREE;
+	hstream->buffer_state[1] = STREAM_BUFFER_FREE;
+	hstream->i_sending = 0;
+	hstream->sequence = 0;
+	hstream->dropped_points = 0;
+	hstream->tx_bytes = 0;
+	hstream->ring.buffer = hstream->ring_buffer;
+	hstream->ring.size = STREAM_RING_SIZE;
+	Ring_Buffer_Init(&hstream->ring);
+}
+
+// Apply host commands, pack and transmit frames, call regularly from main loop
+void Stream_Loop(Stream_t *hstream)
+{
+	if (hstream->flag_command)
+	{
+		Stream_Stop(hstream);
+		if (hstream->command == STREAM_CMD_START)
+		{
+			Stream_Start(hstream, STREAM_TYPE_DATA_POINTS, hstream->command_channels, hstream->command_decimation);
+		}
+		else if (hstream->command == STREAM_CMD_START_RAW)
+		{
+			Stream_Start(hstream, STREAM_TYPE_PIEZO_RAW, hstream->command_channels, hstream->command_decimation);
+		}
+		else if (hstream->command == STREAM_CMD_BENCHMARK)
+		{
+			Stream_Start(hstream, STREAM_TYPE_BENCHMARK, 0, 1);
+		}
+		hstream->flag_command = 0;
+	}
+	if (!hstream->active)
+	{
+		return;
+	}
+
+	// Host stopped reading (e.g. port closed)
+	if (hstream->buffer_state[hstream->i_sending] == STREAM_BUFFER_SENDING && HAL_GetTick() - hstream->tx_start > STREAM_STALL_TIMEOUT)
+	{
+		printf("(%lu) WARNING: Stream_Loop: Host not reading, streaming stopped\r\n", HAL_GetTick());
+		Stream_Stop(hstream);
+		return;
+	}
+
+	// Fill free frame buffers
+	while (1)
+	{
+		uint8_t i_buffer = hstream->buffer_state[0] == STREAM_BUFFER_FREE ? 0 : 1;
+		if (hstream->buffer_state[i_buffer] != STREAM_BUFFER_FREE)
+		{
+			break;
+		}
+		if (hstream->type == STREAM_TYPE_BENCHMARK)
+		{
+			Stream_Pack_Benchmark(hstream, i_buffer);
+		}
+		else if (hstream->type == STREAM_TYPE_PIEZO_RAW ? !Stream_Pack_Raw(hstream, i_buffer) : !Stream_Pack(hstream, i_buffer))
+		{
+			break;
+		}
+	}
+
+	// Start transmission if USB is idle (otherwise started by Stream_CDC_TxCplt)
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	Stream_Transmit(hstream);
+	__set_PRIMASK(primask);
+}
+
+// Queue selected channels of saved acceleration buffer, call before buffer is returned to sampling
+void Stream_Write(Stream_t *hstream, volatile a_data_point_t *buffer, uint32_t len)
+{
+	if (!hstream->active || hstream->type != STREAM_TYPE_DATA_POINTS)
+	{
+		return;
+	}
+
+	uint32_t i_point = 0;
+	while (i_point < len)
+	{
+		uint32_t *entry = Ring_Buffer_Reserve(&hstream->ring, 2 * sizeof(uint32_t) + hstream->samples_per_frame * hstream->sample_len);
+		if (entry == NULL)
+		{
+			// Host not keeping up, rest of buffer is dropped
+			hstream->dropped_points += len - i_point;
+			return;
+		}
+
+		uint8_t *sample = (uint8_t*)&entry[2];
+		uint32_t sample_count = 0;
+		while (i_point < len && sample_count < hstream->samples_per_frame)
+		{
+			volatile a_data_point_t *dp = &buffer[i_point++];
+			uint8_t keep = hstream->i_decimation == 0;
+			if (++hstream->i_decimation >= hstream->decimation)
+			{
+				hstream->i_decimation = 0;
+			}
+			if (!keep)
+			{
+				continue;
+			}
+
+			if (sample_count == 0)
+			{
+				entry[0] = dp->timestamp;
+			}
+			for (uint8_t i = 0; i < STREAM_CHANNEL_PIEZO_1; i++)
+			{
+				if (hstream->channels & (1 << i))
+				{
+					int32_t value = dp->xyz_mems1[i];
+					memcpy(sample, &value, sizeof(value));
+					sample += sizeof(value);
+				}
+			}
+			for (uint8_t i = 0; i < hstream->piezo_count; i++)
+			{
+				if (hstream->channels & (1 << (STREAM_CHANNEL_PIEZO_1 + i)))
+				{
+					int16_t value = dp->a_piezo[i];
+					memcpy(sample, &value, sizeof(value));
+					sample += sizeof(value);
+				}
+			}
+			sample_count++;
+		}
+		if (sample_count == 0)
+		{
+			return;
+		}
+		entry[1] = sample_count;
+		Ring_Buffer_Commit(&hstream->ring, 2 * sizeof(uint32_t) + sample_count * hstream->sample_len);
+	}
+}
+
+// Queue raw piezo ADC samples (oversampling_ratio * piezo_count), call from ADC conversion complete callback
+void Stream_Write_Raw(Stream_t *hstream, volatile uint16_t *adc_buffer)
+{
+	if (!hstream->active || hstream->type != STREAM_TYPE_PIEZO_RAW)
+	{
+		return;
+	}
+
+	uint32_t samples_len = hstream->oversampling_ratio * hstream->piezo_count * sizeof(uint16_t);
+	uint32_t *entry = Ring_Buffer_Reserve(&hstream->ring, sizeof(uint32_t) + samples_len);
+	if (entry != NULL)
+	{
+		entry[0] = hstream->raw_index;
+		memcpy(&entry[1], (void*)adc_buffer, samples_len);
+		Ring_Buffer_Commit(&hstream->ring, sizeof(uint32_t) + samples_len);
+	}
+	hstream->raw_index += hstream->oversampling_ratio;
+}
+
+// Parse host command, call from CDC_RxCallback (USB IRQ)
+void Stream_Receive(Stream_t *hstream, uint8_t *buffer, uint32_t len)
+{
+	if (len < STREAM_CMD_LEN_STOP || buffer[0] != STREAM_SYNC_1 || buffer[1] != STREAM_SYNC_2)
+	{
+		return;
+	}
+	if ((buffer[2] == STREAM_CMD_START || buffer[2] == STREAM_CMD_START_RAW) && len >= STREAM_CMD_LEN_START)
+	{
+		hstream->command_channels = buffer[3];
+		hstream->command_decimation = buffer[4] | (buffer[5] << 8);
+	}
+	else if (buffer[2] != STREAM_CMD_STOP && buffer[2] != STREAM_CMD_BENCHMARK)
+	{
+		return;
+	}
+	hstream->command = buffer[2];
+	hstream->flag_command = 1;
+}
+
+// Call from CDC_TxCpltCallback (USB IRQ)
+void Stream_CDC_TxCplt(Stream_t *hstream, uint8_t *buffer)
+{
+	// Completed transfer may be a log message
+	if (buffer != hstream->frame_buffer[hstream->i_sending] || hstream->buffer_state[hstream->i_sending] != STREAM_BUFFER_SENDING)
+	{
+		return;
+	}
+	hstream->tx_bytes += sizeof(Stream_Frame_Header_t) + ((Stream_Frame_Header_t*)buffer)->payload_len + STREAM_CHECKSUM_LEN;
+	hstream->buffer_state[hstream->i_sending] = STREAM_BUFFER_FREE;
+	if (hstream->active)
+	{
+		Stream_Transmit(hstream);
+	}
+}
+
+void Stream_Start(Stream_t *hstream, uint8_t type, uint8_t channels, uint16_t decimation)
+{
+	// Only channels which are sampled (raw: piezo channels only)
+	channels &= (1 << (STREAM_CHANNEL_PIEZO_1 + hstream->piezo_count)) - 1;
+	if (type == STREAM_TYPE_PIEZO_RAW)
+	{
+		channels &= ~((1 << STREAM_CHANNEL_PIEZO_1) - 1);
+	}
+	if (channels == 0 && type != STREAM_TYPE_BENCHMARK)
+	{
+		printf("(%lu) ERROR: Stream_Start: No valid channel selected\r\n", HAL_GetTick());
+		return;
+	}
+
+	hstream->type = type;
+	hstream->channels = channels;
+	hstream->decimation = decimation > 0 ? decimation : 1;
+	hstream->sample_len = type == STREAM_TYPE_BENCHMARK ? 1 : 0;
+	for (uint8_t i = 0; i < 8; i++)
+	{
+		if (channels & (1 << i))
+		{
+			hstream->sample_len += i < STREAM_CHANNEL_PIEZO_1 ? sizeof(int32_t) : sizeof(int16_t);
+		}
+	}
+	hstream->samples_per_frame = (STREAM_FRAME_LEN - sizeof(Stream_Frame_Header_t) - STREAM_CHECKSUM_LEN) / hstream->sample_len;
+	hstream->i_decimation = 0;
+	hstream->sequence = 0;
+	hstream->dropped_points = 0;
+	hstream->tx_bytes = 0;
+	hstream->start_tick = HAL_GetTick();
+
+	// Queue is empty while not active (ADC IRQ and Stream_Write do not write)
+	hstream->raw_index = 0;
+	hstream->raw_offset = 0;
+	Ring_Buffer_Init(&hstream->ring);
+	hstream->active = 1;
+
+	// Log is not written to USB CDC while streaming
+	if (type == STREAM_TYPE_BENCHMARK)
+	{
+		printf("(%lu) Streaming benchmark started\r\n", HAL_GetTick());
+	}
+	else
+	{
+		printf("(%lu) Streaming %s started (channels 0x%02X, decimation %u)\r\n", HAL_GetTick(), type == STREAM_TYPE_PIEZO_RAW ? "raw piezo data" : "data points", channels, hstream->decimation);
+	}
+}
+
+// Stop streaming (also used when the sampling config changes, host restarts streaming)
+void Stream_Stop(Stream_t *hstream)
+{
+	if (!hstream->active)
+	{
+		return;
+	}
+	hstream->active = 0;
+
+	// Discard frames not yet transmitted (frame in transmission is freed on TX complete)
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	for (uint8_t i = 0; i < 2; i++)
+	{
+		if (hstream->buffer_state[i] == STREAM_BUFFER_READY)
+		{
+			hstream->buffer_state[i] = STREAM_BUFFER_FREE;
+		}
+	}
+	__set_PRIMASK(primask);
+
+	uint32_t duration = HAL_GetTick() - hstream->start_tick;
+	printf("(%lu) Streaming stopped (%u frames, %lu data points dropped, %lu bytes in %lu ms, %lu kB/s)\r\n", HAL_GetTick(), hstream->sequence, hstream->dropped_points,
+			hstream->tx_bytes, duration, duration > 0 ? hstream->tx_bytes / duration : 0);
+}
+
+// Move next queued entry of data points into frame buffer, returns 0 if queue was empty
+uint8_t Stream_Pack(Stream_t *hstream, uint8_t i_buffer)
+{
+	uint32_t len;
+	uint32_t *entry = Ring_Buffer_Peek(&hstream->ring, &len);
+	if (entry == NULL)
+	{
+		return 0;
+	}
+
+	Stream_Frame_Header_t header;
+	header.timestamp = entry[0];
+	header.sample_count = entry[1];
+	memcpy(hstream->frame_buffer[i_buffer] + sizeof(Stream_Frame_Header_t), &entry[2], len - 2 * sizeof(uint32_t));
+	Ring_Buffer_Release(&hstream->ring);
+
+	header.sampling_rate = hstream->sampling_rate;
+	Stream_Finish_Frame(hstream, i_buffer, &header);
+	return 1;
+}
+
+// Pack selected channels of queued raw ADC samples into frame buffer, returns 0 if no sample was left
+uint8_t Stream_Pack_Raw(Stream_t *hstream, uint8_t i_buffer)
+{
+	uint8_t *sample = hstream->frame_buffer[i_buffer] + sizeof(Stream_Frame_Header_t);
+	Stream_Frame_Header_t header;
+	header.sample_count = 0;
+	header.timestamp = 0;
+
+	// Entries lost in ADC IRQ because queue was full
+	hstream->dropped_points += Ring_Buffer_Dropped(&hstream->ring) * hstream->oversampling_ratio;
+
+	uint32_t len;
+	uint32_t *entry;
+	while (header.sample_count < hstream->samples_per_frame && (entry = Ring_Buffer_Peek(&hstream->ring, &len)) != NULL)
+	{
+		// Samples of a frame must be consecutive, start new frame after dropped entries
+		if (header.sample_count > 0 && entry[0] + hstream->raw_offset != hstream->raw_next)
+		{
+			break;
+		}
+		hstream->raw_next = entry[0] + hstream->oversampling_ratio;
+
+		// Continue entry partly packed into previous frame
+		uint16_t *adc = (uint16_t*)&entry[1];
+		while (hstream->raw_offset < hstream->oversampling_ratio && header.sample_count < hstream->samples_per_frame)
+		{
+			uint32_t i_sample = hstream->raw_offset++;
+			uint8_t keep = hstream->i_decimation == 0;
+			if (++hstream->i_decimation >= hstream->decimation)
+			{
+				hstream->i_decimation = 0;
+			}
+			if (!keep)
+			{
+				continue;
+			}
+
+			if (header.sample_count == 0)
+			{
+				header.timestamp = entry[0] + i_sample;
+			}
+			for (uint8_t i = 0; i < hstream->piezo_count; i++)
+			{
+				if (hstream->channels & (1 << (STREAM_CHANNEL_PIEZO_1 + i)))
+				{
+					memcpy(sample, &adc[i_sample * hstream->piezo_count + i], sizeof(uint16_t));
+					sample += sizeof(uint16_t);
+				}
+			}
+			header.sample_count++;
+		}
+		if (hstream->raw_offset >= hstream->oversampling_ratio)
+		{
+			Ring_Buffer_Release(&hstream->ring);
+			hstream->raw_offset = 0;
+		}
+	}
+	if (header.sample_count == 0)
+	{
+		return 0;
+	}
+
+	header.sampling_rate = hstream->sampling_rate * hstream->oversampling_ratio;
+	Stream_Finish_Frame(hstream, i_buffer, &header);
+	return 1;
+}
+
+// Fill frame buffer completely with byte pattern (sequence + i)
+void Stream_Pack_Benchmark(Stream_t *hstream, uint8_t i_buffer)
+{
+	uint8_t *sample = hstream->frame_buffer[i_buffer] + sizeof(Stream_Frame_Header_t);
+	Stream_Frame_Header_t header;
+	header.sample_count = hstream->samples_per_frame;
+	header.timestamp = HAL_GetTick();
+	header.sampling_rate = 1000;
+
+	uint8_t value = hstream->sequence;
+	for (uint16_t i = 0; i < header.sample_count; i++)
+	{
+		sample[i] = value++;
+	}
+	Stream_Finish_Frame(hstream, i_buffer, &header);
+}
+
+// Complete header (sample_count, timestamp and sampling_rate set by caller), append checksum and mark frame ready
+void Stream_Finish_Frame(Stream_t *hstream, uint8_t i_buffer, Stream_Frame_Header_t *header)
+{
+	uint8_t *frame = hstream->frame_buffer[i_buffer];
+	header->sync[0] = STREAM_SYNC_1;
+	header->sync[1] = STREAM_SYNC_2;
+	header->version = STREAM_VERSION;
+	header->channels = hstream->channels;
+	header->sequence = hstream->sequence++;
+	header->decimation = hstream->decimation;
+	header->payload_len = header->sample_count * hstream->sample_len;
+	header->dropped_points = hstream->dropped_points;
+	header->type = hstream->type;
+	memset(header->reserved, 0, sizeof(header->reserved));
+	memcpy(frame, header, sizeof(Stream_Frame_Header_t));
+
+	// Checksum like UBX packets
+	uint8_t *end = frame + sizeof(Stream_Frame_Header_t) + header->payload_len;
+	uint8_t ck_a = 0, ck_b = 0;
+	for (uint8_t *p = frame; p < end; p++)
+	{
+		ck_a += *p;
+		ck_b += ck_a;
+	}
+	end[0] = ck_a;
+	end[1] = ck_b;
+
+	hstream->buffer_state[i_buffer] = STREAM_BUFFER_READY;
+}
+
+// Transmit oldest ready frame if no frame is in transmission (called with USB IRQ masked or from USB IRQ)
+void Stream_Transmit(Stream_t *hstream)
+{
+	if (hstream->buffer_state[hstream->i_sending] == STREAM_BUFFER_SENDING)
+	{
+		return;
+	}
+
+	// Older frame has the lower sequence number
+	int8_t i_next = -1;
+	for (uint8_t i = 0; i < 2; i++)
+	{
+		if (hstream->buffer_state[i] == STREAM_BUFFER_READY)
+		{
+			Stream_Frame_Header_t *header = (Stream_Frame_Header_t*)hstream->frame_buffer[i];
+			if (i_next < 0 || (int16_t)(header->sequence - ((Stream_Frame_Header_t*)hstream->frame_buffer[i_next])->sequence) < 0)
+			{
+				i_next = i;
+			}
+		}
+	}
+	if (i_next < 0)
+	{
+		return;
+	}
+
+	Stream_Frame_Header_t *header = (Stream_Frame_Header_t*)hstream->frame_buffer[i_next];
+	uint16_t len = sizeof(Stream_Frame_Header_t) + header->payload_len + STREAM_CHECKSUM_LEN;
+	// Retried in Stream_Loop if USB is busy (e.g. log message) or not connected
+	if (CDC_Transmit_FS(hstream->frame_buffer[i_next], len) == USBD_OK)
+	{
+		hstream->i_sending = i_next;
+		hstream->tx_start = HAL_GetTick();
+		hstream->buffer_state[i_next] = STREAM_BUFFER_SENDING;
+	}
+}
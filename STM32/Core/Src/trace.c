@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2024 Mirco Heitmann
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ * trace.c
+ *
+ * Binary trace log with deferred formatting (events of trace_events.h)
+ *
+ * Events are queued as records of id, tick and raw argument words and appended to the trace file
+ * without formatting. Format strings are not compiled into the firmware (unless TRACE_TEXT is set),
+ * Python/trace2txt.py renders the trace file as text.
+ */
+
+#include "trace.h"
+
+void Trace_Save(Trace_t *htrace);
+
+#if TRACE_TEXT
+#define TRACE_FORMAT(id, format) format,
+static const char *trace_formats[] = { TRACE_EVENTS(TRACE_FORMAT) };
+#undef TRACE_FORMAT
+#endif
+
+void Trace_Init(Trace_t *htrace)
+{
+	// Provide default values
+	if (htrace->flush_timeout == 0)
+	{
+		htrace->flush_timeout = 1000;
+	}
+
+	// Init struct
+	htrace->ring.buffer = htrace->ring_buffer;
+	htrace->ring.size = TRACE_RING_SIZE;
+	Ring_Buffer_Init(&htrace->ring);
+	htrace->sd_len = 0;
+	htrace->last_write = 0;
+
+	// First record identifies data format and event table
+	uint32_t args[] = { VERSION, TRACE_EVENT_COUNT };
+	Trace_Event(htrace, TRACE_START, args, 2);
+}
+
+void Trace_Uninit(Trace_t *htrace)
+{
+	// Move all queued records to batch, save
+	while (Ring_Buffer_Used(&htrace->ring) > 0 && htrace->hvsd != NULL && htrace->hvsd->trace_file_path[0] != '\0')
+	{
+		Trace_Loop(htrace);
+		Trace_Save(htrace);
+	}
+	Trace_Save(htrace);
+}
+
+// Queue event record, called by TRACE (main loop and interrupts)
+void Trace_Event(Trace_t *htrace, Trace_Event_t id, const uint32_t *args, uint32_t nargs)
+{
+	if (nargs > TRACE_ARGS_MAX)
+	{
+		nargs = TRACE_ARGS_MAX;
+	}
+	uint32_t len = TRACE_RECORD_HEADER_LEN + nargs * sizeof(uint32_t);
+
+	// Producers are serialized by masking interrupts while the record is copied
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	uint32_t *record = Ring_Buffer_Reserve(&htrace->ring, len);
+	if (record != NULL)
+	{
+		record[0] = (TRACE_SYNC << 24) | (nargs << 16) | id;
+		record[1] = HAL_GetTick();
+		for (uint32_t i = 0; i < nargs; i++)
+		{
+			record[2 + i] = args[i];
+		}
+		Ring_Buffer_Commit(&htrace->ring, len);
+	}
+	__set_PRIMASK(primask);
+}
+
+// TRACE_TEXT: format event on target (printf), for debugging with a terminal
+void Trace_Printf(Trace_Event_t id, ...)
+{
+#if TRACE_TEXT
+	va_list args;
+	va_start(args, id);
+	printf("(%lu) ", HAL_GetTick());
+	vprintf(trace_formats[id], args);
+	printf("\r\n");
+	va_end(args);
+#endif
+}
+
+// Move queued records to trace file batch, call regularly from main loop
+void Trace_Loop(Trace_t *htrace)
+{
+	uint32_t len;
+	void *entry;
+	while ((entry = Ring_Buffer_Peek(&htrace->ring, &len)) != NULL && htrace->sd_len + len <= TRACE_SD_BUFFER_LEN)
+	{
+		memcpy(htrace->sd_buffer + htrace->sd_len, entry, len);
+		htrace->sd_len += len;
+		Ring_Buffer_Release(&htrace->ring);
+	}
+
+	// Report dropped events once there is space again (report itself must not be dropped)
+	uint32_t dropped_entries = htrace->ring.dropped_entries;
+	if (dropped_entries != htrace->ring.dropped_reported && Ring_Buffer_Used(&htrace->ring) < TRACE_RING_SIZE / 2)
+	{
+		uint32_t dropped = dropped_entries - htrace->ring.dropped_reported;
+		htrace->ring.dropped_reported = dropped_entries;
+		Trace_Event(htrace, TRACE_DROPPED, &dropped, 1);
+	}
+
+	// Append to trace file in batches (kept until trace file is created)
+	if (htrace->sd_len > 0 && (htrace->sd_len > TRACE_SD_BUFFER_LEN / 2 || HAL_GetTick() - htrace->last_write > htrace->flush_timeout))
+	{
+		Trace_Save(htrace);
+	}
+}
+
+// Append batch to trace file
+void Trace_Save(Trace_t *htrace)
+{
+	htrace->last_write = HAL_GetTick();
+	if (htrace->hvsd == NULL || htrace->hvsd->trace_file_path[0] == '\0' || htrace->sd_len == 0)
+	{
+		return;
+	}
+
+	uint32_t sd_len = htrace->sd_len;
+	htrace->sd_len = 0;
+	if (SD_WriteBuffer(htrace->hvsd, htrace->hvsd->trace_file_path, htrace->sd_buffer, sd_len) != HAL_OK)
+	{
+		// Do not retry with every batch
+		htrace->hvsd = NULL;
+		printf("(%lu) WARNING: Trace_Save: Trace file disabled\r\n", HAL_GetTick());
+	}
+}
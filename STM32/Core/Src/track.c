@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) 2024 Mirco Heitmann
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ * track.c
+ *
+ * Track distance estimation (Kalman filter of MEMS longitudinal acceleration and GNSS speed)
+ */
+
+#include "track.h"
+
+void Track_Predict(Track_t *htrack, float accel, float dt);
+void Track_Correct(Track_t *htrack, float speed);
+
+HAL_StatusTypeDef Track_Init(Track_t *htrack)
+{
+	// Provide default values
+	if (htrack->sampling_rate == 0)
+	{
+		htrack->sampling_rate = 4000;
+	}
+	if (htrack->acceleration_range == 0)
+	{
+		htrack->acceleration_range = 40;
+	}
+	if (htrack->filter_rate == 0 || htrack->filter_rate > htrack->sampling_rate)
+	{
+		htrack->filter_rate = 100;
+	}
+	if (htrack->accel_noise == 0)
+	{
+		htrack->accel_noise = 0.05f;
+	}
+	if (htrack->bias_noise == 0)
+	{
+		htrack->bias_noise = 1e-5f;
+	}
+	if (htrack->speed_noise == 0)
+	{
+		htrack->speed_noise = 0.01f;
+	}
+	if (htrack->axis < -3 || htrack->axis > 3)
+	{
+		printf("(%lu) ERROR: Track_Init: Invalid axis %i\r\n", HAL_GetTick(), htrack->axis);
+		return HAL_ERROR;
+	}
+
+	// Init struct
+	htrack->decimation = htrack->sampling_rate / htrack->filter_rate;
+	htrack->i_decimation = 0;
+	htrack->accel_sum = 0;
+	htrack->accel_count = 0;
+	// Raw data to m/s^2, sign of axis corrects mounting direction
+	htrack->accel_scale = htrack->acceleration_range * TRACK_G / TRACK_ADXL_FULL_SCALE;
+	if (htrack->axis < 0)
+	{
+		htrack->accel_scale = -htrack->accel_scale;
+	}
+	htrack->initialized = 0;
+	htrack->speed = 0;
+	htrack->bias = 0;
+	htrack->P00 = 0;
+	htrack->P01 = 0;
+	htrack->P11 = 0;
+	htrack->distance = 0;
+	htrack->flag_gnss_speed = 0;
+
+	return HAL_OK;
+}
+
+// Pass GNSS speed to filter, call from main loop
+void Track_SetSpeed(Track_t *htrack, float speed_kmh)
+{
+	htrack->gnss_speed = speed_kmh / 3.6f;
+	htrack->flag_gnss_speed = 1;
+}
+
+// Process acceleration sample (NULL if invalid), call at sampling rate, returns track distance in m
+float Track_Update(Track_t *htrack, int32_t xyz[3])
+{
+	if (htrack->axis == 0)
+	{
+		return 0;
+	}
+
+	// Average longitudinal acceleration over decimation block
+	if (xyz != NULL)
+	{
+		htrack->accel_sum += xyz[(htrack->axis < 0 ? -htrack->axis : htrack->axis) - 1];
+		htrack->accel_count++;
+	}
+	if (++htrack->i_decimation >= htrack->decimation)
+	{
+		htrack->i_decimation = 0;
+		if (htrack->initialized)
+		{
+			// Missing samples (invalid SPI transfers) fall back to bias, i.e. constant speed
+			float accel = htrack->bias;
+			if (htrack->accel_count > 0)
+			{
+				accel = (float)htrack->accel_sum / htrack->accel_count * htrack->accel_scale;
+			}
+			Track_Predict(htrack, accel, (float)htrack->decimation / htrack->sampling_rate);
+		}
+		htrack->accel_sum = 0;
+		htrack->accel_count = 0;
+
+		// GNSS speed received in main loop
+		if (htrack->flag_gnss_speed)
+		{
+			htrack->flag_gnss_speed = 0;
+			Track_Correct(htrack, htrack->gnss_speed);
+		}
+	}
+
+	// Integrate speed at sampling rate, GNSS speed is unsigned so track distance only increases
+	if (htrack->initialized && htrack->speed > 0)
+	{
+		htrack->distance += htrack->speed / htrack->sampling_rate;
+	}
+	return (float)htrack->distance;
+}
+
+// Time update: speed integrates bias corrected acceleration
+void Track_Predict(Track_t *htrack, float accel, float dt)
+{
+	htrack->speed += (accel - htrack->bias) * dt;
+
+	// P = F * P * F^T + Q with F = [1 -dt; 0 1]
+	htrack->P00 += dt * (dt * htrack->P11 - 2 * htrack->P01) + htrack->accel_noise * dt;
+	htrack->P01 -= dt * htrack->P11;
+	htrack->P11 += htrack->bias_noise * dt;
+}
+
+// Measurement update with GNSS speed (H = [1 0])
+void Track_Correct(Track_t *htrack, float speed)
+{
+	if (!htrack->initialized)
+	{
+		// Start with measured speed and unknown bias (mounting tilt, gradient)
+		htrack->initialized = 1;
+		htrack->speed = speed;
+		htrack->bias = 0;
+		htrack->P00 = htrack->speed_noise;
+		htrack->P01 = 0;
+		htrack->P11 = 1.0f;
+		return;
+	}
+
+	float s = htrack->P00 + htrack->speed_noise;
+	float k0 = htrack->P00 / s;
+	float k1 = htrack->P01 / s;
+	float y = speed - htrack->speed;
+	htrack->speed += k0 * y;
+	htrack->bias += k1 * y;
+
+	float P00 = htrack->P00, P01 = htrack->P01;
+	htrack->P00 -= k0 * P00;
+	htrack->P01 -= k0 * P01;
+	htrack->P11 -= k1 * P01;
+}
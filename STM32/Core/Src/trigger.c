@@ -0,0 +1,303 @@
+/*
+ * Copyright (c) 2024 Mirco Heitmann
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ *
+ * trigger.c
+ *
+ * Triggered capture: only event windows around triggered blocks are saved, events are listed in event file (_events.bin, read by Python/vera_events.py)
+ *
+ * The acceleration buffer memory is split into a ring of blocks, the double buffering fills one block after another. Completed
+ * blocks are evaluated in the main loop (piezo peak, MEMS RMS, piezo kurtosis, GNSS speed window) and kept as pre-trigger history
+ * until the ring wraps. A triggered block starts an event: the history is saved, followed by all blocks until post_ms after the
+ * last triggered block. Events are appended to the acceleration file of the page (timestamps show the gaps), each event (or part
+ * of an event per page) is recorded with its file offset in the event file.
+ */
+
+#include "trigger.h"
+
+uint8_t Trigger_Evaluate(Trigger_t *htrigger, volatile a_data_point_t *block, uint32_t len);
+HAL_StatusTypeDef Trigger_Save(Trigger_t *htrigger, volatile a_data_point_t *block, uint32_t len);
+HAL_StatusTypeDef Trigger_Event_Save(Trigger_t *htrigger);
+
+HAL_StatusTypeDef Trigger_Init(Trigger_t *htrigger)
+{
+	// Init struct
+	htrigger->slot_count = htrigger->block_len > 0 ? htrigger->ring_len / htrigger->block_len : 0;
+	htrigger->slot_next = 0;
+	htrigger->history_start = 0;
+	htrigger->history_count = 0;
+	htrigger->event_active = 0;
+	htrigger->post_remaining = 0;
+	htrigger->event.point_count = 0;
+	htrigger->page_num = 0;
+	htrigger->page_points = 0;
+	htrigger->block_peak = 0;
+	htrigger->block_rms = 0;
+	htrigger->block_kurtosis = 0;
+	htrigger->blocks_total = 0;
+	htrigger->blocks_saved = 0;
+
+	if (htrigger->block_len == 0)
+	{
+		return HAL_OK;
+	}
+
+	// Round up to whole blocks
+	uint32_t pre_points = (uint64_t)htrigger->pre_ms * htrigger->sampling_rate / 1000;
+	uint32_t post_points = (uint64_t)htrigger->post_ms * htrigger->sampling_rate / 1000;
+	htrigger->pre_blocks = (pre_points + htrigger->block_len - 1) / htrigger->block_len;
+	htrigger->post_blocks = (post_points + htrigger->block_len - 1) / htrigger->block_len;
+	if (htrigger->slot_count > TRIGGER_SLOT_MAX || htrigger->slot_count <= TRIGGER_SLOTS_RESERVED)
+	{
+		printf("(%lu) ERROR: Trigger_Init: Block length %u Sa not supported (%u to %u Sa)\r\n", HAL_GetTick(), htrigger->block_len, TRIGGER_BLOCK_LEN_MIN, TRIGGER_BLOCK_LEN_MAX);
+		htrigger->pre_blocks = 0;
+		return HAL_ERROR;
+	}
+	// Keep as much history as fits into the ring instead of failing
+	if (htrigger->pre_blocks + TRIGGER_SLOTS_RESERVED > htrigger->slot_count)
+	{
+		htrigger->pre_blocks = htrigger->slot_count - TRIGGER_SLOTS_RESERVED;
+		printf("(%lu) WARNING: Trigger_Init: Pre-trigger history of %lu ms exceeds buffer (%u blocks of %u Sa), limited to %lu ms\r\n",
+				HAL_GetTick(), htrigger->pre_ms, htrigger->slot_count, htrigger->block_len, (uint32_t)((uint64_t)htrigger->pre_blocks * htrigger->block_len * 1000 / htrigger->sampling_rate));
+	}
+	return HAL_OK;
+}
+
+// Returns next block of ring for double buffering, set before the save flag of the previous block is cleared
+volatile a_data_point_t* Trigger_Next_Block(Trigger_t *htrigger)
+{
+	volatile a_data_point_t *block = htrigger->ring + htrigger->slot_next * htrigger->block_len;
+	htrigger->slot_next = (htrigger->slot_next + 1) % htrigger->slot_count;
+	return block;
+}
+
+// Process completed block (called instead of saving it), call from main loop
+HAL_StatusTypeDef Trigger_Block(Trigger_t *htrigger, volatile a_data_point_t *block, uint32_t len)
+{
+	if (len == 0)
+	{
+		return HAL_OK;
+	}
+	htrigger->blocks_total++;
+	uint8_t sources = Trigger_Evaluate(htrigger, block, len);
+
+	if (sources)
+	{
+		if (!htrigger->event_active)
+		{
+			// Start event with pre-trigger history
+			htrigger->event_active = 1;
+			htrigger->event_count++;
+			htrigger->event.event_num = htrigger->event_count;
+			htrigger->event.timestamp_trigger = block[0].timestamp;
+			htrigger->event.sources = 0;
+			htrigger->event.piezo_peak = 0;
+			htrigger->event.mems_rms = 0;
+			htrigger->event.kurtosis = 0;
+			htrigger->event.speed = htrigger->speed_valid ? htrigger->speed : -1;
+			printf("(%lu) Event %lu triggered (sources 0x%02X)\r\n", HAL_GetTick(), htrigger->event_count, sources);
+			for (uint16_t i = 0; i < htrigger->history_count; i++)
+			{
+				uint16_t i_history = (htrigger->history_start + i) % TRIGGER_SLOT_MAX;
+				if (Trigger_Save(htrigger, htrigger->history[i_history], htrigger->history_len[i_history]) != HAL_OK)
+				{
+					return HAL_ERROR;
+				}
+			}
+			htrigger->history_count = 0;
+		}
+		htrigger->event.sources |= sources;
+		htrigger->event.piezo_peak = fmaxf(htrigger->event.piezo_peak, htrigger->block_peak);
+		htrigger->event.mems_rms = fmaxf(htrigger->event.mems_rms, htrigger->block_rms);
+		htrigger->event.kurtosis = fmaxf(htrigger->event.kurtosis, htrigger->block_kurtosis);
+		htrigger->post_remaining = htrigger->post_blocks;
+		return Trigger_Save(htrigger, block, len);
+	}
+
+	if (htrigger->event_active)
+	{
+		// Post-trigger context
+		if (Trigger_Save(htrigger, block, len) != HAL_OK)
+		{
+			return HAL_ERROR;
+		}
+		if (htrigger->post_remaining > 0)
+		{
+			htrigger->post_remaining--;
+		}
+		if (htrigger->post_remaining == 0)
+		{
+			return Trigger_Flush(htrigger);
+		}
+		return HAL_OK;
+	}
+
+	// Keep as history, oldest block is dropped
+	if (htrigger->pre_blocks == 0)
+	{
+		return HAL_OK;
+	}
+	if (htrigger->history_count == htrigger->pre_blocks)
+	{
+		htrigger->history_start = (htrigger->history_start + 1) % TRIGGER_SLOT_MAX;
+		htrigger->history_count--;
+	}
+	uint16_t i_history = (htrigger->history_start + htrigger->history_count) % TRIGGER_SLOT_MAX;
+	htrigger->history[i_history] = block;
+	htrigger->history_len[i_history] = len;
+	htrigger->history_count++;
+	return HAL_OK;
+}
+
+// End current event (end of post-trigger context, capture stopped or reconfigured)
+HAL_StatusTypeDef Trigger_Flush(Trigger_t *htrigger)
+{
+	htrigger->history_count = 0;
+	if (!htrigger->event_active)
+	{
+		return HAL_OK;
+	}
+	htrigger->event_active = 0;
+	return Trigger_Event_Save(htrigger);
+}
+
+void Trigger_SetSpeed(Trigger_t *htrigger, float speed_kmh)
+{
+	htrigger->speed = speed_kmh;
+	htrigger->speed_time = HAL_GetTick();
+	htrigger->speed_valid = 1;
+}
+
+// Compute features of block, returns trigger sources (0: not triggered)
+uint8_t Trigger_Evaluate(Trigger_t *htrigger, volatile a_data_point_t *block, uint32_t len)
+{
+	// Piezo: peak deviation from mean and kurtosis (maximum of channels)
+	htrigger->block_peak = 0;
+	htrigger->block_kurtosis = 0;
+	for (uint8_t i_ch = 0; i_ch < htrigger->piezo_count; i_ch++)
+	{
+		float mean = 0;
+		for (uint32_t i = 0; i < len; i++)
+		{
+			mean += block[i].a_piezo[i_ch];
+		}
+		mean /= len;
+		float m2 = 0, m4 = 0, peak = 0;
+		for (uint32_t i = 0; i < len; i++)
+		{
+			float d = block[i].a_piezo[i_ch] - mean;
+			float d2 = d * d;
+			m2 += d2;
+			m4 += d2 * d2;
+			peak = fmaxf(peak, fabsf(d));
+		}
+		htrigger->block_peak = fmaxf(htrigger->block_peak, peak);
+		if (m2 > 0)
+		{
+			htrigger->block_kurtosis = fmaxf(htrigger->block_kurtosis, m4 * len / (m2 * m2));
+		}
+	}
+
+	// MEMS: RMS without mean (maximum of axes)
+	htrigger->block_rms = 0;
+	for (uint8_t i_axis = 0; i_axis < 3; i_axis++)
+	{
+		float mean = 0;
+		for (uint32_t i = 0; i < len; i++)
+		{
+			mean += block[i].xyz_mems1[i_axis];
+		}
+		mean /= len;
+		float m2 = 0;
+		for (uint32_t i = 0; i < len; i++)
+		{
+			float d = block[i].xyz_mems1[i_axis] - mean;
+			m2 += d * d;
+		}
+		htrigger->block_rms = fmaxf(htrigger->block_rms, sqrtf(m2 / len));
+	}
+
+	// Speed window (if enabled) gates all triggers
+	if (htrigger->speed_valid && HAL_GetTick() - htrigger->speed_time > TRIGGER_SPEED_TIMEOUT)
+	{
+		htrigger->speed_valid = 0;
+	}
+	if (htrigger->speed_max > 0 && (!htrigger->speed_valid || htrigger->speed < htrigger->speed_min || htrigger->speed > htrigger->speed_max))
+	{
+		return 0;
+	}
+
+	uint8_t sources = 0;
+	if (htrigger->piezo_peak > 0 && htrigger->block_peak >= htrigger->piezo_peak)
+	{
+		sources |= TRIGGER_SOURCE_PIEZO_PEAK;
+	}
+	if (htrigger->mems_rms > 0 && htrigger->block_rms >= htrigger->mems_rms)
+	{
+		sources |= TRIGGER_SOURCE_MEMS_RMS;
+	}
+	if (htrigger->kurtosis > 0 && htrigger->block_kurtosis * 100 >= htrigger->kurtosis)
+	{
+		sources |= TRIGGER_SOURCE_KURTOSIS;
+	}
+	// Speed window only: all blocks within window are saved
+	if (htrigger->speed_max > 0 && htrigger->piezo_peak == 0 && htrigger->mems_rms == 0 && htrigger->kurtosis == 0)
+	{
+		sources |= TRIGGER_SOURCE_SPEED;
+	}
+	return sources;
+}
+
+// Append block to acceleration file, event is split at page change
+HAL_StatusTypeDef Trigger_Save(Trigger_t *htrigger, volatile a_data_point_t *block, uint32_t len)
+{
+	if (htrigger->hvsd->page_num != htrigger->page_num)
+	{
+		if (htrigger->event.point_count > 0 && Trigger_Event_Save(htrigger) != HAL_OK)
+		{
+			return HAL_ERROR;
+		}
+		htrigger->page_num = htrigger->hvsd->page_num;
+		htrigger->page_points = 0;
+	}
+	if (htrigger->event.point_count == 0)
+	{
+		htrigger->event.page_num = htrigger->page_num;
+		htrigger->event.offset = sizeof(a_data_header_t) + htrigger->page_points * sizeof(a_data_point_t);
+		htrigger->event.timestamp_start = block[0].timestamp;
+	}
+
+	if (SD_WriteBuffer(htrigger->hvsd, htrigger->hvsd->a_file_path, (void*)block, len * sizeof(a_data_point_t)) != HAL_OK)
+	{
+		return HAL_ERROR;
+	}
+	htrigger->page_points += len;
+	htrigger->event.point_count += len;
+	htrigger->blocks_saved++;
+	return HAL_OK;
+}
+
+// Append record of event (part in current page) to event file
+HAL_StatusTypeDef Trigger_Event_Save(Trigger_t *htrigger)
+{
+	if (htrigger->event.point_count == 0 || htrigger->hvsd->events_file_path[0] == '\0')
+	{
+		htrigger->event.point_count = 0;
+		return HAL_OK;
+	}
+	// Event file is created with first event
+	if (!SD_FileExists(htrigger->hvsd, htrigger->hvsd->events_file_path))
+	{
+		e_data_header_t header = { .version = TRIGGER_VERSION, .boot_duration = htrigger->hvsd->a_header.boot_duration, .a_sampling_rate = htrigger->sampling_rate };
+		if (SD_WriteBuffer(htrigger->hvsd, htrigger->hvsd->events_file_path, &header, sizeof(header)) != HAL_OK)
+		{
+			return HAL_ERROR;
+		}
+	}
+	HAL_StatusTypeDef status = SD_WriteBuffer(htrigger->hvsd, htrigger->hvsd->events_file_path, &htrigger->event, sizeof(e_data_point_t));
+	htrigger->event.point_count = 0;
+	return status;
+}
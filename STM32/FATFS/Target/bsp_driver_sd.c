@@ -330,5 +330,20 @@ __weak uint8_t BSP_SD_IsDetected(void)
 }
 
 /* USER CODE BEGIN AdditionalCode */
-/* user code can be inserted here */
+/**
+ * @brief  Gets the allocation unit (erase block) of the card from the SD status register.
+ * @retval Size in blocks (power of two, max. 32768 as supported by f_mkfs), 1 if unknown
+ */
+uint32_t BSP_SD_GetEraseBlockSize(void)
+{
+  /* AU_SIZE: 16 KB ... 64 MB, 12 MB and 24 MB are reduced to the power of two they are a multiple of */
+  static const uint32_t au_blocks[16] = { 1, 32, 64, 128, 256, 512, 1024, 2048, 4096, 8192, 16384, 8192, 32768, 16384, 32768, 32768 };
+  HAL_SD_CardStatusTypeDef card_status;
+
+  if (HAL_SD_GetCardStatus(&hsd1, &card_status) != HAL_OK)
+  {
+    return 1;
+  }
+  return au_blocks[card_status.AllocationUnitSize & 0x0F];
+}
 /* USER CODE END AdditionalCode */
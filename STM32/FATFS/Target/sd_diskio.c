@@ -457,8 +457,8 @@ DRESULT SD_ioctl(BYTE lun, BYTE cmd, void *buff)
 
   /* Get erase block size in unit of sector (DWORD) */
   case GET_BLOCK_SIZE :
-    BSP_SD_GetCardInfo(&CardInfo);
-    *(DWORD*)buff = CardInfo.LogBlockSize / SD_DEFAULT_BLOCK_SIZE;
+    /* Allocation unit of the card, f_mkfs aligns the data area to it */
+    *(DWORD*)buff = BSP_SD_GetEraseBlockSize();
     res = RES_OK;
     break;
 
@@ -261,6 +261,7 @@ static int8_t CDC_Control_FS(uint8_t cmd, uint8_t* pbuf, uint16_t length)
 static int8_t CDC_Receive_FS(uint8_t* Buf, uint32_t *Len)
 {
   /* USER CODE BEGIN 6 */
+  CDC_RxCallback(Buf, *Len);
   USBD_CDC_SetRxBuffer(&hUsbDeviceFS, &Buf[0]);
   USBD_CDC_ReceivePacket(&hUsbDeviceFS);
   return (USBD_OK);
@@ -283,6 +284,10 @@ uint8_t CDC_Transmit_FS(uint8_t* Buf, uint16_t Len)
   uint8_t result = USBD_OK;
   /* USER CODE BEGIN 7 */
   USBD_CDC_HandleTypeDef *hcdc = (USBD_CDC_HandleTypeDef*)hUsbDeviceFS.pClassData;
+  // Not configured by host yet
+  if (hcdc == NULL){
+    return USBD_FAIL;
+  }
   if (hcdc->TxState != 0){
     return USBD_BUSY;
   }
@@ -308,14 +313,32 @@ static int8_t CDC_TransmitCplt_FS(uint8_t *Buf, uint32_t *Len, uint8_t epnum)
 {
   uint8_t result = USBD_OK;
   /* USER CODE BEGIN 13 */
-  UNUSED(Buf);
-  UNUSED(Len);
   UNUSED(epnum);
+  CDC_TxCpltCallback(Buf, *Len);
   /* USER CODE END 13 */
   return result;
 }
 
 /* USER CODE BEGIN PRIVATE_FUNCTIONS_IMPLEMENTATION */
+/**
+  * @brief  CDC_TxCpltCallback
+  *         Transmission of buffer passed to CDC_Transmit_FS completed (IRQ context), override in application
+  */
+__weak void CDC_TxCpltCallback(uint8_t *Buf, uint32_t Len)
+{
+  UNUSED(Buf);
+  UNUSED(Len);
+}
+
+/**
+  * @brief  CDC_RxCallback
+  *         Data received from host (IRQ context, buffer is reused after return), override in application
+  */
+__weak void CDC_RxCallback(uint8_t *Buf, uint32_t Len)
+{
+  UNUSED(Buf);
+  UNUSED(Len);
+}
 
 /* USER CODE END PRIVATE_FUNCTIONS_IMPLEMENTATION */
 
@@ -108,6 +108,8 @@ extern USBD_CDC_ItfTypeDef USBD_Interface_fops_FS;
 uint8_t CDC_Transmit_FS(uint8_t* Buf, uint16_t Len);
 
 /* USER CODE BEGIN EXPORTED_FUNCTIONS */
+void CDC_TxCpltCallback(uint8_t *Buf, uint32_t Len);
+void CDC_RxCallback(uint8_t *Buf, uint32_t Len);
 
 /* USER CODE END EXPORTED_FUNCTIONS */
 